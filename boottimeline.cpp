@@ -0,0 +1,67 @@
+#include "boottimeline.h"
+
+namespace BootTimeline {
+
+namespace {
+
+constexpr uint8_t kPhaseCount = static_cast<uint8_t>(Phase::Count);
+
+const char* const kPhaseNames[kPhaseCount] = {
+  "setup",
+  "config",
+  "wifi",
+  "storage",
+  "sensors",
+  "first_sample",
+  "services",
+  "info",
+};
+
+Span spans[kPhaseCount] = {};
+
+bool isValid(Phase phase) {
+  return static_cast<uint8_t>(phase) < kPhaseCount;
+}
+
+}
+
+void start(Phase phase) {
+  if (!isValid(phase)) {
+    return;
+  }
+
+  Span& span = spans[static_cast<uint8_t>(phase)];
+  if (span.started) {
+    return;
+  }
+  span.startMs = millis();
+  span.started = true;
+}
+
+void finish(Phase phase) {
+  if (!isValid(phase)) {
+    return;
+  }
+
+  Span& span = spans[static_cast<uint8_t>(phase)];
+  if (!span.started || span.finished) {
+    return;
+  }
+  span.endMs = millis();
+  span.finished = true;
+}
+
+const char* getPhaseName(Phase phase) {
+  return isValid(phase) ? kPhaseNames[static_cast<uint8_t>(phase)] : "none";
+}
+
+Span getSpan(Phase phase) {
+  return isValid(phase) ? spans[static_cast<uint8_t>(phase)] : Span{};
+}
+
+uint32_t getFirstSampleMs() {
+  const Span& span = spans[static_cast<uint8_t>(Phase::FirstSample)];
+  return span.finished ? span.endMs : 0;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+
+// When each part of the boot ran, in ms since boot. Phases overlap:
+// sensors and storage start while the Wi-Fi driver is still associating,
+// and work that needs the network is deferred to the network task, which
+// ends its phase from there.
+namespace BootTimeline {
+
+enum class Phase : uint8_t {
+  // All of setup(), up to the start of the loops
+  Setup,
+  Config,
+  WiFi,
+  Storage,
+  Sensors,
+  // The first reading, its end is the time to first sample
+  FirstSample,
+  // mDNS, SNTP, web server and MQTT
+  Services,
+  // Station info upload, run by the network task
+  Info,
+  Count
+};
+
+struct Span {
+  uint32_t startMs;
+  uint32_t endMs;
+  bool started;
+  bool finished;
+};
+
+// Only the first start and finish of a phase count
+void start(Phase phase);
+void finish(Phase phase);
+
+const char* getPhaseName(Phase phase);
+// Read by the web server and metrics while the network task may still
+// finish a deferred phase, a span can lag one update behind
+Span getSpan(Phase phase);
+// 0 until the first reading
+uint32_t getFirstSampleMs();
+
+}
@@ -1,314 +1,469 @@
 #include "config.h"
 
 Config config; 
-const char* configFile = "/config.json";
 
 namespace {
 
-void setDefaultGPIOTriggers() {
-  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
-    config.gpioTriggers[i].enabled = false;
-    config.gpioTriggers[i].triggerOnValue = 0.0f;
-    config.gpioTriggers[i].triggerOffValue = 0.0f;
-    config.gpioTriggers[i].value = GPIO_TRIGGER_METRIC_TEMPERATURE;
-    config.gpioTriggers[i].gpioPin = GPIO_TRIGGER_PIN_DISABLED;
+// Rows of trigger slot n, keys carry the slot number
+#define GPIO_TRIGGER_FIELDS(n) \
+  {"triggerEnabled" #n, "gpioTriggerEnabled" #n, ConfigFieldType::Bool, offsetof(Config, gpioTriggers[n].enabled), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerOnValue" #n, "gpioTriggerOnValue" #n, ConfigFieldType::Float, offsetof(Config, gpioTriggers[n].triggerOnValue), 0, -100000, 100000, 0.0, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerOffValue" #n, "gpioTriggerOffValue" #n, ConfigFieldType::Float, offsetof(Config, gpioTriggers[n].triggerOffValue), 0, -100000, 100000, 0.0, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerValue" #n, "gpioTriggerMetric" #n, ConfigFieldType::UInt8, offsetof(Config, gpioTriggers[n].value), 0, 0, GPIO_TRIGGER_METRIC_COUNT - 1, GPIO_TRIGGER_METRIC_TEMPERATURE, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerGpioPin" #n, "gpioTriggerPin" #n, ConfigFieldType::Int8, offsetof(Config, gpioTriggers[n].gpioPin), 0, GPIO_TRIGGER_PIN_DISABLED, 39, GPIO_TRIGGER_PIN_DISABLED, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerCondition" #n, "gpioTriggerCondition" #n, ConfigFieldType::UInt8, offsetof(Config, gpioTriggers[n].condition), 0, 0, GPIO_TRIGGER_CONDITION_COUNT - 1, GPIO_TRIGGER_CONDITION_LEVEL, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerMinOn" #n, "gpioTriggerMinOn" #n, ConfigFieldType::Int, offsetof(Config, gpioTriggers[n].minOnSec), 0, 0, 86400, 0, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerMinOff" #n, "gpioTriggerMinOff" #n, ConfigFieldType::Int, offsetof(Config, gpioTriggers[n].minOffSec), 0, 0, 86400, 0, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS}, \
+  {"triggerRule" #n, "gpioTriggerRule" #n, ConfigFieldType::Text, offsetof(Config, gpioTriggers[n].rule), decltype(GPIOTriggerConfig::rule)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_TRIGGERS},
+
+// Every persisted field, in config.json order. Rows are
+// {key, formKey, type, offset, capacity, min, max, default, default text, form scale, subsystems}.
+// A null formKey means the form field has the same name as the key.
+constexpr ConfigField kConfigFields[] = {
+  {"debugMode", nullptr, ConfigFieldType::Bool, offsetof(Config, debugMode), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_DEBUG},
+  {"activeHeartbeat", nullptr, ConfigFieldType::Bool, offsetof(Config, activeHeartbeat), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_HEARTBEAT},
+  {"activeAPRS", nullptr, ConfigFieldType::Bool, offsetof(Config, activeAPRS), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_APRS},
+  {"activeMQTT", nullptr, ConfigFieldType::Bool, offsetof(Config, activeMQTT), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_MQTT},
+  {"activeSYSLOG", nullptr, ConfigFieldType::Bool, offsetof(Config, activeSYSLOG), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_SYSLOG},
+  {"stationName", nullptr, ConfigFieldType::Text, offsetof(Config, stationName), decltype(Config::stationName)::kCapacity, 0, 0, 0, "wx-station", 1, CONFIG_SUBSYSTEM_MQTT | CONFIG_SUBSYSTEM_SYSLOG},
+  {"altitude", nullptr, ConfigFieldType::Float, offsetof(Config, altitude), 0, -500, 9000, 230.0, nullptr, 1, CONFIG_SUBSYSTEM_SENSORS},
+  // Used from the next Wi-Fi connect, changing the address under an open
+  // settings page would cut it off
+  {"staticIpActive", nullptr, ConfigFieldType::Bool, offsetof(Config, staticIpActive), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_NONE},
+  {"staticIp", nullptr, ConfigFieldType::Text, offsetof(Config, staticIp), decltype(Config::staticIp)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_NONE},
+  {"staticGateway", nullptr, ConfigFieldType::Text, offsetof(Config, staticGateway), decltype(Config::staticGateway)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_NONE},
+  {"staticSubnet", nullptr, ConfigFieldType::Text, offsetof(Config, staticSubnet), decltype(Config::staticSubnet)::kCapacity, 0, 0, 0, "255.255.255.0", 1, CONFIG_SUBSYSTEM_NONE},
+  {"staticDns", nullptr, ConfigFieldType::Text, offsetof(Config, staticDns), decltype(Config::staticDns)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_NONE},
+  {"activeLight", nullptr, ConfigFieldType::Bool, offsetof(Config, activeLight), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_SENSORS | CONFIG_SUBSYSTEM_TRIGGERS},
+  {"activeRain", nullptr, ConfigFieldType::Bool, offsetof(Config, activeRain), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_RAIN | CONFIG_SUBSYSTEM_TRIGGERS},
+  {"dataTemp", nullptr, ConfigFieldType::Text, offsetof(Config, dataTemp), decltype(Config::dataTemp)::kCapacity, 0, 0, 0, "temperature", 1, CONFIG_SUBSYSTEM_HTTP | CONFIG_SUBSYSTEM_MQTT},
+  {"dataHumi", nullptr, ConfigFieldType::Text, offsetof(Config, dataHumi), decltype(Config::dataHumi)::kCapacity, 0, 0, 0, "humidity", 1, CONFIG_SUBSYSTEM_HTTP | CONFIG_SUBSYSTEM_MQTT},
+  {"dataPress", nullptr, ConfigFieldType::Text, offsetof(Config, dataPress), decltype(Config::dataPress)::kCapacity, 0, 0, 0, "pressure", 1, CONFIG_SUBSYSTEM_HTTP | CONFIG_SUBSYSTEM_MQTT},
+  {"dataLight", nullptr, ConfigFieldType::Text, offsetof(Config, dataLight), decltype(Config::dataLight)::kCapacity, 0, 0, 0, "light", 1, CONFIG_SUBSYSTEM_HTTP | CONFIG_SUBSYSTEM_MQTT},
+  {"dataRssi", nullptr, ConfigFieldType::Text, offsetof(Config, dataRssi), decltype(Config::dataRssi)::kCapacity, 0, 0, 0, "rssi", 1, CONFIG_SUBSYSTEM_HTTP | CONFIG_SUBSYSTEM_MQTT},
+  {"offsetTemp", nullptr, ConfigFieldType::Float, offsetof(Config, offsetTemp), 0, -50, 50, 0.0, nullptr, 1, CONFIG_SUBSYSTEM_SENSORS},
+  {"offsetHumi", nullptr, ConfigFieldType::Float, offsetof(Config, offsetHumi), 0, -50, 50, 0.0, nullptr, 1, CONFIG_SUBSYSTEM_SENSORS},
+  {"offsetPress", nullptr, ConfigFieldType::Float, offsetof(Config, offsetPress), 0, -100, 100, 0.0, nullptr, 1, CONFIG_SUBSYSTEM_SENSORS},
+  {"rainTipMm", nullptr, ConfigFieldType::Float, offsetof(Config, rainTipMm), 0, 0.01, 10, 0.2794, nullptr, 1, CONFIG_SUBSYSTEM_RAIN},
+  {"serverActive0", nullptr, ConfigFieldType::Bool, offsetof(Config, serverActive0), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverUrl0", nullptr, ConfigFieldType::Text, offsetof(Config, serverUrl0), decltype(Config::serverUrl0)::kCapacity, 0, 0, 0, "http://example.com/", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverName0", nullptr, ConfigFieldType::Text, offsetof(Config, serverName0), decltype(Config::serverName0)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"publicIpUrl", nullptr, ConfigFieldType::Text, offsetof(Config, publicIpUrl), decltype(Config::publicIpUrl)::kCapacity, 0, 0, 0, "http://api.ipify.org", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverActive1", nullptr, ConfigFieldType::Bool, offsetof(Config, serverActive1), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverUrl1", nullptr, ConfigFieldType::Text, offsetof(Config, serverUrl1), decltype(Config::serverUrl1)::kCapacity, 0, 0, 0, "http://example.com/", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverName1", nullptr, ConfigFieldType::Text, offsetof(Config, serverName1), decltype(Config::serverName1)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverActive2", nullptr, ConfigFieldType::Bool, offsetof(Config, serverActive2), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverUrl2", nullptr, ConfigFieldType::Text, offsetof(Config, serverUrl2), decltype(Config::serverUrl2)::kCapacity, 0, 0, 0, "http://example.com/", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverName2", nullptr, ConfigFieldType::Text, offsetof(Config, serverName2), decltype(Config::serverName2)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverActive3", nullptr, ConfigFieldType::Bool, offsetof(Config, serverActive3), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverUrl3", nullptr, ConfigFieldType::Text, offsetof(Config, serverUrl3), decltype(Config::serverUrl3)::kCapacity, 0, 0, 0, "http://example.com/", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"serverName3", nullptr, ConfigFieldType::Text, offsetof(Config, serverName3), decltype(Config::serverName3)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_HTTP},
+  {"aprsHost", nullptr, ConfigFieldType::Text, offsetof(Config, aprsHost), decltype(Config::aprsHost)::kCapacity, 0, 0, 0, "euro.aprs2.net", 1, CONFIG_SUBSYSTEM_APRS},
+  {"aprsPort", nullptr, ConfigFieldType::Int, offsetof(Config, aprsPort), 0, 1, 65535, 14580, nullptr, 1, CONFIG_SUBSYSTEM_APRS},
+  {"aprsCall", nullptr, ConfigFieldType::Text, offsetof(Config, aprsCall), decltype(Config::aprsCall)::kCapacity, 0, 0, 0, "NOCALL-13", 1, CONFIG_SUBSYSTEM_APRS},
+  {"aprsPass", nullptr, ConfigFieldType::Text, offsetof(Config, aprsPass), decltype(Config::aprsPass)::kCapacity, 0, 0, 0, "12345", 1, CONFIG_SUBSYSTEM_APRS},
+  {"aprsLat", nullptr, ConfigFieldType::Text, offsetof(Config, aprsLat), decltype(Config::aprsLat)::kCapacity, 0, 0, 0, "0000.00N", 1, CONFIG_SUBSYSTEM_APRS},
+  {"aprsLon", nullptr, ConfigFieldType::Text, offsetof(Config, aprsLon), decltype(Config::aprsLon)::kCapacity, 0, 0, 0, "00000.00E", 1, CONFIG_SUBSYSTEM_APRS},
+  {"aprsComment", nullptr, ConfigFieldType::Text, offsetof(Config, aprsComment), decltype(Config::aprsComment)::kCapacity, 0, 0, 0, "WX-Station https://www.ok1kky.cz", 1, CONFIG_SUBSYSTEM_APRS},
+  {"mqttServer", nullptr, ConfigFieldType::Text, offsetof(Config, mqttServer), decltype(Config::mqttServer)::kCapacity, 0, 0, 0, "example.com", 1, CONFIG_SUBSYSTEM_MQTT},
+  {"mqttPort", nullptr, ConfigFieldType::Int, offsetof(Config, mqttPort), 0, 1, 65535, 1883, nullptr, 1, CONFIG_SUBSYSTEM_MQTT},
+  {"mqttTopicPub1", nullptr, ConfigFieldType::Text, offsetof(Config, mqttTopicPub1), decltype(Config::mqttTopicPub1)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_MQTT},
+  {"mqttTopicPub2", nullptr, ConfigFieldType::Text, offsetof(Config, mqttTopicPub2), decltype(Config::mqttTopicPub2)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_MQTT},
+  {"mqttTopicSub1", nullptr, ConfigFieldType::Text, offsetof(Config, mqttTopicSub1), decltype(Config::mqttTopicSub1)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_MQTT},
+  {"mqttTopicSub2", nullptr, ConfigFieldType::Text, offsetof(Config, mqttTopicSub2), decltype(Config::mqttTopicSub2)::kCapacity, 0, 0, 0, "", 1, CONFIG_SUBSYSTEM_MQTT},
+  {"mqttChangeMode", nullptr, ConfigFieldType::Bool, offsetof(Config, mqttChangeMode), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttDeadbandTemp", nullptr, ConfigFieldType::Float, offsetof(Config, mqttDeadbandTemp), 0, 0, 50, 0.2, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttDeadbandHumi", nullptr, ConfigFieldType::Float, offsetof(Config, mqttDeadbandHumi), 0, 0, 100, 1.0, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttDeadbandPress", nullptr, ConfigFieldType::Float, offsetof(Config, mqttDeadbandPress), 0, 0, 100, 0.3, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttDeadbandLight", nullptr, ConfigFieldType::Float, offsetof(Config, mqttDeadbandLight), 0, 0, 2000, 10.0, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttDeadbandRain", nullptr, ConfigFieldType::Float, offsetof(Config, mqttDeadbandRain), 0, 0, 100, 0.0, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttDeadbandRssi", nullptr, ConfigFieldType::Float, offsetof(Config, mqttDeadbandRssi), 0, 0, 100, 5.0, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttMaxSilence", nullptr, ConfigFieldType::Int, offsetof(Config, mqttMaxSilence), 0, 60000, 86400000, 900000, nullptr, 60000, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttPayloadFormat", nullptr, ConfigFieldType::UInt8, offsetof(Config, mqttPayloadFormat), 0, 0, MQTT_PAYLOAD_FORMAT_COUNT - 1, MQTT_PAYLOAD_JSON, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"mqttReplayRate", nullptr, ConfigFieldType::UInt8, offsetof(Config, mqttReplayRate), 0, 1, 20, 2, nullptr, 1, CONFIG_SUBSYSTEM_MQTT_PUBLISH},
+  {"triggerSlots", "gpioTriggerSlots", ConfigFieldType::UInt8, offsetof(Config, gpioTriggerSlots), 0, 1, GPIO_TRIGGER_COUNT, GPIO_TRIGGER_COUNT, nullptr, 1, CONFIG_SUBSYSTEM_TRIGGERS},
+  GPIO_TRIGGER_FIELDS(0)
+#if WX_GPIO_TRIGGER_COUNT > 1
+  GPIO_TRIGGER_FIELDS(1)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 2
+  GPIO_TRIGGER_FIELDS(2)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 3
+  GPIO_TRIGGER_FIELDS(3)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 4
+  GPIO_TRIGGER_FIELDS(4)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 5
+  GPIO_TRIGGER_FIELDS(5)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 6
+  GPIO_TRIGGER_FIELDS(6)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 7
+  GPIO_TRIGGER_FIELDS(7)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 8
+  GPIO_TRIGGER_FIELDS(8)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 9
+  GPIO_TRIGGER_FIELDS(9)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 10
+  GPIO_TRIGGER_FIELDS(10)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 11
+  GPIO_TRIGGER_FIELDS(11)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 12
+  GPIO_TRIGGER_FIELDS(12)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 13
+  GPIO_TRIGGER_FIELDS(13)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 14
+  GPIO_TRIGGER_FIELDS(14)
+#endif
+#if WX_GPIO_TRIGGER_COUNT > 15
+  GPIO_TRIGGER_FIELDS(15)
+#endif
+  {"syslogServer", nullptr, ConfigFieldType::Text, offsetof(Config, syslogServer), decltype(Config::syslogServer)::kCapacity, 0, 0, 0, "example.com", 1, CONFIG_SUBSYSTEM_SYSLOG},
+  {"syslogPort", nullptr, ConfigFieldType::Int, offsetof(Config, syslogPort), 0, 1, 65535, 514, nullptr, 1, CONFIG_SUBSYSTEM_SYSLOG},
+  {"intervalHttp", nullptr, ConfigFieldType::Int, offsetof(Config, intervalHttp), 0, 60000, 86400000, 300000, nullptr, 60000, CONFIG_SUBSYSTEM_INTERVALS},
+  {"intervalAprs", nullptr, ConfigFieldType::Int, offsetof(Config, intervalAprs), 0, 60000, 86400000, 600000, nullptr, 60000, CONFIG_SUBSYSTEM_INTERVALS},
+  {"intervalMqtt", nullptr, ConfigFieldType::Int, offsetof(Config, intervalMqtt), 0, 60000, 86400000, 100000, nullptr, 60000, CONFIG_SUBSYSTEM_INTERVALS},
+  {"alignIntervals", nullptr, ConfigFieldType::Bool, offsetof(Config, alignIntervals), 0, 0, 1, 0, nullptr, 1, CONFIG_SUBSYSTEM_INTERVALS},
+  {"restartMode", nullptr, ConfigFieldType::Int, offsetof(Config, restartMode), 0, 0, 4, 2, nullptr, 1, CONFIG_SUBSYSTEM_RESTART}
+};
+
+#undef GPIO_TRIGGER_FIELDS
+
+constexpr size_t kConfigFieldCount = sizeof(kConfigFields) / sizeof(kConfigFields[0]);
+// Rows in one GPIO_TRIGGER_FIELDS block
+constexpr size_t kTriggerFieldsPerSlot = 9;
+
+// Rows that point into Config::gpioTriggers, at most one per offset
+constexpr size_t countTriggerRows() {
+  size_t rows = 0;
+  for (const ConfigField& field : kConfigFields) {
+    if (field.offset >= offsetof(Config, gpioTriggers) && field.offset < offsetof(Config, gpioTriggers) + sizeof(Config::gpioTriggers)) {
+      rows++;
+    }
   }
+  return rows;
 }
 
-}  // namespace
+// True when slot has its enabled row, so no #if block is missing in the middle
+constexpr bool hasTriggerSlot(size_t slot) {
+  for (const ConfigField& field : kConfigFields) {
+    if (field.offset == offsetof(Config, gpioTriggers) + slot * sizeof(GPIOTriggerConfig) + offsetof(GPIOTriggerConfig, enabled)) {
+      return true;
+    }
+  }
+  return false;
+}
 
-bool loadConfig() {
-  if (!LittleFS.begin(true)) {
-    Serial.println("SYST | LittleFS mount failed!");
-    return false;
+constexpr bool hasEveryTriggerSlot() {
+  for (size_t slot = 0; slot < GPIO_TRIGGER_COUNT; slot++) {
+    if (!hasTriggerSlot(slot)) {
+      return false;
+    }
   }
+  return true;
+}
 
-  // default
-  if (!LittleFS.exists(configFile)) {
-    Serial.println("SYST | Config file not found, using defaults.");
-    
-    // Active config default
-    config.debugMode     = false; 
-    config.activeHeartbeat = false;
-    config.activeAPRS    = false; 
-    config.activeMQTT    = false; 
-    config.activeSYSLOG  = false; 
-
-    // Station config default
-    config.stationName = "wx-station";
-    config.altitude    = 230.0;
-
-    // Data active
-    config.activeLight = false; 
-    config.activeRain  = false;
-
-    // Data config defaults
-    config.dataTemp    = "temperature";
-    config.dataHumi    = "humidity";
-    config.dataPress   = "pressure";
-    config.dataLight   = "light";
-    config.dataRssi    = "rssi";
-
-    // Offset config defaults
-    config.offsetTemp  = 0.0;
-    config.offsetHumi  = 0.0;
-    config.offsetPress = 0.0;
-
-    // Rain config defaults
-    config.rainTipMm   = 0.2794;
-
-    // SERVER config defaults
-    config.serverActive0 = false;
-    config.serverUrl0    = "http://example.com/";
-    config.serverName0   = "";
-    config.serverActive1 = false;
-    config.serverUrl1    = "http://example.com/";
-    config.serverName1   = "";
-    config.serverActive2 = false;
-    config.serverUrl2    = "http://example.com/";
-    config.serverName2   = "";
-    config.serverActive3 = false;
-    config.serverUrl3    = "http://example.com/";
-    config.serverName3   = "";
-
-    // APRS config defaults
-    config.aprsHost    = "euro.aprs2.net";
-    config.aprsPort    = 14580;
-    config.aprsCall    = "NOCALL-13";
-    config.aprsPass    = "12345";
-    config.aprsLat     = "0000.00N";
-    config.aprsLon     = "00000.00E";
-    strcpy(config.aprsComment, "WX-Station https://www.ok1kky.cz");
-
-    // MQTT config defaults
-    config.mqttServer     = "example.com";
-    config.mqttPort       = 1883;
-    config.mqttTopicPub1  = "";
-    config.mqttTopicPub2  = "";
-    config.mqttTopicSub1  = "";
-    config.mqttTopicSub2  = "";
-
-    // GPIO trigger defaults
-    setDefaultGPIOTriggers();
-
-    // SYSLOG config defaults
-    config.syslogServer  = "example.com";
-    config.syslogPort    = 514;
-
-    // Interval config
-    config.intervalHttp  = 300000;
-    config.intervalAprs  = 600000;
-    config.intervalMqtt  = 100000;  
-    config.restartMode  = 2;   
+static_assert(GPIO_TRIGGER_COUNT >= 1 && GPIO_TRIGGER_COUNT <= 16, "kConfigFields has rows for 1 to 16 triggers");
+static_assert(countTriggerRows() == GPIO_TRIGGER_COUNT * kTriggerFieldsPerSlot && hasEveryTriggerSlot(),
+              "kConfigFields needs one GPIO_TRIGGER_FIELDS block per slot up to WX_GPIO_TRIGGER_COUNT");
+static_assert(kConfigFieldCount < 255, "Field index is stored in uint8_t");
 
-    return false;
+constexpr size_t constLength(const char* text) {
+  size_t len = 0;
+  while (text[len] != '\0') {
+    len++;
+  }
+  return len;
+}
+
+// Every key plus every text value at full length, terminators included
+constexpr size_t sumStringBytes() {
+  size_t bytes = 0;
+  for (const ConfigField& field : kConfigFields) {
+    bytes += constLength(field.key) + 1;
+    if (field.type == ConfigFieldType::Text) {
+      bytes += field.capacity + 1;
+    }
+  }
+  return bytes;
+}
+
+// FNV-1a over what ties a stored Config to this firmware: key, type,
+// offset and capacity of each row, and the size of the struct
+constexpr uint32_t hashLayout() {
+  uint32_t hash = 2166136261UL;
+  auto mix = [&hash](uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      hash ^= (value >> (i * 8)) & 0xFF;
+      hash *= 16777619UL;
+    }
   };
+  for (const ConfigField& field : kConfigFields) {
+    for (const char* key = field.key; *key != '\0'; key++) {
+      mix(static_cast<uint8_t>(*key));
+    }
+    mix(static_cast<uint32_t>(field.type));
+    mix(field.offset);
+    mix(field.capacity);
+  }
+  mix(sizeof(Config));
+  return hash;
+}
 
+constexpr size_t kConfigStringBytes = sumStringBytes();
+constexpr uint32_t kConfigLayoutHash = hashLayout();
+static_assert(kConfigStringBytes > kConfigFieldCount, "Every key takes at least its terminator");
 
-  File file = LittleFS.open(configFile, "r");
-  if (!file) {
-    Serial.println("SYST | Failed to open config file.");
-    return false;
+// FNV-1a
+constexpr uint32_t hashKey(const char* key) {
+  uint32_t hash = 2166136261UL;
+  while (*key != '\0') {
+    hash ^= static_cast<uint8_t>(*key++);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Open-addressing index from key hash to table row, built by the compiler
+// so no task ever sees it half filled
+constexpr size_t kFieldIndexSize = 256;
+constexpr uint8_t kFieldIndexEmpty = 0xFF;
+static_assert(kConfigFieldCount < kFieldIndexSize, "Probing needs an empty slot to stop at");
+
+struct FieldIndex {
+  uint8_t slots[kFieldIndexSize];
+};
+
+constexpr FieldIndex buildFieldIndex() {
+  FieldIndex index = {};
+  for (uint8_t& slot : index.slots) {
+    slot = kFieldIndexEmpty;
+  }
+  for (size_t i = 0; i < kConfigFieldCount; i++) {
+    size_t slot = hashKey(kConfigFields[i].key) % kFieldIndexSize;
+    while (index.slots[slot] != kFieldIndexEmpty) {
+      slot = (slot + 1) % kFieldIndexSize;
+    }
+    index.slots[slot] = static_cast<uint8_t>(i);
   }
+  return index;
+}
 
-  StaticJsonDocument<4096> doc;
-  DeserializationError error = deserializeJson(doc, file);
-  file.close();
+constexpr FieldIndex kFieldIndex = buildFieldIndex();
 
-  if (error) {
-    Serial.println("SYST | Failed to parse config file.");
-    return false;
+template <typename T>
+T& fieldRef(Config& target, const ConfigField& field) {
+  return *reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(&target) + field.offset);
+}
+
+template <typename T>
+const T& fieldRef(const Config& source, const ConfigField& field) {
+  return *reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(&source) + field.offset);
+}
+
+char* textRef(Config& target, const ConfigField& field) {
+  return reinterpret_cast<char*>(&target) + field.offset;
+}
+
+const char* textRef(const Config& source, const ConfigField& field) {
+  return reinterpret_cast<const char*>(&source) + field.offset;
+}
+
+bool isInRange(const ConfigField& field, double value) {
+  return value >= field.minValue && value <= field.maxValue;
+}
+
+void setNumber(Config& target, const ConfigField& field, double value) {
+  switch (field.type) {
+    case ConfigFieldType::Bool:  fieldRef<bool>(target, field) = value != 0; break;
+    case ConfigFieldType::Int:   fieldRef<int>(target, field) = static_cast<int>(value); break;
+    case ConfigFieldType::Float: fieldRef<float>(target, field) = static_cast<float>(value); break;
+    case ConfigFieldType::UInt8: fieldRef<uint8_t>(target, field) = static_cast<uint8_t>(value); break;
+    case ConfigFieldType::Int8:  fieldRef<int8_t>(target, field) = static_cast<int8_t>(value); break;
+    case ConfigFieldType::Text:  break;
   }
+}
 
-  // Active config
-  config.debugMode       = doc["debugMode"]        | false;
-  config.activeHeartbeat = doc["activeHeartbeat"]  | false;
-  config.activeAPRS      = doc["activeAPRS"]       | false;
-  config.activeMQTT      = doc["activeMQTT"]       | false;
-  config.activeSYSLOG    = doc["activeSYSLOG"]     | false;
-
-  // Station config
-  config.stationName = doc["stationName"]    | "wx-station";
-  config.altitude = doc["altitude"]          | 230.0;
-
-  // Data active
-  config.activeLight = doc["activeLight"]   | false;
-  config.activeRain  = doc["activeRain"]    | false;
-
-  // Data config
-  config.dataTemp    = doc["dataTemp"]    | "temperature";
-  config.dataHumi    = doc["dataHumi"]    | "humidity";
-  config.dataPress   = doc["dataPress"]   | "pressure";
-  config.dataLight   = doc["dataLight"]   | "light";
-  config.dataRssi    = doc["dataRssi"]    | "rssi";
-
-  // Offset config
-  config.offsetTemp  = doc["offsetTemp"]  | 0.0;
-  config.offsetHumi  = doc["offsetHumi"]  | 0.0;
-  config.offsetPress = doc["offsetPress"] | 0.0;
-
-  // Rain config
-  config.rainTipMm   = doc["rainTipMm"]   | 0.2794;
-
-  // SERVER config 
-  config.serverActive0   = doc["serverActive0"]  | false;
-  config.serverUrl0      = doc["serverUrl0"]     | "http://example.com/";
-  config.serverName0     = doc["serverName0"]    | "";
-  config.serverActive1   = doc["serverActive1"]  | false;
-  config.serverUrl1      = doc["serverUrl1"]     | "http://example.com/";
-  config.serverName1     = doc["serverName1"]    | "";
-  config.serverActive2   = doc["serverActive2"]  | false;
-  config.serverUrl2      = doc["serverUrl2"]     | "http://example.com/";
-  config.serverName2     = doc["serverName2"]    | "";
-  config.serverActive3   = doc["serverActive3"]  | false;
-  config.serverUrl3      = doc["serverUrl3"]     | "http://example.com/";
-  config.serverName3     = doc["serverName3"]    | "";
-
-  // APRS config
-  config.aprsHost    = doc["aprsHost"]    | "euro.aprs2.net";
-  config.aprsPort    = doc["aprsPort"]    | 14580;
-  config.aprsCall    = doc["aprsCall"]    | "NOCALL-13";
-  config.aprsPass    = doc["aprsPass"]    | "12345";
-  config.aprsLat     = doc["aprsLat"]     | "0000.00N";
-  config.aprsLon     = doc["aprsLon"]     | "00000.00E";
-  const char* comment = doc["aprsComment"] | "WX-Station https://www.ok1kky.cz";
-  strcpy(config.aprsComment, comment);
-
-  // MQTT config
-  config.mqttServer     = doc["mqttServer"]    | "example.com";
-  config.mqttPort       = doc["mqttPort"]      | 1883;
-  config.mqttTopicPub1  = doc["mqttTopicPub1"] | "";
-  config.mqttTopicPub2  = doc["mqttTopicPub2"] | "";
-  config.mqttTopicSub1  = doc["mqttTopicSub1"] | "";
-  config.mqttTopicSub2  = doc["mqttTopicSub2"] | "";
-
-  setDefaultGPIOTriggers();
-  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
-    String enabledKey = "triggerEnabled" + String(i);
-    String onKey = "triggerOnValue" + String(i);
-    String offKey = "triggerOffValue" + String(i);
-    String valueKey = "triggerValue" + String(i);
-    String pinKey = "triggerGpioPin" + String(i);
-
-    config.gpioTriggers[i].enabled = doc[enabledKey] | config.gpioTriggers[i].enabled;
-    config.gpioTriggers[i].triggerOnValue = doc[onKey] | config.gpioTriggers[i].triggerOnValue;
-    config.gpioTriggers[i].triggerOffValue = doc[offKey] | config.gpioTriggers[i].triggerOffValue;
-    config.gpioTriggers[i].value = doc[valueKey] | config.gpioTriggers[i].value;
-    config.gpioTriggers[i].gpioPin = doc[pinKey] | config.gpioTriggers[i].gpioPin;
+void setFieldDefault(Config& target, const ConfigField& field) {
+  if (field.type == ConfigFieldType::Text) {
+    assignFixedText(textRef(target, field), field.capacity, field.defaultText);
+  } else {
+    setNumber(target, field, field.defaultNumber);
   }
+}
 
-  JsonArray gpioTriggers = doc["gpioTriggers"].as<JsonArray>();
-  if (!gpioTriggers.isNull()) {
-    for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT && i < gpioTriggers.size(); i++) {
-      JsonObject trigger = gpioTriggers[i];
-      config.gpioTriggers[i].enabled = trigger["enabled"] | false;
-      config.gpioTriggers[i].triggerOnValue = trigger["triggerOnValue"] | 0.0f;
-      config.gpioTriggers[i].triggerOffValue = trigger["triggerOffValue"] | 0.0f;
-      config.gpioTriggers[i].value = trigger["value"] | trigger["metric"] | GPIO_TRIGGER_METRIC_TEMPERATURE;
-      config.gpioTriggers[i].gpioPin = trigger["gpioPin"] | GPIO_TRIGGER_PIN_DISABLED;
+// Text is compared up to the terminator, bytes past it are left over
+// from earlier, longer values
+bool fieldEquals(const Config& a, const Config& b, const ConfigField& field) {
+  switch (field.type) {
+    case ConfigFieldType::Bool:  return fieldRef<bool>(a, field) == fieldRef<bool>(b, field);
+    case ConfigFieldType::Int:   return fieldRef<int>(a, field) == fieldRef<int>(b, field);
+    case ConfigFieldType::Float: return fieldRef<float>(a, field) == fieldRef<float>(b, field);
+    case ConfigFieldType::UInt8: return fieldRef<uint8_t>(a, field) == fieldRef<uint8_t>(b, field);
+    case ConfigFieldType::Int8:  return fieldRef<int8_t>(a, field) == fieldRef<int8_t>(b, field);
+    case ConfigFieldType::Text:  return strcmp(textRef(a, field), textRef(b, field)) == 0;
+  }
+  return true;
+}
+
+}  // namespace
+
+size_t getConfigFieldCount() {
+  return kConfigFieldCount;
+}
+
+size_t getConfigStringBytes() {
+  return kConfigStringBytes;
+}
+
+uint32_t getConfigLayoutHash() {
+  return kConfigLayoutHash;
+}
+
+const ConfigField& getConfigField(size_t index) {
+  return kConfigFields[index < kConfigFieldCount ? index : 0];
+}
+
+const ConfigField* findConfigField(const char* key) {
+  if (key == nullptr) {
+    return nullptr;
+  }
+
+  size_t slot = hashKey(key) % kFieldIndexSize;
+  while (kFieldIndex.slots[slot] != kFieldIndexEmpty) {
+    const ConfigField& field = kConfigFields[kFieldIndex.slots[slot]];
+    if (strcmp(field.key, key) == 0) {
+      return &field;
     }
+    slot = (slot + 1) % kFieldIndexSize;
   }
+  return nullptr;
+}
 
-  // SYSLOG config
-  config.syslogServer = doc["syslogServer"] | "example.com";
-  config.syslogPort   = doc["syslogPort"]   | 514;
+void setConfigDefaults(Config& target) {
+  for (size_t i = 0; i < kConfigFieldCount; i++) {
+    setFieldDefault(target, kConfigFields[i]);
+  }
+}
 
-  // Interval config
-  config.intervalHttp   = doc["intervalHttp"]  | 300000;
-  config.intervalAprs   = doc["intervalAprs"]  | 600000;
-  config.intervalMqtt   = doc["intervalMqtt"]  | 100000;
-  config.restartMode    = doc["restartMode"]   | 2;
+ConfigSetResult setConfigFieldValue(Config& target, const ConfigField& field, const char* text, bool formUnits) {
+  if (text == nullptr) {
+    return ConfigSetResult::Invalid;
+  }
 
-  return true;
+  if (field.type == ConfigFieldType::Text) {
+    return assignFixedText(textRef(target, field), field.capacity, text) ? ConfigSetResult::Ok : ConfigSetResult::Truncated;
+  }
+
+  if (field.type == ConfigFieldType::Bool) {
+    if (strcmp(text, "true") == 0 || strcmp(text, "1") == 0 || strcmp(text, "on") == 0) {
+      setNumber(target, field, 1);
+    } else if (strcmp(text, "false") == 0 || strcmp(text, "0") == 0 || strcmp(text, "off") == 0) {
+      setNumber(target, field, 0);
+    } else {
+      return ConfigSetResult::Invalid;
+    }
+    return ConfigSetResult::Ok;
+  }
+
+  // Accept a decimal comma as typed on Czech keyboards
+  char number[24];
+  assignFixedText(number, sizeof(number) - 1, text);
+  for (char* c = number; *c != '\0'; c++) {
+    if (*c == ',') {
+      *c = '.';
+    }
+  }
+
+  char* end = nullptr;
+  double value = strtod(number, &end);
+  if (end == number || *end != '\0') {
+    return ConfigSetResult::Invalid;
+  }
+  if (formUnits) {
+    value *= field.formScale;
+  }
+  if (field.type != ConfigFieldType::Float && value != floor(value)) {
+    return ConfigSetResult::Invalid;
+  }
+  if (!isInRange(field, value)) {
+    return ConfigSetResult::OutOfRange;
+  }
+
+  setNumber(target, field, value);
+  return ConfigSetResult::Ok;
+}
+
+String formatConfigFieldValue(const Config& source, const ConfigField& field) {
+  switch (field.type) {
+    case ConfigFieldType::Bool:  return fieldRef<bool>(source, field) ? "true" : "false";
+    case ConfigFieldType::Int:   return String(fieldRef<int>(source, field));
+    case ConfigFieldType::UInt8: return String(fieldRef<uint8_t>(source, field));
+    case ConfigFieldType::Int8:  return String(fieldRef<int8_t>(source, field));
+    case ConfigFieldType::Text:  return String(textRef(source, field));
+    case ConfigFieldType::Float: {
+      String value(fieldRef<float>(source, field), 4);
+      while (value.endsWith("0")) {
+        value.remove(value.length() - 1);
+      }
+      if (value.endsWith(".")) {
+        value.remove(value.length() - 1);
+      }
+      return value;
+    }
+  }
+  return String();
 }
 
-bool saveConfig() {
-  StaticJsonDocument<4096> doc; 
-  doc["debugMode"]        = config.debugMode;
-  doc["activeHeartbeat"]  = config.activeHeartbeat;
-  doc["activeAPRS"]       = config.activeAPRS;
-  doc["activeMQTT"]       = config.activeMQTT;
-  doc["activeSYSLOG"]     = config.activeSYSLOG;
-
-  // Station config
-  doc["stationName"]    = config.stationName;
-  doc["altitude"]       = config.altitude;
-  
-  // Data active  
-  doc["activeLight"] = config.activeLight;
-  doc["activeRain"]  = config.activeRain;
-
-  // Data config
-  doc["dataTemp"]    = config.dataTemp;
-  doc["dataHumi"]    = config.dataHumi;
-  doc["dataPress"]   = config.dataPress;
-  doc["dataLight"]   = config.dataLight;
-  doc["dataRssi"]    = config.dataRssi;
-
-  // Offset config
-  doc["offsetTemp"]  = config.offsetTemp;
-  doc["offsetHumi"]  = config.offsetHumi;
-  doc["offsetPress"] = config.offsetPress;
-
-  // Rain config
-  doc["rainTipMm"]   = config.rainTipMm;
-
-  // SERVER config
-  doc["serverActive0"]    = config.serverActive0;
-  doc["serverUrl0"]       = config.serverUrl0;
-  doc["serverName0"]      = config.serverName0;
-  doc["serverActive1"]    = config.serverActive1;
-  doc["serverUrl1"]       = config.serverUrl1;
-  doc["serverName1"]      = config.serverName1;
-  doc["serverActive2"]    = config.serverActive2;
-  doc["serverUrl2"]       = config.serverUrl2;
-  doc["serverName2"]      = config.serverName2;
-  doc["serverActive3"]    = config.serverActive3;
-  doc["serverUrl3"]       = config.serverUrl3;
-  doc["serverName3"]      = config.serverName3;
-
-  // APRS config
-  doc["aprsHost"]    = config.aprsHost;
-  doc["aprsPort"]    = config.aprsPort;
-  doc["aprsCall"]    = config.aprsCall;
-  doc["aprsPass"]    = config.aprsPass;
-  doc["aprsLat"]     = config.aprsLat;
-  doc["aprsLon"]     = config.aprsLon;
-  doc["aprsComment"] = config.aprsComment;
-
-  // MQTT config
-  doc["mqttServer"]     = config.mqttServer;
-  doc["mqttPort"]       = config.mqttPort;
-  doc["mqttTopicPub1"]  = config.mqttTopicPub1;
-  doc["mqttTopicPub2"]  = config.mqttTopicPub2;
-  doc["mqttTopicSub1"]  = config.mqttTopicSub1;
-  doc["mqttTopicSub2"]  = config.mqttTopicSub2;
-
-  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
-    doc["triggerEnabled" + String(i)] = config.gpioTriggers[i].enabled;
-    doc["triggerOnValue" + String(i)] = config.gpioTriggers[i].triggerOnValue;
-    doc["triggerOffValue" + String(i)] = config.gpioTriggers[i].triggerOffValue;
-    doc["triggerValue" + String(i)] = config.gpioTriggers[i].value;
-    doc["triggerGpioPin" + String(i)] = config.gpioTriggers[i].gpioPin;
+uint16_t diffConfig(const Config& before, const Config& after) {
+  uint16_t changed = CONFIG_SUBSYSTEM_NONE;
+  for (size_t i = 0; i < kConfigFieldCount; i++) {
+    const ConfigField& field = kConfigFields[i];
+    if ((changed & field.subsystems) == field.subsystems) {
+      continue;
+    }
+    if (!fieldEquals(before, after, field)) {
+      changed |= field.subsystems;
+    }
   }
+  return changed;
+}
 
-  // SYSLOG config
-  doc["syslogServer"] = config.syslogServer;
-  doc["syslogPort"]   = config.syslogPort;
 
-  // Interval config
-  doc["intervalHttp"]   = config.intervalHttp;
-  doc["intervalAprs"]   = config.intervalAprs;
-  doc["intervalMqtt"]   = config.intervalMqtt;
-  doc["restartMode"]    = config.restartMode;
+double getConfigFieldNumber(const Config& source, const ConfigField& field) {
+  switch (field.type) {
+    case ConfigFieldType::Bool:  return fieldRef<bool>(source, field) ? 1 : 0;
+    case ConfigFieldType::Int:   return fieldRef<int>(source, field);
+    case ConfigFieldType::Float: return fieldRef<float>(source, field);
+    case ConfigFieldType::UInt8: return fieldRef<uint8_t>(source, field);
+    case ConfigFieldType::Int8:  return fieldRef<int8_t>(source, field);
+    case ConfigFieldType::Text:  break;
+  }
+  return 0;
+}
 
-  File file = LittleFS.open(configFile, "w");
-  if (!file) {
-    Serial.println("SYST | Failed to open config file for writing.");
+const char* getConfigFieldText(const Config& source, const ConfigField& field) {
+  return field.type == ConfigFieldType::Text ? textRef(source, field) : "";
+}
+
+bool setConfigFieldNumber(Config& target, const ConfigField& field, double value) {
+  if (field.type == ConfigFieldType::Text || !isInRange(field, value)) {
     return false;
   }
-
-  serializeJsonPretty(doc, file);
-  file.close();
+  setNumber(target, field, value);
   return true;
 }
+
+void setConfigFieldDefault(Config& target, const ConfigField& field) {
+  setFieldDefault(target, field);
+}
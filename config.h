@@ -1,9 +1,16 @@
 #pragma once
-#include <ArduinoJson.h>
-#include <FS.h>
-#include <LittleFS.h>
-
-constexpr uint8_t GPIO_TRIGGER_COUNT = 3;
+#include <type_traits>
+#include "fixedstring.h"
+
+// Number of trigger slots in the config, 1 to 16. Set here or with
+// -DWX_GPIO_TRIGGER_COUNT=n, each slot costs 88 bytes of config and
+// 9 rows of the config table. How many of them are in use is the runtime
+// setting gpioTriggerSlots.
+#ifndef WX_GPIO_TRIGGER_COUNT
+#define WX_GPIO_TRIGGER_COUNT 8
+#endif
+
+constexpr uint8_t GPIO_TRIGGER_COUNT = WX_GPIO_TRIGGER_COUNT;
 constexpr int8_t GPIO_TRIGGER_PIN_DISABLED = -1;
 
 enum GPIOTriggerMetric : uint8_t {
@@ -17,12 +24,48 @@ enum GPIOTriggerMetric : uint8_t {
   GPIO_TRIGGER_METRIC_COUNT
 };
 
+// Encoding of the periodic MQTT measurement message
+enum MqttPayloadFormat : uint8_t {
+  MQTT_PAYLOAD_JSON = 0,
+  MQTT_PAYLOAD_MSGPACK = 1,
+  MQTT_PAYLOAD_FORMAT_COUNT
+};
+
+// What the ON / OFF thresholds of a trigger are compared with
+enum GPIOTriggerCondition : uint8_t {
+  GPIO_TRIGGER_CONDITION_LEVEL = 0,
+  // Change of the metric per hour, e.g. a pressure drop
+  GPIO_TRIGGER_CONDITION_RATE = 1,
+  // ON while the rule text is true, the thresholds are not used
+  GPIO_TRIGGER_CONDITION_RULE = 2,
+  GPIO_TRIGGER_CONDITION_COUNT
+};
+
+// Capacities of the text fields in Config, in characters
+constexpr size_t kConfigNameLength = 32;
+constexpr size_t kConfigKeyLength = 24;
+constexpr size_t kConfigUrlLength = 128;
+constexpr size_t kConfigHostLength = 64;
+constexpr size_t kConfigCallLength = 16;
+constexpr size_t kConfigPassLength = 8;
+constexpr size_t kConfigCoordLength = 12;
+constexpr size_t kConfigCommentLength = 63;
+constexpr size_t kConfigTopicLength = 96;
+constexpr size_t kConfigRuleLength = 63;
+constexpr size_t kConfigAddressLength = 15;
+
 struct GPIOTriggerConfig {
   bool enabled;
   float triggerOnValue;
   float triggerOffValue;
   uint8_t value;
   int8_t gpioPin;
+  uint8_t condition;
+  // Shortest time the output stays ON / OFF after switching, in seconds
+  int minOnSec;
+  int minOffSec;
+  // Compound condition, see rules.h
+  FixedString<kConfigRuleLength> rule;
 };
 
 // ===== Config structure =====
@@ -35,15 +78,22 @@ struct Config {
   bool activeSYSLOG;
 
   // Station config
-  String stationName;
+  FixedString<kConfigNameLength> stationName;
   float altitude;
 
+  // Network config, empty DNS means the gateway
+  bool staticIpActive;
+  FixedString<kConfigAddressLength> staticIp;
+  FixedString<kConfigAddressLength> staticGateway;
+  FixedString<kConfigAddressLength> staticSubnet;
+  FixedString<kConfigAddressLength> staticDns;
+
   // Data config
-  String dataTemp;
-  String dataHumi;
-  String dataPress;
-  String dataLight;
-  String dataRssi;
+  FixedString<kConfigKeyLength> dataTemp;
+  FixedString<kConfigKeyLength> dataHumi;
+  FixedString<kConfigKeyLength> dataPress;
+  FixedString<kConfigKeyLength> dataLight;
+  FixedString<kConfigKeyLength> dataRssi;
 
   // Data active
   bool activeLight;
@@ -59,52 +109,140 @@ struct Config {
 
   // Server config
   bool serverActive0;
-  String serverUrl0;
-  String serverName0;
+  FixedString<kConfigUrlLength> serverUrl0;
+  FixedString<kConfigNameLength> serverName0;
+  // Answers with the bare public address, empty turns the lookup off
+  FixedString<kConfigUrlLength> publicIpUrl;
   bool serverActive1;
-  String serverUrl1;
-  String serverName1;
+  FixedString<kConfigUrlLength> serverUrl1;
+  FixedString<kConfigNameLength> serverName1;
   bool serverActive2;
-  String serverUrl2;
-  String serverName2;
+  FixedString<kConfigUrlLength> serverUrl2;
+  FixedString<kConfigNameLength> serverName2;
   bool serverActive3;
-  String serverUrl3;
-  String serverName3;
+  FixedString<kConfigUrlLength> serverUrl3;
+  FixedString<kConfigNameLength> serverName3;
 
   // APRS config
-  String aprsHost;
+  FixedString<kConfigHostLength> aprsHost;
   int aprsPort;
-  String aprsCall;
-  String aprsPass;
-  String aprsLat;
-  String aprsLon;
-  char aprsComment[64]; 
+  FixedString<kConfigCallLength> aprsCall;
+  FixedString<kConfigPassLength> aprsPass;
+  FixedString<kConfigCoordLength> aprsLat;
+  FixedString<kConfigCoordLength> aprsLon;
+  FixedString<kConfigCommentLength> aprsComment;
 
   // MQTT config
-  String mqttServer;  
+  FixedString<kConfigHostLength> mqttServer;  
   int mqttPort;     
 
   // MQTT topics
-  String mqttTopicPub1;
-  String mqttTopicPub2;
-  String mqttTopicSub1;
-  String mqttTopicSub2;
-
-  // GPIO trigger config
+  FixedString<kConfigTopicLength> mqttTopicPub1;
+  FixedString<kConfigTopicLength> mqttTopicPub2;
+  FixedString<kConfigTopicLength> mqttTopicSub1;
+  FixedString<kConfigTopicLength> mqttTopicSub2;
+
+  // MQTT change-driven publishing, one retained topic per metric
+  bool mqttChangeMode;
+  float mqttDeadbandTemp;
+  float mqttDeadbandHumi;
+  float mqttDeadbandPress;
+  float mqttDeadbandLight;
+  float mqttDeadbandRain;
+  float mqttDeadbandRssi;
+  int mqttMaxSilence;
+  uint8_t mqttPayloadFormat;
+  uint8_t mqttReplayRate;
+
+  // GPIO trigger config. Slots from gpioTriggerSlots on are kept but
+  // never driven.
+  uint8_t gpioTriggerSlots;
   GPIOTriggerConfig gpioTriggers[GPIO_TRIGGER_COUNT];
 
   // Syslog config
-  String syslogServer;
+  FixedString<kConfigHostLength> syslogServer;
   int syslogPort;
 
   // Interval config
   int intervalHttp; 
   int intervalAprs;   
   int intervalMqtt;   
+  bool alignIntervals;
   int restartMode;
 };
 
+static_assert(std::is_trivially_copyable<Config>::value, "Config must stay a flat POD");
+
+// ===== Config field descriptors =====
+enum class ConfigFieldType : uint8_t {
+  Bool,
+  Int,
+  Float,
+  UInt8,
+  Int8,
+  Text
+};
+
+// Subsystems that have to pick up a change of a field
+enum ConfigSubsystem : uint16_t {
+  CONFIG_SUBSYSTEM_NONE = 0,
+  CONFIG_SUBSYSTEM_DEBUG = 1 << 0,
+  CONFIG_SUBSYSTEM_HEARTBEAT = 1 << 1,
+  CONFIG_SUBSYSTEM_SENSORS = 1 << 2,
+  CONFIG_SUBSYSTEM_RAIN = 1 << 3,
+  CONFIG_SUBSYSTEM_HTTP = 1 << 4,
+  CONFIG_SUBSYSTEM_APRS = 1 << 5,
+  CONFIG_SUBSYSTEM_MQTT = 1 << 6,
+  CONFIG_SUBSYSTEM_TRIGGERS = 1 << 7,
+  CONFIG_SUBSYSTEM_SYSLOG = 1 << 8,
+  CONFIG_SUBSYSTEM_INTERVALS = 1 << 9,
+  CONFIG_SUBSYSTEM_RESTART = 1 << 10,
+  CONFIG_SUBSYSTEM_MQTT_PUBLISH = 1 << 11
+};
+
+// One persisted Config member. key is the JSON and MQTT name, formKey the
+// settings form field. Numbers outside [minValue, maxValue] are rejected,
+// form values are multiplied by formScale before the check.
+struct ConfigField {
+  const char* key;
+  const char* formKey;
+  ConfigFieldType type;
+  uint16_t offset;
+  uint16_t capacity;
+  double minValue;
+  double maxValue;
+  double defaultNumber;
+  const char* defaultText;
+  uint32_t formScale;
+  uint16_t subsystems;
+};
+
+enum class ConfigSetResult : uint8_t {
+  Ok,
+  Truncated,
+  OutOfRange,
+  Invalid
+};
+
 extern Config config;
 
-bool loadConfig();
-bool saveConfig();
+size_t getConfigFieldCount();
+const ConfigField& getConfigField(size_t index);
+// Keys and full-length text values with their terminators, summed over
+// the table. Sizes the JSON documents in configstore.cpp.
+size_t getConfigStringBytes();
+// Changes whenever a field is added, moved, resized or retyped
+uint32_t getConfigLayoutHash();
+const ConfigField* findConfigField(const char* key);
+void setConfigDefaults(Config& target);
+// Parses text into the field, formUnits applies the form scale (minutes)
+ConfigSetResult setConfigFieldValue(Config& target, const ConfigField& field, const char* text, bool formUnits = false);
+String formatConfigFieldValue(const Config& source, const ConfigField& field);
+// Typed access for code that walks the table, e.g. configstore.cpp.
+// Numbers outside [minValue, maxValue] are rejected and leave the field as is.
+double getConfigFieldNumber(const Config& source, const ConfigField& field);
+const char* getConfigFieldText(const Config& source, const ConfigField& field);
+bool setConfigFieldNumber(Config& target, const ConfigField& field, double value);
+void setConfigFieldDefault(Config& target, const ConfigField& field);
+// Returns the CONFIG_SUBSYSTEM_* flags of every field that differs
+uint16_t diffConfig(const Config& before, const Config& after);
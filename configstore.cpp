@@ -0,0 +1,282 @@
+#include "configstore.h"
+
+const char* configFile = "/config.json";
+
+namespace {
+
+constexpr const char* kSnapshotFile = "/config.bin";
+constexpr const char* kSnapshotTempFile = "/config.bin.tmp";
+constexpr uint32_t kSnapshotMagic = 0x46435857;  // "WXCF"
+// Format of the snapshot file itself. Config layout changes are caught
+// by the size and the field table hash in the header.
+constexpr uint16_t kSnapshotVersion = 13;
+// readLegacyGPIOTriggers(): five keys per trigger object, deduplicated
+constexpr size_t kLegacyTriggerCapacity = JSON_ARRAY_SIZE(GPIO_TRIGGER_COUNT)
+  + GPIO_TRIGGER_COUNT * JSON_OBJECT_SIZE(5) + 64;
+
+bool fileSystemMounted = false;
+bool fileSystemMountAttempted = false;
+ConfigLoadStats lastLoadStats = {0, false};
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  static const uint32_t kNibbleTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = kNibbleTable[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = kNibbleTable[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+// Size of the JSON file from its metadata, the file is not read
+bool readJsonFileSize(uint32_t& size) {
+  File file = LittleFS.open(configFile, "r");
+  if (!file) {
+    return false;
+  }
+
+  size = file.size();
+  file.close();
+  return true;
+}
+
+// Snapshot layout: this header followed by the raw Config bytes
+struct SnapshotHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t layoutHash;
+  uint32_t configSize;
+  uint32_t jsonSize;
+  uint32_t configCrc;
+};
+
+void writeSnapshot() {
+  SnapshotHeader header = {};
+  if (!readJsonFileSize(header.jsonSize)) {
+    return;
+  }
+
+  header.magic = kSnapshotMagic;
+  header.version = kSnapshotVersion;
+  header.layoutHash = getConfigLayoutHash();
+  header.configSize = sizeof(Config);
+  header.configCrc = crc32Update(0, reinterpret_cast<const uint8_t*>(&config), sizeof(Config));
+
+  File file = LittleFS.open(kSnapshotTempFile, "w");
+  if (!file) {
+    Serial.println("SYST | Failed to open config snapshot for writing.");
+    return;
+  }
+
+  bool ok = file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header)
+    && file.write(reinterpret_cast<const uint8_t*>(&config), sizeof(Config)) == sizeof(Config);
+  file.close();
+
+  if (!ok) {
+    Serial.println("SYST | Failed to write config snapshot.");
+    LittleFS.remove(kSnapshotTempFile);
+    return;
+  }
+
+  LittleFS.rename(kSnapshotTempFile, kSnapshotFile);
+}
+
+// Loads the snapshot only when it was written by a firmware with the same
+// Config layout. It is taken to match the JSON file when the sizes agree:
+// everything that writes config.json drops the snapshot first, see
+// invalidateConfigSnapshot(), so reading the whole file on every boot to
+// compare contents is not needed.
+bool readSnapshot() {
+  if (!LittleFS.exists(kSnapshotFile)) {
+    return false;
+  }
+
+  uint32_t jsonSize = 0;
+  if (!readJsonFileSize(jsonSize)) {
+    return false;
+  }
+
+  File file = LittleFS.open(kSnapshotFile, "r");
+  if (!file) {
+    return false;
+  }
+
+  SnapshotHeader header = {};
+  if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)
+      || header.magic != kSnapshotMagic || header.version != kSnapshotVersion
+      || header.layoutHash != getConfigLayoutHash() || header.configSize != sizeof(Config)
+      || header.jsonSize != jsonSize) {
+    file.close();
+    return false;
+  }
+
+  // Too big for a task stack. Read at boot and on a reload by the
+  // network task, never at the same time.
+  static Config loaded;
+  bool ok = file.read(reinterpret_cast<uint8_t*>(&loaded), sizeof(Config)) == sizeof(Config)
+    && crc32Update(0, reinterpret_cast<const uint8_t*>(&loaded), sizeof(Config)) == header.configCrc;
+  file.close();
+
+  if (!ok) {
+    Serial.println("SYST | Config snapshot is corrupted, reading JSON.");
+    return false;
+  }
+
+  config = loaded;
+  return true;
+}
+
+// Older firmware stored triggers as an array, it wins over the flat keys
+void readLegacyGPIOTriggers(JsonDocument& doc, Config& target) {
+  JsonArray gpioTriggers = doc["gpioTriggers"].as<JsonArray>();
+  if (gpioTriggers.isNull()) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT && i < gpioTriggers.size(); i++) {
+    JsonObject trigger = gpioTriggers[i];
+    target.gpioTriggers[i].enabled = trigger["enabled"] | false;
+    target.gpioTriggers[i].triggerOnValue = trigger["triggerOnValue"] | 0.0f;
+    target.gpioTriggers[i].triggerOffValue = trigger["triggerOffValue"] | 0.0f;
+    target.gpioTriggers[i].value = trigger["value"] | trigger["metric"] | GPIO_TRIGGER_METRIC_TEMPERATURE;
+    target.gpioTriggers[i].gpioPin = trigger["gpioPin"] | GPIO_TRIGGER_PIN_DISABLED;
+  }
+}
+
+bool loadConfigFromStorage(bool& fromSnapshot) {
+  fromSnapshot = false;
+  if (!mountFileSystem()) {
+    Serial.println("SYST | LittleFS mount failed!");
+    return false;
+  }
+
+  // default
+  if (!LittleFS.exists(configFile)) {
+    Serial.println("SYST | Config file not found, using defaults.");
+    invalidateConfigSnapshot();
+    setConfigDefaults(config);
+    return false;
+  }
+
+  if (readSnapshot()) {
+    fromSnapshot = true;
+    return true;
+  }
+
+  File file = LittleFS.open(configFile, "r");
+  if (!file) {
+    Serial.println("SYST | Failed to open config file.");
+    return false;
+  }
+
+  DynamicJsonDocument doc(getConfigJsonCapacity());
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+
+  if (error) {
+    Serial.println("SYST | Failed to parse config file.");
+    return false;
+  }
+
+  readConfigJson(doc, config);
+  writeSnapshot();
+  return true;
+}
+
+}  // namespace
+
+bool mountFileSystem() {
+  if (!fileSystemMountAttempted) {
+    fileSystemMountAttempted = true;
+    fileSystemMounted = LittleFS.begin(true);
+  }
+  return fileSystemMounted;
+}
+
+size_t getConfigJsonCapacity() {
+  return JSON_OBJECT_SIZE(getConfigFieldCount()) + getConfigStringBytes() + kLegacyTriggerCapacity;
+}
+
+const ConfigLoadStats& getConfigLoadStats() {
+  return lastLoadStats;
+}
+
+void readConfigJson(JsonDocument& doc, Config& target) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    JsonVariant value = doc[field.key];
+
+    if (field.type == ConfigFieldType::Text) {
+      const char* text = value.is<const char*>() ? value.as<const char*>() : field.defaultText;
+      if (setConfigFieldValue(target, field, text) != ConfigSetResult::Ok) {
+        Serial.println(String("SYST | Config value too long, truncated: ") + field.key);
+      }
+    } else if (field.type == ConfigFieldType::Bool) {
+      setConfigFieldNumber(target, field, value.is<bool>() ? value.as<bool>() : field.defaultNumber);
+    } else if (!value.is<double>() || !setConfigFieldNumber(target, field, value.as<double>())) {
+      if (!value.isNull()) {
+        Serial.println(String("SYST | Config value invalid, using default: ") + field.key);
+      }
+      setConfigFieldDefault(target, field);
+    }
+  }
+
+  readLegacyGPIOTriggers(doc, target);
+}
+
+void writeConfigJson(const Config& source, JsonDocument& doc) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    double number = getConfigFieldNumber(source, field);
+    switch (field.type) {
+      case ConfigFieldType::Bool:  doc[field.key] = number != 0; break;
+      case ConfigFieldType::Float: doc[field.key] = static_cast<float>(number); break;
+      case ConfigFieldType::Int:
+      case ConfigFieldType::UInt8:
+      case ConfigFieldType::Int8:  doc[field.key] = static_cast<int>(number); break;
+      case ConfigFieldType::Text:  doc[field.key] = getConfigFieldText(source, field); break;
+    }
+  }
+}
+
+void invalidateConfigSnapshot() {
+  if (LittleFS.exists(kSnapshotFile)) {
+    LittleFS.remove(kSnapshotFile);
+  }
+}
+
+bool loadConfig() {
+  unsigned long startedAtUs = micros();
+  bool loaded = loadConfigFromStorage(lastLoadStats.fromSnapshot);
+  lastLoadStats.durationUs = micros() - startedAtUs;
+
+  if (loaded) {
+    Serial.println(String("SYST | Config loaded from ") + (lastLoadStats.fromSnapshot ? "snapshot" : "JSON")
+      + " in " + String(lastLoadStats.durationUs) + " us");
+  }
+  return loaded;
+}
+
+bool saveConfig() {
+  DynamicJsonDocument doc(getConfigJsonCapacity());
+  writeConfigJson(config, doc);
+
+  // A power cut before the new snapshot is in place leaves no snapshot,
+  // never one for the old JSON
+  invalidateConfigSnapshot();
+  File file = LittleFS.open(configFile, "w");
+  if (!file) {
+    Serial.println("SYST | Failed to open config file for writing.");
+    return false;
+  }
+
+  serializeJsonPretty(doc, file);
+  file.close();
+  writeSnapshot();
+  return true;
+}
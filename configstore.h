@@ -0,0 +1,34 @@
+#pragma once
+#include <ArduinoJson.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include "config.h"
+
+// config.json on LittleFS and its binary snapshot. Kept apart from the
+// field table in config.h, which builds without ArduinoJson.
+
+struct ConfigLoadStats {
+  uint32_t durationUs;
+  bool fromSnapshot;
+};
+
+// Mounts LittleFS on first call and returns the cached result afterwards
+bool mountFileSystem();
+// Loads the binary snapshot when it matches config.json, parses the JSON otherwise
+bool loadConfig();
+bool saveConfig();
+// Drops the binary snapshot, the next load parses config.json. Call before
+// config.json is replaced by anything but saveConfig().
+void invalidateConfigSnapshot();
+const ConfigLoadStats& getConfigLoadStats();
+
+// Room for a parsed config.json: a slot per field, every key and text
+// value at full length, and the array older firmware kept the triggers in.
+// Derived from the field table, allocate it on the heap, it is too big for
+// a task stack.
+size_t getConfigJsonCapacity();
+
+// Fills target from doc, missing or invalid values fall back to defaults
+void readConfigJson(JsonDocument& doc, Config& target);
+// Text values are stored by pointer, keep source alive while doc is used
+void writeConfigJson(const Config& source, JsonDocument& doc);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+#include <string.h>
+
+// Copies value into a buffer of capacity + 1 chars, cutting it at capacity
+// characters. Returns false when the value was cut.
+inline bool assignFixedText(char* data, size_t capacity, const char* value) {
+  if (value == nullptr) {
+    data[0] = '\0';
+    return true;
+  }
+
+  size_t len = strnlen(value, capacity + 1);
+  bool fits = len <= capacity;
+  if (!fits) {
+    len = capacity;
+  }
+  memcpy(data, value, len);
+  data[len] = '\0';
+  return fits;
+}
+
+// Inline, fixed-capacity string for config fields. Holds up to Capacity
+// characters plus the terminator and never allocates, so structs made of
+// these stay trivially copyable. Longer input is cut and reported by
+// assign() returning false. The object is exactly its char buffer, so
+// generic code may address it as char[Capacity + 1].
+template <size_t Capacity>
+class FixedString {
+ public:
+  static constexpr size_t kCapacity = Capacity;
+
+  bool assign(const char* value) {
+    return assignFixedText(data_, Capacity, value);
+  }
+
+  bool assign(const String& value) {
+    return assign(value.c_str());
+  }
+
+  FixedString& operator=(const char* value) {
+    assign(value);
+    return *this;
+  }
+
+  FixedString& operator=(const String& value) {
+    assign(value.c_str());
+    return *this;
+  }
+
+  const char* c_str() const {
+    return data_;
+  }
+
+  size_t length() const {
+    return strlen(data_);
+  }
+
+  bool isEmpty() const {
+    return data_[0] == '\0';
+  }
+
+  bool equals(const char* value) const {
+    return strcmp(data_, value != nullptr ? value : "") == 0;
+  }
+
+  bool operator==(const FixedString& other) const {
+    return strcmp(data_, other.data_) == 0;
+  }
+
+  bool operator!=(const FixedString& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  char data_[Capacity + 1] = {};
+};
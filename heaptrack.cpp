@@ -0,0 +1,135 @@
+#include "heaptrack.h"
+
+#include <ArduinoJson.h>
+#include <esp_heap_caps.h>
+
+namespace HeapTracker {
+
+namespace {
+
+constexpr uint8_t kStageCount = static_cast<uint8_t>(Profiler::Stage::Count);
+
+StageStats stageStats[kStageCount] = {};
+// Network stages run one after another, so one start is enough
+multi_heap_info_t stageStartInfo = {};
+
+Sample history[kHistoryLength] = {};
+uint8_t historyHead = 0;
+uint8_t historyCount = 0;
+unsigned long lastSampleAtMs = 0;
+bool sampled = false;
+
+void readHeapInfo(multi_heap_info_t& info) {
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+}
+
+void recordSample() {
+  multi_heap_info_t info;
+  readHeapInfo(info);
+
+  Sample& sample = history[historyHead];
+  sample.uptimeS = millis() / 1000UL;
+  sample.freeBytes = info.total_free_bytes;
+  sample.largestFreeBlock = info.largest_free_block;
+  sample.minFreeBytes = info.minimum_free_bytes;
+  sample.allocatedBlocks = info.allocated_blocks;
+
+  historyHead = (historyHead + 1) % kHistoryLength;
+  if (historyCount < kHistoryLength) {
+    historyCount++;
+  }
+}
+
+}  // namespace
+
+bool isTracked(Profiler::Stage stage) {
+  return static_cast<uint8_t>(stage) < kStageCount && Profiler::getStageTask(stage) == Profiler::Task::Network;
+}
+
+void beginStage(Profiler::Stage stage) {
+  if (!kEnabled || !isTracked(stage)) {
+    return;
+  }
+
+  readHeapInfo(stageStartInfo);
+}
+
+void endStage(Profiler::Stage stage) {
+  if (!kEnabled || !isTracked(stage)) {
+    return;
+  }
+
+  multi_heap_info_t info;
+  readHeapInfo(info);
+  int32_t blocks = static_cast<int32_t>(info.allocated_blocks) - static_cast<int32_t>(stageStartInfo.allocated_blocks);
+  int32_t bytes = static_cast<int32_t>(info.total_allocated_bytes) - static_cast<int32_t>(stageStartInfo.total_allocated_bytes);
+
+  StageStats& stats = stageStats[static_cast<uint8_t>(stage)];
+  stats.calls++;
+  stats.netBlocks += blocks;
+  stats.netBytes += bytes;
+  if (blocks > 0 || bytes > 0) {
+    stats.growingCalls++;
+  }
+  if (bytes > stats.maxBytesPerCall) {
+    stats.maxBytesPerCall = bytes;
+  }
+}
+
+void update() {
+  unsigned long now = millis();
+  if (sampled && now - lastSampleAtMs < kSampleIntervalMs) {
+    return;
+  }
+
+  sampled = true;
+  lastSampleAtMs = now;
+  recordSample();
+}
+
+const StageStats& getStageStats(Profiler::Stage stage) {
+  uint8_t index = static_cast<uint8_t>(stage);
+  return stageStats[index < kStageCount ? index : 0];
+}
+
+uint8_t getSampleCount() {
+  return historyCount;
+}
+
+const Sample& getSample(uint8_t index) {
+  uint8_t oldest = (historyHead + kHistoryLength - historyCount) % kHistoryLength;
+  return history[(oldest + index) % kHistoryLength];
+}
+
+String buildSummaryJson() {
+  DynamicJsonDocument doc(1024);
+  multi_heap_info_t info;
+  readHeapInfo(info);
+  doc["free"] = info.total_free_bytes;
+  doc["largest"] = info.largest_free_block;
+  doc["minFree"] = info.minimum_free_bytes;
+  doc["blocks"] = info.allocated_blocks;
+  doc["stageTracking"] = kEnabled;
+
+  if (kEnabled) {
+    JsonObject stages = doc.createNestedObject("stages");
+    for (uint8_t i = 0; i < kStageCount; i++) {
+      const StageStats& stats = stageStats[i];
+      if (stats.calls == 0) {
+        continue;
+      }
+
+      JsonObject stage = stages.createNestedObject(Profiler::getStageName(static_cast<Profiler::Stage>(i)));
+      stage["n"] = stats.calls;
+      stage["grew"] = stats.growingCalls;
+      stage["blocks"] = stats.netBlocks;
+      stage["bytes"] = stats.netBytes;
+    }
+  }
+
+  String json;
+  serializeJson(doc, json);
+  return json;
+}
+
+}  // namespace HeapTracker
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include "profiler.h"
+
+// Stage tracking walks the whole heap before and after every network loop
+// stage, so it is meant for diagnostic builds only. Set to 1 here or with
+// -DWX_HEAP_TRACKING=1.
+#ifndef WX_HEAP_TRACKING
+#define WX_HEAP_TRACKING 0
+#endif
+
+// Heap state over time: free bytes, largest free block and allocated
+// blocks, sampled every kSampleIntervalMs for the station as a whole.
+// With WX_HEAP_TRACKING also the net heap change of each network loop
+// stage. The sensing stages are left out, they overlap the network ones
+// and test/unit/allocation_test.cpp covers their paths on the host.
+namespace HeapTracker {
+
+constexpr bool kEnabled = WX_HEAP_TRACKING != 0;
+constexpr uint8_t kHistoryLength = 36;
+constexpr unsigned long kSampleIntervalMs = 10UL * 60UL * 1000UL;
+
+// Heap change across all runs of one stage. Blocks and bytes are net
+// values, a stage that keeps nothing allocated stays near zero. The web
+// server and the TCP/IP stack allocate at the same time and show up in
+// single runs, a stage that keeps memory climbs run after run.
+struct StageStats {
+  uint32_t calls;
+  uint32_t growingCalls;
+  int32_t netBlocks;
+  int32_t netBytes;
+  int32_t maxBytesPerCall;
+};
+
+struct Sample {
+  uint32_t uptimeS;
+  uint32_t freeBytes;
+  uint32_t largestFreeBlock;
+  uint32_t minFreeBytes;
+  uint32_t allocatedBlocks;
+};
+
+// True for the stages that get StageStats
+bool isTracked(Profiler::Stage stage);
+// Called by Profiler::StageTimer, do nothing unless kEnabled
+void beginStage(Profiler::Stage stage);
+void endStage(Profiler::Stage stage);
+
+// Records a history sample every kSampleIntervalMs
+void update();
+
+const StageStats& getStageStats(Profiler::Stage stage);
+uint8_t getSampleCount();
+// Index 0 is the oldest sample still kept
+const Sample& getSample(uint8_t index);
+
+String buildSummaryJson();
+
+}
@@ -1,4 +1,5 @@
 #include "heartbeat.h"
+#include <esp_timer.h>
 
 namespace Heartbeat {
 
@@ -9,6 +10,11 @@ struct PatternStep {
   unsigned long durationMs;
 };
 
+struct Pattern {
+  const PatternStep* steps;
+  size_t length;
+};
+
 constexpr PatternStep NORMAL_PATTERN[] = {
   {true, 120},
   {false, 260},
@@ -21,11 +27,60 @@ constexpr PatternStep ERROR_PATTERN[] = {
   {false, 120},
 };
 
+constexpr PatternStep SENSOR_DEGRADED_PATTERN[] = {
+  {true, 120},
+  {false, 260},
+  {true, 120},
+  {false, 260},
+  {true, 120},
+  {false, 2200},
+};
+
+constexpr PatternStep UPLOADS_FAILING_PATTERN[] = {
+  {true, 800},
+  {false, 800},
+};
+
+constexpr PatternStep NO_TIME_PATTERN[] = {
+  {true, 120},
+  {false, 2600},
+};
+
+// Booting and AccessPoint hold the LED, so they have no steps
+Pattern patternFor(State state) {
+  switch (state) {
+    case State::Normal:
+      return {NORMAL_PATTERN, sizeof(NORMAL_PATTERN) / sizeof(NORMAL_PATTERN[0])};
+    case State::Error:
+      return {ERROR_PATTERN, sizeof(ERROR_PATTERN) / sizeof(ERROR_PATTERN[0])};
+    case State::SensorDegraded:
+      return {SENSOR_DEGRADED_PATTERN, sizeof(SENSOR_DEGRADED_PATTERN) / sizeof(SENSOR_DEGRADED_PATTERN[0])};
+    case State::UploadsFailing:
+      return {UPLOADS_FAILING_PATTERN, sizeof(UPLOADS_FAILING_PATTERN) / sizeof(UPLOADS_FAILING_PATTERN[0])};
+    case State::NoTime:
+      return {NO_TIME_PATTERN, sizeof(NO_TIME_PATTERN) / sizeof(NO_TIME_PATTERN[0])};
+    case State::Booting:
+    case State::AccessPoint:
+      break;
+  }
+  return {nullptr, 0};
+}
+
 State currentState = State::Booting;
-unsigned long lastStepChangeMs = 0;
 size_t currentStep = 0;
 bool initialized = false;
 bool heartbeatEnabled = false;
+esp_timer_handle_t stepTimer = nullptr;
+bool stepArmed = false;
+// Bumped by every applyState(). A step that already fired when
+// applyState() went to stop it still runs its callback afterwards, for a
+// pattern that is gone; fireGeneration stays behind until that callback
+// has been dropped.
+uint32_t generation = 0;
+uint32_t fireGeneration = 0;
+// The step timer fires on the esp_timer task, state changes come from
+// the sensing and network tasks
+portMUX_TYPE stateLock = portMUX_INITIALIZER_UNLOCKED;
 
 void writeLed(bool ledOn) {
   digitalWrite(
@@ -34,65 +89,81 @@ void writeLed(bool ledOn) {
   );
 }
 
-template <size_t N>
-void applyPatternStep(const PatternStep (&pattern)[N], size_t stepIndex, unsigned long now) {
-  writeLed(pattern[stepIndex].ledOn);
-  currentStep = stepIndex;
-  lastStepChangeMs = now;
+void scheduleStep(const Pattern& pattern) {
+  writeLed(pattern.steps[currentStep].ledOn);
+  esp_timer_start_once(stepTimer, static_cast<uint64_t>(pattern.steps[currentStep].durationMs) * 1000ULL);
+  stepArmed = true;
 }
 
-template <size_t N>
-void updatePattern(const PatternStep (&pattern)[N], unsigned long now) {
-  while (now - lastStepChangeMs >= pattern[currentStep].durationMs) {
-    size_t nextStep = (currentStep + 1) % N;
-    applyPatternStep(pattern, nextStep, now);
+// Called with stateLock held
+void applyState() {
+  bool stalePending = fireGeneration != generation;
+  bool fired = esp_timer_stop(stepTimer) != ESP_OK && stepArmed;
+  stepArmed = false;
+  generation++;
+  if (!stalePending && !fired) {
+    fireGeneration = generation;
   }
-}
+  currentStep = 0;
 
-void applyState(State state, unsigned long now) {
   if (!heartbeatEnabled) {
     writeLed(false);
-    lastStepChangeMs = now;
-    currentStep = 0;
     return;
   }
 
-  switch (state) {
-    case State::Booting:
-      writeLed(false);
-      lastStepChangeMs = now;
-      currentStep = 0;
-      break;
-    case State::AccessPoint:
-      writeLed(true);
-      lastStepChangeMs = now;
-      currentStep = 0;
-      break;
-    case State::Normal:
-      applyPatternStep(NORMAL_PATTERN, 0, now);
-      break;
-    case State::Error:
-      applyPatternStep(ERROR_PATTERN, 0, now);
-      break;
+  Pattern pattern = patternFor(currentState);
+  if (pattern.length == 0) {
+    writeLed(currentState == State::AccessPoint);
+    return;
   }
+  scheduleStep(pattern);
 }
 
-} 
+void onStepTimer(void* arg) {
+  (void)arg;
+  portENTER_CRITICAL(&stateLock);
+  // Fired for a step of the pattern applyState() replaced, the new one
+  // is already armed
+  if (fireGeneration != generation) {
+    fireGeneration = generation;
+    portEXIT_CRITICAL(&stateLock);
+    return;
+  }
+
+  stepArmed = false;
+  Pattern pattern = patternFor(currentState);
+  if (heartbeatEnabled && pattern.length > 0) {
+    currentStep = (currentStep + 1) % pattern.length;
+    scheduleStep(pattern);
+  }
+  portEXIT_CRITICAL(&stateLock);
+}
+
+}
 
 void begin() {
   pinMode(HEARTBEAT_LED_PIN, OUTPUT);
+
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = onStepTimer;
+  timerArgs.dispatch_method = ESP_TIMER_TASK;
+  timerArgs.name = "heartbeat";
+  esp_timer_create(&timerArgs, &stepTimer);
+
+  portENTER_CRITICAL(&stateLock);
   initialized = true;
-  applyState(currentState, millis());
+  applyState();
+  portEXIT_CRITICAL(&stateLock);
 }
 
 void setEnabled(bool enabled) {
+  portENTER_CRITICAL(&stateLock);
+  bool changed = heartbeatEnabled != enabled;
   heartbeatEnabled = enabled;
-
-  if (!initialized) {
-    return;
+  if (initialized && changed) {
+    applyState();
   }
-
-  applyState(currentState, millis());
+  portEXIT_CRITICAL(&stateLock);
 }
 
 bool isEnabled() {
@@ -100,37 +171,22 @@ bool isEnabled() {
 }
 
 void setState(State state) {
-  if (!initialized || currentState == state) {
-    currentState = state;
+  // Both loops call this every pass, most calls change nothing
+  if (state == currentState) {
     return;
   }
 
+  portENTER_CRITICAL(&stateLock);
+  bool changed = currentState != state;
   currentState = state;
-  applyState(currentState, millis());
+  if (initialized && changed) {
+    applyState();
+  }
+  portEXIT_CRITICAL(&stateLock);
 }
 
 State getState() {
   return currentState;
 }
 
-void update() {
-  if (!initialized || !heartbeatEnabled) {
-    return;
-  }
-
-  unsigned long now = millis();
-
-  switch (currentState) {
-    case State::Normal:
-      updatePattern(NORMAL_PATTERN, now);
-      break;
-    case State::Error:
-      updatePattern(ERROR_PATTERN, now);
-      break;
-    case State::Booting:
-    case State::AccessPoint:
-      break;
-  }
 }
-
-}  
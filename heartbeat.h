@@ -2,16 +2,26 @@
 
 #include <Arduino.h>
 
+// The LED pattern runs from an esp_timer, so it keeps its timing while a
+// loop blocks on an upload, an APRS connect or the config portal. Safe to
+// call from either task.
 namespace Heartbeat {
 
 constexpr uint8_t HEARTBEAT_LED_PIN = 2;
 constexpr bool HEARTBEAT_LED_ACTIVE_HIGH = true;
 
+// In order of precedence, the station shows the first one that applies
 enum class State : uint8_t {
   Booting,
   Normal,
   AccessPoint,
-  Error
+  Error,
+  // Read errors below the sensor fault limit
+  SensorDegraded,
+  // The last uploads all failed
+  UploadsFailing,
+  // No NTP time yet
+  NoTime
 };
 
 void begin();
@@ -19,6 +29,5 @@ void setEnabled(bool enabled);
 bool isEnabled();
 void setState(State state);
 State getState();
-void update();
 
-}  
+}
@@ -0,0 +1,55 @@
+#include "httpupload.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace HttpUpload {
+
+namespace {
+
+// Appends to buffer at length, false once the text no longer fits
+bool append(char* buffer, size_t size, size_t& length, const char* format, ...) {
+  if (length >= size) {
+    return false;
+  }
+
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + length, size - length, format, args);
+  va_end(args);
+  if (written < 0 || static_cast<size_t>(written) >= size - length) {
+    return false;
+  }
+  length += written;
+  return true;
+}
+
+}
+
+size_t buildUrl(const char* serverUrl, const char* stationName, const Payload::Sample& sample, const Config& settings, char* buffer, size_t size) {
+  size_t length = 0;
+  bool fits = append(buffer, size, length, "%s?", serverUrl);
+  if (stationName[0] != '\0') {
+    fits = fits && append(buffer, size, length, "station=%s&", stationName);
+  }
+  fits = fits && append(buffer, size, length, "%s=%.2f", settings.dataTemp.c_str(), sample.temperature);
+  fits = fits && append(buffer, size, length, "&%s=%.2f", settings.dataHumi.c_str(), sample.humidity);
+  fits = fits && append(buffer, size, length, "&%s=%.2f", settings.dataPress.c_str(), sample.seaLevelPressure);
+  if (settings.activeLight) {
+    fits = fits && append(buffer, size, length, "&%s=%.2f", settings.dataLight.c_str(), sample.lightWm2);
+  }
+  if (settings.activeRain) {
+    fits = fits && append(buffer, size, length, "&rain_1h=%.2f&rain_24h=%.2f", sample.rain1h, sample.rain24h);
+  }
+  fits = fits && append(buffer, size, length, "&%s=%d", settings.dataRssi.c_str(), sample.rssi);
+
+  if (!fits) {
+    if (size > 0) {
+      buffer[0] = '\0';
+    }
+    return 0;
+  }
+  return length;
+}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+#include "payload.h"
+
+// The GET request sent to the HTTP servers: the server URL, the station
+// name and one query parameter per value, keyed by the configured data
+// names. Built in place, so an upload does not grow the heap by a String
+// per parameter.
+namespace HttpUpload {
+
+// Longest server URL and name with every value at its widest
+constexpr size_t kMaxLength = 512;
+
+// Values of inactive sensors are left out, the timestamp always. An empty
+// station name leaves out the station parameter. Returns the length
+// written, 0 when the URL does not fit.
+size_t buildUrl(const char* serverUrl, const char* stationName, const Payload::Sample& sample, const Config& settings, char* buffer, size_t size);
+
+}
@@ -0,0 +1,474 @@
+#include "metrics.h"
+
+#include <WiFi.h>
+#include <esp_timer.h>
+#include "boottimeline.h"
+#include "config.h"
+#include "mqttoutbox.h"
+#include "profiler.h"
+#include "publicip.h"
+#include "rain.h"
+#include "restartinfo.h"
+#include "tasklink.h"
+#include "timekeeper.h"
+#include "wifilink.h"
+
+extern float temperature;
+extern float humidity;
+extern float pressure;
+extern float seaLevelPressure;
+extern float lightWm2;
+
+namespace Metrics {
+
+namespace {
+
+constexpr uint32_t kUploadLatencyBoundsMs[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000};
+constexpr uint8_t kDestinationCount = static_cast<uint8_t>(Destination::Count);
+
+const char* const kDestinationNames[kDestinationCount] = {
+  "info",
+  "server1",
+  "server2",
+  "server3",
+  "aprs",
+  "mqtt"
+};
+
+struct UploadStats {
+  uint32_t success;
+  uint32_t failure;
+  Histogram latencyMs;
+};
+
+UploadStats uploadStats[kDestinationCount] = {
+  {0, 0, Histogram(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]))},
+  {0, 0, Histogram(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]))},
+  {0, 0, Histogram(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]))},
+  {0, 0, Histogram(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]))},
+  {0, 0, Histogram(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]))},
+  {0, 0, Histogram(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]))}
+};
+uint32_t uploadFailureStreak = 0;
+
+constexpr uint8_t kMqttConnectResultCount = static_cast<uint8_t>(MqttConnectResult::Count);
+
+const char* const kMqttConnectResultNames[kMqttConnectResultCount] = {
+  "success",
+  "dns",
+  "tcp",
+  "rejected"
+};
+
+uint32_t mqttConnectResults[kMqttConnectResultCount] = {};
+
+constexpr uint8_t kWifiConnectModeCount = static_cast<uint8_t>(WifiConnectMode::Count);
+constexpr uint32_t kWifiPhaseBoundsMs[] = {100, 250, 500, 1000, 2000, 4000, 8000, 12000};
+
+const char* const kWifiConnectModeNames[kWifiConnectModeCount] = {
+  "direct",
+  "scan"
+};
+
+uint32_t wifiConnectSuccesses[kWifiConnectModeCount] = {};
+uint32_t wifiConnectFailures[kWifiConnectModeCount] = {};
+Histogram wifiAssociateMs[kWifiConnectModeCount] = {
+  Histogram(kWifiPhaseBoundsMs, sizeof(kWifiPhaseBoundsMs) / sizeof(kWifiPhaseBoundsMs[0])),
+  Histogram(kWifiPhaseBoundsMs, sizeof(kWifiPhaseBoundsMs) / sizeof(kWifiPhaseBoundsMs[0]))
+};
+Histogram wifiAddressMs(kWifiPhaseBoundsMs, sizeof(kWifiPhaseBoundsMs) / sizeof(kWifiPhaseBoundsMs[0]));
+Histogram mqttConnectLatencyMs(kUploadLatencyBoundsMs, sizeof(kUploadLatencyBoundsMs) / sizeof(kUploadLatencyBoundsMs[0]));
+uint32_t mqttStreamMessages = 0;
+uint32_t mqttStreamFailures = 0;
+uint64_t mqttStreamBytes = 0;
+uint64_t mqttStreamUs = 0;
+
+void writeHeader(Print& out, const char* name, const char* type, const char* help) {
+  out.print("# HELP ");
+  out.print(name);
+  out.print(' ');
+  out.println(help);
+  out.print("# TYPE ");
+  out.print(name);
+  out.print(' ');
+  out.println(type);
+}
+
+void writeSampleName(Print& out, const char* name, const char* suffix, const char* labels) {
+  out.print(name);
+  out.print(suffix);
+  if (labels != nullptr && labels[0] != '\0') {
+    out.print('{');
+    out.print(labels);
+    out.print('}');
+  }
+  out.print(' ');
+}
+
+void writeFloat(Print& out, float value) {
+  if (isnan(value)) {
+    out.println("NaN");
+    return;
+  }
+  out.println(value, 2);
+}
+
+void writeGauge(Print& out, const char* name, const char* help, float value) {
+  writeHeader(out, name, "gauge", help);
+  writeSampleName(out, name, "", nullptr);
+  writeFloat(out, value);
+}
+
+void writeIntegerGauge(Print& out, const char* name, const char* help, long value) {
+  writeHeader(out, name, "gauge", help);
+  writeSampleName(out, name, "", nullptr);
+  out.println(value);
+}
+
+void writeCounter(Print& out, const char* name, const char* help, uint32_t value) {
+  writeHeader(out, name, "counter", help);
+  writeSampleName(out, name, "", nullptr);
+  out.println(value);
+}
+
+}  // namespace
+
+Histogram::Histogram(const uint32_t* bounds, uint8_t boundCount)
+  : bounds_(bounds),
+    boundCount_(boundCount > kMaxHistogramBuckets ? kMaxHistogramBuckets : boundCount) {
+  reset();
+}
+
+void Histogram::observe(uint32_t value) {
+  uint8_t bucket = 0;
+  while (bucket < boundCount_ && value > bounds_[bucket]) {
+    bucket++;
+  }
+
+  buckets_[bucket]++;
+  count_++;
+  sum_ += value;
+  if (value < min_) {
+    min_ = value;
+  }
+  if (value > max_) {
+    max_ = value;
+  }
+}
+
+void Histogram::reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  sum_ = 0;
+  min_ = UINT32_MAX;
+  max_ = 0;
+}
+
+uint8_t Histogram::getBoundCount() const {
+  return boundCount_;
+}
+
+uint32_t Histogram::getBound(uint8_t index) const {
+  return index < boundCount_ ? bounds_[index] : UINT32_MAX;
+}
+
+uint32_t Histogram::getBucketCount(uint8_t index) const {
+  return index <= boundCount_ ? buckets_[index] : 0;
+}
+
+uint32_t Histogram::getCount() const {
+  return count_;
+}
+
+uint64_t Histogram::getSum() const {
+  return sum_;
+}
+
+uint32_t Histogram::getMin() const {
+  return count_ > 0 ? min_ : 0;
+}
+
+uint32_t Histogram::getMax() const {
+  return max_;
+}
+
+// Estimated as the upper bound of the bucket holding the percentile,
+// clamped to the observed maximum
+uint32_t Histogram::getPercentile(uint8_t percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (static_cast<uint64_t>(count_) * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (uint8_t i = 0; i < boundCount_; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return bounds_[i] < max_ ? bounds_[i] : max_;
+    }
+  }
+
+  return max_;
+}
+
+void recordUpload(Destination destination, bool success, uint32_t latencyMs) {
+  uint8_t index = static_cast<uint8_t>(destination);
+  if (index >= kDestinationCount) {
+    return;
+  }
+
+  if (success) {
+    uploadStats[index].success++;
+    uploadFailureStreak = 0;
+  } else {
+    uploadStats[index].failure++;
+    uploadFailureStreak++;
+  }
+  uploadStats[index].latencyMs.observe(latencyMs);
+}
+
+uint32_t getUploadFailureStreak() {
+  return uploadFailureStreak;
+}
+
+void recordWifiConnect(WifiConnectMode mode, bool success, uint32_t associateMs, uint32_t addressMs) {
+  uint8_t index = static_cast<uint8_t>(mode);
+  if (index >= kWifiConnectModeCount) {
+    return;
+  }
+
+  if (!success) {
+    wifiConnectFailures[index]++;
+    return;
+  }
+
+  wifiConnectSuccesses[index]++;
+  wifiAssociateMs[index].observe(associateMs);
+  wifiAddressMs.observe(addressMs);
+}
+
+void recordMqttConnect(MqttConnectResult result, uint32_t latencyMs) {
+  uint8_t index = static_cast<uint8_t>(result);
+  if (index >= kMqttConnectResultCount) {
+    return;
+  }
+
+  mqttConnectResults[index]++;
+  if (result == MqttConnectResult::Success) {
+    mqttConnectLatencyMs.observe(latencyMs);
+  }
+}
+
+void recordMqttStream(bool success, uint32_t bytes, uint32_t durationUs) {
+  mqttStreamMessages++;
+  if (!success) {
+    mqttStreamFailures++;
+  }
+  mqttStreamBytes += bytes;
+  mqttStreamUs += durationUs;
+}
+
+void writeHistogram(Print& out, const char* name, const char* labels, const Histogram& histogram, float unitsPerSecond) {
+  bool hasLabels = labels != nullptr && labels[0] != '\0';
+  uint32_t cumulative = 0;
+
+  for (uint8_t i = 0; i <= histogram.getBoundCount(); i++) {
+    cumulative += histogram.getBucketCount(i);
+    out.print(name);
+    out.print("_bucket{");
+    if (hasLabels) {
+      out.print(labels);
+      out.print(',');
+    }
+    out.print("le=\"");
+    if (i < histogram.getBoundCount()) {
+      out.print(histogram.getBound(i) / unitsPerSecond, 6);
+    } else {
+      out.print("+Inf");
+    }
+    out.print("\"} ");
+    out.println(cumulative);
+  }
+
+  writeSampleName(out, name, "_sum", labels);
+  out.println(static_cast<double>(histogram.getSum()) / unitsPerSecond, 6);
+  writeSampleName(out, name, "_count", labels);
+  out.println(histogram.getCount());
+}
+
+void writePrometheus(Print& out) {
+  char labels[48];
+
+  // Measurements
+  writeGauge(out, "wx_temperature_celsius", "Measured temperature.", temperature);
+  writeGauge(out, "wx_humidity_percent", "Measured relative humidity.", humidity);
+  writeHeader(out, "wx_pressure_hpa", "gauge", "Measured pressure.");
+  writeSampleName(out, "wx_pressure_hpa", "", "type=\"absolute\"");
+  writeFloat(out, pressure);
+  writeSampleName(out, "wx_pressure_hpa", "", "type=\"sea_level\"");
+  writeFloat(out, seaLevelPressure);
+  if (config.activeLight) {
+    writeGauge(out, "wx_light_wm2", "Measured solar irradiance.", lightWm2);
+  }
+  if (config.activeRain) {
+    writeCounter(out, "wx_rain_tips_total", "Rain gauge bucket tips since the state file was created.", RainGauge::getTotalTips());
+    writeHeader(out, "wx_rain_mm", "gauge", "Rolling rainfall total.");
+    writeSampleName(out, "wx_rain_mm", "", "window=\"1h\"");
+    writeFloat(out, RainGauge::getRainLastHourMm());
+    writeSampleName(out, "wx_rain_mm", "", "window=\"24h\"");
+    writeFloat(out, RainGauge::getRainLast24HoursMm());
+  }
+  writeIntegerGauge(out, "wx_sensor_fault", "1 while the station is in sensor fault state.", TaskLink::hasSensorFault() ? 1 : 0);
+
+  // Uploads
+  writeHeader(out, "wx_upload_total", "counter", "Upload attempts per destination and result.");
+  for (uint8_t i = 0; i < kDestinationCount; i++) {
+    snprintf(labels, sizeof(labels), "destination=\"%s\",result=\"success\"", kDestinationNames[i]);
+    writeSampleName(out, "wx_upload_total", "", labels);
+    out.println(uploadStats[i].success);
+    snprintf(labels, sizeof(labels), "destination=\"%s\",result=\"failure\"", kDestinationNames[i]);
+    writeSampleName(out, "wx_upload_total", "", labels);
+    out.println(uploadStats[i].failure);
+  }
+
+  writeHeader(out, "wx_upload_duration_seconds", "histogram", "Upload latency per destination.");
+  for (uint8_t i = 0; i < kDestinationCount; i++) {
+    snprintf(labels, sizeof(labels), "destination=\"%s\"", kDestinationNames[i]);
+    writeHistogram(out, "wx_upload_duration_seconds", labels, uploadStats[i].latencyMs, 1000.0f);
+  }
+
+  writeHeader(out, "wx_mqtt_reconnects_total", "counter", "MQTT connect attempts by result, failures by the phase that failed.");
+  for (uint8_t i = 0; i < kMqttConnectResultCount; i++) {
+    snprintf(labels, sizeof(labels), "result=\"%s\"", kMqttConnectResultNames[i]);
+    writeSampleName(out, "wx_mqtt_reconnects_total", "", labels);
+    out.println(mqttConnectResults[i]);
+  }
+
+  writeHeader(out, "wx_mqtt_connect_duration_seconds", "histogram", "Time from DNS lookup to CONNACK of successful MQTT connects.");
+  writeHistogram(out, "wx_mqtt_connect_duration_seconds", nullptr, mqttConnectLatencyMs, 1000.0f);
+
+  // Large replies such as get(config), bytes over seconds gives throughput
+  writeHeader(out, "wx_mqtt_stream_messages_total", "counter", "Streamed MQTT messages by result.");
+  writeSampleName(out, "wx_mqtt_stream_messages_total", "", "result=\"success\"");
+  out.println(mqttStreamMessages - mqttStreamFailures);
+  writeSampleName(out, "wx_mqtt_stream_messages_total", "", "result=\"failure\"");
+  out.println(mqttStreamFailures);
+  writeHeader(out, "wx_mqtt_stream_bytes_total", "counter", "Payload bytes of streamed MQTT messages.");
+  writeSampleName(out, "wx_mqtt_stream_bytes_total", "", nullptr);
+  out.println(static_cast<double>(mqttStreamBytes), 0);
+  writeHeader(out, "wx_mqtt_stream_seconds_total", "counter", "Time spent sending streamed MQTT messages.");
+  writeSampleName(out, "wx_mqtt_stream_seconds_total", "", nullptr);
+  out.println(static_cast<double>(mqttStreamUs) / 1000000.0, 6);
+
+  // Measurements waiting for the broker, see MqttOutbox
+  writeIntegerGauge(out, "wx_mqtt_outbox_depth", "Measurement messages waiting in the MQTT outbox.", MqttOutbox::getDepth());
+  writeHeader(out, "wx_mqtt_outbox_messages_total", "counter", "MQTT outbox messages by what happened to them.");
+  writeSampleName(out, "wx_mqtt_outbox_messages_total", "", "event=\"queued\"");
+  out.println(MqttOutbox::getQueuedCount());
+  writeSampleName(out, "wx_mqtt_outbox_messages_total", "", "event=\"replayed\"");
+  out.println(MqttOutbox::getReplayedCount());
+  writeSampleName(out, "wx_mqtt_outbox_messages_total", "", "event=\"dropped\"");
+  out.println(MqttOutbox::getDroppedCount());
+  writeSampleName(out, "wx_mqtt_outbox_messages_total", "", "event=\"replay_failed\"");
+  out.println(MqttOutbox::getFailedCount());
+
+  // Network and system
+  writeIntegerGauge(out, "wx_wifi_connected", "1 while WiFi is connected.", WiFi.status() == WL_CONNECTED ? 1 : 0);
+  writeIntegerGauge(out, "wx_wifi_rssi_dbm", "WiFi signal strength.", WiFi.RSSI());
+
+  // Direct goes to the stored BSSID and channel, scan searches all channels
+  writeHeader(out, "wx_wifi_connects_total", "counter", "WiFi connect attempts by how the access point was found and result.");
+  for (uint8_t i = 0; i < kWifiConnectModeCount; i++) {
+    snprintf(labels, sizeof(labels), "mode=\"%s\",result=\"success\"", kWifiConnectModeNames[i]);
+    writeSampleName(out, "wx_wifi_connects_total", "", labels);
+    out.println(wifiConnectSuccesses[i]);
+    snprintf(labels, sizeof(labels), "mode=\"%s\",result=\"failure\"", kWifiConnectModeNames[i]);
+    writeSampleName(out, "wx_wifi_connects_total", "", labels);
+    out.println(wifiConnectFailures[i]);
+  }
+  writeHeader(out, "wx_wifi_associate_duration_seconds", "histogram", "Time from the start of a successful WiFi connect to association.");
+  for (uint8_t i = 0; i < kWifiConnectModeCount; i++) {
+    snprintf(labels, sizeof(labels), "mode=\"%s\"", kWifiConnectModeNames[i]);
+    writeHistogram(out, "wx_wifi_associate_duration_seconds", labels, wifiAssociateMs[i], 1000.0f);
+  }
+  writeHeader(out, "wx_wifi_address_duration_seconds", "histogram", "Time from WiFi association to an IP address, DHCP or static.");
+  writeHistogram(out, "wx_wifi_address_duration_seconds", nullptr, wifiAddressMs, 1000.0f);
+  writeHeader(out, "wx_wifi_boot_connect_seconds", "gauge", "Time from boot to the first WiFi connection.");
+  writeSampleName(out, "wx_wifi_boot_connect_seconds", "", nullptr);
+  out.println(static_cast<double>(WifiLink::getBootConnectMs()) / 1000.0, 3);
+
+  // One series per source, the current one is 1
+  writeHeader(out, "wx_clock_source", "gauge", "Where the wall clock was last set from.");
+  const TimeKeeper::Source clockSources[] = {
+    TimeKeeper::Source::None, TimeKeeper::Source::Checkpoint, TimeKeeper::Source::Rtc, TimeKeeper::Source::Ntp
+  };
+  for (TimeKeeper::Source source : clockSources) {
+    snprintf(labels, sizeof(labels), "source=\"%s\"", TimeKeeper::getSourceName(source));
+    writeSampleName(out, "wx_clock_source", "", labels);
+    out.println(TimeKeeper::getSource() == source ? 1 : 0);
+  }
+  writeCounter(out, "wx_clock_syncs_total", "NTP answers applied to the clock.", TimeKeeper::getSyncCount());
+  TimeKeeper::SyncRecord lastSync;
+  if (TimeKeeper::getHistory(&lastSync, 1) == 1) {
+    writeGauge(out, "wx_clock_offset_seconds", "NTP minus the local clock at the last answer.", static_cast<float>(lastSync.offsetMs) / 1000.0f);
+    writeIntegerGauge(out, "wx_clock_since_sync_seconds", "Time since the last NTP answer.", static_cast<long>(TimeKeeper::getSecondsSinceSync()));
+  }
+  float driftPpm;
+  if (TimeKeeper::getDriftPpm(driftPpm)) {
+    writeGauge(out, "wx_clock_drift_ppm", "Estimated drift of the local clock, positive when it runs fast.", driftPpm);
+  }
+
+  writeHeader(out, "wx_public_ip_lookups_total", "counter", "Public IP lookups for the info report by result.");
+  writeSampleName(out, "wx_public_ip_lookups_total", "", "result=\"success\"");
+  out.println(PublicIp::getLookupCount(true));
+  writeSampleName(out, "wx_public_ip_lookups_total", "", "result=\"failure\"");
+  out.println(PublicIp::getLookupCount(false));
+
+  writeCounter(out, "wx_restarts_total", "Restarts since the last power on.", RestartInfo::getRestartCount());
+  writeHeader(out, "wx_last_restart_info", "gauge", "Reason of the last restart, always 1.");
+  snprintf(labels, sizeof(labels), "reason=\"%s\"", RestartInfo::getLastReasonName());
+  writeSampleName(out, "wx_last_restart_info", "", labels);
+  out.println(1);
+  writeIntegerGauge(out, "wx_previous_uptime_seconds", "Uptime before the last restart the firmware asked for.", static_cast<long>(RestartInfo::getPreviousUptimeSec()));
+
+  writeHeader(out, "wx_boot_phase_seconds", "gauge", "Duration of each boot phase, phases overlap.");
+  for (uint8_t i = 0; i < static_cast<uint8_t>(BootTimeline::Phase::Count); i++) {
+    BootTimeline::Phase phase = static_cast<BootTimeline::Phase>(i);
+    BootTimeline::Span span = BootTimeline::getSpan(phase);
+    if (!span.finished) {
+      continue;
+    }
+    snprintf(labels, sizeof(labels), "phase=\"%s\"", BootTimeline::getPhaseName(phase));
+    writeSampleName(out, "wx_boot_phase_seconds", "", labels);
+    out.println(static_cast<double>(span.endMs - span.startMs) / 1000.0, 3);
+  }
+  writeHeader(out, "wx_boot_first_sample_seconds", "gauge", "Time from boot to the first sensor reading.");
+  writeSampleName(out, "wx_boot_first_sample_seconds", "", nullptr);
+  out.println(static_cast<double>(BootTimeline::getFirstSampleMs()) / 1000.0, 3);
+
+  writeIntegerGauge(out, "wx_heap_free_bytes", "Free heap.", static_cast<long>(ESP.getFreeHeap()));
+  writeIntegerGauge(out, "wx_heap_min_free_bytes", "Lowest free heap since boot.", static_cast<long>(ESP.getMinFreeHeap()));
+  writeIntegerGauge(out, "wx_heap_largest_free_block_bytes", "Largest allocatable heap block.", static_cast<long>(ESP.getMaxAllocHeap()));
+
+  writeHeader(out, "wx_loop_duration_seconds", "histogram", "Duration of one loop pass per task.");
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Profiler::Task::Count); i++) {
+    Profiler::Task task = static_cast<Profiler::Task>(i);
+    snprintf(labels, sizeof(labels), "task=\"%s\"", Profiler::getTaskName(task));
+    writeHistogram(out, "wx_loop_duration_seconds", labels, Profiler::getIterationHistogram(task), 1000000.0f);
+  }
+
+  writeHeader(out, "wx_loop_stage_duration_seconds", "histogram", "Duration of one main loop stage.");
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Profiler::Stage::Count); i++) {
+    Profiler::Stage stage = static_cast<Profiler::Stage>(i);
+    snprintf(labels, sizeof(labels), "stage=\"%s\"", Profiler::getStageName(stage));
+    writeHistogram(out, "wx_loop_stage_duration_seconds", labels, Profiler::getStageHistogram(stage), 1000000.0f);
+  }
+
+  writeCounter(out, "wx_loop_stalls_total", "Loop iterations longer than the stall threshold.", Profiler::getStallCount());
+
+  writeHeader(out, "wx_uptime_seconds", "counter", "Time since boot.");
+  writeSampleName(out, "wx_uptime_seconds", "", nullptr);
+  out.println(static_cast<unsigned long>(esp_timer_get_time() / 1000000LL));
+}
+
+}  // namespace Metrics
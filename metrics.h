@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace Metrics {
+
+constexpr uint8_t kMaxHistogramBuckets = 12;
+
+enum class Destination : uint8_t {
+  Info,
+  Server1,
+  Server2,
+  Server3,
+  Aprs,
+  Mqtt,
+  Count
+};
+
+// Outcome of one MQTT connect attempt, by the phase that failed
+enum class MqttConnectResult : uint8_t {
+  Success,
+  Dns,
+  Tcp,
+  Rejected,
+  Count
+};
+
+// How a Wi-Fi connect attempt found the access point, see WifiLink
+enum class WifiConnectMode : uint8_t {
+  Direct,
+  Scan,
+  Count
+};
+
+// Fixed-bucket histogram, bounds are ascending upper limits in raw units.
+// Values above the last bound only land in the implicit +Inf bucket.
+class Histogram {
+ public:
+  Histogram(const uint32_t* bounds, uint8_t boundCount);
+
+  void observe(uint32_t value);
+  void reset();
+
+  uint8_t getBoundCount() const;
+  uint32_t getBound(uint8_t index) const;
+  uint32_t getBucketCount(uint8_t index) const;
+  uint32_t getCount() const;
+  uint64_t getSum() const;
+  uint32_t getMin() const;
+  uint32_t getMax() const;
+  uint32_t getPercentile(uint8_t percent) const;
+
+ private:
+  const uint32_t* bounds_;
+  uint8_t boundCount_;
+  uint32_t buckets_[kMaxHistogramBuckets + 1];
+  uint32_t count_;
+  uint64_t sum_;
+  uint32_t min_;
+  uint32_t max_;
+};
+
+void recordUpload(Destination destination, bool success, uint32_t latencyMs);
+// Uploads that failed in a row, to any destination
+uint32_t getUploadFailureStreak();
+// latencyMs runs from the start of DNS lookup to CONNACK or the failure
+void recordMqttConnect(MqttConnectResult result, uint32_t latencyMs);
+// associateMs runs up to the access point accepting the station,
+// addressMs from there to the IP address. Both only count on success.
+void recordWifiConnect(WifiConnectMode mode, bool success, uint32_t associateMs, uint32_t addressMs);
+// One message sent through MqttStream, durationUs covers the whole publish
+void recordMqttStream(bool success, uint32_t bytes, uint32_t durationUs);
+
+void writeHistogram(Print& out, const char* name, const char* labels, const Histogram& histogram, float unitsPerSecond);
+void writePrometheus(Print& out);
+
+}
@@ -0,0 +1,185 @@
+#include "mqttcommand.h"
+
+#include <ctype.h>
+#include <string.h>
+
+namespace MqttCommand {
+
+namespace {
+
+bool isIdChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_';
+}
+
+void trim(const char*& data, size_t& length) {
+  while (length > 0 && isspace(static_cast<unsigned char>(data[0]))) {
+    data++;
+    length--;
+  }
+  while (length > 0 && isspace(static_cast<unsigned char>(data[length - 1]))) {
+    length--;
+  }
+}
+
+Span makeSpan(const char* data, size_t length) {
+  Span span = {data, length};
+  return span;
+}
+
+void clearRequest(Request& request) {
+  request.id = makeSpan("", 0);
+  request.name = makeSpan("", 0);
+  request.argument = makeSpan("", 0);
+  request.hasArgument = false;
+  request.key = makeSpan("", 0);
+  request.value = makeSpan("", 0);
+}
+
+bool checkArgument(ArgType argType, Request& request) {
+  switch (argType) {
+    case ArgType::None:
+      return !request.hasArgument || request.argument.isEmpty();
+    case ArgType::Text:
+      return request.hasArgument && !request.argument.isEmpty();
+    case ArgType::KeyValue:
+      {
+        if (!request.hasArgument) {
+          return false;
+        }
+        const char* equals = static_cast<const char*>(memchr(request.argument.data, '=', request.argument.length));
+        if (equals == nullptr) {
+          return false;
+        }
+        const char* key = request.argument.data;
+        size_t keyLength = equals - key;
+        const char* value = equals + 1;
+        size_t valueLength = request.argument.length - keyLength - 1;
+        trim(key, keyLength);
+        trim(value, valueLength);
+        request.key = makeSpan(key, keyLength);
+        request.value = makeSpan(value, valueLength);
+        return keyLength > 0;
+      }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool Span::isEmpty() const {
+  return length == 0;
+}
+
+bool Span::equalsIgnoreCase(const char* text) const {
+  size_t textLength = strlen(text);
+  return textLength == length && strncasecmp(data, text, length) == 0;
+}
+
+bool Span::copyTo(char* buffer, size_t size) const {
+  if (size == 0) {
+    return false;
+  }
+  size_t count = length < size ? length : size - 1;
+  memcpy(buffer, data, count);
+  buffer[count] = '\0';
+  return count == length;
+}
+
+String Span::toString() const {
+  String text;
+  text.reserve(length);
+  for (size_t i = 0; i < length; i++) {
+    text += data[i];
+  }
+  return text;
+}
+
+bool parsePayload(const char* payload, size_t length, Request& request) {
+  clearRequest(request);
+  const char* cursor = payload;
+  size_t remaining = length;
+  trim(cursor, remaining);
+
+  // Optional correlation id, "@42 get(config)"
+  if (remaining > 0 && cursor[0] == '@') {
+    size_t idLength = 0;
+    while (idLength + 1 < remaining && isIdChar(cursor[idLength + 1])) {
+      idLength++;
+    }
+    if (idLength == 0 || idLength > kMaxIdLength) {
+      return false;
+    }
+    request.id = makeSpan(cursor + 1, idLength);
+    cursor += idLength + 1;
+    remaining -= idLength + 1;
+    if (remaining > 0 && !isspace(static_cast<unsigned char>(cursor[0]))) {
+      return false;
+    }
+    trim(cursor, remaining);
+  }
+
+  size_t nameLength = 0;
+  while (nameLength < remaining && cursor[nameLength] != '(' && !isspace(static_cast<unsigned char>(cursor[nameLength]))) {
+    nameLength++;
+  }
+  if (nameLength == 0) {
+    return false;
+  }
+  request.name = makeSpan(cursor, nameLength);
+
+  cursor += nameLength;
+  remaining -= nameLength;
+  if (remaining == 0) {
+    return true;
+  }
+
+  // The argument runs to the closing parenthesis at the very end, so it
+  // may itself contain parentheses, e.g. a JSON config
+  if (cursor[0] != '(' || cursor[remaining - 1] != ')' || remaining < 2) {
+    return false;
+  }
+  const char* argument = cursor + 1;
+  size_t argumentLength = remaining - 2;
+  trim(argument, argumentLength);
+  request.argument = makeSpan(argument, argumentLength);
+  request.hasArgument = true;
+  return true;
+}
+
+bool parseTopic(const char* topic, const char* base, const char* payload, size_t length, Request& request) {
+  clearRequest(request);
+  size_t baseLength = strlen(base);
+  if (baseLength == 0 || strncmp(topic, base, baseLength) != 0 || topic[baseLength] != '/') {
+    return false;
+  }
+
+  const char* name = topic + baseLength + 1;
+  size_t nameLength = strlen(name);
+  if (nameLength == 0 || memchr(name, '/', nameLength) != nullptr) {
+    return false;
+  }
+  request.name = makeSpan(name, nameLength);
+
+  const char* argument = payload;
+  size_t argumentLength = length;
+  trim(argument, argumentLength);
+  request.argument = makeSpan(argument, argumentLength);
+  request.hasArgument = argumentLength > 0;
+  return true;
+}
+
+Result dispatch(const Entry* entries, size_t count, Request& request) {
+  for (size_t i = 0; i < count; i++) {
+    if (!request.name.equalsIgnoreCase(entries[i].name)) {
+      continue;
+    }
+    if (!checkArgument(entries[i].argType, request)) {
+      return Result::InvalidArgument;
+    }
+    entries[i].handler(request);
+    return Result::Handled;
+  }
+  return Result::UnknownCommand;
+}
+
+}  // namespace MqttCommand
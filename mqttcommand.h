@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace MqttCommand {
+
+constexpr size_t kMaxIdLength = 16;
+
+// Read-only view into the received payload or topic, never NUL-terminated
+struct Span {
+  const char* data;
+  size_t length;
+
+  bool isEmpty() const;
+  bool equalsIgnoreCase(const char* text) const;
+  // Copies into buffer with a terminator, false when it did not fit
+  bool copyTo(char* buffer, size_t size) const;
+  String toString() const;
+};
+
+enum class ArgType : uint8_t {
+  None,      // reboot
+  Text,      // update(url), non-empty
+  KeyValue   // set(key=value), key non-empty
+};
+
+// One parsed command. Payload form is "[@id ]name[(argument)]", on a
+// "<subscribed topic>/<name>" topic the whole payload is the argument.
+// The spans point into the PubSubClient buffer, which the next publish
+// overwrites, so copy what is still needed before replying.
+struct Request {
+  Span id;
+  Span name;
+  Span argument;
+  bool hasArgument;
+  // Split of argument at the first '=' for ArgType::KeyValue
+  Span key;
+  Span value;
+};
+
+using Handler = void (*)(const Request& request);
+
+struct Entry {
+  const char* name;
+  ArgType argType;
+  Handler handler;
+};
+
+enum class Result : uint8_t {
+  Handled,
+  UnknownCommand,
+  InvalidArgument
+};
+
+// Parses a payload sent to a command topic, without copying it
+bool parsePayload(const char* payload, size_t length, Request& request);
+// Parses a payload sent to base + "/" + name, false when topic is not below base
+bool parseTopic(const char* topic, const char* base, const char* payload, size_t length, Request& request);
+
+// Checks the argument against the entry and calls its handler
+Result dispatch(const Entry* entries, size_t count, Request& request);
+
+}
@@ -0,0 +1,297 @@
+#include "mqttlink.h"
+
+#include <lwip/dns.h>
+#include "config.h"
+#include "metrics.h"
+
+namespace MqttLink {
+
+namespace {
+
+constexpr uint8_t kMaxBackoffShift = 8;
+constexpr const char* kStatusOnline = "online";
+constexpr const char* kStatusOffline = "offline";
+
+PubSubClient* mqtt = nullptr;
+WiFiClient* tcp = nullptr;
+
+State state = State::Waiting;
+bool enabled = true;
+Failure lastFailure = Failure::None;
+int lastHandshakeCode = 0;
+uint8_t failedAttempts = 0;
+unsigned long retryDelayMs = 0;
+unsigned long nextAttemptAtMs = 0;
+unsigned long attemptStartedAtMs = 0;
+unsigned long phaseStartedAtMs = 0;
+unsigned long connectedAtMs = 0;
+uint32_t lastConnectMs = 0;
+IPAddress serverAddress;
+
+// Written by the lwIP task, the generation drops answers to old lookups
+volatile uint32_t dnsGeneration = 0;
+volatile uint32_t dnsDoneGeneration = 0;
+volatile uint32_t dnsResult = 0;
+volatile bool dnsResolved = false;
+
+void onDnsFound(const char* name, const ip_addr_t* ipaddr, void* arg) {
+  (void)name;
+  uint32_t generation = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(arg));
+  if (generation != dnsGeneration) {
+    return;
+  }
+
+  dnsResolved = ipaddr != nullptr;
+  dnsResult = ipaddr != nullptr ? ip4_addr_get_u32(ip_2_ip4(ipaddr)) : 0;
+  dnsDoneGeneration = generation;
+}
+
+bool isDue(unsigned long now, unsigned long at) {
+  return static_cast<long>(now - at) >= 0;
+}
+
+void enterPhase(State next) {
+  state = next;
+  phaseStartedAtMs = millis();
+}
+
+Metrics::MqttConnectResult toMetricsResult(Failure failure) {
+  switch (failure) {
+    case Failure::Dns:       return Metrics::MqttConnectResult::Dns;
+    case Failure::Tcp:       return Metrics::MqttConnectResult::Tcp;
+    case Failure::Handshake: return Metrics::MqttConnectResult::Rejected;
+    case Failure::None:      break;
+  }
+  return Metrics::MqttConnectResult::Success;
+}
+
+// Schedules the next attempt after the backoff for the failures so far
+void backOff() {
+  uint8_t shift = failedAttempts < kMaxBackoffShift ? failedAttempts : kMaxBackoffShift;
+  if (failedAttempts < 255) {
+    failedAttempts++;
+  }
+  unsigned long backoffMs = kBackoffMinMs << shift;
+  if (backoffMs > kBackoffMaxMs) {
+    backoffMs = kBackoffMaxMs;
+  }
+
+  // Half fixed, half random, so stations behind one broker spread out
+  retryDelayMs = backoffMs / 2 + static_cast<unsigned long>(random(static_cast<long>(backoffMs / 2) + 1));
+  nextAttemptAtMs = millis() + retryDelayMs;
+}
+
+Event fail(Failure failure) {
+  tcp->stop();
+  lastFailure = failure;
+  Metrics::recordMqttConnect(toMetricsResult(failure), millis() - attemptStartedAtMs);
+  backOff();
+  state = State::Waiting;
+  return Event::Failed;
+}
+
+Event startAttempt() {
+  attemptStartedAtMs = millis();
+
+  if (serverAddress.fromString(config.mqttServer.c_str())) {
+    enterPhase(State::Connecting);
+    return Event::None;
+  }
+
+  dnsGeneration++;
+  ip_addr_t address;
+  err_t err = dns_gethostbyname(config.mqttServer.c_str(), &address, onDnsFound,
+                                reinterpret_cast<void*>(static_cast<uintptr_t>(dnsGeneration)));
+  if (err == ERR_OK) {
+    serverAddress = IPAddress(ip4_addr_get_u32(ip_2_ip4(&address)));
+    enterPhase(State::Connecting);
+    return Event::None;
+  }
+  if (err != ERR_INPROGRESS) {
+    return fail(Failure::Dns);
+  }
+
+  enterPhase(State::Resolving);
+  return Event::None;
+}
+
+Event pollResolver() {
+  if (dnsDoneGeneration == dnsGeneration) {
+    if (!dnsResolved) {
+      return fail(Failure::Dns);
+    }
+    serverAddress = IPAddress(static_cast<uint32_t>(dnsResult));
+    enterPhase(State::Connecting);
+    return Event::None;
+  }
+
+  if (millis() - phaseStartedAtMs > kDnsTimeoutMs) {
+    // A late answer carries this generation and is ignored
+    dnsGeneration++;
+    return fail(Failure::Dns);
+  }
+  return Event::None;
+}
+
+Event openSocket() {
+  if (!tcp->connect(serverAddress, static_cast<uint16_t>(config.mqttPort), kTcpTimeoutMs)) {
+    return fail(Failure::Tcp);
+  }
+
+  enterPhase(State::Handshake);
+  return Event::None;
+}
+
+// PubSubClient reuses the open socket and only sends CONNECT
+Event handshake() {
+  String statusTopic = getStatusTopic();
+  bool connected = statusTopic.length() > 0
+    ? mqtt->connect(config.stationName.c_str(), statusTopic.c_str(), 0, true, kStatusOffline)
+    : mqtt->connect(config.stationName.c_str());
+
+  if (!connected) {
+    lastHandshakeCode = mqtt->state();
+    return fail(Failure::Handshake);
+  }
+
+  if (statusTopic.length() > 0) {
+    mqtt->publish(statusTopic.c_str(), kStatusOnline, true);
+  }
+
+  lastConnectMs = millis() - attemptStartedAtMs;
+  Metrics::recordMqttConnect(Metrics::MqttConnectResult::Success, lastConnectMs);
+  lastFailure = Failure::None;
+  retryDelayMs = 0;
+  connectedAtMs = millis();
+  state = State::Connected;
+  return Event::Connected;
+}
+
+void disconnect() {
+  if (state == State::Resolving) {
+    dnsGeneration++;
+  }
+  if (mqtt->connected()) {
+    String statusTopic = getStatusTopic();
+    if (statusTopic.length() > 0) {
+      mqtt->publish(statusTopic.c_str(), kStatusOffline, true);
+    }
+    mqtt->disconnect();
+  }
+  tcp->stop();
+  state = State::Waiting;
+}
+
+}  // namespace
+
+void begin(PubSubClient& client, WiFiClient& transport) {
+  mqtt = &client;
+  tcp = &transport;
+  mqtt->setSocketTimeout(kHandshakeTimeoutS);
+  state = State::Waiting;
+  nextAttemptAtMs = millis();
+}
+
+Event update() {
+  if (mqtt == nullptr || !enabled) {
+    return Event::None;
+  }
+
+  switch (state) {
+    case State::Waiting:
+      return isDue(millis(), nextAttemptAtMs) ? startAttempt() : Event::None;
+    case State::Resolving:
+      return pollResolver();
+    case State::Connecting:
+      return openSocket();
+    case State::Handshake:
+      return handshake();
+    case State::Connected:
+      if (mqtt->loop()) {
+        if (failedAttempts > 0 && millis() - connectedAtMs >= kStableSessionMs) {
+          failedAttempts = 0;
+        }
+        return Event::None;
+      }
+      tcp->stop();
+      state = State::Waiting;
+      if (millis() - connectedAtMs < kStableSessionMs) {
+        backOff();
+      } else {
+        nextAttemptAtMs = millis();
+      }
+      return Event::Lost;
+  }
+  return Event::None;
+}
+
+void restart() {
+  if (mqtt == nullptr) {
+    return;
+  }
+
+  disconnect();
+  enabled = true;
+  failedAttempts = 0;
+  retryDelayMs = 0;
+  nextAttemptAtMs = millis();
+}
+
+void stop() {
+  if (mqtt == nullptr) {
+    return;
+  }
+
+  disconnect();
+  enabled = false;
+}
+
+State getState() {
+  return state;
+}
+
+const char* getStateName(State value) {
+  switch (value) {
+    case State::Waiting:    return "waiting";
+    case State::Resolving:  return "resolving";
+    case State::Connecting: return "connecting";
+    case State::Handshake:  return "handshake";
+    case State::Connected:  return "connected";
+  }
+  return "unknown";
+}
+
+Failure getLastFailure() {
+  return lastFailure;
+}
+
+const char* getFailureName(Failure failure) {
+  switch (failure) {
+    case Failure::None:      return "none";
+    case Failure::Dns:       return "dns";
+    case Failure::Tcp:       return "tcp";
+    case Failure::Handshake: return "handshake";
+  }
+  return "unknown";
+}
+
+int getLastHandshakeCode() {
+  return lastHandshakeCode;
+}
+
+unsigned long getRetryDelayMs() {
+  return retryDelayMs;
+}
+
+uint32_t getLastConnectMs() {
+  return lastConnectMs;
+}
+
+String getStatusTopic() {
+  if (config.mqttTopicPub1.isEmpty()) {
+    return String();
+  }
+  return String(config.mqttTopicPub1.c_str()) + "/status";
+}
+
+}  // namespace MqttLink
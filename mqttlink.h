@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <WiFiClient.h>
+
+namespace MqttLink {
+
+// Upper bounds for each connect phase, one phase runs per loop pass
+constexpr unsigned long kDnsTimeoutMs = 5000;
+constexpr int32_t kTcpTimeoutMs = 3000;
+constexpr uint16_t kHandshakeTimeoutS = 3;
+
+// Retry delay doubles per failed attempt, half of it is random jitter
+constexpr unsigned long kBackoffMinMs = 2000;
+constexpr unsigned long kBackoffMaxMs = 5UL * 60UL * 1000UL;
+// A session lost before this counts as a failed attempt and keeps the
+// backoff, so a broker that accepts and then drops the client is not
+// hammered. Only a session that lasted resets it.
+constexpr unsigned long kStableSessionMs = 60000;
+
+enum class State : uint8_t {
+  Waiting,
+  Resolving,
+  Connecting,
+  Handshake,
+  Connected
+};
+
+enum class Failure : uint8_t {
+  None,
+  Dns,
+  Tcp,
+  Handshake
+};
+
+enum class Event : uint8_t {
+  None,
+  Connected,
+  Failed,
+  Lost
+};
+
+void begin(PubSubClient& client, WiFiClient& transport);
+
+// Advances the connection by at most one phase and services the client
+// once connected. Uses server, port and station name from config.
+Event update();
+
+// Drops the connection, with an "offline" status when it was up, and
+// connects again right away
+void restart();
+// Drops the connection and stays idle until restart()
+void stop();
+
+State getState();
+const char* getStateName(State state);
+Failure getLastFailure();
+const char* getFailureName(Failure failure);
+// PubSubClient state() of the last failed handshake
+int getLastHandshakeCode();
+unsigned long getRetryDelayMs();
+uint32_t getLastConnectMs();
+
+// Retained "online"/"offline" status, also used as the Last Will topic.
+// Empty when Pub Sub 1 is not set.
+String getStatusTopic();
+
+}
@@ -0,0 +1,238 @@
+#include "mqttoutbox.h"
+
+#include <LittleFS.h>
+#include "metrics.h"
+
+namespace MqttOutbox {
+
+namespace {
+
+// head and count live in a small state file of their own. LittleFS keeps
+// file data copy-on-write, so updating them inside the ring would rewrite
+// the ring from the header to its end on every push and drain.
+const char* const kStateFile = "/mqtt-outbox.bin";
+constexpr uint32_t kMagic = 0x4258514DUL;  // "MQXB"
+constexpr uint16_t kVersion = 2;
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t capacity;
+  uint16_t recordSize;
+  uint16_t head;
+  uint16_t count;
+  uint16_t reserved;
+};
+
+struct Record {
+  uint16_t length;
+  uint8_t payload[kMaxPayloadLength];
+};
+
+// Records live in segment files of one flash block each, so a push only
+// ever touches the block it appends to. One spare segment: the writer
+// starts a segment over only once every record in it has been drained
+// or dropped.
+constexpr uint16_t kSegmentRecords = 4096 / sizeof(Record);
+constexpr uint16_t kSegmentCount = (kCapacity + kSegmentRecords - 1) / kSegmentRecords + 1;
+constexpr uint16_t kSlotCount = kSegmentCount * kSegmentRecords;
+static_assert(kSegmentRecords > 0, "A record must fit a flash block");
+
+Header header = {};
+bool ready = false;
+unsigned long lastDrainAtMs = 0;
+
+uint32_t queuedCount = 0;
+uint32_t replayedCount = 0;
+uint32_t droppedCount = 0;
+uint32_t failedCount = 0;
+
+String segmentPath(uint16_t slot) {
+  return String("/mqtt-outbox-") + String(slot / kSegmentRecords) + ".bin";
+}
+
+uint32_t recordOffset(uint16_t slot) {
+  return static_cast<uint32_t>(slot % kSegmentRecords) * sizeof(Record);
+}
+
+bool isValid(const Header& candidate) {
+  return candidate.magic == kMagic
+    && candidate.version == kVersion
+    && candidate.capacity == kCapacity
+    && candidate.recordSize == sizeof(Record)
+    && candidate.head < kSlotCount
+    && candidate.count <= kCapacity;
+}
+
+bool writeState(const Header& next) {
+  File file = LittleFS.open(kStateFile, "w");
+  if (!file) {
+    return false;
+  }
+
+  bool ok = file.write(reinterpret_cast<const uint8_t*>(&next), sizeof(next)) == sizeof(next);
+  file.close();
+  return ok;
+}
+
+bool create() {
+  header = {};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.capacity = kCapacity;
+  header.recordSize = sizeof(Record);
+  return writeState(header);
+}
+
+// Appends in the normal case. After a power cut between a record and the
+// state that counts it, the orphan is overwritten in place.
+bool writeRecord(uint16_t slot, const Record& record) {
+  String path = segmentPath(slot);
+  uint32_t offset = recordOffset(slot);
+  File file = LittleFS.open(path.c_str(), offset == 0 ? "w" : "a");
+  if (file && file.size() != offset) {
+    file.close();
+    file = LittleFS.open(path.c_str(), "r+", true);
+    if (file && !file.seek(offset)) {
+      file.close();
+      return false;
+    }
+  }
+  if (!file) {
+    return false;
+  }
+
+  bool ok = file.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record);
+  file.close();
+  return ok;
+}
+
+bool readRecord(uint16_t slot, Record& record) {
+  File file = LittleFS.open(segmentPath(slot).c_str(), "r");
+  if (!file) {
+    return false;
+  }
+
+  bool ok = file.seek(recordOffset(slot))
+    && file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record)
+    && record.length > 0
+    && record.length <= kMaxPayloadLength;
+  file.close();
+  return ok;
+}
+
+}  // namespace
+
+bool begin() {
+  ready = false;
+
+  File file = LittleFS.open(kStateFile, "r");
+  if (file) {
+    Header stored = {};
+    bool ok = file.read(reinterpret_cast<uint8_t*>(&stored), sizeof(stored)) == sizeof(stored);
+    file.close();
+
+    if (ok && isValid(stored)) {
+      header = stored;
+      ready = true;
+      return true;
+    }
+  }
+
+  ready = create();
+  return ready;
+}
+
+bool push(const uint8_t* payload, size_t length) {
+  if (!ready || length == 0 || length > kMaxPayloadLength) {
+    return false;
+  }
+
+  Record record = {};
+  record.length = static_cast<uint16_t>(length);
+  memcpy(record.payload, payload, length);
+
+  Header next = header;
+  uint16_t slot = (next.head + next.count) % kSlotCount;
+  bool full = next.count == kCapacity;
+  if (full) {
+    next.head = (next.head + 1) % kSlotCount;
+  } else {
+    next.count++;
+  }
+
+  // The record first, the state that counts it second
+  if (!writeRecord(slot, record) || !writeState(next)) {
+    return false;
+  }
+
+  header = next;
+  queuedCount++;
+  if (full) {
+    droppedCount++;
+  }
+  return true;
+}
+
+bool drain(PubSubClient& client, const char* topic, uint8_t ratePerSecond) {
+  if (!ready || header.count == 0 || !client.connected()) {
+    return false;
+  }
+
+  unsigned long now = millis();
+  unsigned long spacingMs = 1000UL / (ratePerSecond > 0 ? ratePerSecond : 1);
+  if (now - lastDrainAtMs < spacingMs) {
+    return false;
+  }
+  lastDrainAtMs = now;
+
+  Header next = header;
+  next.head = (next.head + 1) % kSlotCount;
+  next.count--;
+
+  Record record;
+  if (!readRecord(header.head, record)) {
+    // Unreadable record, skip it so it cannot block the rest
+    header = next;
+    writeState(next);
+    droppedCount++;
+    return false;
+  }
+
+  unsigned long startedAtMs = millis();
+  bool published = client.publish(topic, record.payload, record.length);
+  Metrics::recordUpload(Metrics::Destination::Mqtt, published, millis() - startedAtMs);
+  if (!published) {
+    failedCount++;
+    return false;
+  }
+
+  // A header that fails to save means one duplicate after a reboot,
+  // never a gap
+  header = next;
+  writeState(next);
+  replayedCount++;
+  return true;
+}
+
+uint16_t getDepth() {
+  return ready ? header.count : 0;
+}
+
+uint32_t getQueuedCount() {
+  return queuedCount;
+}
+
+uint32_t getReplayedCount() {
+  return replayedCount;
+}
+
+uint32_t getDroppedCount() {
+  return droppedCount;
+}
+
+uint32_t getFailedCount() {
+  return failedCount;
+}
+
+}  // namespace MqttOutbox
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+// Measurement messages that could not be published wait here, in a ring
+// on LittleFS, so they survive both broker outages and reboots. They are
+// replayed oldest first once the broker is back. A push programs about one
+// record of flash and a drain a few bytes.
+namespace MqttOutbox {
+
+constexpr uint16_t kCapacity = 96;
+constexpr size_t kMaxPayloadLength = 254;
+
+// Reads the ring state, or starts an empty ring when the state file is
+// missing or was written with another layout. Needs LittleFS mounted.
+bool begin();
+
+// Appends one payload. When the ring is full the oldest message is
+// dropped to make room. Returns false when the payload does not fit a
+// record or the file could not be written.
+bool push(const uint8_t* payload, size_t length);
+
+// Publishes the oldest message when one is waiting and the previous
+// replay was at least 1000 / ratePerSecond ms ago. Returns true when a
+// message went out and was removed from the ring.
+bool drain(PubSubClient& client, const char* topic, uint8_t ratePerSecond);
+
+uint16_t getDepth();
+uint32_t getQueuedCount();
+uint32_t getReplayedCount();
+uint32_t getDroppedCount();
+uint32_t getFailedCount();
+
+}
@@ -0,0 +1,77 @@
+#include "mqttpublish.h"
+
+#include <math.h>
+#include "metrics.h"
+
+namespace ChangePublisher {
+
+namespace {
+
+constexpr uint8_t kMetricCount = static_cast<uint8_t>(Metric::Count);
+
+struct MetricState {
+  bool published;
+  float value;
+  unsigned long publishedAtMs;
+};
+
+MetricState states[kMetricCount] = {};
+uint32_t publishedCount = 0;
+uint32_t suppressedCount = 0;
+
+bool isDue(const MetricState& state, float value, float deadband, unsigned long now, unsigned long maxSilenceMs) {
+  if (!state.published || now - state.publishedAtMs >= maxSilenceMs) {
+    return true;
+  }
+
+  float delta = fabsf(value - state.value);
+  return deadband > 0.0f ? delta >= deadband : delta > 0.0f;
+}
+
+}  // namespace
+
+bool offer(PubSubClient& client, Metric metric, const char* topic, float value, uint8_t decimals, float deadband, unsigned long maxSilenceMs) {
+  uint8_t index = static_cast<uint8_t>(metric);
+  if (index >= kMetricCount || isnan(value)) {
+    return false;
+  }
+
+  MetricState& state = states[index];
+  unsigned long now = millis();
+  if (!isDue(state, value, deadband, now, maxSilenceMs)) {
+    suppressedCount++;
+    return false;
+  }
+
+  char payload[16];
+  snprintf(payload, sizeof(payload), "%.*f", decimals, value);
+
+  unsigned long startedAtMs = millis();
+  bool published = client.publish(topic, payload, true);
+  Metrics::recordUpload(Metrics::Destination::Mqtt, published, millis() - startedAtMs);
+  if (!published) {
+    return false;
+  }
+
+  state.published = true;
+  state.value = value;
+  state.publishedAtMs = now;
+  publishedCount++;
+  return true;
+}
+
+void reset() {
+  for (uint8_t i = 0; i < kMetricCount; i++) {
+    states[i].published = false;
+  }
+}
+
+uint32_t getPublishedCount() {
+  return publishedCount;
+}
+
+uint32_t getSuppressedCount() {
+  return suppressedCount;
+}
+
+}  // namespace ChangePublisher
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+// Change-driven publishing: each metric goes to its own retained topic,
+// but only when it moved by at least its deadband since the last publish
+// or when it has been silent for too long.
+namespace ChangePublisher {
+
+enum class Metric : uint8_t {
+  Temperature,
+  Humidity,
+  Pressure,
+  Light,
+  Rain1h,
+  Rain24h,
+  Rssi,
+  Count
+};
+
+// A deadband of 0 publishes every change. Returns true when the value
+// was published, false when it was suppressed or the publish failed.
+bool offer(PubSubClient& client, Metric metric, const char* topic, float value, uint8_t decimals, float deadband, unsigned long maxSilenceMs);
+
+// Forgets the last published values, so every metric goes out next time
+void reset();
+
+uint32_t getPublishedCount();
+uint32_t getSuppressedCount();
+
+}
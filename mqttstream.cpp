@@ -0,0 +1,89 @@
+#include "mqttstream.h"
+
+#include "metrics.h"
+
+namespace MqttStream {
+
+namespace {
+
+// Collects small serializer writes into kChunkSize blocks, so the network
+// client is not called once per character
+class ChunkWriter : public Print {
+ public:
+  explicit ChunkWriter(PubSubClient& client)
+    : client_(client) {}
+
+  size_t write(uint8_t c) override {
+    if (used_ == kChunkSize && !drain()) {
+      return 0;
+    }
+    buffer_[used_++] = c;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t length) override {
+    size_t written = 0;
+    while (written < length) {
+      if (used_ == kChunkSize && !drain()) {
+        break;
+      }
+      size_t count = min(length - written, kChunkSize - used_);
+      memcpy(buffer_ + used_, data + written, count);
+      used_ += count;
+      written += count;
+    }
+    return written;
+  }
+
+  // Sends what is buffered, returns false once any write came up short
+  bool drain() {
+    if (used_ > 0 && client_.write(buffer_, used_) != used_) {
+      ok_ = false;
+    }
+    used_ = 0;
+    return ok_;
+  }
+
+ private:
+  PubSubClient& client_;
+  uint8_t buffer_[kChunkSize];
+  size_t used_ = 0;
+  bool ok_ = true;
+};
+
+bool finishPublish(PubSubClient& client, bool written, size_t length, unsigned long startedAtUs) {
+  bool published = client.endPublish() == 1 && written;
+  Metrics::recordMqttStream(published, length, static_cast<uint32_t>(micros() - startedAtUs));
+  return published;
+}
+
+}  // namespace
+
+bool publishJson(PubSubClient& client, const char* topic, const JsonDocument& doc, bool pretty) {
+  unsigned long startedAtUs = micros();
+  size_t length = pretty ? measureJsonPretty(doc) : measureJson(doc);
+  if (!client.beginPublish(topic, length, false)) {
+    return false;
+  }
+
+  ChunkWriter writer(client);
+  size_t serialized = pretty ? serializeJsonPretty(doc, writer) : serializeJson(doc, writer);
+  bool written = writer.drain() && serialized == length;
+  return finishPublish(client, written, length, startedAtUs);
+}
+
+bool publishText(PubSubClient& client, const char* topic, const char* text, size_t length) {
+  unsigned long startedAtUs = micros();
+  if (!client.beginPublish(topic, length, false)) {
+    return false;
+  }
+
+  bool written = true;
+  for (size_t offset = 0; written && offset < length; offset += kChunkSize) {
+    size_t count = min(length - offset, kChunkSize);
+    written = client.write(reinterpret_cast<const uint8_t*>(text) + offset, count) == count;
+  }
+  return finishPublish(client, written, length, startedAtUs);
+}
+
+}  // namespace MqttStream
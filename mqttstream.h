@@ -0,0 +1,20 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+
+namespace MqttStream {
+
+// Bytes handed to the network client per write. Payloads of any size go
+// out through this buffer, the PubSubClient buffer only holds the header.
+constexpr size_t kChunkSize = 256;
+
+// Serializes doc straight into an MQTT message, without building the
+// payload in RAM first
+bool publishJson(PubSubClient& client, const char* topic, const JsonDocument& doc, bool pretty = false);
+
+// Publishes text that would not fit the PubSubClient buffer
+bool publishText(PubSubClient& client, const char* topic, const char* text, size_t length);
+
+}
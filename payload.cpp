@@ -0,0 +1,77 @@
+#include "payload.h"
+
+#include <ArduinoJson.h>
+#include <math.h>
+
+namespace Payload {
+
+namespace {
+
+// Temperature, humidity, pressure, light, two rain windows, rssi and ts.
+// Keys and text are stored by pointer, only the slots count.
+constexpr size_t kJsonCapacity = JSON_OBJECT_SIZE(8);
+// The schema version plus the same eight values
+constexpr size_t kMsgPackCapacity = JSON_ARRAY_SIZE(9);
+
+// Double for JSON, so 21.37 does not print as 21.3700008
+double roundForJson(float value) {
+  return roundf(value * 100) / 100.0;
+}
+
+// Float for MessagePack, so it packs as float32
+float roundForMsgPack(float value) {
+  return roundf(value * 100) / 100.0f;
+}
+
+}
+
+size_t buildJson(const Sample& sample, const Config& settings, uint8_t* buffer, size_t size) {
+  StaticJsonDocument<kJsonCapacity> doc;
+  doc[settings.dataTemp.c_str()] = roundForJson(sample.temperature);
+  doc[settings.dataHumi.c_str()] = roundForJson(sample.humidity);
+  doc[settings.dataPress.c_str()] = roundForJson(sample.seaLevelPressure);
+  if (settings.activeLight) {
+    doc[settings.dataLight.c_str()] = roundForJson(sample.lightWm2);
+  }
+  if (settings.activeRain) {
+    doc["rain_1h"] = roundForJson(sample.rain1h);
+    doc["rain_24h"] = roundForJson(sample.rain24h);
+  }
+  doc[settings.dataRssi.c_str()] = sample.rssi;
+  if (sample.timestamp != 0) {
+    doc["ts"] = sample.timestamp;
+  }
+
+  return serializeJson(doc, reinterpret_cast<char*>(buffer), size);
+}
+
+size_t buildMsgPack(const Sample& sample, const Config& settings, uint8_t* buffer, size_t size) {
+  StaticJsonDocument<kMsgPackCapacity> doc;
+  JsonArray values = doc.to<JsonArray>();
+  values.add(kMsgPackSchemaVersion);
+  values.add(roundForMsgPack(sample.temperature));
+  values.add(roundForMsgPack(sample.humidity));
+  values.add(roundForMsgPack(sample.seaLevelPressure));
+  if (settings.activeLight) {
+    values.add(roundForMsgPack(sample.lightWm2));
+  } else {
+    values.add();
+  }
+  if (settings.activeRain) {
+    values.add(roundForMsgPack(sample.rain1h));
+    values.add(roundForMsgPack(sample.rain24h));
+  } else {
+    values.add();
+    values.add();
+  }
+  values.add(sample.rssi);
+  if (sample.timestamp != 0) {
+    values.add(sample.timestamp);
+  } else {
+    values.add();
+  }
+
+  return serializeMsgPack(doc, buffer, size);
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+// The measurement message published to Pub Sub 1 and kept in the outbox:
+// JSON keyed by the configured data names, or a positional MessagePack
+// array for links where every byte counts.
+namespace Payload {
+
+// Schema of the MessagePack sample, bump when the array layout changes
+constexpr uint8_t kMsgPackSchemaVersion = 2;
+// Room for either format with the longest data names
+constexpr size_t kMaxLength = 320;
+
+struct Sample {
+  float temperature;
+  float humidity;
+  float seaLevelPressure;
+  float lightWm2;
+  float rain1h;
+  float rain24h;
+  int rssi;
+  // Unix time, 0 while the clock is not trusted yet
+  uint32_t timestamp;
+};
+
+// Values of inactive sensors are left out, the time when it is 0. Returns
+// the length written.
+size_t buildJson(const Sample& sample, const Config& settings, uint8_t* buffer, size_t size);
+
+// Positional array without keys: [version, temperature, humidity,
+// sea level pressure, light, rain 1h, rain 24h, rssi, ts]. Values of
+// inactive sensors and an unknown time are nil, so the positions never move.
+size_t buildMsgPack(const Sample& sample, const Config& settings, uint8_t* buffer, size_t size);
+
+}
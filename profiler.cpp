@@ -0,0 +1,244 @@
+#include "profiler.h"
+
+#include <ArduinoJson.h>
+#include "heaptrack.h"
+
+namespace Profiler {
+
+namespace {
+
+constexpr uint32_t kStageBoundsUs[] = {50, 100, 250, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000};
+constexpr uint32_t kIterationBoundsUs[] = {100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000};
+constexpr uint8_t kStageBoundCount = sizeof(kStageBoundsUs) / sizeof(kStageBoundsUs[0]);
+constexpr uint8_t kStageCount = static_cast<uint8_t>(Stage::Count);
+constexpr uint8_t kTaskCount = static_cast<uint8_t>(Task::Count);
+constexpr uint16_t kCalibrationRounds = 256;
+
+const char* const kTaskNames[kTaskCount] = {
+  "sensing",
+  "network"
+};
+
+const char* const kStageNames[kStageCount] = {
+  "rain",
+  "triggers",
+  "wifi",
+  "clock",
+  "sensors",
+  "http",
+  "aprs",
+  "mqtt_publish",
+  "mqtt_loop",
+  "web",
+  "recovery"
+};
+
+const Task kStageTasks[kStageCount] = {
+  Task::Sensing,  // rain
+  Task::Sensing,  // triggers
+  Task::Network,  // wifi
+  Task::Network,  // clock
+  Task::Sensing,  // sensors
+  Task::Network,  // http
+  Task::Network,  // aprs
+  Task::Network,  // mqtt_publish
+  Task::Network,  // mqtt_loop
+  Task::Network,  // web
+  Task::Sensing   // recovery
+};
+
+Metrics::Histogram stageHistograms[kStageCount] = {
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount),
+  Metrics::Histogram(kStageBoundsUs, kStageBoundCount)
+};
+Metrics::Histogram iterationHistograms[kTaskCount] = {
+  Metrics::Histogram(kIterationBoundsUs, sizeof(kIterationBoundsUs) / sizeof(kIterationBoundsUs[0])),
+  Metrics::Histogram(kIterationBoundsUs, sizeof(kIterationBoundsUs) / sizeof(kIterationBoundsUs[0]))
+};
+
+// Only the task itself writes its state, so the tasks never share a
+// variable here
+struct TaskState {
+  // Iteration currently running
+  Stage slowestStage;
+  uint32_t slowestStageUs;
+  uint8_t timersInIteration;
+
+  uint8_t timersPerIteration;
+  uint32_t stallCount;
+  StallReport pendingStall;
+  volatile bool stallPending;
+};
+
+TaskState taskStates[kTaskCount] = {};
+uint32_t timerOverheadNs = 0;
+
+uint8_t indexOf(Task task) {
+  uint8_t index = static_cast<uint8_t>(task);
+  return index < kTaskCount ? index : 0;
+}
+
+TaskState& stateOf(Task task) {
+  return taskStates[indexOf(task)];
+}
+
+void recordStage(Stage stage, uint32_t durationUs) {
+  stageHistograms[static_cast<uint8_t>(stage)].observe(durationUs);
+
+  TaskState& state = stateOf(getStageTask(stage));
+  state.timersInIteration++;
+  if (durationUs >= state.slowestStageUs) {
+    state.slowestStage = stage;
+    state.slowestStageUs = durationUs;
+  }
+}
+
+}  // namespace
+
+IterationTimer::IterationTimer(Task task)
+  : task_(task), startedAtUs_(micros()) {
+  TaskState& state = stateOf(task_);
+  state.slowestStage = Stage::Count;
+  state.slowestStageUs = 0;
+  state.timersInIteration = 0;
+}
+
+IterationTimer::~IterationTimer() {
+  uint32_t durationUs = static_cast<uint32_t>(micros() - startedAtUs_);
+  TaskState& state = stateOf(task_);
+  iterationHistograms[indexOf(task_)].observe(durationUs);
+  state.timersPerIteration = state.timersInIteration;
+
+  // A stall still waiting to be reported is kept, not overwritten
+  if (durationUs >= kStallThresholdUs) {
+    state.stallCount++;
+    if (!state.stallPending) {
+      state.pendingStall.task = task_;
+      state.pendingStall.iterationUs = durationUs;
+      state.pendingStall.slowestStage = state.slowestStage;
+      state.pendingStall.slowestStageUs = state.slowestStageUs;
+      state.stallPending = true;
+    }
+  }
+}
+
+// Heap probes run outside the timed window so they do not skew the profile
+StageTimer::StageTimer(Stage stage)
+  : stage_(stage) {
+  HeapTracker::beginStage(stage_);
+  startedAtUs_ = micros();
+}
+
+StageTimer::~StageTimer() {
+  recordStage(stage_, static_cast<uint32_t>(micros() - startedAtUs_));
+  HeapTracker::endStage(stage_);
+}
+
+// Measures what one StageTimer costs by running the same work on a
+// scratch histogram, so the numbers on /debug/perf can be judged against it
+void begin() {
+  Metrics::Histogram scratch(kStageBoundsUs, kStageBoundCount);
+
+  unsigned long startedAtUs = micros();
+  for (uint16_t i = 0; i < kCalibrationRounds; i++) {
+    unsigned long stageStartedAtUs = micros();
+    scratch.observe(static_cast<uint32_t>(micros() - stageStartedAtUs));
+  }
+  timerOverheadNs = static_cast<uint32_t>((micros() - startedAtUs) * 1000UL / kCalibrationRounds);
+}
+
+bool takeStall(Task task, StallReport& report) {
+  TaskState& state = stateOf(task);
+  if (!state.stallPending) {
+    return false;
+  }
+
+  report = state.pendingStall;
+  state.stallPending = false;
+  return true;
+}
+
+Task getStageTask(Stage stage) {
+  uint8_t index = static_cast<uint8_t>(stage);
+  return index < kStageCount ? kStageTasks[index] : Task::Network;
+}
+
+const char* getTaskName(Task task) {
+  uint8_t index = static_cast<uint8_t>(task);
+  return index < kTaskCount ? kTaskNames[index] : "none";
+}
+
+const char* getStageName(Stage stage) {
+  uint8_t index = static_cast<uint8_t>(stage);
+  return index < kStageCount ? kStageNames[index] : "none";
+}
+
+const Metrics::Histogram& getStageHistogram(Stage stage) {
+  uint8_t index = static_cast<uint8_t>(stage);
+  return stageHistograms[index < kStageCount ? index : 0];
+}
+
+const Metrics::Histogram& getIterationHistogram(Task task) {
+  return iterationHistograms[indexOf(task)];
+}
+
+uint32_t getStallCount() {
+  uint32_t count = 0;
+  for (uint8_t i = 0; i < kTaskCount; i++) {
+    count += taskStates[i].stallCount;
+  }
+  return count;
+}
+
+uint32_t getTimerOverheadNs() {
+  return timerOverheadNs;
+}
+
+uint8_t getTimersPerIteration(Task task) {
+  return stateOf(task).timersPerIteration;
+}
+
+String buildSummaryJson() {
+  DynamicJsonDocument doc(2048);
+
+  JsonObject loops = doc.createNestedObject("loops");
+  for (uint8_t i = 0; i < kTaskCount; i++) {
+    const Metrics::Histogram& histogram = iterationHistograms[i];
+    JsonObject loopObj = loops.createNestedObject(kTaskNames[i]);
+    loopObj["n"] = histogram.getCount();
+    loopObj["p50"] = histogram.getPercentile(50);
+    loopObj["p99"] = histogram.getPercentile(99);
+    loopObj["max"] = histogram.getMax();
+    loopObj["stalls"] = taskStates[i].stallCount;
+  }
+  doc["overheadNs"] = timerOverheadNs;
+
+  JsonObject stages = doc.createNestedObject("stages");
+  for (uint8_t i = 0; i < kStageCount; i++) {
+    const Metrics::Histogram& histogram = stageHistograms[i];
+    if (histogram.getCount() == 0) {
+      continue;
+    }
+
+    JsonObject stage = stages.createNestedObject(kStageNames[i]);
+    stage["n"] = histogram.getCount();
+    stage["p50"] = histogram.getPercentile(50);
+    stage["p99"] = histogram.getPercentile(99);
+    stage["max"] = histogram.getMax();
+  }
+
+  String json;
+  serializeJson(doc, json);
+  return json;
+}
+
+}  // namespace Profiler
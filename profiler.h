@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+#include "metrics.h"
+
+namespace Profiler {
+
+// A loop iteration longer than this is reported as a stall
+constexpr uint32_t kStallThresholdUs = 2000000;
+
+enum class Stage : uint8_t {
+  Rain,
+  Triggers,
+  WiFi,
+  Clock,
+  Sensors,
+  Http,
+  Aprs,
+  MqttPublish,
+  MqttLoop,
+  Web,
+  Recovery,
+  Count
+};
+
+// Each stage runs on one task only, see getStageTask()
+enum class Task : uint8_t {
+  Sensing,
+  Network,
+  Count
+};
+
+struct StallReport {
+  Task task;
+  uint32_t iterationUs;
+  Stage slowestStage;
+  uint32_t slowestStageUs;
+};
+
+// Times one whole pass of a task loop, feeds that task's loop histogram
+// and runs the stall detector when it goes out of scope
+class IterationTimer {
+ public:
+  explicit IterationTimer(Task task);
+  ~IterationTimer();
+
+ private:
+  Task task_;
+  unsigned long startedAtUs_;
+};
+
+// Times one stage inside the current iteration
+class StageTimer {
+ public:
+  explicit StageTimer(Stage stage);
+  ~StageTimer();
+
+ private:
+  Stage stage_;
+  unsigned long startedAtUs_;
+};
+
+void begin();
+
+// Returns the last unreported stall of the task, if any, and marks it
+// reported
+bool takeStall(Task task, StallReport& report);
+
+Task getStageTask(Stage stage);
+const char* getTaskName(Task task);
+const char* getStageName(Stage stage);
+const Metrics::Histogram& getStageHistogram(Stage stage);
+const Metrics::Histogram& getIterationHistogram(Task task);
+uint32_t getStallCount();
+uint32_t getTimerOverheadNs();
+uint8_t getTimersPerIteration(Task task);
+
+String buildSummaryJson();
+
+}
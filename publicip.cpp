@@ -0,0 +1,95 @@
+#include "publicip.h"
+
+#include <HTTPClient.h>
+
+namespace PublicIp {
+
+namespace {
+
+char address[kMaxLength + 1] = "";
+// Hash of the URL the address came from, a changed URL looks up again
+uint32_t sourceHash = 0;
+bool cached = false;
+unsigned long fetchedAtMs = 0;
+uint32_t successCount = 0;
+uint32_t failureCount = 0;
+
+uint32_t hashUrl(const char* url) {
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  for (const char* c = url; *c != '\0'; c++) {
+    hash ^= static_cast<uint8_t>(*c);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Digits, dots and colons only, so an error page is never taken for an
+// address
+bool isAddress(const String& text) {
+  if (text.length() == 0 || text.length() > kMaxLength) {
+    return false;
+  }
+
+  for (size_t i = 0; i < text.length(); i++) {
+    char c = text[i];
+    if (!isxdigit(static_cast<unsigned char>(c)) && c != '.' && c != ':') {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+bool isStale(const char* url) {
+  if (url == nullptr || url[0] == '\0') {
+    return cached;
+  }
+  return !cached || hashUrl(url) != sourceHash || millis() - fetchedAtMs >= kTtlMs;
+}
+
+Result refresh(const char* url) {
+  if (url == nullptr || url[0] == '\0') {
+    cached = false;
+    address[0] = '\0';
+    return Result::Off;
+  }
+
+  HTTPClient http;
+  http.setConnectTimeout(kTimeoutMs);
+  http.setTimeout(kTimeoutMs);
+  if (!http.begin(url)) {
+    failureCount++;
+    return Result::Failed;
+  }
+
+  int httpCode = http.GET();
+  String body = httpCode == 200 ? http.getString() : String();
+  http.end();
+  body.trim();
+
+  if (!isAddress(body)) {
+    failureCount++;
+    return Result::Failed;
+  }
+
+  successCount++;
+  bool changed = !cached || strcmp(address, body.c_str()) != 0;
+  strncpy(address, body.c_str(), kMaxLength);
+  address[kMaxLength] = '\0';
+  sourceHash = hashUrl(url);
+  cached = true;
+  fetchedAtMs = millis();
+  return changed ? Result::Changed : Result::Unchanged;
+}
+
+const char* get() {
+  return cached ? address : "unknown";
+}
+
+uint32_t getLookupCount(bool success) {
+  return success ? successCount : failureCount;
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Public address of the station as seen from the internet, for the info
+// report. Looked up from a URL that answers with the bare address, like
+// api.ipify.org or a service on the local network, and cached so the
+// info report never waits for a lookup.
+namespace PublicIp {
+
+constexpr unsigned long kTtlMs = 6UL * 60UL * 60UL * 1000UL;
+constexpr uint16_t kTimeoutMs = 3000;
+// Long enough for an IPv6 address
+constexpr size_t kMaxLength = 45;
+
+enum class Result : uint8_t {
+  Unchanged,
+  Changed,
+  Failed,
+  // Empty URL, lookups are off
+  Off
+};
+
+// True when nothing is cached, the cache is older than kTtlMs or it came
+// from another URL
+bool isStale(const char* url);
+
+// Blocking GET, up to kTimeoutMs each for connect and answer. A failed
+// lookup keeps the last address.
+Result refresh(const char* url);
+
+// "unknown" until the first lookup succeeds
+const char* get();
+uint32_t getLookupCount(bool success);
+
+}
@@ -2,7 +2,12 @@
 
 #include <Arduino.h>
 #include <LittleFS.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <rom/crc.h>
+#include <freertos/semphr.h>
 #include <time.h>
+#include "rtcmemory.h"
 
 namespace RainGauge {
 
@@ -18,6 +23,14 @@ constexpr uint32_t kRain24hWindowSec = 24UL * 60UL * 60UL;
 constexpr size_t kMaxStoredTips = 1024;
 constexpr uint32_t kStateVersion = 6;
 constexpr time_t kValidEpochThreshold = 1700000000;
+// Changes with the RetainedState layout
+constexpr uint32_t kRetainedMagic = 0x52414932;
+// RetainedState counts tips per minute for the last hour and per ten
+// minutes for the rest of the day
+constexpr uint32_t kFineBucketSec = 60;
+constexpr uint32_t kCoarseBucketSec = 600;
+constexpr size_t kFineBucketCount = kRain1hWindowSec / kFineBucketSec;
+constexpr size_t kRetainedBucketCount = kFineBucketCount + (kRain24hWindowSec - kRain1hWindowSec) / kCoarseBucketSec;
 
 volatile uint32_t pendingTips = 0;
 volatile bool pulseLowActive = false;
@@ -47,6 +60,46 @@ struct PersistedState {
 
 PersistedState persistedState;
 
+// Copy of the state handed over a software restart in RTC memory. Only
+// retain() marks it valid and begin() takes it once, so after a crash or
+// a power cut the state comes from flash. Tips are kept as counts per age
+// bucket instead of timestamps, which would take 4 KB of the 8 KB RTC
+// memory. A restored tip is stamped with the young end of its bucket, so
+// it stays in its window up to a bucket longer, never shorter.
+struct RetainedState {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t totalTips;
+  // Not counted yet when retained, no time to stamp them with
+  uint32_t pendingTips;
+  // The state file already matched, nothing left to write
+  bool flashCurrent;
+  // Bucket ages count back from here
+  uint32_t retainedAtSec;
+  // Youngest first, see bucketForAge()
+  uint16_t bucketTips[kRetainedBucketCount];
+  uint32_t crc;
+};
+
+RTC_NOINIT_ATTR RetainedState retainedState;
+static_assert(sizeof(RetainedState) <= RtcMemory::kRainBytes, "RetainedState outgrew its RTC memory budget");
+
+RestoreSource restoreSource = RestoreSource::None;
+
+// update() runs on the sensing task, flush() and reset() come from the
+// network task before a restart or from the web UI
+SemaphoreHandle_t stateMutex = nullptr;
+
+struct StateLock {
+  StateLock() {
+    if (stateMutex == nullptr) {
+      stateMutex = xSemaphoreCreateMutex();
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+  }
+  ~StateLock() { xSemaphoreGive(stateMutex); }
+};
+
 bool getCurrentSeconds(uint32_t& nowSec) {
   time_t now = time(nullptr);
   if (now < kValidEpochThreshold) {
@@ -259,6 +312,57 @@ bool saveState() {
   return true;
 }
 
+size_t bucketForAge(uint32_t ageSec) {
+  if (ageSec < kRain1hWindowSec) {
+    return ageSec / kFineBucketSec;
+  }
+  return kFineBucketCount + (ageSec - kRain1hWindowSec) / kCoarseBucketSec;
+}
+
+// Youngest age that falls into bucket
+uint32_t bucketAgeSec(size_t bucket) {
+  if (bucket < kFineBucketCount) {
+    return bucket * kFineBucketSec;
+  }
+  return kRain1hWindowSec + (bucket - kFineBucketCount) * kCoarseBucketSec;
+}
+
+uint32_t retainedCrc() {
+  return crc32_le(0, reinterpret_cast<const uint8_t*>(&retainedState), offsetof(RetainedState, crc));
+}
+
+bool restoreRetainedState() {
+  bool valid = retainedState.magic == kRetainedMagic
+    && retainedState.version == kStateVersion
+    && retainedState.crc == retainedCrc();
+  // Taken once, a later crash must not bring back an old copy
+  retainedState.magic = 0;
+  if (!valid) {
+    return false;
+  }
+
+  totalTips = retainedState.totalTips;
+  clearTipBuffer();
+  // Oldest bucket first, the tip buffer is in time order
+  for (size_t bucket = kRetainedBucketCount; bucket-- > 0;) {
+    uint32_t tipSec = retainedState.retainedAtSec - bucketAgeSec(bucket);
+    for (uint16_t i = 0; i < retainedState.bucketTips[bucket]; i++) {
+      appendTip(tipSec);
+    }
+  }
+  // Pruned by the first update() once the time is known
+  rain24hTips = static_cast<uint32_t>(tipCount);
+  rain1hTips = rain24hTips;
+
+  noInterrupts();
+  pendingTips += retainedState.pendingTips;
+  interrupts();
+
+  stateDirty = !retainedState.flashCurrent;
+  stateLoaded = true;
+  return true;
+}
+
 void consumePendingTips(uint32_t nowSec) {
   uint32_t capturedTips = 0;
 
@@ -284,12 +388,21 @@ void consumePendingTips(uint32_t nowSec) {
 }  // namespace
 
 void begin(bool enabledValue, float tipMmValue) {
-  loadState();
+  {
+    StateLock lock;
+    if (restoreRetainedState()) {
+      restoreSource = RestoreSource::Rtc;
+    } else {
+      restoreSource = LittleFS.exists(kStateFile) ? RestoreSource::Flash : RestoreSource::None;
+      loadState();
+    }
+  }
   lastPersistAtMs = millis();
   onConfigurationChanged(enabledValue, tipMmValue);
 }
 
 void update() {
+  StateLock lock;
   if (!stateLoaded && !loadState()) {
     return;
   }
@@ -309,6 +422,7 @@ void update() {
 }
 
 void onConfigurationChanged(bool enabledValue, float tipMmValue) {
+  StateLock lock;
   enabled = enabledValue;
   tipMm = (tipMmValue > 0.0f) ? tipMmValue : 0.2794f;
 
@@ -319,12 +433,54 @@ void onConfigurationChanged(bool enabledValue, float tipMmValue) {
 }
 
 void flush() {
+  StateLock lock;
   if (stateDirty) {
     saveState();
   }
 }
 
+void retain() {
+  StateLock lock;
+  // The state file was never read, it is still the better copy
+  if (!stateLoaded) {
+    retainedState.magic = 0;
+    return;
+  }
+
+  uint32_t nowSec = 0;
+  if (getCurrentSeconds(nowSec)) {
+    consumePendingTips(nowSec);
+  }
+
+  noInterrupts();
+  uint32_t uncountedTips = pendingTips;
+  interrupts();
+
+  // Without the time, ages count from the newest tip
+  uint32_t retainedAtSec = nowSec;
+  if (retainedAtSec == 0 && tipCount > 0) {
+    retainedAtSec = tipTimestampsSec[physicalIndex(tipCount - 1)];
+  }
+
+  retainedState.version = kStateVersion;
+  retainedState.totalTips = totalTips;
+  retainedState.pendingTips = uncountedTips;
+  retainedState.flashCurrent = !stateDirty;
+  retainedState.retainedAtSec = retainedAtSec;
+  memset(retainedState.bucketTips, 0, sizeof(retainedState.bucketTips));
+  for (size_t i = 0; i < tipCount; i++) {
+    uint32_t tipSec = tipTimestampsSec[physicalIndex(i)];
+    uint32_t ageSec = tipSec < retainedAtSec ? retainedAtSec - tipSec : 0;
+    if (ageSec < kRain24hWindowSec) {
+      retainedState.bucketTips[bucketForAge(ageSec)]++;
+    }
+  }
+  retainedState.magic = kRetainedMagic;
+  retainedState.crc = retainedCrc();
+}
+
 void reset() {
+  StateLock lock;
   detachGaugeInterrupt();
   noInterrupts();
   pendingTips = 0;
@@ -350,6 +506,10 @@ void reset() {
   }
 }
 
+RestoreSource getRestoreSource() {
+  return restoreSource;
+}
+
 bool isEnabled() {
   return enabled;
 }
@@ -9,8 +9,21 @@ constexpr uint8_t kRainGaugePin = 27;
 void begin(bool enabled, float tipMm);
 void update();
 void onConfigurationChanged(bool enabled, float tipMm);
+// Where begin() found the state. Rtc after a software restart preceded
+// by retain(), otherwise the state file.
+enum class RestoreSource : uint8_t {
+  None,
+  Rtc,
+  Flash
+};
+
+// Writes the state file when it changed, for a restart with power loss
 void flush();
+// Keeps the state in RTC memory for the software restart that follows,
+// without touching flash. Call right before ESP.restart().
+void retain();
 void reset();
+RestoreSource getRestoreSource();
 
 bool isEnabled();
 uint8_t getPin();
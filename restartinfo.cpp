@@ -0,0 +1,106 @@
+#include "restartinfo.h"
+
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <rom/crc.h>
+#include "rtcmemory.h"
+
+namespace RestartInfo {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x52535452;
+
+struct Record {
+  uint32_t magic;
+  uint32_t restartCount;
+  uint32_t uptimeSec;
+  Reason reason;
+  uint32_t crc;
+};
+
+RTC_NOINIT_ATTR Record record;
+static_assert(sizeof(Record) <= RtcMemory::kRestartInfoBytes, "Record outgrew its RTC memory budget");
+
+uint32_t restartCount = 0;
+Reason lastReason = Reason::None;
+esp_reset_reason_t resetReason = ESP_RST_UNKNOWN;
+uint32_t previousUptimeSec = 0;
+
+uint32_t recordCrc() {
+  return crc32_le(0, reinterpret_cast<const uint8_t*>(&record), offsetof(Record, crc));
+}
+
+void saveRecord() {
+  record.magic = kMagic;
+  record.crc = recordCrc();
+}
+
+const char* getResetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:   return "power_on";
+    case ESP_RST_EXT:       return "external";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:       return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep_sleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    default:                break;
+  }
+  return "other";
+}
+
+}
+
+void begin() {
+  resetReason = esp_reset_reason();
+  bool valid = record.magic == kMagic && record.crc == recordCrc();
+
+  if (resetReason == ESP_RST_POWERON || !valid) {
+    restartCount = 0;
+    lastReason = Reason::None;
+    previousUptimeSec = 0;
+  } else {
+    restartCount = record.restartCount + 1;
+    lastReason = record.reason;
+    previousUptimeSec = lastReason != Reason::None ? record.uptimeSec : 0;
+  }
+
+  // A crash before the next prepare() is named by the reset reason
+  record.restartCount = restartCount;
+  record.uptimeSec = 0;
+  record.reason = Reason::None;
+  saveRecord();
+}
+
+void prepare(Reason reason) {
+  record.uptimeSec = static_cast<uint32_t>(esp_timer_get_time() / 1000000LL);
+  record.reason = reason;
+  saveRecord();
+}
+
+uint32_t getRestartCount() {
+  return restartCount;
+}
+
+const char* getLastReasonName() {
+  switch (lastReason) {
+    case Reason::Periodic: return "periodic";
+    case Reason::Command:  return "command";
+    case Reason::Web:      return "web";
+    case Reason::WiFi:     return "wifi";
+    case Reason::Update:   return "update";
+    case Reason::Portal:   return "portal";
+    case Reason::None:     break;
+  }
+  return getResetReasonName(resetReason);
+}
+
+uint32_t getPreviousUptimeSec() {
+  return previousUptimeSec;
+}
+
+}
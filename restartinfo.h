@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Why and after how long the station last restarted, and how many times
+// since power on. Kept in RTC memory, which survives a restart but not a
+// power cut.
+namespace RestartInfo {
+
+// Restarts the firmware asks for. Anything else, a crash or a watchdog,
+// is named after the chip's reset reason.
+enum class Reason : uint8_t {
+  None,
+  Periodic,
+  Command,
+  Web,
+  WiFi,
+  Update,
+  Portal
+};
+
+// First thing in setup()
+void begin();
+
+// Right before ESP.restart()
+void prepare(Reason reason);
+
+// 0 after a power on
+uint32_t getRestartCount();
+const char* getLastReasonName();
+// Uptime when the firmware restarted itself, 0 after a crash or power on
+uint32_t getPreviousUptimeSec();
+
+}
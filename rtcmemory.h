@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+// Budgets for the records kept in RTC slow memory over a software restart
+// (RTC_NOINIT_ATTR). The chip has 8 KB of it, shared with ESP-IDF, the
+// ULP and deep sleep data, so the station keeps its own records to a
+// quarter. Each module checks its record against its budget.
+namespace RtcMemory {
+
+constexpr size_t kTotalBytes = 2048;
+constexpr size_t kRestartInfoBytes = 64;
+constexpr size_t kTimeKeeperBytes = 64;
+constexpr size_t kRainBytes = 512;
+
+static_assert(kRestartInfoBytes + kTimeKeeperBytes + kRainBytes <= kTotalBytes, "RTC records exceed their share of RTC slow memory");
+
+}
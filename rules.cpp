@@ -0,0 +1,261 @@
+#include "rules.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace RuleEngine {
+
+namespace {
+
+struct MetricName {
+  const char* name;
+  uint8_t metric;
+};
+
+const MetricName kMetricNames[] = {
+  {"temp", GPIO_TRIGGER_METRIC_TEMPERATURE},
+  {"temperature", GPIO_TRIGGER_METRIC_TEMPERATURE},
+  {"hum", GPIO_TRIGGER_METRIC_HUMIDITY},
+  {"humidity", GPIO_TRIGGER_METRIC_HUMIDITY},
+  {"pressure", GPIO_TRIGGER_METRIC_PRESSURE},
+  {"light", GPIO_TRIGGER_METRIC_LIGHT},
+  {"rain_1h", GPIO_TRIGGER_METRIC_RAIN_1H},
+  {"rain_24h", GPIO_TRIGGER_METRIC_RAIN_24H},
+  {"rssi", GPIO_TRIGGER_METRIC_RSSI}
+};
+
+// Recursive descent over the text, emitting postfix code as it goes.
+// Tracks how many operands the program will have on the evaluation stack
+// at each point, so evaluate() needs no bounds checks.
+class Compiler {
+ public:
+  Compiler(const char* text, Program& program, Error& error)
+    : text_(text), pos_(0), program_(program), error_(error), depth_(0) {}
+
+  bool run() {
+    program_.length = 0;
+    skipSpaces();
+    if (text_[pos_] == '\0') {
+      return fail("empty rule");
+    }
+    if (!parseOr()) {
+      return false;
+    }
+    skipSpaces();
+    if (text_[pos_] != '\0') {
+      return fail("expected 'and', 'or' or end of rule");
+    }
+    return true;
+  }
+
+ private:
+  bool fail(const char* message) {
+    error_.position = static_cast<uint8_t>(pos_ > 255 ? 255 : pos_);
+    error_.message = message;
+    return false;
+  }
+
+  void skipSpaces() {
+    while (text_[pos_] == ' ' || text_[pos_] == '\t') {
+      pos_++;
+    }
+  }
+
+  // Matches a word keyword only when it is not the start of a longer word
+  bool acceptWord(const char* word) {
+    skipSpaces();
+    size_t len = strlen(word);
+    if (strncasecmp(text_ + pos_, word, len) != 0) {
+      return false;
+    }
+    char next = text_[pos_ + len];
+    if (isalnum(static_cast<unsigned char>(next)) || next == '_') {
+      return false;
+    }
+    pos_ += len;
+    return true;
+  }
+
+  bool acceptSymbol(const char* symbol) {
+    skipSpaces();
+    size_t len = strlen(symbol);
+    if (strncmp(text_ + pos_, symbol, len) != 0) {
+      return false;
+    }
+    pos_ += len;
+    return true;
+  }
+
+  bool emit(Op op, uint8_t metric = 0, float operand = 0.0f) {
+    if (program_.length >= kMaxInstructions) {
+      return fail("rule too long");
+    }
+    program_.code[program_.length++] = {op, metric, operand};
+    return true;
+  }
+
+  // Operands currently on the evaluation stack
+  bool push() {
+    depth_++;
+    if (depth_ > kMaxStackDepth) {
+      return fail("rule nested too deep");
+    }
+    return true;
+  }
+
+  bool parseOr() {
+    if (!parseAnd()) {
+      return false;
+    }
+    while (acceptWord("or") || acceptSymbol("||")) {
+      if (!parseAnd() || !emit(Op::Or)) {
+        return false;
+      }
+      depth_--;
+    }
+    return true;
+  }
+
+  bool parseAnd() {
+    if (!parseUnary()) {
+      return false;
+    }
+    while (acceptWord("and") || acceptSymbol("&&")) {
+      if (!parseUnary() || !emit(Op::And)) {
+        return false;
+      }
+      depth_--;
+    }
+    return true;
+  }
+
+  bool parseUnary() {
+    if (acceptWord("not") || (text_[pos_] == '!' && text_[pos_ + 1] != '=' && acceptSymbol("!"))) {
+      return parseUnary() && emit(Op::Not);
+    }
+    if (acceptSymbol("(")) {
+      if (!parseOr()) {
+        return false;
+      }
+      if (!acceptSymbol(")")) {
+        return fail("expected ')'");
+      }
+      return true;
+    }
+    return parseComparison();
+  }
+
+  bool parseMetric(uint8_t& metric) {
+    skipSpaces();
+    size_t start = pos_;
+    while (isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_') {
+      pos_++;
+    }
+    size_t len = pos_ - start;
+    for (const MetricName& entry : kMetricNames) {
+      if (strlen(entry.name) == len && strncasecmp(text_ + start, entry.name, len) == 0) {
+        metric = entry.metric;
+        return true;
+      }
+    }
+    pos_ = start;
+    return fail("expected metric name");
+  }
+
+  bool parseOperator(Op& op) {
+    // Two character operators first, so ">=" is not read as ">"
+    if (acceptSymbol(">=")) { op = Op::GreaterEqual; return true; }
+    if (acceptSymbol("<=")) { op = Op::LessEqual; return true; }
+    if (acceptSymbol("==")) { op = Op::Equal; return true; }
+    if (acceptSymbol("!=")) { op = Op::NotEqual; return true; }
+    if (acceptSymbol(">")) { op = Op::Greater; return true; }
+    if (acceptSymbol("<")) { op = Op::Less; return true; }
+    return fail("expected comparison operator");
+  }
+
+  bool parseNumber(float& value) {
+    skipSpaces();
+    char* end = nullptr;
+    double parsed = strtod(text_ + pos_, &end);
+    if (end == text_ + pos_) {
+      return fail("expected number");
+    }
+    pos_ = end - text_;
+    value = static_cast<float>(parsed);
+    return true;
+  }
+
+  bool parseComparison() {
+    uint8_t metric = 0;
+    Op op = Op::Greater;
+    float value = 0.0f;
+    return parseMetric(metric) && parseOperator(op) && parseNumber(value)
+      && push() && emit(op, metric, value);
+  }
+
+  const char* text_;
+  size_t pos_;
+  Program& program_;
+  Error& error_;
+  uint8_t depth_;
+};
+
+bool compare(Op op, float value, float operand) {
+  switch (op) {
+    case Op::Greater: return value > operand;
+    case Op::GreaterEqual: return value >= operand;
+    case Op::Less: return value < operand;
+    case Op::LessEqual: return value <= operand;
+    case Op::Equal: return value == operand;
+    case Op::NotEqual: return value != operand;
+    default: return false;
+  }
+}
+
+}  // namespace
+
+bool compile(const char* text, Program& program, Error& error) {
+  error = {0, nullptr};
+  if (text == nullptr) {
+    text = "";
+  }
+
+  Compiler compiler(text, program, error);
+  if (!compiler.run()) {
+    program.length = 0;
+    return false;
+  }
+  return true;
+}
+
+bool evaluate(const Program& program, const float* values, const bool* valid) {
+  bool stack[kMaxStackDepth];
+  uint8_t depth = 0;
+
+  // compile() guarantees the stack never over- or underflows
+  for (uint8_t i = 0; i < program.length; i++) {
+    const Instruction& instruction = program.code[i];
+    switch (instruction.op) {
+      case Op::And:
+        depth--;
+        stack[depth - 1] = stack[depth - 1] && stack[depth];
+        break;
+      case Op::Or:
+        depth--;
+        stack[depth - 1] = stack[depth - 1] || stack[depth];
+        break;
+      case Op::Not:
+        stack[depth - 1] = !stack[depth - 1];
+        break;
+      default:
+        stack[depth++] = valid[instruction.metric]
+          && compare(instruction.op, values[instruction.metric], instruction.operand);
+        break;
+    }
+  }
+
+  return depth > 0 && stack[0];
+}
+
+}  // namespace RuleEngine
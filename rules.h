@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+// Compound trigger conditions such as
+//
+//   temp > 30 and humidity > 70 or rain_1h > 2
+//
+// A rule is compiled once, when the trigger config is applied, into a
+// flat postfix program. evaluate() runs it per reading with a fixed size
+// stack and never allocates.
+//
+// Grammar, keywords are case insensitive:
+//   rule       := and-expr { ("or" | "||") and-expr }
+//   and-expr   := unary { ("and" | "&&") unary }
+//   unary      := ("not" | "!") unary | "(" rule ")" | metric op number
+//   op         := ">" | ">=" | "<" | "<=" | "==" | "!="
+//   metric     := temp | temperature | humidity | hum | pressure | light
+//                 | rain_1h | rain_24h | rssi
+// "and" binds tighter than "or". A comparison on a metric without a value
+// in the reading, e.g. a disabled sensor, is false.
+namespace RuleEngine {
+
+constexpr uint8_t kMaxInstructions = 24;
+constexpr uint8_t kMaxStackDepth = 8;
+
+enum class Op : uint8_t {
+  Greater,
+  GreaterEqual,
+  Less,
+  LessEqual,
+  Equal,
+  NotEqual,
+  And,
+  Or,
+  Not
+};
+
+struct Instruction {
+  Op op;
+  // Comparisons only
+  uint8_t metric;
+  float operand;
+};
+
+struct Program {
+  Instruction code[kMaxInstructions];
+  uint8_t length;
+};
+
+struct Error {
+  // Offset into the rule text where compiling stopped
+  uint8_t position;
+  const char* message;
+};
+
+// Returns false with error filled in when the text is not a valid rule or
+// does not fit kMaxInstructions / kMaxStackDepth. An empty rule is invalid.
+bool compile(const char* text, Program& program, Error& error);
+
+// values and valid are indexed by GPIOTriggerMetric
+bool evaluate(const Program& program, const float* values, const bool* valid);
+
+}
@@ -0,0 +1,253 @@
+#include "scheduler.h"
+
+namespace Scheduler {
+
+namespace {
+
+uint32_t defaultNowMs() {
+  return millis();
+}
+
+uint32_t unknownUnixSeconds() {
+  return 0;
+}
+
+const JobStats kNoStats = {};
+
+// Wrap-safe, a deadline up to 24 days behind still counts as passed
+int32_t msUntil(uint32_t deadlineMs, uint32_t nowMs) {
+  return static_cast<int32_t>(deadlineMs - nowMs);
+}
+
+}  // namespace
+
+JobTable::JobTable()
+  : clock_{defaultNowMs, unknownUnixSeconds} {
+}
+
+void JobTable::begin(const Clock& clock) {
+  clock_ = clock;
+}
+
+bool JobTable::isValid(JobId id) const {
+  return id < jobCount_;
+}
+
+// Next point phase after a whole multiple of the period on the UTC
+// clock, at least half a period away so a run that finished a little
+// before its boundary second does not fire twice
+bool JobTable::alignedDeadline(const Job& job, uint32_t nowMs, uint32_t& deadlineMs) const {
+  uint32_t unixSeconds = clock_.unixSeconds();
+  uint32_t periodS = job.periodMs / 1000UL;
+  if (unixSeconds == 0 || periodS == 0) {
+    return false;
+  }
+
+  uint32_t intoPeriodMs = (unixSeconds % periodS) * 1000UL;
+  uint32_t offsetMs = job.phaseMs % job.periodMs;
+  uint32_t waitMs = offsetMs >= intoPeriodMs
+    ? offsetMs - intoPeriodMs
+    : job.periodMs - intoPeriodMs + offsetMs;
+  if (waitMs < job.periodMs / 2) {
+    waitMs += job.periodMs;
+  }
+
+  deadlineMs = nowMs + waitMs;
+  return true;
+}
+
+void JobTable::rescheduleAfterRun(Job& job, uint32_t startedAtMs, uint32_t lateMs) {
+  if (job.periodMs == 0) {
+    job.armed = false;
+    return;
+  }
+
+  if (lateMs >= job.periodMs) {
+    job.stats.overruns++;
+  }
+
+  if (job.aligned && alignedDeadline(job, startedAtMs, job.deadlineMs)) {
+    job.onWallClock = true;
+    return;
+  }
+
+  // Skips the periods that were missed but keeps the phase
+  job.deadlineMs += (lateMs / job.periodMs + 1) * job.periodMs;
+}
+
+JobId JobTable::addPeriodic(const char* name, Callback callback, uint32_t periodMs, uint32_t phaseMs) {
+  if (jobCount_ >= kMaxJobs || callback == nullptr || periodMs == 0) {
+    return kNoJob;
+  }
+
+  Job& job = jobs_[jobCount_];
+  job = {};
+  job.name = name;
+  job.callback = callback;
+  job.periodMs = periodMs;
+  job.phaseMs = phaseMs;
+  job.deadlineMs = clock_.nowMs() + phaseMs;
+  job.enabled = true;
+  job.armed = true;
+  return jobCount_++;
+}
+
+JobId JobTable::addOneShot(const char* name, Callback callback, uint32_t delayMs) {
+  if (jobCount_ >= kMaxJobs || callback == nullptr) {
+    return kNoJob;
+  }
+
+  Job& job = jobs_[jobCount_];
+  job = {};
+  job.name = name;
+  job.callback = callback;
+  job.deadlineMs = clock_.nowMs() + delayMs;
+  job.enabled = true;
+  job.armed = true;
+  return jobCount_++;
+}
+
+void JobTable::setPeriod(JobId id, uint32_t periodMs) {
+  if (!isValid(id) || periodMs == 0 || jobs_[id].periodMs == 0) {
+    return;
+  }
+
+  Job& job = jobs_[id];
+  if (job.periodMs == periodMs) {
+    return;
+  }
+
+  job.deadlineMs = job.deadlineMs - job.periodMs + periodMs;
+  job.periodMs = periodMs;
+  job.onWallClock = false;
+}
+
+void JobTable::setAligned(JobId id, bool aligned) {
+  if (!isValid(id) || jobs_[id].aligned == aligned) {
+    return;
+  }
+
+  jobs_[id].aligned = aligned;
+  jobs_[id].onWallClock = false;
+}
+
+void JobTable::setEnabled(JobId id, bool enabled) {
+  if (!isValid(id) || jobs_[id].enabled == enabled) {
+    return;
+  }
+
+  Job& job = jobs_[id];
+  job.enabled = enabled;
+  if (!enabled) {
+    return;
+  }
+
+  // A deadline that passed while disabled is due now, not a run of
+  // overruns. One too far ahead can only be a millis() wrap.
+  uint32_t now = clock_.nowMs();
+  int32_t untilMs = msUntil(job.deadlineMs, now);
+  if (untilMs < 0 || (job.periodMs > 0 && untilMs > static_cast<int32_t>(job.periodMs))) {
+    job.deadlineMs = now;
+  }
+}
+
+void JobTable::schedule(JobId id, uint32_t delayMs) {
+  if (!isValid(id)) {
+    return;
+  }
+
+  Job& job = jobs_[id];
+  job.deadlineMs = clock_.nowMs() + delayMs;
+  job.armed = true;
+  job.onWallClock = false;
+}
+
+bool JobTable::runNext() {
+  uint32_t now = clock_.nowMs();
+  Job* next = nullptr;
+  int32_t nextUntilMs = 0;
+
+  for (uint8_t i = 0; i < jobCount_; i++) {
+    Job& job = jobs_[i];
+    if (!job.enabled || !job.armed) {
+      continue;
+    }
+
+    // Moves onto the wall clock as soon as it is known
+    if (job.aligned && !job.onWallClock && job.periodMs > 0
+        && msUntil(job.deadlineMs, now) > 0 && alignedDeadline(job, now, job.deadlineMs)) {
+      job.onWallClock = true;
+    }
+
+    int32_t untilMs = msUntil(job.deadlineMs, now);
+    if (untilMs <= 0 && (next == nullptr || untilMs < nextUntilMs)) {
+      next = &job;
+      nextUntilMs = untilMs;
+    }
+  }
+
+  if (next == nullptr) {
+    return false;
+  }
+
+  uint32_t lateMs = static_cast<uint32_t>(-nextUntilMs);
+  next->callback();
+  uint32_t durationMs = clock_.nowMs() - now;
+
+  JobStats& stats = next->stats;
+  stats.runs++;
+  stats.lateSumMs += lateMs;
+  if (lateMs > stats.lateMaxMs) {
+    stats.lateMaxMs = lateMs;
+  }
+  stats.lastDurationMs = durationMs;
+  if (durationMs > stats.durationMaxMs) {
+    stats.durationMaxMs = durationMs;
+  }
+
+  rescheduleAfterRun(*next, now, lateMs);
+  return true;
+}
+
+uint32_t JobTable::getIdleMs() const {
+  uint32_t now = clock_.nowMs();
+  uint32_t idleMs = UINT32_MAX;
+
+  for (uint8_t i = 0; i < jobCount_; i++) {
+    const Job& job = jobs_[i];
+    if (!job.enabled || !job.armed) {
+      continue;
+    }
+
+    int32_t untilMs = msUntil(job.deadlineMs, now);
+    if (untilMs <= 0) {
+      return 0;
+    }
+    if (static_cast<uint32_t>(untilMs) < idleMs) {
+      idleMs = static_cast<uint32_t>(untilMs);
+    }
+  }
+  return idleMs;
+}
+
+uint8_t JobTable::getJobCount() const {
+  return jobCount_;
+}
+
+const char* JobTable::getJobName(JobId id) const {
+  return isValid(id) ? jobs_[id].name : "none";
+}
+
+uint32_t JobTable::getPeriodMs(JobId id) const {
+  return isValid(id) ? jobs_[id].periodMs : 0;
+}
+
+bool JobTable::isEnabled(JobId id) const {
+  return isValid(id) && jobs_[id].enabled;
+}
+
+const JobStats& JobTable::getJobStats(JobId id) const {
+  return isValid(id) ? jobs_[id].stats : kNoStats;
+}
+
+}  // namespace Scheduler
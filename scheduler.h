@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cooperative deadline scheduler for periodic work. Each call to
+// runNext() runs at most the one job whose deadline passed longest ago,
+// so jobs that fall due together are spread over several loop passes
+// instead of piling up in one. Time comes from a Clock, so the scheduler
+// can be driven by a fake clock off the device.
+namespace Scheduler {
+
+using JobId = uint8_t;
+using Callback = void (*)();
+
+constexpr uint8_t kMaxJobs = 10;
+constexpr JobId kNoJob = 0xFF;
+
+struct Clock {
+  uint32_t (*nowMs)();
+  // Unix seconds, 0 while the wall clock is unknown
+  uint32_t (*unixSeconds)();
+};
+
+struct JobStats {
+  uint32_t runs;
+  // Runs that started a whole period late, the missed runs are skipped
+  uint32_t overruns;
+  uint32_t lateSumMs;
+  uint32_t lateMaxMs;
+  uint32_t durationMaxMs;
+  uint32_t lastDurationMs;
+};
+
+// One table per task, a table is never touched from two tasks
+class JobTable {
+ public:
+  // Runs on millis() without a wall clock until begin() sets a Clock
+  JobTable();
+  void begin(const Clock& clock);
+
+  // Registers a job running every periodMs, first phaseMs after now. Once
+  // aligned, phaseMs modulo the period is the offset after each wall clock
+  // boundary instead, see setAligned().
+  JobId addPeriodic(const char* name, Callback callback, uint32_t periodMs, uint32_t phaseMs = 0);
+
+  // Registers a job that runs once, delayMs after now. schedule() arms it
+  // again.
+  JobId addOneShot(const char* name, Callback callback, uint32_t delayMs);
+
+  // Keeps the job's last run as reference, a shorter period may make it
+  // due right away
+  void setPeriod(JobId id, uint32_t periodMs);
+
+  // Aligned jobs run at whole multiples of their period on the UTC clock
+  // plus their phase, e.g. every 5 min at :00:10, :05:10, ... Until the wall
+  // clock is known they run on their plain period.
+  void setAligned(JobId id, bool aligned);
+
+  // Disabled jobs keep their stats. A deadline that passed while the job
+  // was disabled is due right away once it is enabled again.
+  void setEnabled(JobId id, bool enabled);
+
+  // Makes the job due delayMs from now, also re-arms a one-shot job
+  void schedule(JobId id, uint32_t delayMs = 0);
+
+  // Runs the most overdue job, returns false when nothing was due
+  bool runNext();
+
+  // Time until the next deadline, 0 when a job is already due and
+  // UINT32_MAX when nothing is scheduled
+  uint32_t getIdleMs() const;
+
+  uint8_t getJobCount() const;
+  const char* getJobName(JobId id) const;
+  uint32_t getPeriodMs(JobId id) const;
+  bool isEnabled(JobId id) const;
+  const JobStats& getJobStats(JobId id) const;
+
+ private:
+  struct Job {
+    const char* name;
+    Callback callback;
+    uint32_t periodMs;
+    uint32_t phaseMs;
+    uint32_t deadlineMs;
+    bool enabled;
+    bool armed;
+    bool aligned;
+    bool onWallClock;
+    JobStats stats;
+  };
+
+  bool isValid(JobId id) const;
+  bool alignedDeadline(const Job& job, uint32_t nowMs, uint32_t& deadlineMs) const;
+  void rescheduleAfterRun(Job& job, uint32_t startedAtMs, uint32_t lateMs);
+
+  Clock clock_;
+  Job jobs_[kMaxJobs] = {};
+  uint8_t jobCount_ = 0;
+};
+
+}
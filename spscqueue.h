@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queue between exactly one producer task and one
+// consumer task. Neither side ever blocks, push() fails when the queue
+// is full and pop() when it is empty. Items are copied, so T should be a
+// small trivially copyable struct.
+template <typename T, size_t Capacity>
+class SpscQueue {
+ public:
+  // Keeps the slot index continuous when the counters wrap
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  // Producer side only
+  bool push(const T& item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= Capacity) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    slots_[tail % Capacity] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side only
+  bool pop(T& item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = slots_[head % Capacity];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Either side, the value may be stale by the time it is used
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  uint32_t getDroppedCount() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  T slots_[Capacity] = {};
+  // Free running counters, the unsigned difference stays right across wrap
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+  std::atomic<uint32_t> dropped_{0};
+};
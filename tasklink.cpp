@@ -0,0 +1,100 @@
+#include "tasklink.h"
+
+#include <atomic>
+#include "spscqueue.h"
+
+namespace TaskLink {
+
+namespace {
+
+struct LogLine {
+  char text[kLogLineLength];
+};
+
+SpscQueue<Sample, 4> sampleQueue;
+SpscQueue<LogLine, 16> logQueue;
+SpscQueue<uint16_t, 8> configChangeQueue;
+
+std::atomic<TaskHandle_t> sensingTask{nullptr};
+std::atomic<bool> sensorFault{false};
+
+}
+
+void setSensingTask(TaskHandle_t task) {
+  sensingTask = task;
+}
+
+bool isSensingTask() {
+  TaskHandle_t task = sensingTask;
+  return task != nullptr && xTaskGetCurrentTaskHandle() == task;
+}
+
+bool pushSample(const Sample& sample) {
+  return sampleQueue.push(sample);
+}
+
+bool receiveSample(Sample& sample) {
+  bool received = false;
+  while (sampleQueue.pop(sample)) {
+    received = true;
+  }
+  return received;
+}
+
+bool deferLogLine(const char* text) {
+  if (!isSensingTask()) {
+    return false;
+  }
+
+  LogLine line;
+  strncpy(line.text, text, sizeof(line.text) - 1);
+  line.text[sizeof(line.text) - 1] = '\0';
+  logQueue.push(line);
+  return true;
+}
+
+bool takeLogLine(char* text, size_t size) {
+  LogLine line;
+  if (size == 0 || !logQueue.pop(line)) {
+    return false;
+  }
+  strncpy(text, line.text, size - 1);
+  text[size - 1] = '\0';
+  return true;
+}
+
+uint32_t getDroppedLogLines() {
+  return logQueue.getDroppedCount();
+}
+
+bool pushConfigChange(uint16_t changed) {
+  return configChangeQueue.push(changed);
+}
+
+uint16_t takeConfigChanges() {
+  uint16_t changed = 0;
+  uint16_t next = 0;
+  while (configChangeQueue.pop(next)) {
+    changed |= next;
+  }
+  return changed;
+}
+
+void setSensorFault(bool fault) {
+  sensorFault = fault;
+}
+
+bool hasSensorFault() {
+  return sensorFault;
+}
+
+bool followSensorFault(bool& followed) {
+  bool fault = sensorFault;
+  if (fault == followed) {
+    return false;
+  }
+  followed = fault;
+  return true;
+}
+
+}
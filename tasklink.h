@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+// What the sensing task (the Arduino loop) and the network task hand each
+// other. Readings and log lines go to the network task, config changes
+// come back, each through a single producer queue. Apart from these the
+// tasks share only the sensor fault flag and atomic status flags.
+namespace TaskLink {
+
+constexpr size_t kLogLineLength = 120;
+
+struct Sample {
+  float temperature;
+  float humidity;
+  float pressure;
+  float seaLevelPressure;
+  float lightLux;
+  float lightWm2;
+  int rssi;
+};
+
+// Set before the network task starts, so its first log line already
+// goes out directly. nullptr while one loop runs both sides.
+void setSensingTask(TaskHandle_t task);
+bool isSensingTask();
+
+// Sensing task. Fails when the network task is a few readings behind.
+bool pushSample(const Sample& sample);
+// Network task: the latest reading, the ones queued before it are skipped
+bool receiveSample(Sample& sample);
+
+// Queues the line on the sensing task. Elsewhere returns false and the
+// caller sends the line at once.
+bool deferLogLine(const char* text);
+// Network task
+bool takeLogLine(char* text, size_t size);
+uint32_t getDroppedLogLines();
+
+// Network task, CONFIG_SUBSYSTEM_* flags the sensing task applies
+bool pushConfigChange(uint16_t changed);
+// Sensing task: everything queued since the last call
+uint16_t takeConfigChanges();
+
+// Written by the sensing task, read anywhere
+void setSensorFault(bool fault);
+bool hasSensorFault();
+// Network task: copies the flag into followed, true when that changed it
+bool followSensorFault(bool& followed);
+
+}
@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+
+#include "configstore.h"
+#include "host.h"
+
+namespace {
+
+void prepare() {
+  Host::reset();
+  mountFileSystem();
+  setConfigDefaults(config);
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+    config.gpioTriggers[i].rule = "temp > 30 and humidity > 70 or rain_1h > 2";
+  }
+  saveConfig();
+}
+
+// Boot path with a matching snapshot
+void BM_LoadConfigSnapshot(benchmark::State& state) {
+  prepare();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(loadConfig());
+  }
+}
+BENCHMARK(BM_LoadConfigSnapshot);
+
+// Boot path after config.json changed, the snapshot is not used
+void BM_LoadConfigJson(benchmark::State& state) {
+  prepare();
+  for (auto _ : state) {
+    state.PauseTiming();
+    LittleFS.remove("/config.bin");
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(loadConfig());
+  }
+}
+BENCHMARK(BM_LoadConfigJson);
+
+void BM_SaveConfig(benchmark::State& state) {
+  prepare();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(saveConfig());
+  }
+}
+BENCHMARK(BM_SaveConfig);
+
+// Parse and fill only, without the file system
+void BM_ReadConfigJson(benchmark::State& state) {
+  prepare();
+  DynamicJsonDocument doc(getConfigJsonCapacity());
+  writeConfigJson(config, doc);
+  Config target;
+  for (auto _ : state) {
+    readConfigJson(doc, target);
+    benchmark::DoNotOptimize(target);
+  }
+}
+BENCHMARK(BM_ReadConfigJson);
+
+}  // namespace
@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+
+#include <string.h>
+
+#include "mqttcommand.h"
+
+namespace {
+
+void parse(benchmark::State& state, const char* payload) {
+  size_t length = strlen(payload);
+  MqttCommand::Request request;
+  for (auto _ : state) {
+    bool parsed = MqttCommand::parsePayload(payload, length, request);
+    benchmark::DoNotOptimize(parsed);
+    benchmark::DoNotOptimize(request.name.length);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(length));
+}
+
+void BM_ParseName(benchmark::State& state) {
+  parse(state, "reboot");
+}
+BENCHMARK(BM_ParseName);
+
+void BM_ParseIdAndKeyValue(benchmark::State& state) {
+  parse(state, "@req-42 set(mqttPort=8883)");
+}
+BENCHMARK(BM_ParseIdAndKeyValue);
+
+void BM_ParseTopic(benchmark::State& state) {
+  const char* payload = "http://192.168.1.10/firmware.bin";
+  size_t length = strlen(payload);
+  MqttCommand::Request request;
+  for (auto _ : state) {
+    bool parsed = MqttCommand::parseTopic("wx/station/cmd/update", "wx/station/cmd", payload, length, request);
+    benchmark::DoNotOptimize(parsed);
+  }
+}
+BENCHMARK(BM_ParseTopic);
+
+void ignoreCommand(const MqttCommand::Request&) {
+}
+
+// The station's table, set() sits near its end
+void BM_ParseAndDispatch(benchmark::State& state) {
+  const MqttCommand::Entry entries[] = {
+    {"reboot", MqttCommand::ArgType::None, ignoreCommand},
+    {"start-ap", MqttCommand::ArgType::None, ignoreCommand},
+    {"info", MqttCommand::ArgType::None, ignoreCommand},
+    {"perf", MqttCommand::ArgType::None, ignoreCommand},
+    {"heap", MqttCommand::ArgType::None, ignoreCommand},
+    {"get", MqttCommand::ArgType::Text, ignoreCommand},
+    {"set", MqttCommand::ArgType::KeyValue, ignoreCommand},
+    {"update", MqttCommand::ArgType::Text, ignoreCommand},
+  };
+  const char* payload = "@req-42 set(mqttPort=8883)";
+  size_t length = strlen(payload);
+  MqttCommand::Request request;
+  for (auto _ : state) {
+    MqttCommand::parsePayload(payload, length, request);
+    MqttCommand::Result result = MqttCommand::dispatch(entries, 8, request);
+    benchmark::DoNotOptimize(result);
+  }
+}
+BENCHMARK(BM_ParseAndDispatch);
+
+}  // namespace
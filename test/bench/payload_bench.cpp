@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include "payload.h"
+
+namespace {
+
+Payload::Sample makeSample() {
+  Payload::Sample sample;
+  sample.temperature = 21.374f;
+  sample.humidity = 64.2f;
+  sample.seaLevelPressure = 1013.256f;
+  sample.lightWm2 = 120.5f;
+  sample.rain1h = 0.4f;
+  sample.rain24h = 2.2f;
+  sample.rssi = -67;
+  sample.timestamp = 1750000000;
+  return sample;
+}
+
+// Arg 0 is a BME280 only station, 1 one with the light sensor and the
+// rain gauge as well
+Config makeSettings(const benchmark::State& state) {
+  Config settings;
+  setConfigDefaults(settings);
+  settings.activeLight = state.range(0) != 0;
+  settings.activeRain = state.range(0) != 0;
+  return settings;
+}
+
+// Bytes per sample, the figure that matters for the broker fleet, next to
+// the time per build
+void reportSize(benchmark::State& state, size_t length) {
+  state.counters["bytes"] = static_cast<double>(length);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(length));
+}
+
+void BM_BuildJson(benchmark::State& state) {
+  Payload::Sample sample = makeSample();
+  Config settings = makeSettings(state);
+  uint8_t buffer[Payload::kMaxLength];
+  size_t length = 0;
+  for (auto _ : state) {
+    length = Payload::buildJson(sample, settings, buffer, sizeof(buffer));
+    benchmark::DoNotOptimize(buffer);
+  }
+  reportSize(state, length);
+}
+BENCHMARK(BM_BuildJson)->Arg(0)->Arg(1);
+
+void BM_BuildMsgPack(benchmark::State& state) {
+  Payload::Sample sample = makeSample();
+  Config settings = makeSettings(state);
+  uint8_t buffer[Payload::kMaxLength];
+  size_t length = 0;
+  for (auto _ : state) {
+    length = Payload::buildMsgPack(sample, settings, buffer, sizeof(buffer));
+    benchmark::DoNotOptimize(buffer);
+  }
+  reportSize(state, length);
+}
+BENCHMARK(BM_BuildMsgPack)->Arg(0)->Arg(1);
+
+}  // namespace
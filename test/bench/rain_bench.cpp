@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+
+#include <LittleFS.h>
+
+#include "host.h"
+#include "rain.h"
+
+namespace {
+
+constexpr uint32_t kStartUnix = 1750000000;
+
+void tip() {
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, LOW);
+  Host::advanceMs(50);
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+  Host::advanceMs(300);
+}
+
+// A gauge holding tipCount tips spread over the last day
+void fillGauge(int tipCount) {
+  Host::reset();
+  Host::advanceMs(5000);
+  Host::setUnixTime(kStartUnix);
+  LittleFS.begin();
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+  RainGauge::begin(true, 0.2f);
+  RainGauge::reset();
+  uint32_t stepMs = 23UL * 3600UL * 1000UL / static_cast<uint32_t>(tipCount);
+  for (int i = 0; i < tipCount; i++) {
+    tip();
+    RainGauge::update();
+    Host::advanceMs(stepMs);
+  }
+}
+
+// The sensing task's call per reading, with nothing to prune
+void BM_RainUpdate(benchmark::State& state) {
+  fillGauge(static_cast<int>(state.range(0)));
+  for (auto _ : state) {
+    RainGauge::update();
+    benchmark::DoNotOptimize(RainGauge::getRainLastHourMm());
+  }
+}
+BENCHMARK(BM_RainUpdate)->Arg(16)->Arg(256)->Arg(1024);
+
+// One minute later each time, so the hour window keeps moving
+void BM_RainUpdateSlidingWindow(benchmark::State& state) {
+  fillGauge(static_cast<int>(state.range(0)));
+  for (auto _ : state) {
+    Host::setUnixTime(static_cast<uint32_t>(time(nullptr)) + 60);
+    RainGauge::update();
+    benchmark::DoNotOptimize(RainGauge::getRainLast24HoursMm());
+  }
+}
+BENCHMARK(BM_RainUpdateSlidingWindow)->Arg(256)->Arg(1024);
+
+void BM_RainWindowRead(benchmark::State& state) {
+  fillGauge(256);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(RainGauge::getRainLastHourMm());
+    benchmark::DoNotOptimize(RainGauge::getRainLast24HoursMm());
+  }
+}
+BENCHMARK(BM_RainWindowRead);
+
+}  // namespace
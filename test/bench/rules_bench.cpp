@@ -0,0 +1,46 @@
+#include <benchmark/benchmark.h>
+
+#include "rules.h"
+
+// evaluate() runs per reading for every rule trigger, so the figure that
+// matters is rule evaluations per second
+namespace {
+
+const char* const kRules[] = {
+  "temp > 30",
+  "temp > 30 and humidity > 70 or rain_1h > 2",
+  "not (light < 10 or rssi < -80) and (pressure >= 1000 || rain_24h > 5)",
+  "temp > 1 or temp > 2 or temp > 3 or temp > 4 or temp > 5 or temp > 6 or temp > 7 or temp > 8",
+};
+
+void BM_Evaluate(benchmark::State& state) {
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  if (!RuleEngine::compile(kRules[state.range(0)], program, error)) {
+    state.SkipWithError(error.message);
+    return;
+  }
+  float values[GPIO_TRIGGER_METRIC_COUNT] = {20.0f, 80.0f, 1013.0f, 500.0f, 3.0f, 6.0f, -70.0f};
+  bool valid[GPIO_TRIGGER_METRIC_COUNT] = {true, true, true, true, true, true, true};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(values);
+    bool result = RuleEngine::evaluate(program, values, valid);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.counters["instructions"] = program.length;
+}
+BENCHMARK(BM_Evaluate)->DenseRange(0, 3);
+
+void BM_Compile(benchmark::State& state) {
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  for (auto _ : state) {
+    bool compiled = RuleEngine::compile(kRules[1], program, error);
+    benchmark::DoNotOptimize(compiled);
+    benchmark::DoNotOptimize(program);
+  }
+}
+BENCHMARK(BM_Compile);
+
+}  // namespace
@@ -0,0 +1,85 @@
+#include <benchmark/benchmark.h>
+
+#include "triggers.h"
+
+// Built with -DWX_GPIO_TRIGGER_COUNT=48. The config table stops at 16
+// slots, the engine itself is sized by the same flag, so the larger
+// counts show how the cost per reading grows with the number of triggers.
+namespace {
+
+static_assert(GPIO_TRIGGER_COUNT == 48, "built for 48 slots, see CMakeLists.txt");
+
+GPIOTriggerConfig triggers[GPIO_TRIGGER_COUNT];
+TriggerEngine::Change changes[GPIO_TRIGGER_COUNT];
+
+enum class Kind {
+  Level,
+  Rate,
+  Rule
+};
+
+// Activates the first count slots, all of one kind, spread over the
+// metrics and with thresholds the readings below cross now and then
+void activate(uint8_t count, Kind kind) {
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  RuleEngine::compile("temp > 30 and humidity > 70 or rain_1h > 2", program, error);
+
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+    GPIOTriggerConfig& trigger = triggers[i];
+    trigger = {};
+    trigger.enabled = i < count;
+    trigger.gpioPin = GPIO_TRIGGER_PIN_DISABLED;
+    trigger.value = static_cast<uint8_t>(i % GPIO_TRIGGER_METRIC_COUNT);
+    trigger.condition = kind == Kind::Level ? GPIO_TRIGGER_CONDITION_LEVEL
+      : kind == Kind::Rate ? GPIO_TRIGGER_CONDITION_RATE
+      : GPIO_TRIGGER_CONDITION_RULE;
+    trigger.triggerOnValue = kind == Kind::Rate ? 2.0f : 20.0f + i % 10;
+    trigger.triggerOffValue = kind == Kind::Rate ? 1.0f : 18.0f + i % 10;
+    if (kind == Kind::Rule) {
+      TriggerEngine::setRule(i, program);
+    }
+    TriggerEngine::setActive(i, false);
+    TriggerEngine::setActive(i, i < count);
+  }
+}
+
+// One reading every 30 s, as the sensing task takes them
+void evaluate(benchmark::State& state, Kind kind) {
+  uint8_t count = static_cast<uint8_t>(state.range(0));
+  activate(count, kind);
+  TriggerEngine::Sample sample = {};
+  for (bool& valid : sample.valid) {
+    valid = true;
+  }
+
+  uint32_t reading = 0;
+  for (auto _ : state) {
+    for (uint8_t metric = 0; metric < GPIO_TRIGGER_METRIC_COUNT; metric++) {
+      sample.values[metric] = static_cast<float>((reading + metric * 7) % 40);
+    }
+    sample.atMs = reading * 30000;
+    reading++;
+    uint8_t changed = TriggerEngine::evaluate(triggers, sample, changes);
+    benchmark::DoNotOptimize(changed);
+  }
+  // items_per_second is trigger evaluations per second
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * count);
+}
+
+void BM_EvaluateLevel(benchmark::State& state) {
+  evaluate(state, Kind::Level);
+}
+BENCHMARK(BM_EvaluateLevel)->Arg(3)->Arg(8)->Arg(16)->Arg(32)->Arg(48);
+
+void BM_EvaluateRate(benchmark::State& state) {
+  evaluate(state, Kind::Rate);
+}
+BENCHMARK(BM_EvaluateRate)->Arg(3)->Arg(8)->Arg(16)->Arg(32)->Arg(48);
+
+void BM_EvaluateRule(benchmark::State& state) {
+  evaluate(state, Kind::Rule);
+}
+BENCHMARK(BM_EvaluateRule)->Arg(3)->Arg(8)->Arg(16)->Arg(32)->Arg(48);
+
+}  // namespace
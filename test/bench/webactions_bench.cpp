@@ -0,0 +1,38 @@
+#include <benchmark/benchmark.h>
+
+#include "host.h"
+#include "webactions.h"
+
+namespace {
+
+// A save from the web handler and the network task taking it, with the
+// benchmark threads standing in for browsers hitting the queue at once
+void BM_SaveRoundTrip(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    Host::reset();
+    WebActions::begin();
+  }
+  Config updated = {};
+  Config applied = {};
+  WebActions::Entry entry;
+  for (auto _ : state) {
+    updated.altitude += 1.0f;
+    benchmark::DoNotOptimize(WebActions::pushConfig(updated));
+    if (WebActions::peek(entry, applied)) {
+      WebActions::complete(entry.ticket);
+    }
+  }
+}
+BENCHMARK(BM_SaveRoundTrip)->Threads(1)->Threads(2)->Threads(4)->UseRealTime();
+
+void BM_IsDone(benchmark::State& state) {
+  Host::reset();
+  WebActions::begin();
+  uint32_t ticket = WebActions::push(WebActions::Action::ReloadConfig);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(WebActions::isDone(ticket));
+  }
+}
+BENCHMARK(BM_IsDone);
+
+}  // namespace
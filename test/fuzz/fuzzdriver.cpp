@@ -0,0 +1,78 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+// Stands in for libFuzzer where the compiler has none: feeds the target
+// seeded random inputs, or the files given on the command line to replay
+// a crash. "fuzz_target [runs] [seed]" or "fuzz_target file...".
+// Inputs lean on the characters the station's parsers care about, plain
+// random bytes would rarely get past the first token.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+
+constexpr size_t kMaxInputBytes = 512;
+constexpr char kAlphabet[] = "abcdefghijklmnopqrstuvwxyz_0123456789 ()=@/.-+<>!&|,\"\n";
+
+bool isNumber(const char* text) {
+  if (*text == '\0') {
+    return false;
+  }
+  for (; *text != '\0'; text++) {
+    if (*text < '0' || *text > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+int replayFiles(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::ifstream file(argv[i], std::ios::binary);
+    if (!file) {
+      fprintf(stderr, "cannot read %s\n", argv[i]);
+      return 1;
+    }
+    std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && !isNumber(argv[1])) {
+    return replayFiles(argc, argv);
+  }
+
+  unsigned long runs = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  unsigned long seed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+  std::mt19937 random(static_cast<std::mt19937::result_type>(seed));
+  std::uniform_int_distribution<size_t> lengthOf(0, kMaxInputBytes);
+  std::uniform_int_distribution<size_t> letterOf(0, sizeof(kAlphabet) - 2);
+  std::uniform_int_distribution<int> byteOf(0, 255);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  std::vector<uint8_t> input;
+  for (unsigned long run = 0; run < runs; run++) {
+    // Mostly short inputs, the odd long one
+    size_t length = percent(random) < 90 ? lengthOf(random) % 48 : lengthOf(random);
+    input.resize(length);
+    for (uint8_t& byte : input) {
+      byte = percent(random) < 95 ? static_cast<uint8_t>(kAlphabet[letterOf(random)]) : static_cast<uint8_t>(byteOf(random));
+    }
+    // Exact size, so reading past the end trips the address sanitizer
+    std::vector<uint8_t> exact(input);
+    LLVMFuzzerTestOneInput(exact.data(), exact.size());
+  }
+  printf("%lu runs, seed %lu\n", runs, seed);
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "mqttcommand.h"
+
+// Payloads and topics come straight off the network. Whatever arrives,
+// the parser must stay inside the buffer and hand out spans into it.
+
+namespace {
+
+void ignoreCommand(const MqttCommand::Request&) {
+}
+
+const MqttCommand::Entry kEntries[] = {
+  {"reboot", MqttCommand::ArgType::None, ignoreCommand},
+  {"update", MqttCommand::ArgType::Text, ignoreCommand},
+  {"set", MqttCommand::ArgType::KeyValue, ignoreCommand},
+};
+
+void checkSpan(const MqttCommand::Span& span, const uint8_t* data, size_t size) {
+  if (span.length == 0) {
+    return;
+  }
+  const char* begin = reinterpret_cast<const char*>(data);
+  if (span.data < begin || span.data + span.length > begin + size) {
+    abort();
+  }
+}
+
+void checkRequest(MqttCommand::Request& request, const uint8_t* data, size_t size) {
+  checkSpan(request.id, data, size);
+  checkSpan(request.name, data, size);
+  checkSpan(request.argument, data, size);
+  if (request.id.length > MqttCommand::kMaxIdLength) {
+    abort();
+  }
+
+  MqttCommand::dispatch(kEntries, sizeof(kEntries) / sizeof(kEntries[0]), request);
+  checkSpan(request.key, data, size);
+  checkSpan(request.value, data, size);
+
+  char buffer[8];
+  request.argument.copyTo(buffer, sizeof(buffer));
+  if (strlen(buffer) >= sizeof(buffer)) {
+    abort();
+  }
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  MqttCommand::Request request;
+  if (MqttCommand::parsePayload(reinterpret_cast<const char*>(data), size, request)) {
+    if (request.name.length == 0) {
+      abort();
+    }
+    checkRequest(request, data, size);
+  }
+
+  // The first line as the topic below the command base, the rest as its payload
+  const uint8_t* newline = size > 0 ? static_cast<const uint8_t*>(memchr(data, '\n', size)) : nullptr;
+  if (newline != nullptr) {
+    std::string topic = "wx/cmd/" + std::string(reinterpret_cast<const char*>(data), newline - data);
+    const uint8_t* payload = newline + 1;
+    size_t payloadSize = size - (payload - data);
+    if (MqttCommand::parseTopic(topic.c_str(), "wx/cmd", reinterpret_cast<const char*>(payload), payloadSize, request)) {
+      checkSpan(request.argument, payload, payloadSize);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "rules.h"
+
+// Rule texts come from the settings page and MQTT set(). Whatever the
+// text, compile() must stop inside it, and a program it accepts must
+// run within the evaluation stack and end with one result.
+
+namespace {
+
+void checkProgram(const RuleEngine::Program& program) {
+  if (program.length == 0 || program.length > RuleEngine::kMaxInstructions) {
+    abort();
+  }
+  int depth = 0;
+  for (uint8_t i = 0; i < program.length; i++) {
+    const RuleEngine::Instruction& instruction = program.code[i];
+    switch (instruction.op) {
+      case RuleEngine::Op::And:
+      case RuleEngine::Op::Or:
+        depth--;
+        break;
+      case RuleEngine::Op::Not:
+        break;
+      default:
+        if (instruction.metric >= GPIO_TRIGGER_METRIC_COUNT) {
+          abort();
+        }
+        depth++;
+        break;
+    }
+    if (depth < 1 || depth > RuleEngine::kMaxStackDepth) {
+      abort();
+    }
+  }
+  if (depth != 1) {
+    abort();
+  }
+}
+
+// Random bytes hardly ever make a valid rule, so each input is also read
+// as tokens in comparison order: metric, operator, number, joiner. A byte
+// from 0xc0 up takes any token instead, to break the order.
+const char* const kMetrics[] = {"temp", "humidity", "pressure", "light", "rain_1h", "rain_24h", "rssi", "wind"};
+const char* const kOperators[] = {">", ">=", "<", "<=", "==", "!=", "="};
+const char* const kNumbers[] = {"30", "-4.5", "0", ".5", "1e3", "nan"};
+const char* const kJoiners[] = {"and", "or", "and (", ") or", "or not", "&&", "|| !(", ")"};
+
+struct TokenSet {
+  const char* const* tokens;
+  size_t count;
+};
+
+const TokenSet kTokenSets[] = {
+  {kMetrics, sizeof(kMetrics) / sizeof(kMetrics[0])},
+  {kOperators, sizeof(kOperators) / sizeof(kOperators[0])},
+  {kNumbers, sizeof(kNumbers) / sizeof(kNumbers[0])},
+  {kJoiners, sizeof(kJoiners) / sizeof(kJoiners[0])},
+};
+
+std::string tokensOf(const uint8_t* data, size_t size) {
+  std::string text;
+  for (size_t i = 0; i < size; i++) {
+    const TokenSet& set = kTokenSets[data[i] >= 0xc0 ? data[i] % 4 : i % 4];
+    text += set.tokens[data[i] % set.count];
+    text += ' ';
+  }
+  return text;
+}
+
+void compileAndRun(const std::string& text) {
+  RuleEngine::Program program;
+  RuleEngine::Error error = {0, nullptr};
+  if (!RuleEngine::compile(text.c_str(), program, error)) {
+    if (error.message == nullptr || error.position > strlen(text.c_str())) {
+      abort();
+    }
+    return;
+  }
+  checkProgram(program);
+
+  // Against readings with and without values
+  float values[GPIO_TRIGGER_METRIC_COUNT];
+  bool valid[GPIO_TRIGGER_METRIC_COUNT];
+  for (int metric = 0; metric < GPIO_TRIGGER_METRIC_COUNT; metric++) {
+    values[metric] = metric * 10.0f - 20.0f;
+    valid[metric] = true;
+  }
+  RuleEngine::evaluate(program, values, valid);
+  for (int metric = 0; metric < GPIO_TRIGGER_METRIC_COUNT; metric++) {
+    values[metric] = NAN;
+    valid[metric] = metric % 2 == 0;
+  }
+  RuleEngine::evaluate(program, values, valid);
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  // The compiler reads up to the terminator, as in the config field
+  compileAndRun(std::string(reinterpret_cast<const char*>(data), size));
+  compileAndRun(tokensOf(data, size));
+  return 0;
+}
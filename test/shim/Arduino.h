@@ -0,0 +1,275 @@
+#pragma once
+
+// Host stand-in for the Arduino-ESP32 core, just enough of it for the
+// station modules. Time is a fake clock that only moves when a test or
+// delay() moves it, see host.h.
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define F(text) (text)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+// Hold off the simulated pin interrupts, see Host::Gpio::setInput()
+void noInterrupts();
+void interrupts();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+using std::max;
+using std::min;
+
+template <typename T, typename L, typename H>
+T constrain(T value, L low, H high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+class String {
+ public:
+  String(const char* value = "") : text_(value != nullptr ? value : "") {}
+  String(const std::string& value) : text_(value) {}
+  String(const String&) = default;
+  String(String&&) = default;
+  explicit String(char value) : text_(1, value) {}
+  explicit String(unsigned char value, unsigned char base = 10) : text_(formatUnsigned(value, base)) {}
+  explicit String(int value, unsigned char base = 10) : text_(formatSigned(value, base)) {}
+  explicit String(unsigned int value, unsigned char base = 10) : text_(formatUnsigned(value, base)) {}
+  explicit String(long value, unsigned char base = 10) : text_(formatSigned(value, base)) {}
+  explicit String(unsigned long value, unsigned char base = 10) : text_(formatUnsigned(value, base)) {}
+  explicit String(long long value, unsigned char base = 10) : text_(formatSigned(value, base)) {}
+  explicit String(unsigned long long value, unsigned char base = 10) : text_(formatUnsigned(value, base)) {}
+  explicit String(float value, unsigned int decimals = 2) : text_(formatFloat(value, decimals)) {}
+  explicit String(double value, unsigned int decimals = 2) : text_(formatFloat(value, decimals)) {}
+
+  String& operator=(const String&) = default;
+  String& operator=(String&&) = default;
+  String& operator=(const char* value) {
+    text_ = value != nullptr ? value : "";
+    return *this;
+  }
+
+  bool reserve(unsigned int size) {
+    text_.reserve(size);
+    return true;
+  }
+  unsigned int length() const { return static_cast<unsigned int>(text_.size()); }
+  bool isEmpty() const { return text_.empty(); }
+  const char* c_str() const { return text_.c_str(); }
+  char* begin() { return &text_[0]; }
+  char* end() { return &text_[0] + text_.size(); }
+  const std::string& str() const { return text_; }
+
+  bool concat(const String& value) { text_ += value.text_; return true; }
+  bool concat(const char* value) { if (value != nullptr) text_ += value; return true; }
+  bool concat(const char* value, unsigned int length) { text_.append(value, length); return true; }
+  bool concat(char value) { text_ += value; return true; }
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+  bool concat(long long value) { return concat(String(value)); }
+  bool concat(unsigned long long value) { return concat(String(value)); }
+  bool concat(float value) { return concat(String(value)); }
+  bool concat(double value) { return concat(String(value)); }
+
+  template <typename T>
+  String& operator+=(const T& value) {
+    concat(value);
+    return *this;
+  }
+
+  bool operator==(const String& other) const { return text_ == other.text_; }
+  bool operator==(const char* other) const { return text_ == (other != nullptr ? other : ""); }
+  bool operator!=(const String& other) const { return !(*this == other); }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  bool operator<(const String& other) const { return text_ < other.text_; }
+  bool equals(const String& other) const { return *this == other; }
+  bool equals(const char* other) const { return *this == other; }
+  bool equalsIgnoreCase(const String& other) const;
+  bool startsWith(const String& prefix) const { return text_.compare(0, prefix.text_.size(), prefix.text_) == 0; }
+  bool endsWith(const String& suffix) const;
+
+  char charAt(unsigned int index) const { return (*this)[index]; }
+  char operator[](unsigned int index) const { return index < text_.size() ? text_[index] : '\0'; }
+  char& operator[](unsigned int index) { return text_[index]; }
+
+  int indexOf(char value, unsigned int from = 0) const { return toIndex(text_.find(value, from)); }
+  int indexOf(const String& value, unsigned int from = 0) const { return toIndex(text_.find(value.text_, from)); }
+  int lastIndexOf(char value) const { return toIndex(text_.rfind(value)); }
+  int lastIndexOf(const String& value) const { return toIndex(text_.rfind(value.text_)); }
+  String substring(unsigned int from) const { return from < text_.size() ? String(text_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(char from, char to) { std::replace(text_.begin(), text_.end(), from, to); }
+  void replace(const String& from, const String& to);
+  void remove(unsigned int index) { if (index < text_.size()) text_.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < text_.size()) text_.erase(index, count); }
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const { return strtol(text_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(text_.c_str(), nullptr); }
+  double toDouble() const { return strtod(text_.c_str(), nullptr); }
+
+ private:
+  static std::string formatSigned(long long value, unsigned char base);
+  static std::string formatUnsigned(unsigned long long value, unsigned char base);
+  static std::string formatFloat(double value, unsigned int decimals);
+  static int toIndex(size_t position) { return position == std::string::npos ? -1 : static_cast<int>(position); }
+
+  std::string text_;
+};
+
+// Arduino builds these through StringSumHelper, the result is the same
+template <typename T>
+String operator+(const String& left, const T& right) {
+  String result(left);
+  result.concat(right);
+  return result;
+}
+
+inline String operator+(const char* left, const String& right) {
+  String result(left);
+  result.concat(right);
+  return result;
+}
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size && write(buffer[written]) == 1) {
+      written++;
+    }
+    return written;
+  }
+  size_t write(const char* text) { return text != nullptr ? write(reinterpret_cast<const uint8_t*>(text), strlen(text)) : 0; }
+  size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+
+  size_t print(const char* text) { return write(text); }
+  size_t print(const String& text) { return write(text.c_str(), text.length()); }
+  size_t print(char value) { return write(static_cast<uint8_t>(value)); }
+  size_t print(int value, int base = 10) { return print(String(value, static_cast<unsigned char>(base))); }
+  size_t print(unsigned int value, int base = 10) { return print(String(value, static_cast<unsigned char>(base))); }
+  size_t print(long value, int base = 10) { return print(String(value, static_cast<unsigned char>(base))); }
+  size_t print(unsigned long value, int base = 10) { return print(String(value, static_cast<unsigned char>(base))); }
+  size_t print(long long value, int base = 10) { return print(String(value, static_cast<unsigned char>(base))); }
+  size_t print(unsigned long long value, int base = 10) { return print(String(value, static_cast<unsigned char>(base))); }
+  size_t print(double value, int decimals = 2) { return print(String(value, static_cast<unsigned int>(decimals))); }
+
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char* buffer, size_t size);
+  size_t readBytes(uint8_t* buffer, size_t size) { return readBytes(reinterpret_cast<char*>(buffer), size); }
+  String readString();
+  void setTimeout(unsigned long) {}
+};
+
+// Collects what the modules print, tests can look at or clear it
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t value) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  const String& getOutput() const { return output_; }
+  void clearOutput() { output_ = String(); }
+
+ private:
+  String output_;
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress {
+ public:
+  IPAddress() = default;
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes_{a, b, c, d} {}
+  // Network byte order in memory, like lwIP
+  IPAddress(uint32_t address) { memcpy(bytes_, &address, sizeof(bytes_)); }
+
+  operator uint32_t() const {
+    uint32_t address;
+    memcpy(&address, bytes_, sizeof(address));
+    return address;
+  }
+  uint8_t operator[](int index) const { return bytes_[index]; }
+  uint8_t& operator[](int index) { return bytes_[index]; }
+  bool operator==(const IPAddress& other) const { return memcmp(bytes_, other.bytes_, sizeof(bytes_)) == 0; }
+  bool operator!=(const IPAddress& other) const { return !(*this == other); }
+
+  bool fromString(const char* text);
+  bool fromString(const String& text) { return fromString(text.c_str()); }
+  String toString() const;
+
+ private:
+  uint8_t bytes_[4] = {0, 0, 0, 0};
+};
+
+class EspClass {
+ public:
+  // Records the request, see Host::getRestartCount()
+  void restart();
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 150000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+  uint32_t getHeapSize() { return 320000; }
+};
+
+extern EspClass ESP;
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+
+namespace fs {
+
+struct FileImpl;
+
+// A file under the host directory that stands in for the flash, see
+// Host::Fs. Copies share the open file, like on the device.
+class File : public Stream {
+ public:
+  File() = default;
+  explicit File(std::shared_ptr<FileImpl> impl) : impl_(std::move(impl)) {}
+
+  explicit operator bool() const;
+
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+
+  bool seek(uint32_t position);
+  size_t position() const;
+  size_t size() const;
+  void flush();
+  void close();
+  const char* name() const;
+  bool isDirectory() const { return false; }
+
+ private:
+  std::shared_ptr<FileImpl> impl_;
+};
+
+class FS {
+ public:
+  virtual ~FS() = default;
+
+  // Modes "r", "w", "a" and "r+", as LittleFS on the ESP32 takes them
+  File open(const char* path, const char* mode = "r", bool create = false);
+  File open(const String& path, const char* mode = "r", bool create = false) { return open(path.c_str(), mode, create); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char* path);
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+// Answers with whatever Host::Http was told to, and counts the requests
+class HTTPClient {
+ public:
+  bool begin(const String& url);
+  bool begin(WiFiClient& client, const String& url);
+  void end();
+  int GET();
+  int POST(const String& body);
+  int POST(uint8_t* body, size_t size);
+  String getString();
+  int getSize();
+  void setTimeout(uint16_t) {}
+  void setConnectTimeout(int32_t) {}
+  void setReuse(bool) {}
+  void addHeader(const String&, const String&) {}
+  static String errorToString(int code);
+
+ private:
+  int request(const char* method, const std::string& body);
+
+  String url_;
+  bool begun_ = false;
+  String body_;
+};
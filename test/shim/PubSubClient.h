@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <WiFiClient.h>
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_BAD_PROTOCOL 1
+#define MQTT_CONNECT_BAD_CLIENT_ID 2
+#define MQTT_CONNECT_UNAVAILABLE 3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED 5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+// Same interface as knolleary's client, connected to the in-process
+// broker of Host::Broker instead of a socket
+class PubSubClient : public Print {
+ public:
+  PubSubClient() = default;
+  explicit PubSubClient(Client& client) : client_(&client) {}
+
+  PubSubClient& setServer(const char*, uint16_t) { return *this; }
+  PubSubClient& setServer(IPAddress, uint16_t) { return *this; }
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient& setClient(Client& client) { client_ = &client; return *this; }
+  PubSubClient& setKeepAlive(uint16_t) { return *this; }
+  PubSubClient& setSocketTimeout(uint16_t) { return *this; }
+  bool setBufferSize(uint16_t size) { bufferSize_ = size; return true; }
+  uint16_t getBufferSize() { return bufferSize_; }
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage);
+  void disconnect();
+  bool connected();
+  bool loop();
+  int state() { return state_; }
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  bool beginPublish(const char* topic, unsigned int length, bool retained);
+  int endPublish();
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  bool subscribe(const char*) { return connected(); }
+  bool subscribe(const char*, uint8_t) { return connected(); }
+  bool unsubscribe(const char*) { return connected(); }
+
+  // Delivers a message as if the broker had sent it
+  void deliver(const char* topic, const uint8_t* payload, unsigned int length);
+
+ private:
+  Client* client_ = nullptr;
+  std::function<void(char*, uint8_t*, unsigned int)> callback_;
+  uint16_t bufferSize_ = 256;
+  uint32_t session_ = 0;
+  int state_ = MQTT_DISCONNECTED;
+  bool streaming_ = false;
+  String streamTopic_;
+  std::string streamPayload_;
+  bool streamRetained_ = false;
+};
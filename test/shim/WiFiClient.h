@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+class Client : public Stream {
+ public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual operator bool() = 0;
+  virtual void flush() {}
+};
+
+// Connects when the fake broker is up and takes connections, see
+// Host::Broker. Carries no bytes, PubSubClient talks to the broker
+// directly.
+class WiFiClient : public Client {
+ public:
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+  int connect(const char* host, uint16_t port, int32_t timeoutMs);
+  uint8_t connected() override { return open_ ? 1 : 0; }
+  void stop() override { open_ = false; }
+  operator bool() override { return open_; }
+
+  size_t write(uint8_t) override { return open_ ? 1 : 0; }
+  size_t write(const uint8_t*, size_t size) override { return open_ ? size : 0; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  int setTimeout(uint32_t) { return 0; }
+  int setNoDelay(bool) { return 0; }
+
+ private:
+  bool open_ = false;
+};
@@ -0,0 +1,232 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+
+#include "host.h"
+#include "hostinternal.h"
+
+struct HostTimer {
+  esp_timer_cb_t callback;
+  void* arg;
+  std::string name;
+  bool armed;
+  uint64_t dueUs;
+  uint64_t periodUs;
+};
+
+namespace {
+
+std::atomic<uint64_t> uptimeUs{0};
+// Wall clock minus uptime, unset until something sets the time
+std::atomic<int64_t> wallOffsetUs{0};
+
+// The list owns the timers, handles stay valid for the whole run
+std::mutex timerMutex;
+std::list<HostTimer> timers;
+
+HostTimer* nextDueTimer(uint64_t untilUs) {
+  HostTimer* next = nullptr;
+  for (HostTimer& timer : timers) {
+    if (timer.armed && timer.dueUs <= untilUs && (next == nullptr || timer.dueUs < next->dueUs)) {
+      next = &timer;
+    }
+  }
+  return next;
+}
+
+}  // namespace
+
+extern "C" int64_t hostGetWallUs(void) {
+  return static_cast<int64_t>(uptimeUs.load()) + wallOffsetUs.load();
+}
+
+extern "C" void hostSetWallUs(int64_t wallUs) {
+  wallOffsetUs.store(wallUs - static_cast<int64_t>(uptimeUs.load()));
+}
+
+unsigned long millis() {
+  return static_cast<unsigned long>(static_cast<uint32_t>(uptimeUs.load() / 1000ULL));
+}
+
+unsigned long micros() {
+  return static_cast<unsigned long>(static_cast<uint32_t>(uptimeUs.load()));
+}
+
+void delay(uint32_t ms) {
+  Host::advanceMs(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+  Host::advanceUs(us);
+}
+
+void yield() {
+}
+
+void vTaskDelay(TickType_t ticks) {
+  Host::advanceMs(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+  return static_cast<TickType_t>(millis());
+}
+
+int64_t esp_timer_get_time() {
+  return static_cast<int64_t>(uptimeUs.load());
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+  if (args == nullptr || handle == nullptr || args->callback == nullptr) {
+    return ESP_FAIL;
+  }
+
+  std::lock_guard<std::mutex> lock(timerMutex);
+  timers.push_back({args->callback, args->arg, args->name != nullptr ? args->name : "", false, 0, 0});
+  *handle = &timers.back();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timer == nullptr || timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  timer->dueUs = uptimeUs.load() + timeoutUs;
+  timer->periodUs = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timer == nullptr || timer->armed || periodUs == 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  timer->dueUs = uptimeUs.load() + periodUs;
+  timer->periodUs = periodUs;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timer == nullptr || !timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timer == nullptr || timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  // Kept in the list so a stale handle in a test stays harmless
+  timer->callback = nullptr;
+  return ESP_OK;
+}
+
+namespace Host {
+
+void advanceMs(uint32_t ms) {
+  advanceUs(static_cast<uint64_t>(ms) * 1000ULL);
+}
+
+// Callbacks run without the timer lock, they usually re-arm their timer
+void advanceUs(uint64_t us) {
+  uint64_t untilUs = uptimeUs.load() + us;
+  while (true) {
+    esp_timer_cb_t callback = nullptr;
+    void* arg = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(timerMutex);
+      HostTimer* timer = nextDueTimer(untilUs);
+      if (timer == nullptr) {
+        break;
+      }
+      if (timer->dueUs > uptimeUs.load()) {
+        uptimeUs.store(timer->dueUs);
+      }
+      if (timer->periodUs > 0) {
+        timer->dueUs += timer->periodUs;
+      } else {
+        timer->armed = false;
+      }
+      callback = timer->callback;
+      arg = timer->arg;
+    }
+    if (callback != nullptr) {
+      callback(arg);
+    }
+  }
+  uptimeUs.store(untilUs);
+}
+
+uint64_t getUptimeUs() {
+  return uptimeUs.load();
+}
+
+void setUnixTime(uint32_t sec) {
+  hostSetWallUs(static_cast<int64_t>(sec) * 1000000LL);
+}
+
+namespace Timers {
+
+esp_timer_handle_t find(const char* name) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  for (auto it = timers.rbegin(); it != timers.rend(); ++it) {
+    if (it->callback != nullptr && it->name == name) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+bool isArmed(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  return timer != nullptr && timer->armed;
+}
+
+uint64_t getDueUs(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  return timer != nullptr && timer->armed ? timer->dueUs : 0;
+}
+
+void fire(esp_timer_handle_t timer) {
+  esp_timer_cb_t callback = nullptr;
+  void* arg = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if (timer == nullptr) {
+      return;
+    }
+    callback = timer->callback;
+    arg = timer->arg;
+  }
+  if (callback != nullptr) {
+    callback(arg);
+  }
+}
+
+}  // namespace Timers
+
+namespace Internal {
+
+void resetClock() {
+  // Disarmed rather than freed, modules may still hold their handles
+  std::lock_guard<std::mutex> lock(timerMutex);
+  for (HostTimer& timer : timers) {
+    timer.armed = false;
+  }
+  uptimeUs.store(0);
+  wallOffsetUs.store(0);
+}
+
+}  // namespace Internal
+
+}  // namespace Host
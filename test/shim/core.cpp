@@ -0,0 +1,515 @@
+#include <Arduino.h>
+#include <esp_system.h>
+#include <rom/crc.h>
+
+#include <stdarg.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "host.h"
+#include "hostinternal.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+
+struct PinState {
+  uint8_t mode;
+  int level;
+  uint32_t writeCount;
+  void (*handler)();
+  int interruptMode;
+};
+
+std::recursive_mutex pinMutex;
+std::map<uint8_t, PinState> pins;
+// Held by noInterrupts(), a simulated edge waits for interrupts()
+std::recursive_mutex interruptMutex;
+
+std::mutex randomMutex;
+std::mt19937 randomEngine(1);
+
+uint32_t restartCount = 0;
+esp_reset_reason_t resetReason = ESP_RST_POWERON;
+
+}  // namespace
+
+// ===== String =====
+
+bool String::equalsIgnoreCase(const String& other) const {
+  if (text_.size() != other.text_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < text_.size(); i++) {
+    if (tolower(static_cast<unsigned char>(text_[i])) != tolower(static_cast<unsigned char>(other.text_[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return text_.size() >= suffix.text_.size()
+    && text_.compare(text_.size() - suffix.text_.size(), suffix.text_.size(), suffix.text_) == 0;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    std::swap(from, to);
+  }
+  if (from >= text_.size()) {
+    return String();
+  }
+  return String(text_.substr(from, std::min<size_t>(to, text_.size()) - from));
+}
+
+void String::replace(const String& from, const String& to) {
+  if (from.text_.empty()) {
+    return;
+  }
+  size_t position = 0;
+  while ((position = text_.find(from.text_, position)) != std::string::npos) {
+    text_.replace(position, from.text_.size(), to.text_);
+    position += to.text_.size();
+  }
+}
+
+void String::toLowerCase() {
+  for (char& c : text_) {
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  }
+}
+
+void String::toUpperCase() {
+  for (char& c : text_) {
+    c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+  }
+}
+
+void String::trim() {
+  size_t first = 0;
+  while (first < text_.size() && isspace(static_cast<unsigned char>(text_[first]))) {
+    first++;
+  }
+  size_t last = text_.size();
+  while (last > first && isspace(static_cast<unsigned char>(text_[last - 1]))) {
+    last--;
+  }
+  text_ = text_.substr(first, last - first);
+}
+
+std::string String::formatSigned(long long value, unsigned char base) {
+  if (value < 0 && base == 10) {
+    return "-" + formatUnsigned(static_cast<unsigned long long>(-(value + 1)) + 1, base);
+  }
+  return formatUnsigned(static_cast<unsigned long long>(value), base);
+}
+
+std::string String::formatUnsigned(unsigned long long value, unsigned char base) {
+  if (base < 2 || base > 36) {
+    base = 10;
+  }
+  std::string digits;
+  do {
+    unsigned digit = static_cast<unsigned>(value % base);
+    digits.insert(digits.begin(), static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10));
+    value /= base;
+  } while (value != 0);
+  return digits;
+}
+
+// dtostrf() as the core uses it, including "nan" and "inf"
+std::string String::formatFloat(double value, unsigned int decimals) {
+  if (isnan(value)) {
+    return "nan";
+  }
+  if (isinf(value)) {
+    return value > 0 ? "inf" : "-inf";
+  }
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", static_cast<int>(decimals), value);
+  return buffer;
+}
+
+// ===== Print, Stream, Serial =====
+
+size_t Print::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  if (static_cast<size_t>(length) < sizeof(buffer)) {
+    return write(buffer, static_cast<size_t>(length));
+  }
+
+  std::string text(static_cast<size_t>(length) + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&text[0], text.size(), format, args);
+  va_end(args);
+  return write(text.c_str(), static_cast<size_t>(length));
+}
+
+size_t Stream::readBytes(char* buffer, size_t size) {
+  size_t count = 0;
+  while (count < size) {
+    int value = read();
+    if (value < 0) {
+      break;
+    }
+    buffer[count++] = static_cast<char>(value);
+  }
+  return count;
+}
+
+String Stream::readString() {
+  String text;
+  int value;
+  while ((value = read()) >= 0) {
+    text += static_cast<char>(value);
+  }
+  return text;
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  output_ += static_cast<char>(value);
+  return 1;
+}
+
+// ===== IPAddress =====
+
+bool IPAddress::fromString(const char* text) {
+  if (text == nullptr) {
+    return false;
+  }
+
+  uint8_t parsed[4] = {};
+  uint8_t part = 0;
+  unsigned value = 0;
+  bool digits = false;
+  for (const char* c = text; ; c++) {
+    if (*c >= '0' && *c <= '9') {
+      value = value * 10 + static_cast<unsigned>(*c - '0');
+      digits = true;
+      if (value > 255) {
+        return false;
+      }
+    } else if (*c == '.' || *c == '\0') {
+      if (!digits || part > 3) {
+        return false;
+      }
+      parsed[part++] = static_cast<uint8_t>(value);
+      value = 0;
+      digits = false;
+      if (*c == '\0') {
+        break;
+      }
+    } else {
+      return false;
+    }
+  }
+  if (part != 4) {
+    return false;
+  }
+
+  memcpy(bytes_, parsed, sizeof(bytes_));
+  return true;
+}
+
+String IPAddress::toString() const {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes_[0], bytes_[1], bytes_[2], bytes_[3]);
+  return String(buffer);
+}
+
+// ===== ESP =====
+
+void EspClass::restart() {
+  restartCount++;
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+  return resetReason;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t* buffer, uint32_t length) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < length; i++) {
+    crc ^= buffer[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1UL)));
+    }
+  }
+  return ~crc;
+}
+
+// ===== random =====
+
+long random(long max) {
+  if (max <= 0) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(randomMutex);
+  return static_cast<long>(randomEngine() % static_cast<unsigned long>(max));
+}
+
+long random(long min, long max) {
+  return min >= max ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+  std::lock_guard<std::mutex> lock(randomMutex);
+  randomEngine.seed(static_cast<std::mt19937::result_type>(seed));
+}
+
+// ===== GPIO =====
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  PinState& state = pins[pin];
+  state.mode = mode;
+  if (mode == INPUT_PULLUP) {
+    state.level = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  PinState& state = pins[pin];
+  state.level = value != LOW ? HIGH : LOW;
+  state.writeCount++;
+}
+
+int digitalRead(uint8_t pin) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  auto it = pins.find(pin);
+  return it != pins.end() ? it->second.level : LOW;
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  return pin;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  PinState& state = pins[interrupt];
+  state.handler = handler;
+  state.interruptMode = mode;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  pins[interrupt].handler = nullptr;
+}
+
+void noInterrupts() {
+  interruptMutex.lock();
+}
+
+void interrupts() {
+  interruptMutex.unlock();
+}
+
+// ===== FreeRTOS =====
+
+void portENTER_CRITICAL(portMUX_TYPE* mux) {
+  while (mux->locked.exchange(true, std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+  mux->locked.store(false, std::memory_order_release);
+}
+
+struct HostSemaphore {
+  std::mutex mutex;
+  std::condition_variable released;
+  uint32_t count;
+  bool recursive;
+  std::thread::id owner;
+  uint32_t depth;
+};
+
+namespace {
+
+SemaphoreHandle_t createSemaphore(uint32_t count, bool recursive) {
+  HostSemaphore* semaphore = new HostSemaphore();
+  semaphore->count = count;
+  semaphore->recursive = recursive;
+  semaphore->depth = 0;
+  return semaphore;
+}
+
+bool waitFor(std::unique_lock<std::mutex>& lock, HostSemaphore* semaphore, TickType_t ticks, bool (*ready)(HostSemaphore*)) {
+  if (ticks == portMAX_DELAY) {
+    semaphore->released.wait(lock, [semaphore, ready] { return ready(semaphore); });
+    return true;
+  }
+  return semaphore->released.wait_for(lock, std::chrono::milliseconds(ticks), [semaphore, ready] { return ready(semaphore); });
+}
+
+}  // namespace
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return createSemaphore(1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return createSemaphore(1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return createSemaphore(0, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(semaphore->mutex);
+  if (!waitFor(lock, semaphore, ticks, [](HostSemaphore* s) { return s->count > 0; })) {
+    return pdFALSE;
+  }
+  semaphore->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  {
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->count > 0) {
+      return pdFALSE;
+    }
+    semaphore->count++;
+  }
+  semaphore->released.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(semaphore->mutex);
+  std::thread::id self = std::this_thread::get_id();
+  if (semaphore->depth > 0 && semaphore->owner == self) {
+    semaphore->depth++;
+    return pdTRUE;
+  }
+  if (!waitFor(lock, semaphore, ticks, [](HostSemaphore* s) { return s->depth == 0; })) {
+    return pdFALSE;
+  }
+  semaphore->owner = self;
+  semaphore->depth = 1;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+  {
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->depth == 0 || semaphore->owner != std::this_thread::get_id()) {
+      return pdFALSE;
+    }
+    if (--semaphore->depth > 0) {
+      return pdTRUE;
+    }
+  }
+  semaphore->released.notify_one();
+  return pdTRUE;
+}
+
+// ===== Tasks =====
+
+struct HostTask {
+  int unused;
+};
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  thread_local HostTask task;
+  return &task;
+}
+
+// ===== Host =====
+
+namespace Host {
+
+void reset() {
+  Internal::resetClock();
+  Internal::resetCore();
+  Internal::resetFs();
+  Internal::resetNetwork();
+}
+
+uint32_t getRestartCount() {
+  return restartCount;
+}
+
+void setResetReason(esp_reset_reason_t reason) {
+  resetReason = reason;
+}
+
+namespace Gpio {
+
+uint8_t getMode(uint8_t pin) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  auto it = pins.find(pin);
+  return it != pins.end() ? it->second.mode : 0;
+}
+
+int getLevel(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+void setInput(uint8_t pin, int level) {
+  std::lock_guard<std::recursive_mutex> interruptLock(interruptMutex);
+  void (*handler)() = nullptr;
+  {
+    std::lock_guard<std::recursive_mutex> lock(pinMutex);
+    PinState& state = pins[pin];
+    int previous = state.level;
+    state.level = level != LOW ? HIGH : LOW;
+    bool rising = previous == LOW && state.level == HIGH;
+    bool falling = previous == HIGH && state.level == LOW;
+    if (state.handler != nullptr
+        && ((state.interruptMode == CHANGE && (rising || falling))
+            || (state.interruptMode == RISING && rising)
+            || (state.interruptMode == FALLING && falling))) {
+      handler = state.handler;
+    }
+  }
+  if (handler != nullptr) {
+    handler();
+  }
+}
+
+uint32_t getWriteCount(uint8_t pin) {
+  std::lock_guard<std::recursive_mutex> lock(pinMutex);
+  auto it = pins.find(pin);
+  return it != pins.end() ? it->second.writeCount : 0;
+}
+
+}  // namespace Gpio
+
+namespace Internal {
+
+void resetCore() {
+  {
+    std::lock_guard<std::recursive_mutex> lock(pinMutex);
+    pins.clear();
+  }
+  randomSeed(1);
+  restartCount = 0;
+  resetReason = ESP_RST_POWERON;
+  Serial.clearOutput();
+}
+
+}  // namespace Internal
+
+}  // namespace Host
@@ -0,0 +1,9 @@
+#pragma once
+
+// Placement attributes mean nothing on the host. RTC_NOINIT_ATTR data is
+// an ordinary global, a simulated restart keeps it as long as the test
+// does not touch it.
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
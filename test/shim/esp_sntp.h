@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef enum {
+  SNTP_SYNC_STATUS_RESET,
+  SNTP_SYNC_STATUS_COMPLETED,
+  SNTP_SYNC_STATUS_IN_PROGRESS
+} sntp_sync_status_t;
+
+void sntp_set_sync_interval(uint32_t intervalMs);
+void sntp_set_sync_status(sntp_sync_status_t status);
+sntp_sync_status_t sntp_get_sync_status(void);
+
+// Defined by the firmware, ESP-IDF calls it for every answer. Tests call
+// it to play an NTP answer.
+extern "C" void sntp_sync_time(struct timeval* tv);
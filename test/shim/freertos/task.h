@@ -0,0 +1,11 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+
+// Moves the fake clock, like delay()
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+// Every host thread counts as a task of its own
+TaskHandle_t xTaskGetCurrentTaskHandle();
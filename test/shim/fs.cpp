@@ -0,0 +1,290 @@
+#include <LittleFS.h>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+
+#include "host.h"
+#include "hostinternal.h"
+
+LittleFSFS LittleFS;
+
+namespace fs {
+
+struct FileImpl {
+  FILE* handle;
+  std::string path;
+  std::string name;
+  // Lowest offset written while open, SIZE_MAX when nothing was
+  size_t firstWriteOffset;
+  size_t appendedBytes;
+  bool appendOnly;
+
+  // The last copy of a File closes it, like on the device
+  ~FileImpl();
+};
+
+}  // namespace fs
+
+namespace {
+
+std::mutex rootMutex;
+std::string root;
+bool mountFails = false;
+std::atomic<uint64_t> programmedBytes{0};
+
+// One directory per process, removed at exit
+const std::string& getRootDirectory() {
+  std::lock_guard<std::mutex> lock(rootMutex);
+  if (root.empty()) {
+    std::string pattern = (std::filesystem::temp_directory_path() / "wx-station-fs-XXXXXX").string();
+    if (mkdtemp(&pattern[0]) == nullptr) {
+      perror("mkdtemp");
+      abort();
+    }
+    root = pattern;
+    atexit([] {
+      std::error_code error;
+      std::filesystem::remove_all(root, error);
+    });
+  }
+  return root;
+}
+
+std::string hostPath(const char* path) {
+  std::string relative = path != nullptr ? path : "";
+  while (!relative.empty() && relative[0] == '/') {
+    relative.erase(0, 1);
+  }
+  return getRootDirectory() + "/" + relative;
+}
+
+// Copy-on-write cost of the writes through one open file, see host.h
+void accountWrites(fs::FileImpl& file) {
+  if (file.firstWriteOffset == SIZE_MAX) {
+    return;
+  }
+
+  if (file.appendOnly) {
+    programmedBytes += file.appendedBytes;
+    return;
+  }
+
+  fseek(file.handle, 0, SEEK_END);
+  size_t size = static_cast<size_t>(ftell(file.handle));
+  size_t firstBlock = file.firstWriteOffset / Host::Fs::kBlockSize * Host::Fs::kBlockSize;
+  programmedBytes += size > firstBlock ? size - firstBlock : 0;
+}
+
+}  // namespace
+
+namespace fs {
+
+FileImpl::~FileImpl() {
+  if (handle != nullptr) {
+    accountWrites(*this);
+    fclose(handle);
+  }
+}
+
+File::operator bool() const {
+  return impl_ != nullptr && impl_->handle != nullptr;
+}
+
+size_t File::write(uint8_t value) {
+  return write(&value, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!*this || size == 0) {
+    return 0;
+  }
+
+  size_t offset = static_cast<size_t>(ftell(impl_->handle));
+  size_t written = fwrite(buffer, 1, size, impl_->handle);
+  if (written > 0) {
+    if (offset < impl_->firstWriteOffset) {
+      impl_->firstWriteOffset = offset;
+    }
+    impl_->appendedBytes += written;
+  }
+  return written;
+}
+
+int File::available() {
+  if (!*this) {
+    return 0;
+  }
+  long position = ftell(impl_->handle);
+  fseek(impl_->handle, 0, SEEK_END);
+  long end = ftell(impl_->handle);
+  fseek(impl_->handle, position, SEEK_SET);
+  return static_cast<int>(end - position);
+}
+
+int File::read() {
+  uint8_t value;
+  return read(&value, 1) == 1 ? value : -1;
+}
+
+int File::peek() {
+  if (!*this) {
+    return -1;
+  }
+  int value = fgetc(impl_->handle);
+  if (value != EOF) {
+    ungetc(value, impl_->handle);
+  }
+  return value == EOF ? -1 : value;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  return *this ? fread(buffer, 1, size, impl_->handle) : 0;
+}
+
+bool File::seek(uint32_t position) {
+  return *this && fseek(impl_->handle, static_cast<long>(position), SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  return *this ? static_cast<size_t>(ftell(impl_->handle)) : 0;
+}
+
+size_t File::size() const {
+  if (!*this) {
+    return 0;
+  }
+  struct stat info;
+  fflush(impl_->handle);
+  return stat(impl_->path.c_str(), &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+}
+
+void File::flush() {
+  if (*this) {
+    fflush(impl_->handle);
+  }
+}
+
+void File::close() {
+  if (!*this) {
+    return;
+  }
+  accountWrites(*impl_);
+  fclose(impl_->handle);
+  impl_->handle = nullptr;
+}
+
+const char* File::name() const {
+  return impl_ != nullptr ? impl_->name.c_str() : "";
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  std::string file = hostPath(path);
+  std::string fileMode = mode != nullptr ? mode : "r";
+  bool exists = access(file.c_str(), F_OK) == 0;
+  if (fileMode == "r+" && !exists && !create) {
+    return File();
+  }
+  if (fileMode == "r+" && !exists) {
+    fileMode = "w+";
+  }
+
+  FILE* handle = fopen(file.c_str(), (fileMode + "b").c_str());
+  if (handle == nullptr) {
+    return File();
+  }
+
+  auto impl = std::make_shared<FileImpl>();
+  impl->handle = handle;
+  impl->path = file;
+  impl->name = path != nullptr ? path : "";
+  impl->firstWriteOffset = SIZE_MAX;
+  impl->appendedBytes = 0;
+  impl->appendOnly = fileMode[0] == 'a' || fileMode[0] == 'w';
+  return File(impl);
+}
+
+bool FS::exists(const char* path) {
+  return access(hostPath(path).c_str(), F_OK) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  return ::mkdir(hostPath(path).c_str(), 0700) == 0;
+}
+
+}  // namespace fs
+
+bool LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  getRootDirectory();
+  return !mountFails;
+}
+
+void LittleFSFS::end() {
+}
+
+bool LittleFSFS::format() {
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator(getRootDirectory(), error)) {
+    std::filesystem::remove_all(entry.path(), error);
+  }
+  return !error;
+}
+
+size_t LittleFSFS::totalBytes() {
+  return 1441792;
+}
+
+size_t LittleFSFS::usedBytes() {
+  size_t used = 0;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(getRootDirectory(), error)) {
+    if (entry.is_regular_file(error)) {
+      // Whole blocks, like LittleFS
+      used += (entry.file_size(error) + Host::Fs::kBlockSize - 1) / Host::Fs::kBlockSize * Host::Fs::kBlockSize;
+    }
+  }
+  return used;
+}
+
+namespace Host {
+namespace Fs {
+
+std::string getRoot() {
+  return getRootDirectory();
+}
+
+void setMountFails(bool fails) {
+  mountFails = fails;
+}
+
+uint64_t getProgrammedBytes() {
+  return programmedBytes.load();
+}
+
+}  // namespace Fs
+
+namespace Internal {
+
+void resetFs() {
+  LittleFS.format();
+  mountFails = false;
+  programmedBytes.store(0);
+}
+
+}  // namespace Internal
+}  // namespace Host
@@ -0,0 +1,114 @@
+#pragma once
+
+// Test side of the host shims: moves the fake clock, plays pin changes,
+// NTP answers and broker outages, and looks at what the modules did.
+
+#include <Arduino.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <string>
+#include <vector>
+
+namespace Host {
+
+// Back to power on: clock and uptime at 0, wall clock unset, empty file
+// system, no timers, pins low, broker up. RTC_NOINIT data is left alone.
+void reset();
+
+// Moves uptime and the wall clock together and fires every timer that
+// falls due on the way, in order
+void advanceMs(uint32_t ms);
+void advanceUs(uint64_t us);
+uint64_t getUptimeUs();
+
+// Wall clock as settimeofday() would set it
+void setUnixTime(uint32_t sec);
+
+// ESP.restart() calls since reset()
+uint32_t getRestartCount();
+void setResetReason(esp_reset_reason_t reason);
+
+namespace Gpio {
+
+uint8_t getMode(uint8_t pin);
+int getLevel(uint8_t pin);
+// Drives an input and runs an attached interrupt handler that matches the
+// edge, unless noInterrupts() holds it off
+void setInput(uint8_t pin, int level);
+uint32_t getWriteCount(uint8_t pin);
+
+}  // namespace Gpio
+
+namespace Fs {
+
+std::string getRoot();
+void setMountFails(bool fails);
+// Bytes a LittleFS with 4 KB blocks would program for the writes so far.
+// LittleFS keeps file data copy-on-write, so a write at an offset rewrites
+// the file from that block to its end.
+uint64_t getProgrammedBytes();
+constexpr size_t kBlockSize = 4096;
+
+}  // namespace Fs
+
+namespace Timers {
+
+// Newest timer of that name, nullptr when there is none
+esp_timer_handle_t find(const char* name);
+bool isArmed(esp_timer_handle_t timer);
+// Uptime the armed timer falls due at
+uint64_t getDueUs(esp_timer_handle_t timer);
+// Runs the callback now, armed or not, like a dispatch that raced a stop
+void fire(esp_timer_handle_t timer);
+
+}  // namespace Timers
+
+namespace Broker {
+
+struct Message {
+  std::string topic;
+  std::string payload;
+  bool retained;
+};
+
+// A broker that is down refuses connections and drops every client
+void setUp(bool up);
+bool isUp();
+// A broker that is up but refuses CONNECT with the given return code
+void setRefuse(bool refuse, int code = 5);
+// Drops the connected clients, the broker stays up
+void dropClients();
+void setPublishFails(bool fails);
+uint32_t getConnectCount();
+const std::vector<Message>& getMessages();
+void clearMessages();
+
+}  // namespace Broker
+
+namespace Dns {
+
+// Unknown names fail at once. Pending answers wait for complete().
+void setAddress(const char* host, IPAddress address);
+void setPending(bool pending);
+void complete();
+
+}  // namespace Dns
+
+namespace Http {
+
+void setResponse(int code, const char* body);
+uint32_t getRequestCount();
+std::string getLastUrl();
+
+}  // namespace Http
+
+namespace Sntp {
+
+// Plays an NTP answer through the firmware's sntp_sync_time() hook
+void answer(uint32_t sec, uint32_t usec = 0);
+uint32_t getSyncIntervalMs();
+uint32_t getStartCount();
+
+}  // namespace Sntp
+
+}  // namespace Host
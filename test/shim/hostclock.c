@@ -0,0 +1,47 @@
+// The C library's clock calls, pointed at the fake wall clock. Defined in
+// the test binary, they take precedence over the ones in libc. C rather
+// than C++ so the declarations need not match glibc's exception specs.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <time.h>
+
+int64_t hostGetWallUs(void);
+void hostSetWallUs(int64_t wallUs);
+
+time_t time(time_t* out) {
+  time_t now = (time_t)(hostGetWallUs() / 1000000);
+  if (out != NULL) {
+    *out = now;
+  }
+  return now;
+}
+
+int gettimeofday(struct timeval* tv, void* tz) {
+  (void)tz;
+  int64_t wallUs = hostGetWallUs();
+  tv->tv_sec = (time_t)(wallUs / 1000000);
+  tv->tv_usec = (suseconds_t)(wallUs % 1000000);
+  return 0;
+}
+
+int settimeofday(const struct timeval* tv, const struct timezone* tz) {
+  (void)tz;
+  if (tv != NULL) {
+    hostSetWallUs((int64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+  }
+  return 0;
+}
+
+// Applied at once, the slew of the device is not simulated
+int adjtime(const struct timeval* delta, struct timeval* olddelta) {
+  if (delta != NULL) {
+    hostSetWallUs(hostGetWallUs() + (int64_t)delta->tv_sec * 1000000 + delta->tv_usec);
+  }
+  if (olddelta != NULL) {
+    olddelta->tv_sec = 0;
+    olddelta->tv_usec = 0;
+  }
+  return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Shared between the shim sources only, tests use host.h
+
+#include <stdint.h>
+
+extern "C" {
+// Wall clock in microseconds since the epoch, read by hostclock.c
+int64_t hostGetWallUs(void);
+void hostSetWallUs(int64_t wallUs);
+}
+
+namespace Host {
+namespace Internal {
+
+void resetClock();
+void resetCore();
+void resetFs();
+void resetNetwork();
+
+}  // namespace Internal
+}  // namespace Host
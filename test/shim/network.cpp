@@ -0,0 +1,387 @@
+#include <HTTPClient.h>
+#include <PubSubClient.h>
+#include <WiFiClient.h>
+#include <lwip/dns.h>
+
+#include <map>
+#include <mutex>
+
+#include "host.h"
+#include "hostinternal.h"
+
+namespace {
+
+std::recursive_mutex networkMutex;
+
+struct BrokerState {
+  bool up = true;
+  bool refuse = false;
+  int refuseCode = MQTT_CONNECT_UNAUTHORIZED;
+  bool publishFails = false;
+  // Bumped whenever the broker drops its clients
+  uint32_t session = 1;
+  uint32_t connectCount = 0;
+  std::vector<Host::Broker::Message> messages;
+};
+
+BrokerState broker;
+
+struct PendingLookup {
+  std::string host;
+  dns_found_callback found;
+  void* arg;
+};
+
+std::map<std::string, uint32_t> dnsAddresses;
+bool dnsPending = false;
+std::vector<PendingLookup> pendingLookups;
+
+int httpCode = 200;
+std::string httpBody;
+uint32_t httpRequestCount = 0;
+std::string httpLastUrl;
+
+}  // namespace
+
+// ===== WiFiClient =====
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip, port, 3000);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  return connect(host, port, 3000);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+  (void)ip;
+  (void)port;
+  (void)timeoutMs;
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  open_ = broker.up;
+  return open_ ? 1 : 0;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  (void)host;
+  return connect(IPAddress(), port, timeoutMs);
+}
+
+// ===== PubSubClient =====
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  callback_ = callback;
+  return *this;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, 0, false, nullptr);
+}
+
+bool PubSubClient::connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage) {
+  (void)id;
+  (void)willTopic;
+  (void)willQos;
+  (void)willRetain;
+  (void)willMessage;
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  // Like the real client, opens the socket itself
+  if (client_ != nullptr && !client_->connected()) {
+    client_->connect("broker", 1883);
+  }
+  if (!broker.up || (client_ != nullptr && !client_->connected())) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  if (broker.refuse) {
+    state_ = broker.refuseCode;
+    return false;
+  }
+
+  broker.connectCount++;
+  session_ = broker.session;
+  state_ = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  state_ = MQTT_DISCONNECTED;
+  if (client_ != nullptr) {
+    client_->stop();
+  }
+}
+
+bool PubSubClient::connected() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  if (state_ == MQTT_CONNECTED && (!broker.up || session_ != broker.session)) {
+    state_ = MQTT_CONNECTION_LOST;
+    if (client_ != nullptr) {
+      client_->stop();
+    }
+  }
+  return state_ == MQTT_CONNECTED;
+}
+
+bool PubSubClient::loop() {
+  return connected();
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, payload, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, reinterpret_cast<const uint8_t*>(payload), payload != nullptr ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  if (!connected() || broker.publishFails || topic == nullptr) {
+    return false;
+  }
+  broker.messages.push_back({topic, std::string(reinterpret_cast<const char*>(payload), length), retained});
+  return true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  streaming_ = true;
+  streamTopic_ = topic;
+  streamPayload_.clear();
+  streamPayload_.reserve(length);
+  streamRetained_ = retained;
+  return true;
+}
+
+int PubSubClient::endPublish() {
+  if (!streaming_) {
+    return 0;
+  }
+  streaming_ = false;
+  return publish(streamTopic_.c_str(), reinterpret_cast<const uint8_t*>(streamPayload_.data()),
+                 static_cast<unsigned int>(streamPayload_.size()), streamRetained_) ? 1 : 0;
+}
+
+size_t PubSubClient::write(uint8_t value) {
+  return write(&value, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* buffer, size_t size) {
+  if (!streaming_) {
+    return 0;
+  }
+  streamPayload_.append(reinterpret_cast<const char*>(buffer), size);
+  return size;
+}
+
+void PubSubClient::deliver(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (!callback_) {
+    return;
+  }
+  std::string topicCopy = topic;
+  std::vector<uint8_t> payloadCopy(payload, payload + length);
+  callback_(&topicCopy[0], payloadCopy.data(), length);
+}
+
+// ===== lwIP DNS =====
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  if (hostname == nullptr || hostname[0] == '\0') {
+    return ERR_ARG;
+  }
+  if (dnsPending) {
+    pendingLookups.push_back({hostname, found, callback_arg});
+    return ERR_INPROGRESS;
+  }
+
+  auto it = dnsAddresses.find(hostname);
+  if (it == dnsAddresses.end()) {
+    return ERR_ARG;
+  }
+  addr->u_addr.ip4.addr = it->second;
+  addr->type = 0;
+  return ERR_OK;
+}
+
+// ===== HTTPClient =====
+
+bool HTTPClient::begin(const String& url) {
+  url_ = url;
+  begun_ = url.startsWith("http://") || url.startsWith("https://");
+  return begun_;
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+  (void)client;
+  return begin(url);
+}
+
+void HTTPClient::end() {
+  begun_ = false;
+}
+
+int HTTPClient::GET() {
+  return request("GET", std::string());
+}
+
+int HTTPClient::POST(const String& body) {
+  return request("POST", body.str());
+}
+
+int HTTPClient::POST(uint8_t* body, size_t size) {
+  return request("POST", std::string(reinterpret_cast<const char*>(body), size));
+}
+
+String HTTPClient::getString() {
+  return body_;
+}
+
+int HTTPClient::getSize() {
+  return static_cast<int>(body_.length());
+}
+
+String HTTPClient::errorToString(int code) {
+  return String("error ") + code;
+}
+
+int HTTPClient::request(const char* method, const std::string& body) {
+  (void)method;
+  (void)body;
+  if (!begun_) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  httpRequestCount++;
+  httpLastUrl = url_.str();
+  body_ = httpCode > 0 ? String(httpBody) : String();
+  return httpCode;
+}
+
+// ===== Host =====
+
+namespace Host {
+
+namespace Broker {
+
+void setUp(bool up) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  if (broker.up && !up) {
+    broker.session++;
+  }
+  broker.up = up;
+}
+
+bool isUp() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  return broker.up;
+}
+
+void setRefuse(bool refuse, int code) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  broker.refuse = refuse;
+  broker.refuseCode = code;
+}
+
+void dropClients() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  broker.session++;
+}
+
+void setPublishFails(bool fails) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  broker.publishFails = fails;
+}
+
+uint32_t getConnectCount() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  return broker.connectCount;
+}
+
+const std::vector<Message>& getMessages() {
+  return broker.messages;
+}
+
+void clearMessages() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  broker.messages.clear();
+}
+
+}  // namespace Broker
+
+namespace Dns {
+
+void setAddress(const char* host, IPAddress address) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  dnsAddresses[host] = static_cast<uint32_t>(address);
+}
+
+void setPending(bool pending) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  dnsPending = pending;
+}
+
+void complete() {
+  std::vector<PendingLookup> lookups;
+  {
+    std::lock_guard<std::recursive_mutex> lock(networkMutex);
+    lookups.swap(pendingLookups);
+  }
+  for (const PendingLookup& lookup : lookups) {
+    auto it = dnsAddresses.find(lookup.host);
+    if (it == dnsAddresses.end()) {
+      lookup.found(lookup.host.c_str(), nullptr, lookup.arg);
+      continue;
+    }
+    ip_addr_t address = {};
+    address.u_addr.ip4.addr = it->second;
+    lookup.found(lookup.host.c_str(), &address, lookup.arg);
+  }
+}
+
+}  // namespace Dns
+
+namespace Http {
+
+void setResponse(int code, const char* body) {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  httpCode = code;
+  httpBody = body != nullptr ? body : "";
+}
+
+uint32_t getRequestCount() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  return httpRequestCount;
+}
+
+std::string getLastUrl() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  return httpLastUrl;
+}
+
+}  // namespace Http
+
+namespace Internal {
+
+void resetNetwork() {
+  std::lock_guard<std::recursive_mutex> lock(networkMutex);
+  broker = BrokerState();
+  dnsAddresses.clear();
+  dnsPending = false;
+  pendingLookups.clear();
+  httpCode = 200;
+  httpBody.clear();
+  httpRequestCount = 0;
+  httpLastUrl.clear();
+}
+
+}  // namespace Internal
+
+}  // namespace Host
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Same polynomial and conditioning as the ESP32 ROM
+uint32_t crc32_le(uint32_t crc, const uint8_t* buffer, uint32_t length);
@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include <esp_sntp.h>
+
+#include <atomic>
+
+#include "host.h"
+
+// Kept apart from clock.cpp: Host::Sntp::answer() needs the firmware's
+// sntp_sync_time(), so only binaries that link timekeeper.cpp pull this in.
+
+namespace {
+
+std::atomic<uint32_t> syncIntervalMs{3600000};
+std::atomic<sntp_sync_status_t> syncStatus{SNTP_SYNC_STATUS_RESET};
+std::atomic<uint32_t> startCount{0};
+
+}  // namespace
+
+void sntp_set_sync_interval(uint32_t intervalMs) {
+  syncIntervalMs.store(intervalMs);
+}
+
+void sntp_set_sync_status(sntp_sync_status_t status) {
+  syncStatus.store(status);
+}
+
+sntp_sync_status_t sntp_get_sync_status(void) {
+  return syncStatus.load();
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2, const char* server3) {
+  (void)gmtOffsetSec;
+  (void)daylightOffsetSec;
+  (void)server1;
+  (void)server2;
+  (void)server3;
+  startCount++;
+  syncStatus.store(SNTP_SYNC_STATUS_RESET);
+}
+
+namespace Host {
+namespace Sntp {
+
+void answer(uint32_t sec, uint32_t usec) {
+  struct timeval tv = {static_cast<time_t>(sec), static_cast<suseconds_t>(usec)};
+  sntp_sync_time(&tv);
+}
+
+uint32_t getSyncIntervalMs() {
+  return syncIntervalMs.load();
+}
+
+uint32_t getStartCount() {
+  return startCount.load();
+}
+
+}  // namespace Sntp
+}  // namespace Host
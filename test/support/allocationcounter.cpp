@@ -0,0 +1,59 @@
+#include "allocationcounter.h"
+
+#include <stdlib.h>
+#include <new>
+
+namespace {
+
+thread_local bool counting = false;
+thread_local size_t allocations = 0;
+
+void* allocate(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void* block = malloc(size != 0 ? size : 1);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+}  // namespace
+
+AllocationCounter::AllocationCounter() {
+  allocations = 0;
+  counting = true;
+}
+
+AllocationCounter::~AllocationCounter() {
+  counting = false;
+}
+
+size_t AllocationCounter::getCount() const {
+  return allocations;
+}
+
+void* operator new(size_t size) {
+  return allocate(size);
+}
+
+void* operator new[](size_t size) {
+  return allocate(size);
+}
+
+void operator delete(void* block) noexcept {
+  free(block);
+}
+
+void operator delete[](void* block) noexcept {
+  free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+  free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+  free(block);
+}
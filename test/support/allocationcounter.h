@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+
+// Counts operator new on the calling thread between construction and
+// destruction. Linking allocationcounter.cpp replaces the global operator
+// new and delete of the executable. On the host the Arduino String shim
+// sits on std::string, so a String built on a hot path shows up as well.
+class AllocationCounter {
+ public:
+  AllocationCounter();
+  ~AllocationCounter();
+
+  size_t getCount() const;
+};
@@ -0,0 +1,54 @@
+#include "fakemetrics.h"
+
+#include <string.h>
+
+namespace {
+
+FakeMetrics::Counts counts = {};
+uint32_t uploadFailureStreak = 0;
+
+}  // namespace
+
+namespace Metrics {
+
+void recordUpload(Destination destination, bool success, uint32_t latencyMs) {
+  (void)latencyMs;
+  counts.uploads[static_cast<uint8_t>(destination)][success ? 1 : 0]++;
+  uploadFailureStreak = success ? 0 : uploadFailureStreak + 1;
+}
+
+uint32_t getUploadFailureStreak() {
+  return uploadFailureStreak;
+}
+
+void recordMqttConnect(MqttConnectResult result, uint32_t latencyMs) {
+  (void)latencyMs;
+  counts.mqttConnects[static_cast<uint8_t>(result)]++;
+}
+
+void recordWifiConnect(WifiConnectMode mode, bool success, uint32_t associateMs, uint32_t addressMs) {
+  (void)associateMs;
+  (void)addressMs;
+  counts.wifiConnects[static_cast<uint8_t>(mode)][success ? 1 : 0]++;
+}
+
+void recordMqttStream(bool success, uint32_t bytes, uint32_t durationUs) {
+  (void)bytes;
+  (void)durationUs;
+  counts.mqttStreams[success ? 1 : 0]++;
+}
+
+}  // namespace Metrics
+
+namespace FakeMetrics {
+
+const Counts& getCounts() {
+  return counts;
+}
+
+void reset() {
+  memset(&counts, 0, sizeof(counts));
+  uploadFailureStreak = 0;
+}
+
+}  // namespace FakeMetrics
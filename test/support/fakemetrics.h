@@ -0,0 +1,19 @@
+#pragma once
+
+#include "metrics.h"
+
+// Stands in for metrics.cpp, which reads the whole station through
+// extern globals. Counts what the modules under test reported.
+namespace FakeMetrics {
+
+struct Counts {
+  uint32_t uploads[static_cast<uint8_t>(Metrics::Destination::Count)][2];
+  uint32_t mqttConnects[static_cast<uint8_t>(Metrics::MqttConnectResult::Count)];
+  uint32_t wifiConnects[static_cast<uint8_t>(Metrics::WifiConnectMode::Count)][2];
+  uint32_t mqttStreams[2];
+};
+
+const Counts& getCounts();
+void reset();
+
+}  // namespace FakeMetrics
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <LittleFS.h>
+
+#include <string.h>
+
+#include "allocationcounter.h"
+#include "host.h"
+#include "httpupload.h"
+#include "mqttcommand.h"
+#include "rain.h"
+#include "rules.h"
+#include "scheduler.h"
+#include "spscqueue.h"
+#include "triggers.h"
+#include "webactions.h"
+
+namespace {
+
+constexpr int kPasses = 1000;
+
+TEST(AllocationTest, CounterSeesAllocations) {
+  AllocationCounter counter;
+  String text("a value long enough to leave the small string buffer");
+  EXPECT_GT(counter.getCount(), 0u);
+}
+
+// The sensing task evaluates every reading against the active slots
+TEST(AllocationTest, TriggerEvaluationAllocatesNothing) {
+  GPIOTriggerConfig triggers[GPIO_TRIGGER_COUNT] = {};
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+    triggers[i].enabled = true;
+    triggers[i].gpioPin = GPIO_TRIGGER_PIN_DISABLED;
+    triggers[i].value = static_cast<uint8_t>(i % GPIO_TRIGGER_METRIC_COUNT);
+    triggers[i].condition = static_cast<uint8_t>(i % GPIO_TRIGGER_CONDITION_COUNT);
+    triggers[i].triggerOnValue = 20;
+    triggers[i].triggerOffValue = 18;
+  }
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  ASSERT_TRUE(RuleEngine::compile("temp > 20 and (humidity < 40 or rain_1h > 0.5)", program, error));
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+    TriggerEngine::setRule(i, program);
+    TriggerEngine::setActive(i, true);
+  }
+
+  TriggerEngine::Sample sample = {};
+  for (bool& valid : sample.valid) {
+    valid = true;
+  }
+  TriggerEngine::Change changes[GPIO_TRIGGER_COUNT];
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < kPasses; pass++) {
+    for (float& value : sample.values) {
+      value = static_cast<float>(pass % 40);
+    }
+    sample.atMs = static_cast<uint32_t>(pass) * 30000;
+    TriggerEngine::evaluate(triggers, sample, changes);
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+}
+
+void ignoreCommand(const MqttCommand::Request&) {
+}
+
+// Every message on the command topics is parsed and dispatched in place
+TEST(AllocationTest, CommandParsingAllocatesNothing) {
+  const MqttCommand::Entry entries[] = {
+    {"reboot", MqttCommand::ArgType::None, ignoreCommand},
+    {"set", MqttCommand::ArgType::KeyValue, ignoreCommand},
+    {"update", MqttCommand::ArgType::Text, ignoreCommand},
+  };
+  const char* payloads[] = {"@req-1 set(mqttPort=8883)", "reboot", "update(http://example.com/fw.bin)", "nonsense(("};
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < kPasses; pass++) {
+    const char* payload = payloads[pass % 4];
+    MqttCommand::Request request;
+    if (MqttCommand::parsePayload(payload, strlen(payload), request)) {
+      MqttCommand::dispatch(entries, 3, request);
+    }
+    const char* value = "altitude=312";
+    if (MqttCommand::parseTopic("wx/roof/cmd/set", "wx/roof/cmd", value, strlen(value), request)) {
+      MqttCommand::dispatch(entries, 3, request);
+    }
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+}
+
+// The upload job builds one URL per active server
+TEST(AllocationTest, ServerUrlAllocatesNothing) {
+  Config settings;
+  setConfigDefaults(settings);
+  settings.activeLight = true;
+  settings.activeRain = true;
+  Payload::Sample sample = {};
+  char url[HttpUpload::kMaxLength];
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < kPasses; pass++) {
+    sample.temperature = static_cast<float>(pass % 40);
+    sample.rssi = -(pass % 90);
+    HttpUpload::buildUrl("http://example.com/wx.php", pass % 2 == 0 ? "roof" : "", sample, settings, url, sizeof(url));
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+}
+
+uint32_t fakeNowMs = 0;
+uint32_t jobRuns = 0;
+
+uint32_t nowMs() {
+  return fakeNowMs;
+}
+
+uint32_t noWallClock() {
+  return 0;
+}
+
+void countRun() {
+  jobRuns++;
+}
+
+TEST(AllocationTest, SchedulerPassAllocatesNothing) {
+  Scheduler::JobTable table;
+  table.begin({nowMs, noWallClock});
+  table.addPeriodic("fast", countRun, 1000);
+  table.addPeriodic("slow", countRun, 60000, 500);
+  table.addOneShot("once", countRun, 2000);
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < kPasses; pass++) {
+    fakeNowMs += 250;
+    while (table.runNext()) {
+    }
+    table.getIdleMs();
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+  EXPECT_GT(jobRuns, 0u);
+}
+
+// Readings handed from the sensing task to the network task
+TEST(AllocationTest, SampleQueueAllocatesNothing) {
+  SpscQueue<TriggerEngine::Sample, 8> queue;
+  TriggerEngine::Sample sample = {};
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < kPasses; pass++) {
+    sample.atMs = static_cast<uint32_t>(pass);
+    queue.push(sample);
+    queue.pop(sample);
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+}
+
+// Readings and tips between two writes of the state file
+TEST(AllocationTest, RainUpdateAllocatesNothing) {
+  Host::reset();
+  Host::advanceMs(5000);
+  Host::setUnixTime(1750000000);
+  ASSERT_TRUE(LittleFS.begin());
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+  RainGauge::begin(true, 0.2f);
+  RainGauge::update();
+  RainGauge::flush();
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < 25; pass++) {
+    Host::Gpio::setInput(RainGauge::kRainGaugePin, LOW);
+    Host::advanceMs(50);
+    Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+    Host::advanceMs(300);
+    RainGauge::update();
+    RainGauge::getRainLastHourMm();
+    RainGauge::getRainLast24HoursMm();
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+  EXPECT_EQ(RainGauge::getTotalTips(), 25u);
+}
+
+// The web handlers queue settings for the network task
+TEST(AllocationTest, WebActionQueueAllocatesNothing) {
+  WebActions::begin();
+  Config updated = {};
+  Config applied = {};
+  WebActions::Entry entry;
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < kPasses; pass++) {
+    uint32_t ticket = WebActions::pushConfig(updated);
+    if (WebActions::peek(entry, applied)) {
+      WebActions::complete(entry.ticket);
+    }
+    WebActions::isDone(ticket);
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+}
+
+}  // namespace
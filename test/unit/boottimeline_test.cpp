@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+
+#include "boottimeline.h"
+#include "host.h"
+
+// The timeline lives for the whole boot and has no reset, so each test
+// works on phases of its own
+namespace {
+
+using BootTimeline::Phase;
+using BootTimeline::Span;
+
+class BootTimelineTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    Host::advanceMs(100);
+  }
+};
+
+TEST_F(BootTimelineTest, KeepsTheFirstStartAndFinish) {
+  uint32_t startMs = millis();
+  BootTimeline::start(Phase::Config);
+  Host::advanceMs(5);
+  BootTimeline::start(Phase::Config);
+  Host::advanceMs(20);
+  uint32_t endMs = millis();
+  BootTimeline::finish(Phase::Config);
+  Host::advanceMs(5);
+  BootTimeline::finish(Phase::Config);
+
+  Span span = BootTimeline::getSpan(Phase::Config);
+  EXPECT_TRUE(span.started);
+  EXPECT_TRUE(span.finished);
+  EXPECT_EQ(span.startMs, startMs);
+  EXPECT_EQ(span.endMs, endMs);
+}
+
+TEST_F(BootTimelineTest, FinishBeforeStartIsIgnored) {
+  BootTimeline::finish(Phase::Storage);
+  EXPECT_FALSE(BootTimeline::getSpan(Phase::Storage).finished);
+
+  BootTimeline::start(Phase::Storage);
+  Host::advanceMs(30);
+  BootTimeline::finish(Phase::Storage);
+  Span span = BootTimeline::getSpan(Phase::Storage);
+  EXPECT_TRUE(span.finished);
+  EXPECT_EQ(span.endMs - span.startMs, 30u);
+}
+
+// setup() starts the Wi-Fi association and brings the sensors up while
+// it runs
+TEST_F(BootTimelineTest, PhasesOverlap) {
+  BootTimeline::start(Phase::WiFi);
+  Host::advanceMs(10);
+  BootTimeline::start(Phase::Sensors);
+  Host::advanceMs(200);
+  BootTimeline::finish(Phase::Sensors);
+  Host::advanceMs(1500);
+  BootTimeline::finish(Phase::WiFi);
+
+  Span wifi = BootTimeline::getSpan(Phase::WiFi);
+  Span sensors = BootTimeline::getSpan(Phase::Sensors);
+  EXPECT_EQ(sensors.startMs - wifi.startMs, 10u);
+  EXPECT_EQ(sensors.endMs - sensors.startMs, 200u);
+  EXPECT_EQ(wifi.endMs - sensors.endMs, 1500u);
+}
+
+TEST_F(BootTimelineTest, FirstSampleIsKnownOnceItEnds) {
+  EXPECT_EQ(BootTimeline::getFirstSampleMs(), 0u);
+  BootTimeline::start(Phase::FirstSample);
+  Host::advanceMs(40);
+  EXPECT_EQ(BootTimeline::getFirstSampleMs(), 0u);
+
+  uint32_t endMs = millis();
+  BootTimeline::finish(Phase::FirstSample);
+  EXPECT_EQ(BootTimeline::getFirstSampleMs(), endMs);
+}
+
+// The names label the Boot panel rows and the wx_boot_phase_seconds series
+TEST_F(BootTimelineTest, EveryPhaseHasItsOwnName) {
+  std::set<std::string> names;
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Phase::Count); i++) {
+    const char* name = BootTimeline::getPhaseName(static_cast<Phase>(i));
+    ASSERT_NE(name, nullptr);
+    EXPECT_STRNE(name, "none");
+    EXPECT_TRUE(names.insert(name).second) << name;
+  }
+
+  EXPECT_STREQ(BootTimeline::getPhaseName(Phase::Count), "none");
+  BootTimeline::start(Phase::Count);
+  EXPECT_FALSE(BootTimeline::getSpan(Phase::Count).started);
+}
+
+}  // namespace
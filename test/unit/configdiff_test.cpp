@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include "config.h"
+
+// diffConfig() decides which subsystems applyConfigChanges() restarts
+// after a save or an MQTT set(), so every field has to land on its own
+// subsystems and nothing else
+namespace {
+
+class ConfigDiffTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    setConfigDefaults(before);
+    after = before;
+  }
+
+  // Any other valid value of the field
+  static void change(Config& target, const ConfigField& field) {
+    if (field.type == ConfigFieldType::Text) {
+      const char* value = strcmp(getConfigFieldText(target, field), "x") == 0 ? "y" : "x";
+      ASSERT_EQ(setConfigFieldValue(target, field, value), ConfigSetResult::Ok) << field.key;
+      return;
+    }
+    double value = getConfigFieldNumber(target, field);
+    double changed = value + 1 <= field.maxValue ? value + 1 : value - 1;
+    ASSERT_TRUE(setConfigFieldNumber(target, field, changed)) << field.key;
+  }
+
+  Config before;
+  Config after;
+};
+
+TEST_F(ConfigDiffTest, SameConfigChangesNothing) {
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_NONE);
+}
+
+TEST_F(ConfigDiffTest, EveryFieldReportsExactlyItsSubsystems) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    after = before;
+    change(after, field);
+    EXPECT_EQ(diffConfig(before, after), field.subsystems) << field.key;
+    EXPECT_EQ(diffConfig(after, before), field.subsystems) << field.key;
+  }
+}
+
+// The broker address used to reach mqttClient.setServer() only after a reboot
+TEST_F(ConfigDiffTest, BrokerChangeRestartsOnlyMqtt) {
+  after.mqttServer = "broker.local";
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_MQTT);
+
+  after = before;
+  after.mqttPort = 8883;
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_MQTT);
+}
+
+TEST_F(ConfigDiffTest, IntervalAndSyslogChangesApplyAtOnce) {
+  after.intervalHttp = 120000;
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_INTERVALS);
+
+  after = before;
+  after.syslogServer = "logs.local";
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_SYSLOG);
+}
+
+TEST_F(ConfigDiffTest, ChangesAddUp) {
+  after.activeRain = !before.activeRain;
+  after.aprsPort = 14581;
+  after.gpioTriggers[0].triggerOnValue = 25.0f;
+  EXPECT_EQ(diffConfig(before, after),
+    CONFIG_SUBSYSTEM_RAIN | CONFIG_SUBSYSTEM_TRIGGERS | CONFIG_SUBSYSTEM_APRS);
+}
+
+TEST_F(ConfigDiffTest, StaleBytesPastTheTextEndAreNotAChange) {
+  after.aprsComment = "a much longer comment than the default one";
+  after.aprsComment = before.aprsComment.c_str();
+  ASSERT_NE(memcmp(&before.aprsComment, &after.aprsComment, sizeof(before.aprsComment)), 0);
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_NONE);
+}
+
+// The slots in use are a setting, the slots that exist a build option
+TEST_F(ConfigDiffTest, TriggerSlotsStayWithinTheBuild) {
+  const ConfigField* field = findConfigField("triggerSlots");
+  ASSERT_NE(field, nullptr);
+  EXPECT_EQ(before.gpioTriggerSlots, GPIO_TRIGGER_COUNT);
+  EXPECT_EQ(setConfigFieldValue(after, *field, "0"), ConfigSetResult::OutOfRange);
+  EXPECT_EQ(setConfigFieldValue(after, *field, String(GPIO_TRIGGER_COUNT + 1).c_str()), ConfigSetResult::OutOfRange);
+  EXPECT_EQ(setConfigFieldValue(after, *field, "1"), ConfigSetResult::Ok);
+  EXPECT_EQ(diffConfig(before, after), CONFIG_SUBSYSTEM_TRIGGERS);
+}
+
+}  // namespace
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "configstore.h"
+#include "host.h"
+
+namespace {
+
+std::string readHostFile(const char* path) {
+  std::ifstream in(Host::Fs::getRoot() + path, std::ios::binary);
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+void writeHostFile(const char* path, const std::string& text) {
+  std::ofstream out(Host::Fs::getRoot() + path, std::ios::binary | std::ios::trunc);
+  out << text;
+}
+
+class ConfigStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    ASSERT_TRUE(mountFileSystem());
+    setConfigDefaults(config);
+  }
+};
+
+TEST_F(ConfigStoreTest, MissingFileLoadsDefaults) {
+  config.mqttPort = 1;
+  EXPECT_FALSE(loadConfig());
+  EXPECT_EQ(config.mqttPort, 1883);
+  EXPECT_STREQ(config.stationName.c_str(), "wx-station");
+}
+
+TEST_F(ConfigStoreTest, SavedConfigLoadsBackFromTheSnapshot) {
+  config.mqttPort = 8883;
+  config.altitude = 312.5f;
+  config.activeRain = true;
+  config.stationName = "roof";
+  config.gpioTriggers[3].gpioPin = 26;
+  config.gpioTriggers[3].rule = "temp > 30 and hum > 70";
+  Config saved = config;
+  ASSERT_TRUE(saveConfig());
+  EXPECT_TRUE(LittleFS.exists("/config.json"));
+  EXPECT_TRUE(LittleFS.exists("/config.bin"));
+
+  setConfigDefaults(config);
+  ASSERT_TRUE(loadConfig());
+  EXPECT_TRUE(getConfigLoadStats().fromSnapshot);
+  EXPECT_EQ(diffConfig(saved, config), CONFIG_SUBSYSTEM_NONE);
+  EXPECT_STREQ(config.gpioTriggers[3].rule.c_str(), "temp > 30 and hum > 70");
+}
+
+// What /restore does: the snapshot goes, then the JSON is replaced by one
+// of the same size
+TEST_F(ConfigStoreTest, RestoredJsonWinsOverTheSnapshot) {
+  config.mqttPort = 8883;
+  ASSERT_TRUE(saveConfig());
+
+  std::string json = readHostFile("/config.json");
+  size_t port = json.find("8883");
+  ASSERT_NE(port, std::string::npos);
+  json.replace(port, 4, "1884");
+  invalidateConfigSnapshot();
+  writeHostFile("/config.json", json);
+  EXPECT_FALSE(LittleFS.exists("/config.bin"));
+
+  ASSERT_TRUE(loadConfig());
+  EXPECT_FALSE(getConfigLoadStats().fromSnapshot);
+  EXPECT_EQ(config.mqttPort, 1884);
+
+  // The snapshot was rewritten for the new JSON
+  ASSERT_TRUE(loadConfig());
+  EXPECT_TRUE(getConfigLoadStats().fromSnapshot);
+}
+
+// The snapshot is checked against the size of the JSON, not its contents
+TEST_F(ConfigStoreTest, JsonOfAnotherSizeWinsOverTheSnapshot) {
+  config.mqttPort = 8883;
+  ASSERT_TRUE(saveConfig());
+
+  std::string json = readHostFile("/config.json");
+  size_t port = json.find("8883");
+  ASSERT_NE(port, std::string::npos);
+  json.replace(port, 4, "883");
+  writeHostFile("/config.json", json);
+
+  ASSERT_TRUE(loadConfig());
+  EXPECT_FALSE(getConfigLoadStats().fromSnapshot);
+  EXPECT_EQ(config.mqttPort, 883);
+}
+
+TEST_F(ConfigStoreTest, CorruptSnapshotFallsBackToJson) {
+  config.intervalMqtt = 300000;
+  ASSERT_TRUE(saveConfig());
+  std::string snapshot = readHostFile("/config.bin");
+  snapshot[snapshot.size() / 2] ^= 0x55;
+  writeHostFile("/config.bin", snapshot);
+
+  setConfigDefaults(config);
+  ASSERT_TRUE(loadConfig());
+  EXPECT_FALSE(getConfigLoadStats().fromSnapshot);
+  EXPECT_EQ(config.intervalMqtt, 300000);
+}
+
+TEST_F(ConfigStoreTest, InvalidValuesFallBackToDefaults) {
+  writeHostFile("/config.json", "{\"mqttPort\": 70000, \"altitude\": \"high\", \"activeMQTT\": true, \"stationName\": \"garden\"}");
+  ASSERT_TRUE(loadConfig());
+  EXPECT_EQ(config.mqttPort, 1883);
+  EXPECT_FLOAT_EQ(config.altitude, 230.0f);
+  EXPECT_TRUE(config.activeMQTT);
+  EXPECT_STREQ(config.stationName.c_str(), "garden");
+}
+
+TEST_F(ConfigStoreTest, BrokenJsonIsNotLoaded) {
+  writeHostFile("/config.json", "{\"mqttPort\": ");
+  EXPECT_FALSE(loadConfig());
+}
+
+TEST_F(ConfigStoreTest, JsonRoundTripKeepsEveryField) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    if (field.type == ConfigFieldType::Text) {
+      setConfigFieldValue(config, field, "x");
+    } else {
+      setConfigFieldNumber(config, field, field.maxValue);
+    }
+  }
+
+  DynamicJsonDocument doc(getConfigJsonCapacity());
+  writeConfigJson(config, doc);
+  EXPECT_FALSE(doc.overflowed());
+  Config copy;
+  setConfigDefaults(copy);
+  readConfigJson(doc, copy);
+  EXPECT_EQ(diffConfig(config, copy), CONFIG_SUBSYSTEM_NONE);
+}
+
+// Every text field at full length has to parse back from the file, the
+// capacity is summed from the field table
+TEST_F(ConfigStoreTest, FullLengthConfigFitsTheDocument) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    if (field.type == ConfigFieldType::Text) {
+      // Distinct values, ArduinoJson would store duplicates once
+      std::string text = std::to_string(i);
+      text.resize(field.capacity, 'w');
+      ASSERT_EQ(setConfigFieldValue(config, field, text.c_str()), ConfigSetResult::Ok) << field.key;
+    } else {
+      setConfigFieldNumber(config, field, field.minValue);
+    }
+  }
+  Config saved = config;
+  ASSERT_TRUE(saveConfig());
+  LittleFS.remove("/config.bin");
+
+  DynamicJsonDocument doc(getConfigJsonCapacity());
+  EXPECT_EQ(deserializeJson(doc, readHostFile("/config.json")), DeserializationError::Ok);
+  EXPECT_LE(doc.memoryUsage(), getConfigJsonCapacity());
+
+  setConfigDefaults(config);
+  ASSERT_TRUE(loadConfig());
+  EXPECT_FALSE(getConfigLoadStats().fromSnapshot);
+  EXPECT_EQ(diffConfig(saved, config), CONFIG_SUBSYSTEM_NONE);
+}
+
+// A firmware with a different field table must not take the raw bytes
+TEST_F(ConfigStoreTest, SnapshotOfAnotherLayoutIsIgnored) {
+  config.mqttPort = 8883;
+  ASSERT_TRUE(saveConfig());
+  std::string snapshot = readHostFile("/config.bin");
+  // layoutHash follows magic, version and reserved
+  snapshot[8] ^= 0x01;
+  writeHostFile("/config.bin", snapshot);
+
+  setConfigDefaults(config);
+  ASSERT_TRUE(loadConfig());
+  EXPECT_FALSE(getConfigLoadStats().fromSnapshot);
+  EXPECT_EQ(config.mqttPort, 8883);
+}
+
+}  // namespace
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include "config.h"
+#include "fixedstring.h"
+
+namespace {
+
+TEST(FixedStringTest, KeepsTextThatFits) {
+  FixedString<8> text;
+  EXPECT_TRUE(text.isEmpty());
+  EXPECT_TRUE(text.assign("station"));
+  EXPECT_STREQ(text.c_str(), "station");
+  EXPECT_EQ(text.length(), 7u);
+  EXPECT_TRUE(text.equals("station"));
+}
+
+TEST(FixedStringTest, CutsAtCapacityAndReportsIt) {
+  FixedString<4> text;
+  EXPECT_FALSE(text.assign("weather"));
+  EXPECT_STREQ(text.c_str(), "weat");
+  EXPECT_TRUE(text.assign("wxst"));
+  EXPECT_STREQ(text.c_str(), "wxst");
+}
+
+TEST(FixedStringTest, NullClearsAndEqualsEmpty) {
+  FixedString<4> text;
+  text = "abc";
+  EXPECT_TRUE(text.assign(static_cast<const char*>(nullptr)));
+  EXPECT_TRUE(text.isEmpty());
+  EXPECT_TRUE(text.equals(nullptr));
+}
+
+TEST(FixedStringTest, IsExactlyItsBuffer) {
+  static_assert(sizeof(FixedString<15>) == 16, "no hidden members");
+  static_assert(std::is_trivially_copyable<FixedString<15>>::value, "copyable as bytes");
+  FixedString<3> a;
+  FixedString<3> b;
+  a = String("abc");
+  b = "abc";
+  EXPECT_EQ(a, b);
+  b = "abd";
+  EXPECT_NE(a, b);
+}
+
+TEST(ConfigFieldTest, EveryKeyIsFoundAndUnique) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    EXPECT_EQ(findConfigField(field.key), &field) << field.key;
+  }
+  EXPECT_EQ(findConfigField("noSuchField"), nullptr);
+}
+
+TEST(ConfigFieldTest, TextCapacityMatchesTheMember) {
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    if (field.type == ConfigFieldType::Text) {
+      EXPECT_GT(field.capacity, 0u) << field.key;
+      EXPECT_LE(field.offset + field.capacity + 1u, sizeof(Config)) << field.key;
+    }
+  }
+}
+
+TEST(ConfigFieldTest, DefaultsAreInRange) {
+  Config target;
+  setConfigDefaults(target);
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    if (field.type == ConfigFieldType::Text) {
+      EXPECT_STREQ(getConfigFieldText(target, field), field.defaultText) << field.key;
+    } else {
+      double value = getConfigFieldNumber(target, field);
+      EXPECT_GE(value, field.minValue) << field.key;
+      EXPECT_LE(value, field.maxValue) << field.key;
+    }
+  }
+}
+
+TEST(ConfigFieldTest, ParsesNumbersAndRejectsBadInput) {
+  Config target;
+  setConfigDefaults(target);
+  const ConfigField& port = *findConfigField("mqttPort");
+  EXPECT_EQ(setConfigFieldValue(target, port, "8883"), ConfigSetResult::Ok);
+  EXPECT_EQ(target.mqttPort, 8883);
+  EXPECT_EQ(setConfigFieldValue(target, port, "70000"), ConfigSetResult::OutOfRange);
+  EXPECT_EQ(setConfigFieldValue(target, port, "12.5"), ConfigSetResult::Invalid);
+  EXPECT_EQ(setConfigFieldValue(target, port, "abc"), ConfigSetResult::Invalid);
+  EXPECT_EQ(setConfigFieldValue(target, port, nullptr), ConfigSetResult::Invalid);
+  EXPECT_EQ(target.mqttPort, 8883);
+
+  const ConfigField& altitude = *findConfigField("altitude");
+  EXPECT_EQ(setConfigFieldValue(target, altitude, "312,5"), ConfigSetResult::Ok);
+  EXPECT_FLOAT_EQ(target.altitude, 312.5f);
+  EXPECT_EQ(formatConfigFieldValue(target, altitude), "312.5");
+
+  const ConfigField& debug = *findConfigField("debugMode");
+  EXPECT_EQ(setConfigFieldValue(target, debug, "on"), ConfigSetResult::Ok);
+  EXPECT_TRUE(target.debugMode);
+  EXPECT_EQ(setConfigFieldValue(target, debug, "maybe"), ConfigSetResult::Invalid);
+  EXPECT_TRUE(target.debugMode);
+}
+
+TEST(ConfigFieldTest, FormUnitsApplyTheScale) {
+  Config target;
+  setConfigDefaults(target);
+  const ConfigField& interval = *findConfigField("intervalMqtt");
+  EXPECT_EQ(setConfigFieldValue(target, interval, "5", true), ConfigSetResult::Ok);
+  EXPECT_EQ(target.intervalMqtt, 300000);
+  EXPECT_EQ(setConfigFieldValue(target, interval, "5"), ConfigSetResult::OutOfRange);
+}
+
+TEST(ConfigFieldTest, LongTextIsCut) {
+  Config target;
+  setConfigDefaults(target);
+  const ConfigField& name = *findConfigField("stationName");
+  std::string longName(kConfigNameLength + 5, 'x');
+  EXPECT_EQ(setConfigFieldValue(target, name, longName.c_str()), ConfigSetResult::Truncated);
+  EXPECT_EQ(target.stationName.length(), kConfigNameLength);
+}
+
+TEST(ConfigFieldTest, TypedSettersRespectTheRange) {
+  Config target;
+  setConfigDefaults(target);
+  const ConfigField& pin = *findConfigField("triggerGpioPin0");
+  EXPECT_TRUE(setConfigFieldNumber(target, pin, 27));
+  EXPECT_EQ(target.gpioTriggers[0].gpioPin, 27);
+  EXPECT_FALSE(setConfigFieldNumber(target, pin, 40));
+  EXPECT_EQ(target.gpioTriggers[0].gpioPin, 27);
+  EXPECT_FALSE(setConfigFieldNumber(target, *findConfigField("stationName"), 1));
+  setConfigFieldDefault(target, pin);
+  EXPECT_EQ(target.gpioTriggers[0].gpioPin, GPIO_TRIGGER_PIN_DISABLED);
+}
+
+}  // namespace
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include "heartbeat.h"
+#include "host.h"
+
+namespace {
+
+using Heartbeat::State;
+
+constexpr uint8_t kPin = Heartbeat::HEARTBEAT_LED_PIN;
+
+class HeartbeatTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    Heartbeat::begin();
+    Heartbeat::setEnabled(true);
+    timer = Host::Timers::find("heartbeat");
+    ASSERT_NE(timer, nullptr);
+  }
+
+  static bool ledOn() {
+    return Host::Gpio::getLevel(kPin) == (Heartbeat::HEARTBEAT_LED_ACTIVE_HIGH ? HIGH : LOW);
+  }
+
+  // What the esp_timer task does when the step falls due: takes the
+  // timer off its list, then calls back. A state change can get in
+  // between the two.
+  void dispatch() {
+    ASSERT_TRUE(Host::Timers::isArmed(timer));
+    esp_timer_stop(timer);
+  }
+
+  esp_timer_handle_t timer = nullptr;
+};
+
+TEST_F(HeartbeatTest, StepsThroughThePattern) {
+  Heartbeat::setState(State::UploadsFailing);
+  EXPECT_TRUE(ledOn());
+  Host::advanceMs(800);
+  EXPECT_FALSE(ledOn());
+  Host::advanceMs(800);
+  EXPECT_TRUE(ledOn());
+}
+
+TEST_F(HeartbeatTest, HoldsTheLedWithoutAPattern) {
+  Heartbeat::setState(State::AccessPoint);
+  EXPECT_TRUE(ledOn());
+  EXPECT_FALSE(Host::Timers::isArmed(timer));
+
+  Heartbeat::setEnabled(false);
+  EXPECT_FALSE(ledOn());
+}
+
+// The step timer fired for the old pattern and waited on the lock while
+// setState() restarted the LED on the new one. The late callback used to
+// skip the new pattern's first step, and its re-arm failed on the timer
+// the restart had armed.
+TEST_F(HeartbeatTest, FireRacingAStateChangeIsDropped) {
+  Heartbeat::setState(State::Normal);
+  Host::advanceMs(100);
+  dispatch();
+
+  Heartbeat::setState(State::UploadsFailing);
+  uint64_t dueUs = Host::Timers::getDueUs(timer);
+  Host::Timers::fire(timer);
+
+  EXPECT_TRUE(ledOn());
+  EXPECT_TRUE(Host::Timers::isArmed(timer));
+  EXPECT_EQ(Host::Timers::getDueUs(timer), dueUs);
+
+  // And the new pattern runs on from there
+  Host::advanceMs(800);
+  EXPECT_FALSE(ledOn());
+  Host::advanceMs(800);
+  EXPECT_TRUE(ledOn());
+}
+
+TEST_F(HeartbeatTest, FireRacingTwoStateChangesIsDroppedOnce) {
+  Heartbeat::setState(State::Normal);
+  dispatch();
+  Heartbeat::setState(State::Error);
+  Heartbeat::setState(State::UploadsFailing);
+  Host::Timers::fire(timer);
+  EXPECT_TRUE(ledOn());
+
+  Host::advanceMs(800);
+  EXPECT_FALSE(ledOn());
+  Host::advanceMs(800);
+  EXPECT_TRUE(ledOn());
+}
+
+TEST_F(HeartbeatTest, FireRacingDisableLeavesTheLedOff) {
+  Heartbeat::setState(State::Error);
+  dispatch();
+  Heartbeat::setEnabled(false);
+  Host::Timers::fire(timer);
+
+  EXPECT_FALSE(ledOn());
+  EXPECT_FALSE(Host::Timers::isArmed(timer));
+
+  Heartbeat::setEnabled(true);
+  EXPECT_TRUE(ledOn());
+  Host::advanceMs(120);
+  EXPECT_FALSE(ledOn());
+}
+
+}  // namespace
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <string>
+
+#include "httpupload.h"
+
+namespace {
+
+class HttpUploadTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    setConfigDefaults(settings);
+    sample.temperature = 21.374f;
+    sample.humidity = 64.2f;
+    sample.seaLevelPressure = 1013.256f;
+    sample.lightWm2 = 120.5f;
+    sample.rain1h = 0.4f;
+    sample.rain24h = 2.2f;
+    sample.rssi = -67;
+    sample.timestamp = 1750000000;
+  }
+
+  Config settings;
+  Payload::Sample sample;
+  char url[HttpUpload::kMaxLength];
+};
+
+TEST_F(HttpUploadTest, KeysAndValuesFollowTheStationName) {
+  size_t length = HttpUpload::buildUrl("http://example.com/wx.php", "roof", sample, settings, url, sizeof(url));
+  EXPECT_EQ(length, strlen(url));
+  EXPECT_STREQ(url, "http://example.com/wx.php?station=roof&temperature=21.37&humidity=64.20&pressure=1013.26&rssi=-67");
+}
+
+TEST_F(HttpUploadTest, EmptyStationNameStartsWithTheFirstValue) {
+  settings.dataTemp = "t";
+  HttpUpload::buildUrl("http://example.com/wx.php", "", sample, settings, url, sizeof(url));
+  EXPECT_STREQ(url, "http://example.com/wx.php?t=21.37&humidity=64.20&pressure=1013.26&rssi=-67");
+}
+
+TEST_F(HttpUploadTest, ActiveSensorsAddTheirValues) {
+  settings.activeLight = true;
+  settings.activeRain = true;
+  HttpUpload::buildUrl("http://example.com/wx.php", "", sample, settings, url, sizeof(url));
+  EXPECT_STREQ(url,
+               "http://example.com/wx.php?temperature=21.37&humidity=64.20&pressure=1013.26"
+               "&light=120.50&rain_1h=0.40&rain_24h=2.20&rssi=-67");
+}
+
+// Longest URL, name and keys the config allows, every value at a width
+// no sensor reaches
+TEST_F(HttpUploadTest, LongestSettingsFit) {
+  std::string serverUrl = "http://" + std::string(kConfigUrlLength - 7, 'u');
+  std::string name(kConfigNameLength, 'n');
+  std::string key(kConfigKeyLength, 'k');
+  settings.dataTemp = key.c_str();
+  settings.dataHumi = key.c_str();
+  settings.dataPress = key.c_str();
+  settings.dataLight = key.c_str();
+  settings.dataRssi = key.c_str();
+  settings.activeLight = true;
+  settings.activeRain = true;
+  sample.temperature = -99999.99f;
+  sample.humidity = -99999.99f;
+  sample.seaLevelPressure = -99999.99f;
+  sample.lightWm2 = -99999.99f;
+  sample.rain1h = -99999.99f;
+  sample.rain24h = -99999.99f;
+  sample.rssi = -2147483647;
+
+  EXPECT_GT(HttpUpload::buildUrl(serverUrl.c_str(), name.c_str(), sample, settings, url, sizeof(url)), 0u);
+}
+
+TEST_F(HttpUploadTest, TooLongReturnsNothing) {
+  char small[40];
+  EXPECT_EQ(HttpUpload::buildUrl("http://example.com/wx.php", "roof", sample, settings, small, sizeof(small)), 0u);
+  EXPECT_STREQ(small, "");
+}
+
+}  // namespace
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <string>
+
+#include "mqttcommand.h"
+
+namespace {
+
+std::string str(const MqttCommand::Span& span) {
+  return std::string(span.data, span.length);
+}
+
+bool parse(const char* text, MqttCommand::Request& request) {
+  return MqttCommand::parsePayload(text, strlen(text), request);
+}
+
+TEST(MqttCommandTest, ParsesNameOnly) {
+  MqttCommand::Request request;
+  ASSERT_TRUE(parse("  reboot \n", request));
+  EXPECT_EQ(str(request.name), "reboot");
+  EXPECT_FALSE(request.hasArgument);
+  EXPECT_TRUE(request.id.isEmpty());
+}
+
+TEST(MqttCommandTest, ParsesIdAndArgument) {
+  MqttCommand::Request request;
+  ASSERT_TRUE(parse("@req-42 set( mqttPort = 8883 )", request));
+  EXPECT_EQ(str(request.id), "req-42");
+  EXPECT_EQ(str(request.name), "set");
+  EXPECT_TRUE(request.hasArgument);
+  EXPECT_EQ(str(request.argument), "mqttPort = 8883");
+}
+
+TEST(MqttCommandTest, ArgumentKeepsInnerParentheses) {
+  MqttCommand::Request request;
+  ASSERT_TRUE(parse("config({\"rule\":\"(temp > 3)\"})", request));
+  EXPECT_EQ(str(request.argument), "{\"rule\":\"(temp > 3)\"}");
+}
+
+TEST(MqttCommandTest, RejectsMalformedPayloads) {
+  MqttCommand::Request request;
+  EXPECT_FALSE(parse("", request));
+  EXPECT_FALSE(parse("   ", request));
+  EXPECT_FALSE(parse("@ reboot", request));
+  EXPECT_FALSE(parse("@12345678901234567 reboot", request));
+  EXPECT_FALSE(parse("@id!reboot", request));
+  EXPECT_FALSE(parse("update(http://x", request));
+  EXPECT_FALSE(parse("reboot now", request));
+  EXPECT_FALSE(parse("(x)", request));
+}
+
+TEST(MqttCommandTest, ParsesTopicBelowTheBase) {
+  MqttCommand::Request request;
+  const char* payload = " http://host/fw.bin ";
+  ASSERT_TRUE(MqttCommand::parseTopic("wx/cmd/update", "wx/cmd", payload, strlen(payload), request));
+  EXPECT_EQ(str(request.name), "update");
+  EXPECT_EQ(str(request.argument), "http://host/fw.bin");
+
+  EXPECT_FALSE(MqttCommand::parseTopic("wx/cmdx/update", "wx/cmd", payload, strlen(payload), request));
+  EXPECT_FALSE(MqttCommand::parseTopic("wx/cmd/a/b", "wx/cmd", payload, strlen(payload), request));
+  EXPECT_FALSE(MqttCommand::parseTopic("wx/cmd/", "wx/cmd", payload, strlen(payload), request));
+  EXPECT_FALSE(MqttCommand::parseTopic("wx/cmd/x", "", payload, strlen(payload), request));
+}
+
+int handledCount = 0;
+std::string lastKey;
+std::string lastValue;
+
+void onReboot(const MqttCommand::Request&) {
+  handledCount++;
+}
+
+void onSet(const MqttCommand::Request& request) {
+  handledCount++;
+  lastKey = str(request.key);
+  lastValue = str(request.value);
+}
+
+const MqttCommand::Entry kEntries[] = {
+  {"reboot", MqttCommand::ArgType::None, onReboot},
+  {"update", MqttCommand::ArgType::Text, onReboot},
+  {"set", MqttCommand::ArgType::KeyValue, onSet}
+};
+
+MqttCommand::Result dispatch(const char* text) {
+  MqttCommand::Request request;
+  EXPECT_TRUE(parse(text, request)) << text;
+  return MqttCommand::dispatch(kEntries, sizeof(kEntries) / sizeof(kEntries[0]), request);
+}
+
+TEST(MqttCommandTest, DispatchChecksTheArgument) {
+  handledCount = 0;
+  EXPECT_EQ(dispatch("REBOOT"), MqttCommand::Result::Handled);
+  EXPECT_EQ(dispatch("reboot()"), MqttCommand::Result::Handled);
+  EXPECT_EQ(dispatch("reboot(now)"), MqttCommand::Result::InvalidArgument);
+  EXPECT_EQ(dispatch("update()"), MqttCommand::Result::InvalidArgument);
+  EXPECT_EQ(dispatch("set(novalue)"), MqttCommand::Result::InvalidArgument);
+  EXPECT_EQ(dispatch("set( = 3)"), MqttCommand::Result::InvalidArgument);
+  EXPECT_EQ(dispatch("shutdown"), MqttCommand::Result::UnknownCommand);
+  EXPECT_EQ(handledCount, 2);
+
+  EXPECT_EQ(dispatch("set( altitude = 312,5 )"), MqttCommand::Result::Handled);
+  EXPECT_EQ(lastKey, "altitude");
+  EXPECT_EQ(lastValue, "312,5");
+}
+
+TEST(MqttCommandTest, SpanCopyReportsTruncation) {
+  MqttCommand::Span span = {"abcdef", 6};
+  char buffer[4];
+  EXPECT_FALSE(span.copyTo(buffer, sizeof(buffer)));
+  EXPECT_STREQ(buffer, "abc");
+  char wide[8];
+  EXPECT_TRUE(span.copyTo(wide, sizeof(wide)));
+  EXPECT_STREQ(wide, "abcdef");
+  EXPECT_EQ(span.toString(), "abcdef");
+}
+
+}  // namespace
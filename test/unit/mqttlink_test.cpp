@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include "config.h"
+#include "fakemetrics.h"
+#include "host.h"
+#include "mqttlink.h"
+
+namespace {
+
+using MqttLink::Event;
+using MqttLink::State;
+
+constexpr uint32_t kPassMs = 10;
+
+class MqttLinkTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    FakeMetrics::reset();
+    setConfigDefaults(config);
+    config.mqttServer = "192.168.1.10";
+    config.mqttTopicPub1 = "wx/roof";
+    client.setClient(socket);
+    MqttLink::begin(client, socket);
+    MqttLink::restart();
+  }
+
+  // Network task passes until the link is up, false after timeoutMs
+  bool connect(uint32_t timeoutMs = 1000) {
+    for (uint32_t elapsedMs = 0; elapsedMs < timeoutMs; elapsedMs += kPassMs) {
+      if (MqttLink::update() == Event::Connected) {
+        return true;
+      }
+      Host::advanceMs(kPassMs);
+    }
+    return false;
+  }
+
+  WiFiClient socket;
+  PubSubClient client{socket};
+};
+
+TEST_F(MqttLinkTest, ConnectsAndAnnouncesOnline) {
+  ASSERT_TRUE(connect());
+  EXPECT_EQ(MqttLink::getState(), State::Connected);
+  ASSERT_FALSE(Host::Broker::getMessages().empty());
+  EXPECT_EQ(Host::Broker::getMessages().back().topic, "wx/roof/status");
+  EXPECT_EQ(Host::Broker::getMessages().back().payload, "online");
+}
+
+TEST_F(MqttLinkTest, FailedAttemptsBackOff) {
+  Host::Broker::setUp(false);
+  unsigned long lastDelayMs = 0;
+  for (int attempt = 0; attempt < 5; attempt++) {
+    Event event = Event::None;
+    while ((event = MqttLink::update()) == Event::None) {
+      Host::advanceMs(kPassMs);
+    }
+    ASSERT_EQ(event, Event::Failed);
+    EXPECT_EQ(MqttLink::getLastFailure(), MqttLink::Failure::Tcp);
+    EXPECT_GE(MqttLink::getRetryDelayMs(), lastDelayMs);
+    lastDelayMs = MqttLink::getRetryDelayMs();
+  }
+  EXPECT_GE(lastDelayMs, MqttLink::kBackoffMinMs << 3);
+
+  Host::Broker::setUp(true);
+  EXPECT_TRUE(connect(2 * MqttLink::kBackoffMinMs << 4));
+}
+
+// A broker that takes the client and drops it at once, e.g. for a
+// duplicate client id, used to get a new connect on every loop pass
+TEST_F(MqttLinkTest, ShortSessionsKeepTheBackoff) {
+  constexpr uint32_t kRunMs = 120000;
+  uint32_t lostCount = 0;
+  for (uint32_t elapsedMs = 0; elapsedMs < kRunMs; elapsedMs += kPassMs) {
+    if (MqttLink::getState() == State::Connected) {
+      Host::Broker::dropClients();
+    }
+    if (MqttLink::update() == Event::Lost) {
+      lostCount++;
+    }
+    Host::advanceMs(kPassMs);
+  }
+
+  // 1 to 2 s after the first drop, doubling up to 2 min in
+  EXPECT_GE(lostCount, 4u);
+  EXPECT_LE(Host::Broker::getConnectCount(), 10u);
+  EXPECT_GT(MqttLink::getRetryDelayMs(), MqttLink::kBackoffMinMs << 3);
+}
+
+TEST_F(MqttLinkTest, LostStableSessionReconnectsAtOnce) {
+  // Build up some backoff first
+  Host::Broker::setUp(false);
+  for (int attempt = 0; attempt < 4;) {
+    if (MqttLink::update() == Event::Failed) {
+      attempt++;
+    }
+    Host::advanceMs(kPassMs);
+  }
+  Host::Broker::setUp(true);
+  ASSERT_TRUE(connect(MqttLink::kBackoffMaxMs));
+
+  for (uint32_t elapsedMs = 0; elapsedMs <= MqttLink::kStableSessionMs; elapsedMs += kPassMs) {
+    ASSERT_EQ(MqttLink::update(), Event::None);
+    Host::advanceMs(kPassMs);
+  }
+
+  Host::Broker::dropClients();
+  EXPECT_EQ(MqttLink::update(), Event::Lost);
+  uint32_t connectsBefore = Host::Broker::getConnectCount();
+  EXPECT_TRUE(connect(5 * kPassMs));
+  EXPECT_EQ(Host::Broker::getConnectCount(), connectsBefore + 1);
+}
+
+TEST_F(MqttLinkTest, StopStaysIdleUntilRestart) {
+  ASSERT_TRUE(connect());
+  MqttLink::stop();
+  EXPECT_EQ(MqttLink::getState(), State::Waiting);
+  EXPECT_EQ(Host::Broker::getMessages().back().payload, "offline");
+
+  uint32_t connects = Host::Broker::getConnectCount();
+  for (int pass = 0; pass < 100; pass++) {
+    EXPECT_EQ(MqttLink::update(), Event::None);
+    Host::advanceMs(kPassMs);
+  }
+  EXPECT_EQ(Host::Broker::getConnectCount(), connects);
+
+  MqttLink::restart();
+  EXPECT_TRUE(connect());
+}
+
+}  // namespace
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <LittleFS.h>
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "fakemetrics.h"
+#include "host.h"
+#include "mqttlink.h"
+#include "mqttoutbox.h"
+
+namespace {
+
+constexpr const char* kTopic = "wx/roof";
+constexpr uint8_t kReplayRate = 10;
+
+class MqttOutboxTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    FakeMetrics::reset();
+    // Past the replay spacing, as on a station that has been up a while
+    Host::advanceMs(5000);
+    ASSERT_TRUE(LittleFS.begin());
+    ASSERT_TRUE(MqttOutbox::begin());
+    client.setClient(socket);
+  }
+
+  static bool push(const std::string& text) {
+    return MqttOutbox::push(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+  }
+
+  // Replays everything at the configured rate, returns how many went out
+  int drainAll() {
+    int sent = 0;
+    for (int pass = 0; pass < 10000 && MqttOutbox::getDepth() > 0; pass++) {
+      if (MqttOutbox::drain(client, kTopic, kReplayRate)) {
+        sent++;
+      }
+      Host::advanceMs(10);
+    }
+    return sent;
+  }
+
+  static std::vector<std::string> payloads() {
+    std::vector<std::string> texts;
+    for (const Host::Broker::Message& message : Host::Broker::getMessages()) {
+      if (message.topic == kTopic) {
+        texts.push_back(message.payload);
+      }
+    }
+    return texts;
+  }
+
+  WiFiClient socket;
+  PubSubClient client{socket};
+};
+
+TEST_F(MqttOutboxTest, ReplaysOldestFirst) {
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(push("m" + std::to_string(i)));
+  }
+  EXPECT_EQ(MqttOutbox::getDepth(), 5);
+
+  ASSERT_TRUE(client.connect("wx-test"));
+  EXPECT_EQ(drainAll(), 5);
+  EXPECT_EQ(payloads(), (std::vector<std::string>{"m0", "m1", "m2", "m3", "m4"}));
+  EXPECT_EQ(MqttOutbox::getReplayedCount(), 5u);
+}
+
+TEST_F(MqttOutboxTest, SurvivesARestart) {
+  for (int i = 0; i < 40; i++) {
+    ASSERT_TRUE(push("m" + std::to_string(i)));
+  }
+  ASSERT_TRUE(client.connect("wx-test"));
+  for (int i = 0; i < 10;) {
+    if (MqttOutbox::drain(client, kTopic, kReplayRate)) {
+      i++;
+    }
+    Host::advanceMs(100);
+  }
+
+  ASSERT_TRUE(MqttOutbox::begin());
+  EXPECT_EQ(MqttOutbox::getDepth(), 30);
+  Host::Broker::clearMessages();
+  EXPECT_EQ(drainAll(), 30);
+  ASSERT_EQ(payloads().size(), 30u);
+  EXPECT_EQ(payloads().front(), "m10");
+  EXPECT_EQ(payloads().back(), "m39");
+}
+
+TEST_F(MqttOutboxTest, FullRingDropsTheOldest) {
+  int pushed = MqttOutbox::kCapacity + 20;
+  for (int i = 0; i < pushed; i++) {
+    ASSERT_TRUE(push("m" + std::to_string(i)));
+  }
+  EXPECT_EQ(MqttOutbox::getDepth(), MqttOutbox::kCapacity);
+  EXPECT_EQ(MqttOutbox::getDroppedCount(), 20u);
+
+  ASSERT_TRUE(client.connect("wx-test"));
+  EXPECT_EQ(drainAll(), MqttOutbox::kCapacity);
+  std::vector<std::string> texts = payloads();
+  for (size_t i = 0; i < texts.size(); i++) {
+    EXPECT_EQ(texts[i], "m" + std::to_string(20 + i));
+  }
+}
+
+TEST_F(MqttOutboxTest, FailedPublishKeepsTheMessage) {
+  ASSERT_TRUE(push("m0"));
+  ASSERT_TRUE(client.connect("wx-test"));
+  Host::Broker::setPublishFails(true);
+  EXPECT_FALSE(MqttOutbox::drain(client, kTopic, kReplayRate));
+  EXPECT_EQ(MqttOutbox::getDepth(), 1);
+  EXPECT_EQ(MqttOutbox::getFailedCount(), 1u);
+
+  Host::Broker::setPublishFails(false);
+  EXPECT_EQ(drainAll(), 1);
+}
+
+// A header inside the ring made every push and drain rewrite the whole
+// ring file, about 24 KB each
+TEST_F(MqttOutboxTest, PushAndDrainProgramLittleFlash) {
+  constexpr int kMessages = 300;
+  const std::string payload(120, 'p');
+
+  uint64_t before = Host::Fs::getProgrammedBytes();
+  for (int i = 0; i < kMessages; i++) {
+    ASSERT_TRUE(push(payload));
+  }
+  uint64_t perPush = (Host::Fs::getProgrammedBytes() - before) / kMessages;
+
+  ASSERT_TRUE(client.connect("wx-test"));
+  before = Host::Fs::getProgrammedBytes();
+  int drained = drainAll();
+  ASSERT_GT(drained, 0);
+  uint64_t perDrain = (Host::Fs::getProgrammedBytes() - before) / static_cast<uint64_t>(drained);
+
+  EXPECT_LE(perPush, 512u);
+  EXPECT_LE(perDrain, 64u);
+}
+
+// The network task with the broker going away for a while: readings
+// published live while it is up, queued while it is down, replayed in
+// order once it is back, none lost and none twice
+TEST_F(MqttOutboxTest, BrokerStopAndStartKeepsTheSeries) {
+  setConfigDefaults(config);
+  config.mqttServer = "192.168.1.10";
+  MqttLink::begin(client, socket);
+  MqttLink::restart();
+
+  constexpr uint32_t kSampleMs = 10000;
+  constexpr uint32_t kPassMs = 50;
+  constexpr uint32_t kRunMs = 15UL * 60UL * 1000UL;
+  constexpr uint32_t kDownAtMs = 2UL * 60UL * 1000UL;
+  constexpr uint32_t kUpAtMs = 7UL * 60UL * 1000UL;
+
+  int sample = 0;
+  uint32_t nextSampleAtMs = 0;
+  for (uint32_t nowMs = 0; nowMs < kRunMs; nowMs += kPassMs) {
+    if (nowMs == kDownAtMs) {
+      Host::Broker::setUp(false);
+    }
+    if (nowMs == kUpAtMs) {
+      Host::Broker::setUp(true);
+    }
+
+    MqttLink::update();
+    if (nowMs >= nextSampleAtMs) {
+      nextSampleAtMs += kSampleMs;
+      std::string text = "s" + std::to_string(sample++);
+      bool live = MqttLink::getState() == MqttLink::State::Connected && MqttOutbox::getDepth() == 0
+        && client.publish(kTopic, text.c_str());
+      if (!live) {
+        ASSERT_TRUE(push(text));
+      }
+    }
+    if (MqttLink::getState() == MqttLink::State::Connected) {
+      MqttOutbox::drain(client, kTopic, kReplayRate);
+    }
+    Host::advanceMs(kPassMs);
+  }
+
+  EXPECT_EQ(MqttOutbox::getDepth(), 0);
+  EXPECT_GT(MqttOutbox::getReplayedCount(), 25u);
+  std::vector<std::string> texts = payloads();
+  ASSERT_EQ(texts.size(), static_cast<size_t>(sample));
+  for (size_t i = 0; i < texts.size(); i++) {
+    EXPECT_EQ(texts[i], "s" + std::to_string(i));
+  }
+}
+
+}  // namespace
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "fakemetrics.h"
+#include "host.h"
+#include "mqttpublish.h"
+
+namespace {
+
+using ChangePublisher::Metric;
+
+constexpr unsigned long kMaxSilenceMs = 600000;
+
+class ChangePublisherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    FakeMetrics::reset();
+    ChangePublisher::reset();
+    client.setClient(socket);
+    ASSERT_TRUE(client.connect("wx-test"));
+  }
+
+  bool offer(float value, float deadband = 0.5f) {
+    return ChangePublisher::offer(client, Metric::Temperature, "wx/temperature", value, 2, deadband, kMaxSilenceMs);
+  }
+
+  WiFiClient socket;
+  PubSubClient client{socket};
+};
+
+TEST_F(ChangePublisherTest, FirstValueGoesOutRetained) {
+  EXPECT_TRUE(offer(21.374f));
+  ASSERT_EQ(Host::Broker::getMessages().size(), 1u);
+  EXPECT_EQ(Host::Broker::getMessages()[0].topic, "wx/temperature");
+  EXPECT_EQ(Host::Broker::getMessages()[0].payload, "21.37");
+  EXPECT_TRUE(Host::Broker::getMessages()[0].retained);
+}
+
+TEST_F(ChangePublisherTest, DeadbandSuppressesSmallMoves) {
+  EXPECT_TRUE(offer(20.0f));
+  EXPECT_FALSE(offer(20.4f));
+  EXPECT_FALSE(offer(19.6f));
+  EXPECT_TRUE(offer(20.5f));
+  EXPECT_EQ(ChangePublisher::getPublishedCount(), 2u);
+  EXPECT_EQ(ChangePublisher::getSuppressedCount(), 2u);
+}
+
+TEST_F(ChangePublisherTest, ZeroDeadbandPublishesAnyChange) {
+  EXPECT_TRUE(offer(20.0f, 0));
+  EXPECT_FALSE(offer(20.0f, 0));
+  EXPECT_TRUE(offer(20.01f, 0));
+}
+
+TEST_F(ChangePublisherTest, SilenceForcesARepeat) {
+  EXPECT_TRUE(offer(20.0f));
+  Host::advanceMs(kMaxSilenceMs - 1);
+  EXPECT_FALSE(offer(20.0f));
+  Host::advanceMs(1);
+  EXPECT_TRUE(offer(20.0f));
+}
+
+TEST_F(ChangePublisherTest, FailedPublishIsRetried) {
+  Host::Broker::setPublishFails(true);
+  EXPECT_FALSE(offer(20.0f));
+  EXPECT_EQ(FakeMetrics::getCounts().uploads[static_cast<uint8_t>(Metrics::Destination::Mqtt)][0], 1u);
+  Host::Broker::setPublishFails(false);
+  EXPECT_TRUE(offer(20.0f));
+}
+
+TEST_F(ChangePublisherTest, ResetSendsEverythingAgain) {
+  EXPECT_TRUE(offer(20.0f));
+  ChangePublisher::reset();
+  EXPECT_TRUE(offer(20.0f));
+}
+
+TEST_F(ChangePublisherTest, NanIsNeverPublished) {
+  EXPECT_FALSE(offer(NAN));
+  EXPECT_TRUE(Host::Broker::getMessages().empty());
+}
+
+}  // namespace
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include <ArduinoJson.h>
+
+#include "allocationcounter.h"
+#include "payload.h"
+
+namespace {
+
+class PayloadTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    setConfigDefaults(settings);
+    sample.temperature = 21.374f;
+    sample.humidity = 64.2f;
+    sample.seaLevelPressure = 1013.256f;
+    sample.lightWm2 = 120.5f;
+    sample.rain1h = 0.4f;
+    sample.rain24h = 2.2f;
+    sample.rssi = -67;
+    sample.timestamp = 1750000000;
+  }
+
+  Config settings;
+  Payload::Sample sample;
+  uint8_t buffer[Payload::kMaxLength];
+};
+
+TEST_F(PayloadTest, JsonUsesTheConfiguredKeys) {
+  settings.dataTemp = "t";
+  size_t length = Payload::buildJson(sample, settings, buffer, sizeof(buffer));
+  ASSERT_GT(length, 0u);
+  EXPECT_EQ(std::string(reinterpret_cast<char*>(buffer), length),
+            "{\"t\":21.37,\"humidity\":64.2,\"pressure\":1013.26,\"rssi\":-67,\"ts\":1750000000}");
+}
+
+TEST_F(PayloadTest, JsonAddsActiveSensorsAndDropsUnknownTime) {
+  settings.activeLight = true;
+  settings.activeRain = true;
+  sample.timestamp = 0;
+  size_t length = Payload::buildJson(sample, settings, buffer, sizeof(buffer));
+
+  StaticJsonDocument<1024> doc;
+  ASSERT_FALSE(deserializeJson(doc, buffer, length));
+  EXPECT_DOUBLE_EQ(doc["light"].as<double>(), 120.5);
+  EXPECT_DOUBLE_EQ(doc["rain_1h"].as<double>(), 0.4);
+  EXPECT_DOUBLE_EQ(doc["rain_24h"].as<double>(), 2.2);
+  EXPECT_FALSE(doc.containsKey("ts"));
+}
+
+TEST_F(PayloadTest, MsgPackKeepsThePositions) {
+  size_t length = Payload::buildMsgPack(sample, settings, buffer, sizeof(buffer));
+  StaticJsonDocument<1024> doc;
+  ASSERT_FALSE(deserializeMsgPack(doc, buffer, length));
+  JsonArray values = doc.as<JsonArray>();
+  ASSERT_EQ(values.size(), 9u);
+  EXPECT_EQ(values[0].as<int>(), Payload::kMsgPackSchemaVersion);
+  EXPECT_NEAR(values[1].as<float>(), 21.37f, 0.001f);
+  EXPECT_TRUE(values[4].isNull());
+  EXPECT_TRUE(values[5].isNull());
+  EXPECT_TRUE(values[6].isNull());
+  EXPECT_EQ(values[7].as<int>(), -67);
+  EXPECT_EQ(values[8].as<uint32_t>(), 1750000000u);
+
+  settings.activeLight = true;
+  sample.timestamp = 0;
+  length = Payload::buildMsgPack(sample, settings, buffer, sizeof(buffer));
+  ASSERT_FALSE(deserializeMsgPack(doc, buffer, length));
+  values = doc.as<JsonArray>();
+  ASSERT_EQ(values.size(), 9u);
+  EXPECT_NEAR(values[4].as<float>(), 120.5f, 0.001f);
+  EXPECT_TRUE(values[8].isNull());
+}
+
+// The reason for the option: no keys and binary numbers
+TEST_F(PayloadTest, MsgPackIsLessThanHalfTheJson) {
+  for (bool allSensors : {false, true}) {
+    settings.activeLight = allSensors;
+    settings.activeRain = allSensors;
+    size_t json = Payload::buildJson(sample, settings, buffer, sizeof(buffer));
+    size_t msgPack = Payload::buildMsgPack(sample, settings, buffer, sizeof(buffer));
+    ASSERT_GT(msgPack, 0u);
+    EXPECT_LT(msgPack * 2, json) << (allSensors ? "all sensors" : "BME280 only");
+  }
+}
+
+TEST_F(PayloadTest, LongestKeysStillFit) {
+  settings.activeLight = true;
+  settings.activeRain = true;
+  std::string key(kConfigKeyLength, 'k');
+  for (char suffix : std::string("thplr")) {
+    key.back() = suffix;
+    FixedString<kConfigKeyLength>* field = suffix == 't' ? &settings.dataTemp
+      : suffix == 'h' ? &settings.dataHumi
+      : suffix == 'p' ? &settings.dataPress
+      : suffix == 'l' ? &settings.dataLight
+      : &settings.dataRssi;
+    field->assign(key.c_str());
+  }
+  size_t length = Payload::buildJson(sample, settings, buffer, sizeof(buffer));
+  StaticJsonDocument<1024> doc;
+  ASSERT_FALSE(deserializeJson(doc, buffer, length));
+  EXPECT_EQ(doc.size(), 8u);
+}
+
+// The MQTT publish job builds one of the two on every run
+TEST_F(PayloadTest, BuildersAllocateNothing) {
+  settings.activeLight = true;
+  settings.activeRain = true;
+
+  AllocationCounter counter;
+  for (int pass = 0; pass < 1000; pass++) {
+    sample.temperature = static_cast<float>(pass % 40);
+    Payload::buildJson(sample, settings, buffer, sizeof(buffer));
+    Payload::buildMsgPack(sample, settings, buffer, sizeof(buffer));
+  }
+  EXPECT_EQ(counter.getCount(), 0u);
+}
+
+}  // namespace
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <HTTPClient.h>
+
+#include "host.h"
+#include "publicip.h"
+
+namespace {
+
+using PublicIp::Result;
+
+constexpr const char* kUrl = "http://api.ipify.org";
+constexpr const char* kLocalUrl = "http://192.168.1.2/ip";
+
+class PublicIpTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    // The cache outlives a test, an empty URL clears it
+    PublicIp::refresh("");
+    Host::Http::setResponse(200, "203.0.113.7\n");
+  }
+};
+
+TEST_F(PublicIpTest, CachesTheAddressForTheTtl) {
+  EXPECT_STREQ(PublicIp::get(), "unknown");
+  EXPECT_TRUE(PublicIp::isStale(kUrl));
+
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Changed);
+  EXPECT_STREQ(PublicIp::get(), "203.0.113.7");
+  EXPECT_EQ(Host::Http::getLastUrl(), kUrl);
+  EXPECT_FALSE(PublicIp::isStale(kUrl));
+
+  Host::advanceMs(PublicIp::kTtlMs - 1);
+  EXPECT_FALSE(PublicIp::isStale(kUrl));
+  Host::advanceMs(1);
+  EXPECT_TRUE(PublicIp::isStale(kUrl));
+
+  uint32_t requests = Host::Http::getRequestCount();
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Unchanged);
+  EXPECT_EQ(Host::Http::getRequestCount(), requests + 1);
+  EXPECT_FALSE(PublicIp::isStale(kUrl));
+}
+
+TEST_F(PublicIpTest, AnotherUrlLooksUpAgain) {
+  ASSERT_EQ(PublicIp::refresh(kUrl), Result::Changed);
+  EXPECT_TRUE(PublicIp::isStale(kLocalUrl));
+
+  Host::Http::setResponse(200, "198.51.100.4");
+  EXPECT_EQ(PublicIp::refresh(kLocalUrl), Result::Changed);
+  EXPECT_EQ(Host::Http::getLastUrl(), kLocalUrl);
+  EXPECT_STREQ(PublicIp::get(), "198.51.100.4");
+  EXPECT_FALSE(PublicIp::isStale(kLocalUrl));
+  EXPECT_TRUE(PublicIp::isStale(kUrl));
+}
+
+// A captive portal or proxy answers 200 with a page of its own
+TEST_F(PublicIpTest, RejectsABodyThatIsNotAnAddress) {
+  uint32_t failures = PublicIp::getLookupCount(false);
+  Host::Http::setResponse(200, "<html>Sign in to continue</html>");
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Failed);
+  EXPECT_STREQ(PublicIp::get(), "unknown");
+
+  Host::Http::setResponse(200, "");
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Failed);
+  Host::Http::setResponse(200, "1111:2222:3333:4444:5555:6666:7777:8888:9999:aaaa");
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Failed);
+  EXPECT_EQ(PublicIp::getLookupCount(false), failures + 3);
+
+  Host::Http::setResponse(200, "2001:db8::1");
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Changed);
+  EXPECT_STREQ(PublicIp::get(), "2001:db8::1");
+}
+
+TEST_F(PublicIpTest, FailedLookupKeepsTheLastAddress) {
+  ASSERT_EQ(PublicIp::refresh(kUrl), Result::Changed);
+  uint32_t successes = PublicIp::getLookupCount(true);
+  Host::advanceMs(PublicIp::kTtlMs);
+
+  Host::Http::setResponse(503, "203.0.113.99");
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Failed);
+  Host::Http::setResponse(HTTPC_ERROR_READ_TIMEOUT, "");
+  EXPECT_EQ(PublicIp::refresh(kUrl), Result::Failed);
+  EXPECT_EQ(PublicIp::refresh("not a url"), Result::Failed);
+
+  EXPECT_STREQ(PublicIp::get(), "203.0.113.7");
+  EXPECT_TRUE(PublicIp::isStale(kUrl));
+  EXPECT_EQ(PublicIp::getLookupCount(true), successes);
+}
+
+TEST_F(PublicIpTest, EmptyUrlTurnsLookupsOff) {
+  ASSERT_EQ(PublicIp::refresh(kUrl), Result::Changed);
+  EXPECT_TRUE(PublicIp::isStale(""));
+
+  uint32_t requests = Host::Http::getRequestCount();
+  EXPECT_EQ(PublicIp::refresh(""), Result::Off);
+  EXPECT_EQ(Host::Http::getRequestCount(), requests);
+  EXPECT_STREQ(PublicIp::get(), "unknown");
+  EXPECT_FALSE(PublicIp::isStale(""));
+}
+
+}  // namespace
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include <LittleFS.h>
+
+#include "host.h"
+#include "rain.h"
+
+namespace {
+
+constexpr float kTipMm = 0.2f;
+constexpr uint32_t kStartUnix = 1750000000;
+
+class RainGaugeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    // A few seconds after boot, as on the device
+    Host::advanceMs(5000);
+    Host::setUnixTime(kStartUnix);
+    ASSERT_TRUE(LittleFS.begin());
+    Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+    RainGauge::begin(true, kTipMm);
+  }
+
+  // One bucket tip: the reed contact closes for lowMs
+  static void tip(uint32_t lowMs = 50) {
+    Host::Gpio::setInput(RainGauge::kRainGaugePin, LOW);
+    Host::advanceMs(lowMs);
+    Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+    Host::advanceMs(300);
+  }
+
+  static void advanceMinutes(uint32_t minutes) {
+    for (uint32_t i = 0; i < minutes; i++) {
+      Host::advanceMs(60000);
+      RainGauge::update();
+    }
+  }
+};
+
+TEST_F(RainGaugeTest, CountsTipsIntoBothWindows) {
+  tip();
+  tip();
+  tip();
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 3u);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLastHourMm(), 3 * kTipMm);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 3 * kTipMm);
+}
+
+TEST_F(RainGaugeTest, IgnoresBounceAndStuckContacts) {
+  tip(5);
+  tip(1500);
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 0u);
+
+  // Two closures 100 ms apart count once
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, LOW);
+  Host::advanceMs(50);
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+  Host::advanceMs(50);
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, LOW);
+  Host::advanceMs(50);
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 1u);
+}
+
+TEST_F(RainGaugeTest, TipsLeaveTheHourWindowFirst) {
+  tip();
+  RainGauge::update();
+  advanceMinutes(30);
+  tip();
+  RainGauge::update();
+
+  advanceMinutes(31);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLastHourMm(), kTipMm);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 2 * kTipMm);
+
+  advanceMinutes(30);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLastHourMm(), 0);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 2 * kTipMm);
+
+  advanceMinutes(23 * 60);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 0);
+  EXPECT_EQ(RainGauge::getTotalTips(), 2u);
+}
+
+TEST_F(RainGaugeTest, WaitsForTheWallClock) {
+  Host::reset();
+  Host::advanceMs(5000);
+  Host::Gpio::setInput(RainGauge::kRainGaugePin, HIGH);
+  RainGauge::onConfigurationChanged(true, kTipMm);
+  tip();
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 0u);
+
+  // The tip waited for a time to stamp it with
+  Host::setUnixTime(kStartUnix);
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 1u);
+}
+
+// begin() again stands in for the next boot
+TEST_F(RainGaugeTest, StateSurvivesAPowerCutThroughFlash) {
+  tip();
+  tip();
+  RainGauge::update();
+  RainGauge::flush();
+
+  Host::advanceMs(5000);
+  RainGauge::begin(true, kTipMm);
+  EXPECT_EQ(RainGauge::getRestoreSource(), RainGauge::RestoreSource::Flash);
+  EXPECT_EQ(RainGauge::getTotalTips(), 2u);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLastHourMm(), 2 * kTipMm);
+}
+
+TEST_F(RainGaugeTest, SoftRestartHandsOverUnflushedTips) {
+  tip();
+  RainGauge::update();
+  uint64_t programmedBefore = Host::Fs::getProgrammedBytes();
+  RainGauge::retain();
+  EXPECT_EQ(Host::Fs::getProgrammedBytes(), programmedBefore);
+
+  RainGauge::begin(true, kTipMm);
+  EXPECT_EQ(RainGauge::getRestoreSource(), RainGauge::RestoreSource::Rtc);
+  EXPECT_EQ(RainGauge::getTotalTips(), 1u);
+
+  // Taken once: the boot after that reads flash
+  RainGauge::begin(true, kTipMm);
+  EXPECT_NE(RainGauge::getRestoreSource(), RainGauge::RestoreSource::Rtc);
+}
+
+// The RTC copy keeps tips by age bucket, they leave the windows about
+// when they would have without the restart
+TEST_F(RainGaugeTest, SoftRestartKeepsTheWindows) {
+  tip();
+  RainGauge::update();
+  advanceMinutes(5 * 60);
+  tip();
+  RainGauge::update();
+  advanceMinutes(30);
+  tip();
+  RainGauge::update();
+  advanceMinutes(10);
+  RainGauge::retain();
+
+  RainGauge::begin(true, kTipMm);
+  ASSERT_EQ(RainGauge::getRestoreSource(), RainGauge::RestoreSource::Rtc);
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 3u);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLastHourMm(), 2 * kTipMm);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 3 * kTipMm);
+
+  // The older hour tip is 61 minutes old
+  advanceMinutes(21);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLastHourMm(), kTipMm);
+  // The first tip leaves the day within a ten minute bucket of its time
+  advanceMinutes(17 * 60 + 58);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 3 * kTipMm);
+  advanceMinutes(12);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 2 * kTipMm);
+}
+
+TEST_F(RainGaugeTest, ResetClearsTheCountsAndTheFile) {
+  tip();
+  RainGauge::update();
+  RainGauge::flush();
+  RainGauge::reset();
+  EXPECT_EQ(RainGauge::getTotalTips(), 0u);
+  EXPECT_FLOAT_EQ(RainGauge::getRainLast24HoursMm(), 0);
+  EXPECT_FALSE(LittleFS.exists("/rain_state.bin"));
+}
+
+TEST_F(RainGaugeTest, DisabledGaugeCountsNothing) {
+  RainGauge::onConfigurationChanged(false, kTipMm);
+  tip();
+  RainGauge::update();
+  EXPECT_EQ(RainGauge::getTotalTips(), 0u);
+  EXPECT_FALSE(RainGauge::isEnabled());
+}
+
+}  // namespace
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "rules.h"
+
+namespace {
+
+struct Reading {
+  float values[GPIO_TRIGGER_METRIC_COUNT] = {};
+  bool valid[GPIO_TRIGGER_METRIC_COUNT] = {true, true, true, true, true, true, true};
+
+  Reading& set(GPIOTriggerMetric metric, float value) {
+    values[metric] = value;
+    valid[metric] = true;
+    return *this;
+  }
+};
+
+bool run(const char* text, const Reading& reading) {
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  EXPECT_TRUE(RuleEngine::compile(text, program, error)) << text << ": " << error.message;
+  return RuleEngine::evaluate(program, reading.values, reading.valid);
+}
+
+TEST(RuleEngineTest, ComparesOneMetric) {
+  Reading reading;
+  reading.set(GPIO_TRIGGER_METRIC_TEMPERATURE, 31);
+  EXPECT_TRUE(run("temp > 30", reading));
+  EXPECT_FALSE(run("temp < 30", reading));
+  EXPECT_TRUE(run("temperature >= 31", reading));
+  EXPECT_TRUE(run("temp <= 31", reading));
+  EXPECT_TRUE(run("temp == 31", reading));
+  EXPECT_FALSE(run("temp != 31", reading));
+}
+
+TEST(RuleEngineTest, AndBindsTighterThanOr) {
+  Reading reading;
+  reading.set(GPIO_TRIGGER_METRIC_TEMPERATURE, 20)
+      .set(GPIO_TRIGGER_METRIC_HUMIDITY, 80)
+      .set(GPIO_TRIGGER_METRIC_RAIN_1H, 3);
+  EXPECT_TRUE(run("temp > 30 and humidity > 70 or rain_1h > 2", reading));
+  EXPECT_FALSE(run("temp > 30 and (humidity > 70 or rain_1h > 2)", reading));
+  EXPECT_TRUE(run("TEMP > 30 || HUM > 70 && RAIN_1H > 2", reading));
+}
+
+TEST(RuleEngineTest, NotInvertsAndKeepsNotEqual) {
+  Reading reading;
+  reading.set(GPIO_TRIGGER_METRIC_RSSI, -70);
+  EXPECT_TRUE(run("not rssi > -60", reading));
+  EXPECT_TRUE(run("!(rssi > -60)", reading));
+  EXPECT_TRUE(run("rssi != -60", reading));
+  EXPECT_FALSE(run("not not rssi > -60", reading));
+}
+
+TEST(RuleEngineTest, MissingValueComparesFalse) {
+  Reading reading;
+  reading.valid[GPIO_TRIGGER_METRIC_LIGHT] = false;
+  EXPECT_FALSE(run("light < 10", reading));
+  EXPECT_FALSE(run("light >= 10", reading));
+  EXPECT_TRUE(run("not light < 10", reading));
+}
+
+TEST(RuleEngineTest, ReadsEveryMetricName) {
+  Reading reading;
+  reading.set(GPIO_TRIGGER_METRIC_TEMPERATURE, 1)
+      .set(GPIO_TRIGGER_METRIC_HUMIDITY, 2)
+      .set(GPIO_TRIGGER_METRIC_PRESSURE, 3)
+      .set(GPIO_TRIGGER_METRIC_LIGHT, 4)
+      .set(GPIO_TRIGGER_METRIC_RAIN_1H, 5)
+      .set(GPIO_TRIGGER_METRIC_RAIN_24H, 6)
+      .set(GPIO_TRIGGER_METRIC_RSSI, 7);
+  EXPECT_TRUE(run("temp == 1 and temperature == 1", reading));
+  EXPECT_TRUE(run("hum == 2 and humidity == 2", reading));
+  EXPECT_TRUE(run("pressure == 3 and light == 4", reading));
+  EXPECT_TRUE(run("rain_1h == 5 and rain_24h == 6 and rssi == 7", reading));
+}
+
+TEST(RuleEngineTest, ReadsSignedAndDecimalNumbers) {
+  Reading reading;
+  reading.set(GPIO_TRIGGER_METRIC_RAIN_1H, 0.25f).set(GPIO_TRIGGER_METRIC_TEMPERATURE, -4.5f);
+  EXPECT_TRUE(run("rain_1h > 0.2 and rain_1h < .3", reading));
+  EXPECT_TRUE(run("temp < -4 and temp > -5e0", reading));
+  EXPECT_TRUE(run("temp>-4.6&&temp<+0", reading));
+}
+
+TEST(RuleEngineTest, ReportsWhereCompilingStopped) {
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  EXPECT_FALSE(RuleEngine::compile("", program, error));
+  EXPECT_FALSE(RuleEngine::compile("   ", program, error));
+
+  EXPECT_FALSE(RuleEngine::compile("wind > 3", program, error));
+  EXPECT_EQ(error.position, 0);
+
+  EXPECT_FALSE(RuleEngine::compile("temp >> 3", program, error));
+  EXPECT_FALSE(RuleEngine::compile("temp > 3 and", program, error));
+  EXPECT_FALSE(RuleEngine::compile("(temp > 3", program, error));
+
+  EXPECT_FALSE(RuleEngine::compile("temp > 3 xor hum > 2", program, error));
+  EXPECT_EQ(error.position, 9);
+}
+
+TEST(RuleEngineTest, RejectsRulesOverTheProgramLimits) {
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  std::string longRule = "temp > 1";
+  for (int i = 0; i < RuleEngine::kMaxInstructions; i++) {
+    longRule += " or temp > 1";
+  }
+  EXPECT_FALSE(RuleEngine::compile(longRule.c_str(), program, error));
+  EXPECT_STREQ(error.message, "rule too long");
+
+  // Each open "or (" keeps one more operand on the stack
+  std::string nested = "temp > 1";
+  for (int i = 1; i < RuleEngine::kMaxStackDepth; i++) {
+    nested = "temp > 1 or (" + nested + ")";
+  }
+  EXPECT_TRUE(RuleEngine::compile(nested.c_str(), program, error)) << error.message;
+  nested = "temp > 1 or (" + nested + ")";
+  EXPECT_FALSE(RuleEngine::compile(nested.c_str(), program, error));
+  EXPECT_STREQ(error.message, "rule nested too deep");
+}
+
+}  // namespace
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace {
+
+uint32_t fakeNowMs = 0;
+// Unix time at fakeNowMs 0, 0 while the wall clock is unknown
+uint32_t fakeWallBaseSec = 0;
+std::string runLog;
+std::vector<uint32_t> runUnixSeconds;
+
+uint32_t nowMs() {
+  return fakeNowMs;
+}
+
+uint32_t unixSeconds() {
+  return fakeWallBaseSec == 0 ? 0 : fakeWallBaseSec + fakeNowMs / 1000;
+}
+
+void runA() {
+  runLog += 'a';
+}
+
+void runB() {
+  runLog += 'b';
+}
+
+void runStamped() {
+  runUnixSeconds.push_back(unixSeconds());
+}
+
+void runSlow() {
+  runLog += 's';
+  fakeNowMs += 40;
+}
+
+class JobTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    fakeNowMs = 1000;
+    fakeWallBaseSec = 0;
+    runLog.clear();
+    runUnixSeconds.clear();
+    table.begin({nowMs, unixSeconds});
+  }
+
+  // Runs everything due, then moves the clock by stepMs, until untilMs
+  void runUntil(uint32_t untilMs, uint32_t stepMs = 10) {
+    while (fakeNowMs < untilMs) {
+      while (table.runNext()) {
+      }
+      fakeNowMs += stepMs;
+    }
+  }
+
+  Scheduler::JobTable table;
+};
+
+TEST_F(JobTableTest, RunsPeriodicJobsOnTheirPhase) {
+  Scheduler::JobId a = table.addPeriodic("a", runA, 100);
+  table.addPeriodic("b", runB, 100, 50);
+  EXPECT_EQ(table.getJobCount(), 2);
+  EXPECT_STREQ(table.getJobName(a), "a");
+
+  runUntil(1300);
+  EXPECT_EQ(runLog, "ababab");
+  EXPECT_EQ(table.getJobStats(a).runs, 3u);
+  EXPECT_EQ(table.getJobStats(a).overruns, 0u);
+}
+
+TEST_F(JobTableTest, RunsOneJobPerCallMostOverdueFirst) {
+  table.addPeriodic("a", runA, 100, 20);
+  table.addPeriodic("b", runB, 100, 10);
+  fakeNowMs += 30;
+
+  EXPECT_TRUE(table.runNext());
+  EXPECT_EQ(runLog, "b");
+  EXPECT_TRUE(table.runNext());
+  EXPECT_EQ(runLog, "ba");
+  EXPECT_FALSE(table.runNext());
+}
+
+TEST_F(JobTableTest, IdleTimeRunsToTheNextDeadline) {
+  EXPECT_EQ(table.getIdleMs(), UINT32_MAX);
+  table.addPeriodic("a", runA, 100, 60);
+  EXPECT_EQ(table.getIdleMs(), 60u);
+  fakeNowMs += 60;
+  EXPECT_EQ(table.getIdleMs(), 0u);
+  table.runNext();
+  EXPECT_EQ(table.getIdleMs(), 100u);
+}
+
+TEST_F(JobTableTest, OneShotRunsOnceUntilScheduledAgain) {
+  Scheduler::JobId shot = table.addOneShot("shot", runA, 50);
+  runUntil(1500);
+  EXPECT_EQ(runLog, "a");
+
+  table.schedule(shot, 20);
+  runUntil(1600);
+  EXPECT_EQ(runLog, "aa");
+}
+
+TEST_F(JobTableTest, SkipsMissedPeriodsAndCountsTheOverrun) {
+  Scheduler::JobId a = table.addPeriodic("a", runA, 100);
+  fakeNowMs += 350;
+  EXPECT_TRUE(table.runNext());
+  EXPECT_FALSE(table.runNext());
+  EXPECT_EQ(table.getJobStats(a).overruns, 1u);
+  EXPECT_EQ(table.getJobStats(a).lateMaxMs, 350u);
+  // Phase kept: next run at 1400, not 1450
+  EXPECT_EQ(table.getIdleMs(), 50u);
+}
+
+TEST_F(JobTableTest, MeasuresTheRunDuration) {
+  Scheduler::JobId slow = table.addPeriodic("slow", runSlow, 100);
+  runUntil(1150);
+  EXPECT_EQ(table.getJobStats(slow).lastDurationMs, 40u);
+  EXPECT_EQ(table.getJobStats(slow).durationMaxMs, 40u);
+}
+
+TEST_F(JobTableTest, RecordsHowLateEachRunStarted) {
+  Scheduler::JobId a = table.addPeriodic("a", runA, 100);
+  fakeNowMs += 30;
+  ASSERT_TRUE(table.runNext());
+  fakeNowMs += 80;
+  ASSERT_TRUE(table.runNext());
+  EXPECT_EQ(table.getJobStats(a).runs, 2u);
+  EXPECT_EQ(table.getJobStats(a).lateSumMs, 40u);
+  EXPECT_EQ(table.getJobStats(a).lateMaxMs, 30u);
+  EXPECT_EQ(table.getJobStats(a).overruns, 0u);
+}
+
+// Uploads every 5 min at :00:10, :05:10, ... whatever the uptime
+TEST_F(JobTableTest, AlignedJobRunsOnWallClockBoundaries) {
+  constexpr uint32_t kPeriodS = 300;
+  fakeWallBaseSec = 1750000123;
+  Scheduler::JobId job = table.addPeriodic("upload", runStamped, kPeriodS * 1000, 10000);
+  table.setAligned(job, true);
+
+  runUntil(1000 + 4 * kPeriodS * 1000, 1000);
+  ASSERT_GE(runUnixSeconds.size(), 3u);
+  for (uint32_t sec : runUnixSeconds) {
+    EXPECT_EQ(sec % kPeriodS, 10u) << sec;
+  }
+  for (size_t i = 1; i < runUnixSeconds.size(); i++) {
+    EXPECT_EQ(runUnixSeconds[i] - runUnixSeconds[i - 1], kPeriodS);
+  }
+}
+
+TEST_F(JobTableTest, AlignedJobRunsOnItsPeriodUntilTheClockIsKnown) {
+  Scheduler::JobId job = table.addPeriodic("upload", runStamped, 60000);
+  table.setAligned(job, true);
+  runUntil(1000 + 150000, 1000);
+  EXPECT_EQ(runUnixSeconds, (std::vector<uint32_t>{0, 0, 0}));
+
+  // NTP answers: the next run moves onto the minute
+  fakeWallBaseSec = 1750000007;
+  runUnixSeconds.clear();
+  runUntil(1000 + 400000, 1000);
+  ASSERT_FALSE(runUnixSeconds.empty());
+  for (uint32_t sec : runUnixSeconds) {
+    EXPECT_EQ(sec % 60, 0u) << sec;
+  }
+}
+
+TEST_F(JobTableTest, EnabledJobCatchesUpOnce) {
+  Scheduler::JobId a = table.addPeriodic("a", runA, 100);
+  table.setEnabled(a, false);
+  runUntil(2000);
+  EXPECT_EQ(runLog, "");
+  EXPECT_FALSE(table.isEnabled(a));
+
+  table.setEnabled(a, true);
+  EXPECT_EQ(table.getIdleMs(), 0u);
+  EXPECT_TRUE(table.runNext());
+  EXPECT_FALSE(table.runNext());
+  EXPECT_EQ(runLog, "a");
+  EXPECT_EQ(table.getIdleMs(), 100u);
+}
+
+TEST_F(JobTableTest, ShorterPeriodCountsFromTheLastRun) {
+  Scheduler::JobId a = table.addPeriodic("a", runA, 1000);
+  ASSERT_TRUE(table.runNext());
+  fakeNowMs += 300;
+  table.setPeriod(a, 200);
+  EXPECT_EQ(table.getPeriodMs(a), 200u);
+  EXPECT_EQ(table.getIdleMs(), 0u);
+  EXPECT_TRUE(table.runNext());
+  EXPECT_EQ(table.getIdleMs(), 100u);
+}
+
+TEST_F(JobTableTest, KeepsTimeAcrossTheMillisWrap) {
+  fakeNowMs = UINT32_MAX - 250;
+  Scheduler::JobId a = table.addPeriodic("a", runA, 100);
+  for (int step = 0; step < 100; step++) {
+    while (table.runNext()) {
+    }
+    fakeNowMs += 10;
+  }
+  EXPECT_EQ(table.getJobStats(a).runs, 10u);
+  EXPECT_EQ(table.getJobStats(a).overruns, 0u);
+  EXPECT_EQ(table.getJobStats(a).lateMaxMs, 0u);
+}
+
+TEST_F(JobTableTest, RefusesMoreThanTheTableHolds) {
+  for (uint8_t i = 0; i < Scheduler::kMaxJobs; i++) {
+    EXPECT_NE(table.addPeriodic("a", runA, 100), Scheduler::kNoJob);
+  }
+  EXPECT_EQ(table.addPeriodic("a", runA, 100), Scheduler::kNoJob);
+  EXPECT_EQ(table.addOneShot("a", runA, 100), Scheduler::kNoJob);
+}
+
+}  // namespace
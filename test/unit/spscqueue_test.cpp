@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "spscqueue.h"
+
+namespace {
+
+struct Item {
+  uint32_t sequence;
+  float value;
+};
+
+TEST(SpscQueueTest, KeepsOrderAndRefusesWhenFull) {
+  SpscQueue<Item, 4> queue;
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.push({i, i * 1.5f}));
+  }
+  EXPECT_FALSE(queue.push({99, 0}));
+  EXPECT_EQ(queue.getDroppedCount(), 1u);
+  EXPECT_EQ(queue.size(), 4u);
+
+  Item item;
+  for (uint32_t i = 0; i < 4; i++) {
+    ASSERT_TRUE(queue.pop(item));
+    EXPECT_EQ(item.sequence, i);
+  }
+  EXPECT_FALSE(queue.pop(item));
+  EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(SpscQueueTest, WrapsAroundTheSlots) {
+  SpscQueue<Item, 2> queue;
+  Item item;
+  for (uint32_t i = 0; i < 1000; i++) {
+    ASSERT_TRUE(queue.push({i, 0}));
+    ASSERT_TRUE(queue.pop(item));
+    ASSERT_EQ(item.sequence, i);
+  }
+  EXPECT_EQ(queue.getDroppedCount(), 0u);
+}
+
+// The device case: a sensing task producing, the network task consuming
+TEST(SpscQueueTest, PassesEveryItemBetweenThreads) {
+  constexpr uint32_t kItems = 200000;
+  SpscQueue<Item, 8> queue;
+
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < kItems; i++) {
+      while (!queue.push({i, static_cast<float>(i)})) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  Item item;
+  while (expected < kItems) {
+    if (!queue.pop(item)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(item.sequence, expected);
+    ASSERT_EQ(item.value, static_cast<float>(expected));
+    expected++;
+  }
+  producer.join();
+  EXPECT_EQ(queue.size(), 0u);
+}
+
+}  // namespace
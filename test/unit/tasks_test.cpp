@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "config.h"
+#include "tasklink.h"
+
+// The station's two tasks as host threads, going through TaskLink the
+// way wx-station.ino does. Meant for the thread sanitizer
+// (-DWX_SANITIZE=thread), which fails the run on any data race.
+namespace {
+
+constexpr int kSamples = 20000;
+constexpr int kFaultEvery = 2000;
+
+std::atomic<bool> sensingDone{false};
+
+// The reading's sequence number rides in rssi
+TaskLink::Sample makeSample(int sequence) {
+  TaskLink::Sample sample = {};
+  sample.temperature = static_cast<float>(sequence % 40);
+  sample.rssi = sequence;
+  return sample;
+}
+
+TEST(TasksTest, SensingAndNetworkShareOnlyTheLink) {
+  // startTasks(): the handle is in place before the other thread can read it
+  TaskLink::setSensingTask(xTaskGetCurrentTaskHandle());
+  ASSERT_TRUE(TaskLink::isSensingTask());
+
+  int lastReceived = -1;
+  int linesSent = 0;
+  int faultsFollowed = 0;
+  bool networkOnSensingTask = false;
+  uint16_t changesPushed = CONFIG_SUBSYSTEM_NONE;
+  std::thread networkTask([&] {
+    // Not the sensing task, logs go out at once
+    networkOnSensingTask = TaskLink::isSensingTask() || TaskLink::deferLogLine("SYST | Network task started");
+    bool followed = false;
+    int pass = 0;
+    TaskLink::Sample sample;
+    char text[TaskLink::kLogLineLength];
+    for (;;) {
+      // Read before the last drain, so nothing pushed after it is missed
+      bool done = sensingDone;
+      if (TaskLink::receiveSample(sample)) {
+        ASSERT_GT(sample.rssi, lastReceived);
+        lastReceived = sample.rssi;
+      }
+      while (TaskLink::takeLogLine(text, sizeof(text))) {
+        ASSERT_EQ(strncmp(text, "SENS | ", 7), 0) << text;
+        linesSent++;
+      }
+      if (TaskLink::followSensorFault(followed) && followed) {
+        faultsFollowed++;
+      }
+      // applyConfigChanges() with a different subsystem now and then
+      if (++pass % 50 == 0 && changesPushed != 0xff) {
+        uint16_t changed = 1 << ((pass / 50) % 8);
+        if (TaskLink::pushConfigChange(changed)) {
+          changesPushed |= changed;
+        }
+      }
+      if (done) {
+        break;
+      }
+      std::this_thread::yield();
+    }
+  });
+
+  // Sensing task: readings while healthy, a fault now and then that
+  // pauses them for a few passes
+  int sampled = 0;
+  int faults = 0;
+  int faultPasses = 0;
+  uint16_t changesTaken = CONFIG_SUBSYSTEM_NONE;
+  char line[48];
+  while (sampled < kSamples || TaskLink::hasSensorFault()) {
+    changesTaken |= TaskLink::takeConfigChanges();
+    if (TaskLink::hasSensorFault()) {
+      // Gives the network thread time to see the fault, like the tick
+      // delay between passes on the device
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      if (++faultPasses % 4 == 0) {
+        TaskLink::setSensorFault(false);
+        ASSERT_TRUE(TaskLink::deferLogLine("SENS | Sensor restored"));
+      }
+      continue;
+    }
+
+    while (!TaskLink::pushSample(makeSample(sampled))) {
+      std::this_thread::yield();
+    }
+    sampled++;
+    if (sampled % kFaultEvery == 0) {
+      TaskLink::setSensorFault(true);
+      faults++;
+      snprintf(line, sizeof(line), "SENS | Sensor fault %d", faults);
+      ASSERT_TRUE(TaskLink::deferLogLine(line));
+    }
+  }
+  sensingDone = true;
+  networkTask.join();
+  changesTaken |= TaskLink::takeConfigChanges();
+
+  EXPECT_FALSE(networkOnSensingTask);
+  EXPECT_EQ(lastReceived, sampled - 1);
+  // One fault and one restored line per fault
+  EXPECT_EQ(linesSent, 2 * faults);
+  EXPECT_EQ(TaskLink::getDroppedLogLines(), 0u);
+  EXPECT_GT(faultsFollowed, 0);
+  EXPECT_LE(faultsFollowed, faults);
+  EXPECT_EQ(changesTaken, changesPushed);
+
+  TaskLink::setSensingTask(nullptr);
+  EXPECT_FALSE(TaskLink::isSensingTask());
+}
+
+}  // namespace
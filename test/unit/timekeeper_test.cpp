@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <LittleFS.h>
+
+#include <time.h>
+
+#include "host.h"
+#include "timekeeper.h"
+
+namespace {
+
+using TimeKeeper::Source;
+
+constexpr uint32_t kNtpSec = 1750000000;
+
+class TimeKeeperTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    ASSERT_TRUE(LittleFS.begin());
+    TimeKeeper::begin();
+  }
+
+  // NTP answers and the network task writes the checkpoint
+  static void syncTo(uint32_t sec) {
+    Host::Sntp::answer(sec);
+    TimeKeeper::SyncRecord record;
+    ASSERT_TRUE(TimeKeeper::update(record));
+  }
+
+  // The wall clock is lost, flash keeps the checkpoint
+  static void powerCut() {
+    Host::setUnixTime(0);
+    TimeKeeper::begin();
+  }
+
+  // The RTC keeps counting, as in ESP.restart()
+  static void restart() {
+    Host::advanceMs(1000);
+    TimeKeeper::begin();
+  }
+};
+
+TEST_F(TimeKeeperTest, NtpTimeIsCarriedOverARestart) {
+  EXPECT_EQ(TimeKeeper::getSource(), Source::None);
+  syncTo(kNtpSec);
+  EXPECT_EQ(TimeKeeper::getSource(), Source::Ntp);
+
+  restart();
+  EXPECT_EQ(TimeKeeper::getSource(), Source::Rtc);
+  EXPECT_TRUE(TimeKeeper::isTrusted());
+  EXPECT_GE(static_cast<uint32_t>(time(nullptr)), kNtpSec);
+
+  // And over the next one too
+  restart();
+  EXPECT_EQ(TimeKeeper::getSource(), Source::Rtc);
+}
+
+TEST_F(TimeKeeperTest, CheckpointBootStartsUntrusted) {
+  syncTo(kNtpSec);
+  powerCut();
+  EXPECT_EQ(TimeKeeper::getSource(), Source::Checkpoint);
+  EXPECT_FALSE(TimeKeeper::isTrusted());
+  EXPECT_GE(static_cast<uint32_t>(time(nullptr)), kNtpSec);
+}
+
+// The RTC kept counting from a checkpoint time, which made it look like
+// a trusted carried-over clock after the restart
+TEST_F(TimeKeeperTest, RestartDoesNotLaunderACheckpointTime) {
+  syncTo(kNtpSec);
+  powerCut();
+  ASSERT_EQ(TimeKeeper::getSource(), Source::Checkpoint);
+
+  restart();
+  EXPECT_EQ(TimeKeeper::getSource(), Source::Checkpoint);
+  EXPECT_FALSE(TimeKeeper::isTrusted());
+  restart();
+  EXPECT_FALSE(TimeKeeper::isTrusted());
+
+  syncTo(kNtpSec + 7200);
+  restart();
+  EXPECT_EQ(TimeKeeper::getSource(), Source::Rtc);
+  EXPECT_TRUE(TimeKeeper::isTrusted());
+}
+
+}  // namespace
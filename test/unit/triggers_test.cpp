@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include "triggers.h"
+
+namespace {
+
+class TriggerEngineTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (GPIOTriggerConfig& trigger : triggers) {
+      trigger = {};
+      trigger.gpioPin = GPIO_TRIGGER_PIN_DISABLED;
+    }
+  }
+
+  GPIOTriggerConfig& level(uint8_t index, GPIOTriggerMetric metric, float on, float off) {
+    GPIOTriggerConfig& trigger = triggers[index];
+    trigger.enabled = true;
+    trigger.value = metric;
+    trigger.condition = GPIO_TRIGGER_CONDITION_LEVEL;
+    trigger.triggerOnValue = on;
+    trigger.triggerOffValue = off;
+    TriggerEngine::setActive(index, true);
+    return trigger;
+  }
+
+  uint8_t feed(GPIOTriggerMetric metric, float value, uint32_t atMs) {
+    TriggerEngine::Sample sample = {};
+    sample.values[metric] = value;
+    sample.valid[metric] = true;
+    sample.atMs = atMs;
+    return TriggerEngine::evaluate(triggers, sample, changes);
+  }
+
+  GPIOTriggerConfig triggers[GPIO_TRIGGER_COUNT];
+  TriggerEngine::Change changes[GPIO_TRIGGER_COUNT];
+};
+
+TEST_F(TriggerEngineTest, SwitchesWithHysteresis) {
+  level(0, GPIO_TRIGGER_METRIC_TEMPERATURE, 30, 28);
+
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 29, 0), 0);
+  ASSERT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 30, 1000), 1);
+  EXPECT_EQ(changes[0].index, 0);
+  EXPECT_TRUE(changes[0].on);
+  EXPECT_FLOAT_EQ(changes[0].value, 30);
+
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 29, 2000), 0);
+  EXPECT_TRUE(TriggerEngine::isOn(0));
+  ASSERT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 28, 3000), 1);
+  EXPECT_FALSE(changes[0].on);
+}
+
+TEST_F(TriggerEngineTest, InvertedThresholdsSwitchOnBelow) {
+  level(1, GPIO_TRIGGER_METRIC_HUMIDITY, 20, 25);
+  ASSERT_EQ(feed(GPIO_TRIGGER_METRIC_HUMIDITY, 19, 0), 1);
+  EXPECT_TRUE(changes[0].on);
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_HUMIDITY, 24, 1000), 0);
+  ASSERT_EQ(feed(GPIO_TRIGGER_METRIC_HUMIDITY, 25, 2000), 1);
+  EXPECT_FALSE(changes[0].on);
+}
+
+TEST_F(TriggerEngineTest, HoldTimeDelaysTheNextSwitch) {
+  level(0, GPIO_TRIGGER_METRIC_TEMPERATURE, 30, 28).minOnSec = 60;
+  ASSERT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 31, 0), 1);
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 20, 30000), 0);
+  EXPECT_TRUE(TriggerEngine::isOn(0));
+  // Retried with the next reading once the hold is over
+  ASSERT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 20, 60000), 1);
+  EXPECT_FALSE(changes[0].on);
+}
+
+TEST_F(TriggerEngineTest, SkipsReadingsWithoutTheMetric) {
+  level(0, GPIO_TRIGGER_METRIC_LIGHT, 100, 50);
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 500, 0), 0);
+  EXPECT_FALSE(TriggerEngine::isOn(0));
+}
+
+TEST_F(TriggerEngineTest, RateNeedsTheMinimumSpan) {
+  GPIOTriggerConfig& trigger = level(0, GPIO_TRIGGER_METRIC_PRESSURE, -2, -1);
+  trigger.condition = GPIO_TRIGGER_CONDITION_RATE;
+
+  // Falling 0.5 hPa per minute, 30 hPa per hour
+  uint32_t atMs = 0;
+  float pressure = 1013;
+  uint8_t count = 0;
+  while (atMs < TriggerEngine::kRateMinSpanMs) {
+    EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_PRESSURE, pressure, atMs), 0);
+    atMs += TriggerEngine::kRateStepMs;
+    pressure -= 0.5f;
+  }
+  count = feed(GPIO_TRIGGER_METRIC_PRESSURE, pressure, atMs);
+  ASSERT_EQ(count, 1);
+  EXPECT_TRUE(changes[0].on);
+  EXPECT_NEAR(changes[0].value, -30, 0.01);
+}
+
+TEST_F(TriggerEngineTest, RulesUseTheWholeReading) {
+  triggers[2].enabled = true;
+  triggers[2].condition = GPIO_TRIGGER_CONDITION_RULE;
+  RuleEngine::Program program;
+  RuleEngine::Error error;
+  ASSERT_TRUE(RuleEngine::compile("temp > 30 and humidity > 70", program, error));
+  TriggerEngine::setRule(2, program);
+  TriggerEngine::setActive(2, true);
+
+  TriggerEngine::Sample sample = {};
+  sample.values[GPIO_TRIGGER_METRIC_TEMPERATURE] = 31;
+  sample.values[GPIO_TRIGGER_METRIC_HUMIDITY] = 60;
+  sample.valid[GPIO_TRIGGER_METRIC_TEMPERATURE] = true;
+  sample.valid[GPIO_TRIGGER_METRIC_HUMIDITY] = true;
+  EXPECT_EQ(TriggerEngine::evaluate(triggers, sample, changes), 0);
+
+  sample.values[GPIO_TRIGGER_METRIC_HUMIDITY] = 75;
+  ASSERT_EQ(TriggerEngine::evaluate(triggers, sample, changes), 1);
+  EXPECT_EQ(changes[0].index, 2);
+  EXPECT_FLOAT_EQ(changes[0].value, 1);
+}
+
+TEST_F(TriggerEngineTest, DeactivatedSlotsAreOffAndSkipped) {
+  level(0, GPIO_TRIGGER_METRIC_TEMPERATURE, 30, 28);
+  level(3, GPIO_TRIGGER_METRIC_TEMPERATURE, 10, 5);
+  EXPECT_EQ(TriggerEngine::getActiveCount(), 2);
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 35, 0), 2);
+
+  TriggerEngine::setActive(0, false);
+  EXPECT_FALSE(TriggerEngine::isActive(0));
+  EXPECT_FALSE(TriggerEngine::isOn(0));
+  EXPECT_EQ(TriggerEngine::getActiveCount(), 1);
+  EXPECT_EQ(feed(GPIO_TRIGGER_METRIC_TEMPERATURE, 0, 1000), 1);
+  EXPECT_EQ(changes[0].index, 3);
+}
+
+}  // namespace
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "host.h"
+#include "webactions.h"
+
+namespace {
+
+using WebActions::Action;
+
+class WebActionsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Host::reset();
+    WebActions::begin();
+    // The queue outlives a test when the suite runs in one process
+    WebActions::Entry entry;
+    Config applied = {};
+    while (runNext(entry, applied)) {
+    }
+  }
+
+  static Config withAltitude(float altitude) {
+    Config updated = {};
+    updated.altitude = altitude;
+    return updated;
+  }
+
+  // What the network task does in serviceWeb()
+  static bool runNext(WebActions::Entry& entry, Config& applied) {
+    if (!WebActions::peek(entry, applied)) {
+      return false;
+    }
+    WebActions::complete(entry.ticket);
+    return true;
+  }
+};
+
+TEST_F(WebActionsTest, RunsActionsInOrder) {
+  uint32_t reload = WebActions::push(Action::ReloadConfig);
+  uint32_t factory = WebActions::push(Action::FactoryReset);
+  ASSERT_NE(reload, WebActions::kNoTicket);
+  EXPECT_GT(factory, reload);
+
+  WebActions::Entry entry;
+  Config applied = {};
+  ASSERT_TRUE(runNext(entry, applied));
+  EXPECT_EQ(entry.action, Action::ReloadConfig);
+  EXPECT_TRUE(WebActions::isDone(reload));
+  EXPECT_FALSE(WebActions::isDone(factory));
+
+  ASSERT_TRUE(runNext(entry, applied));
+  EXPECT_EQ(entry.action, Action::FactoryReset);
+  EXPECT_TRUE(WebActions::isDone(factory));
+  EXPECT_FALSE(runNext(entry, applied));
+}
+
+// The old single slot let a save overwrite a reboot that had not run yet
+TEST_F(WebActionsTest, SaveDoesNotCancelQueuedReboot) {
+  uint32_t reboot = WebActions::push(Action::Reboot);
+  uint32_t save = WebActions::pushConfig(withAltitude(312.0f));
+  ASSERT_NE(save, WebActions::kNoTicket);
+  EXPECT_EQ(WebActions::getDepth(), 2);
+
+  WebActions::Entry entry;
+  Config applied = {};
+  ASSERT_TRUE(runNext(entry, applied));
+  EXPECT_EQ(entry.action, Action::Reboot);
+  EXPECT_EQ(entry.ticket, reboot);
+  ASSERT_TRUE(runNext(entry, applied));
+  EXPECT_EQ(entry.action, Action::ApplyConfig);
+  EXPECT_FLOAT_EQ(applied.altitude, 312.0f);
+}
+
+TEST_F(WebActionsTest, SavesCoalesceUntilTheyStart) {
+  uint32_t first = WebActions::pushConfig(withAltitude(100.0f));
+  uint32_t second = WebActions::pushConfig(withAltitude(200.0f));
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(WebActions::getDepth(), 1);
+
+  WebActions::Entry entry;
+  Config applied = {};
+  ASSERT_TRUE(WebActions::peek(entry, applied));
+  EXPECT_FLOAT_EQ(applied.altitude, 200.0f);
+
+  // Started, so the next save queues behind it and leaves it alone
+  uint32_t third = WebActions::pushConfig(withAltitude(300.0f));
+  EXPECT_NE(third, first);
+  ASSERT_TRUE(WebActions::peek(entry, applied));
+  EXPECT_EQ(entry.ticket, first);
+  EXPECT_FLOAT_EQ(applied.altitude, 200.0f);
+  WebActions::complete(entry.ticket);
+
+  ASSERT_TRUE(runNext(entry, applied));
+  EXPECT_EQ(entry.ticket, third);
+  EXPECT_FLOAT_EQ(applied.altitude, 300.0f);
+}
+
+TEST_F(WebActionsTest, CompleteOnlyClearsTheMatchingEntry) {
+  uint32_t reboot = WebActions::push(Action::Reboot);
+  WebActions::complete(reboot + 1);
+  EXPECT_EQ(WebActions::getDepth(), 1);
+  EXPECT_FALSE(WebActions::isDone(reboot));
+
+  WebActions::complete(reboot);
+  EXPECT_EQ(WebActions::getDepth(), 0);
+  WebActions::complete(reboot);
+  EXPECT_TRUE(WebActions::isDone(reboot));
+}
+
+TEST_F(WebActionsTest, RefusesWhenFull) {
+  for (uint8_t i = 0; i < WebActions::kCapacity; i++) {
+    ASSERT_NE(WebActions::push(Action::ReloadConfig), WebActions::kNoTicket);
+  }
+  EXPECT_EQ(WebActions::push(Action::Reboot), WebActions::kNoTicket);
+  EXPECT_EQ(WebActions::pushConfig(withAltitude(1.0f)), WebActions::kNoTicket);
+  EXPECT_FALSE(WebActions::isDone(WebActions::kNoTicket));
+}
+
+// The ticket queue only, from the threads of several savers while the
+// network task takes its time applying: pushConfig() must return at once
+// instead of waiting for the apply, and no save may be lost. The HTTP
+// handlers around it do not build on the host.
+TEST_F(WebActionsTest, PushConfigReturnsAtOnceUnderConcurrentSavers) {
+  constexpr int kSavers = 6;
+  constexpr int kSavesPerSaver = 200;
+  constexpr auto kApplyTime = std::chrono::milliseconds(2);
+  // The old handlers blocked for up to 3 s, a queued push takes
+  // microseconds. Generous for a loaded CI machine.
+  constexpr auto kMaxPushTime = std::chrono::milliseconds(50);
+
+  std::atomic<bool> stop{false};
+  std::atomic<int> applies{0};
+  std::atomic<float> lastApplied{0.0f};
+  std::thread networkTask([&] {
+    WebActions::Entry entry;
+    Config applied = {};
+    while (!stop.load() || WebActions::getDepth() > 0) {
+      if (!WebActions::peek(entry, applied)) {
+        std::this_thread::yield();
+        continue;
+      }
+      // Saving the file and restarting subsystems, outside the queue lock
+      std::this_thread::sleep_for(kApplyTime);
+      lastApplied.store(applied.altitude);
+      applies++;
+      WebActions::complete(entry.ticket);
+    }
+  });
+
+  std::vector<std::chrono::steady_clock::duration> slowest(kSavers);
+  std::vector<uint32_t> lastTicket(kSavers);
+  std::vector<std::thread> savers;
+  for (int saver = 0; saver < kSavers; saver++) {
+    savers.emplace_back([&, saver] {
+      for (int save = 0; save < kSavesPerSaver; save++) {
+        auto startedAt = std::chrono::steady_clock::now();
+        uint32_t ticket = WebActions::pushConfig(withAltitude(static_cast<float>(saver * 1000 + save)));
+        slowest[saver] = std::max(slowest[saver], std::chrono::steady_clock::now() - startedAt);
+        ASSERT_NE(ticket, WebActions::kNoTicket);
+        lastTicket[saver] = ticket;
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (std::thread& saver : savers) {
+    saver.join();
+  }
+  uint32_t finalTicket = WebActions::pushConfig(withAltitude(-1.0f));
+  stop.store(true);
+  networkTask.join();
+
+  for (int saver = 0; saver < kSavers; saver++) {
+    EXPECT_LT(slowest[saver], kMaxPushTime) << "saver " << saver;
+    EXPECT_TRUE(WebActions::isDone(lastTicket[saver]));
+  }
+  // Saves coalesce while one applies, so far fewer applies than saves,
+  // and the last one wins
+  EXPECT_TRUE(WebActions::isDone(finalTicket));
+  EXPECT_LT(applies.load(), kSavers * kSavesPerSaver);
+  EXPECT_FLOAT_EQ(lastApplied.load(), -1.0f);
+}
+
+}  // namespace
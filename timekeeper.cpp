@@ -0,0 +1,296 @@
+#include "timekeeper.h"
+
+#include <LittleFS.h>
+#include <esp_attr.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+#include <time.h>
+#include "rtcmemory.h"
+
+namespace TimeKeeper {
+
+namespace {
+
+constexpr const char* kCheckpointFile = "/clock.bin";
+constexpr uint32_t kCheckpointVersion = 1;
+// Changes with the RtcRecord layout
+constexpr uint32_t kRtcMagic = 0x54494d32;
+// Weight of a new drift sample in the running estimate
+constexpr float kDriftSmoothing = 0.25f;
+// Two answers closer than this say little about drift
+constexpr int64_t kMinDriftSpanUs = 10LL * 60LL * 1000000LL;
+
+struct Checkpoint {
+  uint32_t version;
+  uint32_t epochSec;
+  uint32_t lastSyncSec;
+  float driftPpm;
+  bool driftValid;
+};
+
+// Survives a software restart, not a power cut
+struct RtcRecord {
+  uint32_t magic;
+  uint32_t lastSyncSec;
+  float driftPpm;
+  bool driftValid;
+  // The time the RTC carries came from NTP, or from an RTC that did
+  bool timeTrusted;
+};
+
+RTC_NOINIT_ATTR RtcRecord rtcRecord;
+static_assert(sizeof(RtcRecord) <= RtcMemory::kTimeKeeperBytes, "RtcRecord outgrew its RTC memory budget");
+
+Source source = Source::None;
+float driftPpm = 0.0f;
+bool driftValid = false;
+uint32_t lastSyncSec = 0;
+unsigned long lastCheckpointAtMs = 0;
+
+// Written from the lwIP task by the SNTP hook, read by the network task
+// and the web server
+portMUX_TYPE historyLock = portMUX_INITIALIZER_UNLOCKED;
+SyncRecord history[kHistoryLength] = {};
+uint8_t historyHead = 0;
+uint8_t historyCount = 0;
+uint32_t syncCount = 0;
+uint32_t reportedSyncCount = 0;
+int64_t lastSyncUptimeUs = 0;
+
+uint32_t nowSec() {
+  return static_cast<uint32_t>(time(nullptr));
+}
+
+void setSeconds(uint32_t sec, int32_t usec = 0) {
+  timeval tv = {static_cast<time_t>(sec), usec};
+  settimeofday(&tv, nullptr);
+}
+
+bool loadCheckpoint(Checkpoint& checkpoint) {
+  if (!LittleFS.exists(kCheckpointFile)) {
+    return false;
+  }
+
+  File file = LittleFS.open(kCheckpointFile, "r");
+  if (!file) {
+    return false;
+  }
+
+  size_t bytesRead = file.read(reinterpret_cast<uint8_t*>(&checkpoint), sizeof(checkpoint));
+  file.close();
+  return bytesRead == sizeof(checkpoint)
+    && checkpoint.version == kCheckpointVersion
+    && checkpoint.epochSec >= kValidEpochSec;
+}
+
+bool saveCheckpoint() {
+  Checkpoint checkpoint = {};
+  checkpoint.version = kCheckpointVersion;
+  checkpoint.epochSec = nowSec();
+  checkpoint.lastSyncSec = lastSyncSec;
+  checkpoint.driftPpm = driftPpm;
+  checkpoint.driftValid = driftValid;
+
+  File file = LittleFS.open(kCheckpointFile, "w");
+  if (!file) {
+    return false;
+  }
+
+  size_t bytesWritten = file.write(reinterpret_cast<const uint8_t*>(&checkpoint), sizeof(checkpoint));
+  file.close();
+  return bytesWritten == sizeof(checkpoint);
+}
+
+void saveRtcRecord() {
+  rtcRecord.magic = kRtcMagic;
+  rtcRecord.lastSyncSec = lastSyncSec;
+  rtcRecord.driftPpm = driftPpm;
+  rtcRecord.driftValid = driftValid;
+  rtcRecord.timeTrusted = isTrusted();
+}
+
+// The drift since the last answer is not corrected by anyone until the
+// next one, so a restart in between carries it over
+void correctCarriedOverTime() {
+  if (rtcRecord.magic != kRtcMagic || !rtcRecord.driftValid || rtcRecord.lastSyncSec == 0) {
+    return;
+  }
+
+  timeval now;
+  gettimeofday(&now, nullptr);
+  if (static_cast<uint32_t>(now.tv_sec) <= rtcRecord.lastSyncSec) {
+    return;
+  }
+
+  int64_t elapsedSec = static_cast<int64_t>(now.tv_sec) - rtcRecord.lastSyncSec;
+  int64_t correctionUs = -static_cast<int64_t>(rtcRecord.driftPpm * static_cast<float>(elapsedSec));
+  int64_t correctedUs = static_cast<int64_t>(now.tv_sec) * 1000000LL + now.tv_usec + correctionUs;
+  setSeconds(static_cast<uint32_t>(correctedUs / 1000000LL), static_cast<int32_t>(correctedUs % 1000000LL));
+}
+
+void recordSync(const SyncRecord& record, int64_t offsetUs) {
+  int64_t uptimeUs = esp_timer_get_time();
+
+  portENTER_CRITICAL(&historyLock);
+  // A stepped answer corrects a provisional time, not drift
+  if (!record.stepped && syncCount > 0 && uptimeUs - lastSyncUptimeUs >= kMinDriftSpanUs) {
+    float sample = -static_cast<float>(offsetUs) * 1000000.0f / static_cast<float>(uptimeUs - lastSyncUptimeUs);
+    driftPpm = driftValid ? driftPpm + (sample - driftPpm) * kDriftSmoothing : sample;
+    driftValid = true;
+  }
+  history[historyHead] = record;
+  historyHead = (historyHead + 1) % kHistoryLength;
+  if (historyCount < kHistoryLength) {
+    historyCount++;
+  }
+  syncCount++;
+  lastSyncUptimeUs = uptimeUs;
+  lastSyncSec = record.atSec;
+  source = Source::Ntp;
+  portEXIT_CRITICAL(&historyLock);
+
+  saveRtcRecord();
+}
+
+void applyNtpTime(const timeval& ntp) {
+  timeval now;
+  gettimeofday(&now, nullptr);
+  int64_t offsetUs = (static_cast<int64_t>(ntp.tv_sec) - now.tv_sec) * 1000000LL + (ntp.tv_usec - now.tv_usec);
+  int64_t offsetMs = offsetUs / 1000LL;
+
+  SyncRecord record = {};
+  record.atSec = static_cast<uint32_t>(ntp.tv_sec);
+  record.offsetMs = static_cast<int32_t>(offsetMs > INT32_MAX ? INT32_MAX : (offsetMs < INT32_MIN ? INT32_MIN : offsetMs));
+  record.stepped = offsetMs > kSlewLimitMs || offsetMs < -kSlewLimitMs;
+
+  if (record.stepped) {
+    settimeofday(&ntp, nullptr);
+  } else {
+    timeval delta = {static_cast<time_t>(offsetUs / 1000000LL), static_cast<suseconds_t>(offsetUs % 1000000LL)};
+    adjtime(&delta, nullptr);
+  }
+  sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+
+  recordSync(record, offsetUs);
+}
+
+}  // namespace
+
+void begin() {
+  timeval now;
+  gettimeofday(&now, nullptr);
+
+  source = Source::None;
+  if (static_cast<uint32_t>(now.tv_sec) >= kValidEpochSec) {
+    // Kept counting through the restart, but it is only as good as the
+    // time the last boot had: a checkpoint time stays one until NTP
+    if (rtcRecord.magic == kRtcMagic && rtcRecord.timeTrusted) {
+      correctCarriedOverTime();
+      source = Source::Rtc;
+    } else {
+      source = Source::Checkpoint;
+    }
+  } else {
+    Checkpoint checkpoint;
+    if (loadCheckpoint(checkpoint)) {
+      setSeconds(checkpoint.epochSec);
+      source = Source::Checkpoint;
+    }
+  }
+
+  if (rtcRecord.magic == kRtcMagic) {
+    driftPpm = rtcRecord.driftPpm;
+    driftValid = rtcRecord.driftValid;
+    lastSyncSec = rtcRecord.lastSyncSec;
+  } else {
+    Checkpoint checkpoint;
+    if (loadCheckpoint(checkpoint)) {
+      driftPpm = checkpoint.driftPpm;
+      driftValid = checkpoint.driftValid;
+      lastSyncSec = checkpoint.lastSyncSec;
+    }
+  }
+  saveRtcRecord();
+  lastCheckpointAtMs = millis();
+}
+
+void startSntp(const char* primary, const char* secondary, const char* tertiary) {
+  sntp_set_sync_interval(kSyncIntervalMs);
+  configTime(0, 0, primary, secondary, tertiary);
+}
+
+bool update(SyncRecord& record) {
+  if (source != Source::None && millis() - lastCheckpointAtMs >= kCheckpointIntervalMs) {
+    saveCheckpoint();
+    lastCheckpointAtMs = millis();
+  }
+
+  bool answered = false;
+  portENTER_CRITICAL(&historyLock);
+  if (reportedSyncCount != syncCount) {
+    reportedSyncCount = syncCount;
+    record = history[(historyHead + kHistoryLength - 1) % kHistoryLength];
+    answered = true;
+  }
+  portEXIT_CRITICAL(&historyLock);
+
+  // The first answer after a checkpoint boot is worth keeping at once
+  if (answered && record.stepped) {
+    saveCheckpoint();
+    lastCheckpointAtMs = millis();
+  }
+  return answered;
+}
+
+Source getSource() {
+  return source;
+}
+
+const char* getSourceName(Source clockSource) {
+  switch (clockSource) {
+    case Source::Checkpoint: return "checkpoint";
+    case Source::Rtc:        return "rtc";
+    case Source::Ntp:        return "ntp";
+    case Source::None:       break;
+  }
+  return "none";
+}
+
+bool isTrusted() {
+  return source == Source::Ntp || source == Source::Rtc;
+}
+
+uint32_t getSyncCount() {
+  return syncCount;
+}
+
+uint32_t getSecondsSinceSync() {
+  if (syncCount == 0) {
+    return 0;
+  }
+  return static_cast<uint32_t>((esp_timer_get_time() - lastSyncUptimeUs) / 1000000LL);
+}
+
+uint8_t getHistory(SyncRecord* records, uint8_t capacity) {
+  portENTER_CRITICAL(&historyLock);
+  uint8_t count = historyCount < capacity ? historyCount : capacity;
+  for (uint8_t i = 0; i < count; i++) {
+    records[i] = history[(historyHead + kHistoryLength - 1 - i) % kHistoryLength];
+  }
+  portEXIT_CRITICAL(&historyLock);
+  return count;
+}
+
+bool getDriftPpm(float& ppm) {
+  ppm = driftPpm;
+  return driftValid;
+}
+
+}  // namespace TimeKeeper
+
+// Replaces ESP-IDF's weak default, which only sees the time after it has
+// been applied. Runs on the lwIP task for every SNTP answer.
+extern "C" void sntp_sync_time(struct timeval* tv) {
+  TimeKeeper::applyNtpTime(*tv);
+}
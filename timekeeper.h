@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Wall clock without waiting for NTP at boot. begin() sets a provisional
+// time right away: the one the RTC kept across a restart, or else the
+// last flash checkpoint. The RTC time is trusted only when the boot
+// before had NTP or trusted RTC time itself. SNTP then runs in the background. Small
+// corrections are slewed so timestamps never jump back, a provisional time
+// that is far off is stepped. The offset of each NTP answer is kept, and
+// the offsets give an estimate of how fast the local clock drifts.
+namespace TimeKeeper {
+
+// Anything earlier is a clock that was never set
+constexpr uint32_t kValidEpochSec = 1700000000;
+
+constexpr uint32_t kSyncIntervalMs = 60UL * 60UL * 1000UL;
+constexpr uint32_t kCheckpointIntervalMs = 60UL * 60UL * 1000UL;
+// Offsets up to this are slewed, larger ones stepped
+constexpr int32_t kSlewLimitMs = 10000;
+constexpr uint8_t kHistoryLength = 8;
+
+enum class Source : uint8_t {
+  None,
+  // Behind by however long the station was off. Also kept through a
+  // restart that comes before the first NTP answer.
+  Checkpoint,
+  // Kept counting through a restart, corrected for the estimated drift
+  Rtc,
+  Ntp
+};
+
+struct SyncRecord {
+  // Unix time of the answer
+  uint32_t atSec;
+  // NTP minus the local clock before the correction
+  int32_t offsetMs;
+  bool stepped;
+};
+
+// Before anything reads the time. Needs LittleFS mounted.
+void begin();
+
+// Starts SNTP with up to three servers, once Wi-Fi is up
+void startSntp(const char* primary, const char* secondary, const char* tertiary);
+
+// Network task. Writes the hourly checkpoint. Returns true once per NTP
+// answer, with the answer in record.
+bool update(SyncRecord& record);
+
+Source getSource();
+const char* getSourceName(Source source);
+// Set by NTP this boot or carried over by the RTC from a boot that was
+// trusted. A checkpoint time is
+// only good enough for rain windows, not for timestamps or alignment.
+bool isTrusted();
+
+uint32_t getSyncCount();
+// Seconds since the last NTP answer, 0 before the first one
+uint32_t getSecondsSinceSync();
+// Newest first, returns how many records were copied
+uint8_t getHistory(SyncRecord* records, uint8_t capacity);
+// Positive when the local clock runs fast, in parts per million
+bool getDriftPpm(float& driftPpm);
+
+}
@@ -0,0 +1,176 @@
+#include "triggers.h"
+
+namespace TriggerEngine {
+
+namespace {
+
+struct SlotState {
+  bool active;
+  bool on;
+  // No hold applies until the slot has switched once
+  bool switched;
+  uint32_t switchedAtMs;
+};
+
+struct RatePoint {
+  float value;
+  uint32_t atMs;
+};
+
+struct RateHistory {
+  RatePoint points[kRateHistoryLength];
+  uint8_t head;
+  uint8_t count;
+};
+
+SlotState slots[GPIO_TRIGGER_COUNT] = {};
+RuleEngine::Program rules[GPIO_TRIGGER_COUNT] = {};
+// Indexes of the active slots, evaluate() walks only these
+uint8_t activeSlots[GPIO_TRIGGER_COUNT] = {};
+uint8_t activeCount = 0;
+RateHistory rateHistory[GPIO_TRIGGER_METRIC_COUNT] = {};
+
+void rebuildActiveList() {
+  activeCount = 0;
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+    if (slots[i].active) {
+      activeSlots[activeCount++] = i;
+    }
+  }
+}
+
+void recordRatePoint(RateHistory& history, float value, uint32_t atMs) {
+  if (history.count > 0) {
+    const RatePoint& newest = history.points[(history.head + history.count - 1) % kRateHistoryLength];
+    if (atMs - newest.atMs < kRateStepMs) {
+      return;
+    }
+  }
+
+  if (history.count == kRateHistoryLength) {
+    history.head = (history.head + 1) % kRateHistoryLength;
+    history.count--;
+  }
+  history.points[(history.head + history.count) % kRateHistoryLength] = {value, atMs};
+  history.count++;
+}
+
+bool ratePerHour(uint8_t metric, const Sample& sample, float& rate) {
+  const RateHistory& history = rateHistory[metric];
+  if (!sample.valid[metric] || history.count == 0) {
+    return false;
+  }
+
+  const RatePoint& oldest = history.points[history.head];
+  uint32_t spanMs = sample.atMs - oldest.atMs;
+  if (spanMs < kRateMinSpanMs) {
+    return false;
+  }
+
+  rate = (sample.values[metric] - oldest.value) * 3600000.0f / static_cast<float>(spanMs);
+  return true;
+}
+
+// Hysteresis between the two thresholds: ON at or above the ON value
+// when it is the higher one, at or below it otherwise
+bool nextState(const GPIOTriggerConfig& trigger, bool on, float value) {
+  if (trigger.triggerOnValue >= trigger.triggerOffValue) {
+    if (!on && value >= trigger.triggerOnValue) {
+      return true;
+    }
+    if (on && value <= trigger.triggerOffValue) {
+      return false;
+    }
+  } else {
+    if (!on && value <= trigger.triggerOnValue) {
+      return true;
+    }
+    if (on && value >= trigger.triggerOffValue) {
+      return false;
+    }
+  }
+  return on;
+}
+
+}  // namespace
+
+void setActive(uint8_t index, bool active) {
+  if (index >= GPIO_TRIGGER_COUNT || slots[index].active == active) {
+    return;
+  }
+
+  slots[index] = {};
+  slots[index].active = active;
+  rebuildActiveList();
+}
+
+bool isActive(uint8_t index) {
+  return index < GPIO_TRIGGER_COUNT && slots[index].active;
+}
+
+void setRule(uint8_t index, const RuleEngine::Program& program) {
+  if (index < GPIO_TRIGGER_COUNT) {
+    rules[index] = program;
+  }
+}
+
+uint8_t getActiveCount() {
+  return activeCount;
+}
+
+bool isOn(uint8_t index) {
+  return index < GPIO_TRIGGER_COUNT && slots[index].on;
+}
+
+uint8_t evaluate(const GPIOTriggerConfig* triggers, const Sample& sample, Change* changes) {
+  uint8_t changeCount = 0;
+
+  for (uint8_t i = 0; i < activeCount; i++) {
+    uint8_t index = activeSlots[i];
+    const GPIOTriggerConfig& trigger = triggers[index];
+
+    SlotState& slot = slots[index];
+    float value = 0.0f;
+    bool next = false;
+    if (trigger.condition == GPIO_TRIGGER_CONDITION_RULE) {
+      next = RuleEngine::evaluate(rules[index], sample.values, sample.valid);
+      value = next ? 1.0f : 0.0f;
+    } else if (trigger.condition == GPIO_TRIGGER_CONDITION_RATE) {
+      if (!ratePerHour(trigger.value, sample, value)) {
+        continue;
+      }
+      next = nextState(trigger, slot.on, value);
+    } else {
+      if (!sample.valid[trigger.value]) {
+        continue;
+      }
+      value = sample.values[trigger.value];
+      next = nextState(trigger, slot.on, value);
+    }
+
+    if (next == slot.on) {
+      continue;
+    }
+
+    uint32_t holdMs = static_cast<uint32_t>(slot.on ? trigger.minOnSec : trigger.minOffSec) * 1000UL;
+    if (slot.switched && sample.atMs - slot.switchedAtMs < holdMs) {
+      continue;
+    }
+
+    slot.on = next;
+    slot.switched = true;
+    slot.switchedAtMs = sample.atMs;
+    changes[changeCount++] = {index, next, value};
+  }
+
+  // After the rates above, so a reading is never compared with itself
+  for (uint8_t metric = 0; metric < GPIO_TRIGGER_METRIC_COUNT; metric++) {
+    if (sample.valid[metric]) {
+      recordRatePoint(rateHistory[metric], sample.values[metric], sample.atMs);
+    }
+  }
+
+  return changeCount;
+}
+
+}  // namespace TriggerEngine
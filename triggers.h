@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+#include "rules.h"
+
+// Decides when the GPIO trigger outputs switch. Evaluated once per sensor
+// reading instead of on every loop pass, only over the slots that are
+// active. Knows nothing about pins, the caller drives the outputs from
+// the changes evaluate() returns.
+namespace TriggerEngine {
+
+// Rate conditions use the change per hour between the reading and the
+// oldest history point, once that is at least kRateMinSpanMs old. One
+// point is kept per kRateStepMs, so the span settles at about 16 minutes.
+constexpr uint32_t kRateStepMs = 60000;
+constexpr uint32_t kRateMinSpanMs = 10UL * 60UL * 1000UL;
+constexpr uint8_t kRateHistoryLength = 16;
+
+struct Sample {
+  float values[GPIO_TRIGGER_METRIC_COUNT];
+  // False for metrics without a value in this reading, e.g. a disabled
+  // sensor
+  bool valid[GPIO_TRIGGER_METRIC_COUNT];
+  uint32_t atMs;
+};
+
+struct Change {
+  uint8_t index;
+  bool on;
+  // Level or rate per hour that made the output switch, 1 or 0 for rules
+  float value;
+};
+
+// Adds the slot to the evaluation list or removes it. A removed slot is
+// OFF, a slot that stays active keeps its state and hold time.
+void setActive(uint8_t index, bool active);
+bool isActive(uint8_t index);
+uint8_t getActiveCount();
+
+// Output state the engine last decided for the slot
+bool isOn(uint8_t index);
+
+// Compiled rule of a slot whose condition is GPIO_TRIGGER_CONDITION_RULE,
+// set before the slot is activated
+void setRule(uint8_t index, const RuleEngine::Program& program);
+
+// Evaluates every active slot against the reading, then adds it to the
+// rate history. Fills changes with at most GPIO_TRIGGER_COUNT entries
+// and returns how many there are. A switch that a hold time blocks is
+// retried with the next reading.
+uint8_t evaluate(const GPIOTriggerConfig* triggers, const Sample& sample, Change* changes);
+
+}
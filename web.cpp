@@ -1,18 +1,26 @@
 #include <ArduinoJson.h>
 #include <LittleFS.h>
 #include <WiFi.h>
-#include "config.h"
+#include <atomic>
+#include <memory>
+#include "boottimeline.h"
+#include "configstore.h"
 #include "heartbeat.h"
+#include "heaptrack.h"
+#include "metrics.h"
+#include "profiler.h"
 #include "rain.h"
+#include "restartinfo.h"
+#include "rules.h"
+#include "scheduler.h"
+#include "tasklink.h"
+#include "timekeeper.h"
 #include "web.h"
+#include "webactions.h"
 
 extern const char* programVers;
 
-extern bool bmeOK;
-extern bool lightOK;
-extern bool runtimeSensorFaultActive;
-extern bool accessPointModeActive;
-extern bool clockSynchronized;
+extern std::atomic<bool> accessPointModeActive;
 extern float temperature;
 extern float humidity;
 extern float pressure;
@@ -20,12 +28,14 @@ extern float seaLevelPressure;
 extern float lightLux;
 extern float lightWm2;
 extern int rssi;
-extern void applyGPIOTriggerConfiguration();
+extern void applyConfigChanges(uint16_t changed);
+extern Scheduler::JobTable sensingJobs;
+extern Scheduler::JobTable networkJobs;
 
-// WebServer instance on port 80
-WebServer server(80);
+// Async web server on port 80, requests are served from the AsyncTCP task
+AsyncWebServer server(80);
 
-File uploadFile;
+Config scratchConfig;
 
 namespace {
 
@@ -37,6 +47,42 @@ constexpr uint8_t kI2cSdaPin = 21;
 constexpr uint8_t kI2cSclPin = 22;
 #endif
 
+constexpr const char* kConfigFile = "/config.json";
+constexpr const char* kRestoreTempFile = "/config.upload";
+constexpr size_t kMaxFormBodyBytes = 8192;
+constexpr size_t kMaxRestoreBytes = 16384;
+constexpr unsigned long kRebootDelayMs = 500;
+
+SemaphoreHandle_t stationStateMutex = nullptr;
+
+// How a backup upload went, kept in the request's _tempObject and freed
+// with the request
+enum class RestoreUpload : uint8_t {
+  Receiving,
+  Complete,
+  TooLarge,
+  Busy,
+  Failed
+};
+
+// The request writing kRestoreTempFile. One restore at a time, as they
+// share the file; AsyncTCP runs all handlers on one task.
+AsyncWebServerRequest* restoringRequest = nullptr;
+// A form being read into a Config, AsyncTCP task only. The network task
+// has scratchConfig.
+Config formConfig;
+
+using SectionRenderer = String (*)(AsyncWebServerRequest* request);
+
+struct SectionedResponse {
+  AsyncWebServerRequest* request;
+  const SectionRenderer* sections;
+  size_t sectionCount;
+  size_t nextSection;
+  String pending;
+  size_t pendingOffset;
+};
+
 String htmlEscape(const String& value) {
   String escaped = value;
   escaped.replace("&", "&amp;");
@@ -47,6 +93,11 @@ String htmlEscape(const String& value) {
   return escaped;
 }
 
+template <size_t N>
+String htmlEscape(const FixedString<N>& value) {
+  return htmlEscape(String(value.c_str()));
+}
+
 String formatFloatValue(float value, uint8_t decimals = 1, const char* suffix = "") {
   if (isnan(value)) {
     return "N/A";
@@ -58,6 +109,13 @@ String formatIntValue(int value, const char* suffix = "") {
   return String(value) + suffix;
 }
 
+String formatDurationUs(uint32_t valueUs) {
+  if (valueUs >= 1000) {
+    return String(valueUs / 1000.0f, 1) + " ms";
+  }
+  return String(valueUs) + " µs";
+}
+
 String formatBoolBadge(bool enabled, const char* onLabel = "Active", const char* offLabel = "Off") {
   return String("<span class='status-pill ") + (enabled ? "ok'>" : "muted'>") + (enabled ? onLabel : offLabel) + "</span>";
 }
@@ -186,7 +244,7 @@ String logEscape(const String& value) {
 }
 
 String formatRuntimeState() {
-  if (runtimeSensorFaultActive) {
+  if (TaskLink::hasSensorFault()) {
     return "<span class='status-pill danger'>Sensor fault</span>";
   }
   if (accessPointModeActive) {
@@ -334,6 +392,7 @@ String buildNavbar(const String& activePath, bool showSaveButton = false) {
               "<a class='nav-link dropdown-toggle' href='#' id='moreDropdown' role='button' data-bs-toggle='dropdown' aria-expanded='false'>More</a>"
               "<ul class='dropdown-menu dropdown-menu-end' aria-labelledby='moreDropdown'>"
                 "<li><a class='dropdown-item' href='/debug'>Debug</a></li>"
+                "<li><a class='dropdown-item' href='/debug/perf'>Perf</a></li>"
                 "<li><a class='dropdown-item' href='/config.json' target='_blank'>Config</a></li>"
               "</ul>"
             "</li>"
@@ -343,7 +402,7 @@ String buildNavbar(const String& activePath, bool showSaveButton = false) {
     html += "<button class='btn btn-success ms-auto' type='submit' form='configForm'>Save</button>";
   } else {
     html += "<div class='ms-auto d-flex align-items-center gap-2'><span class='mini-note'>"
-            + htmlEscape(config.stationName.length() ? config.stationName : String("Weather station"))
+            + htmlEscape(String(config.stationName.isEmpty() ? "Weather station" : config.stationName.c_str()))
             + "</span></div>";
   }
 
@@ -355,20 +414,28 @@ String buildNavbar(const String& activePath, bool showSaveButton = false) {
   return html;
 }
 
-String buildSweetAlertScript() {
+String buildSweetAlertScript(AsyncWebServerRequest* request) {
   String flashTitle;
   String flashText;
   String flashIcon;
 
-  if (server.hasArg("saved")) {
+  if (request->hasArg("rejected")) {
+    flashTitle = "Settings saved";
+    flashText = "Some values were invalid or out of range and have not been changed.";
+    flashIcon = "warning";
+  } else if (request->hasArg("truncated")) {
+    flashTitle = "Settings saved";
+    flashText = "Some values were too long and have been shortened.";
+    flashIcon = "warning";
+  } else if (request->hasArg("saved")) {
     flashTitle = "Settings saved";
     flashText = "Configuration was saved successfully.";
     flashIcon = "success";
-  } else if (server.hasArg("restored")) {
+  } else if (request->hasArg("restored")) {
     flashTitle = "Backup restored";
     flashText = "Configuration was restored successfully.";
     flashIcon = "success";
-  } else if (server.hasArg("factory")) {
+  } else if (request->hasArg("factory")) {
     flashTitle = "Factory reset complete";
     flashText = "Default configuration has been loaded.";
     flashIcon = "success";
@@ -385,7 +452,17 @@ String buildSweetAlertScript() {
       "async function confirmFactoryReset(){const result=await Swal.fire(Object.assign({},swalTheme,{icon:'warning',title:'Factory reset?',text:'All settings will be deleted.',showCancelButton:true,confirmButtonText:'Reset',cancelButtonText:'Cancel'}));if(result.isConfirmed){window.location.href='/factory';}}"
       "async function confirmReboot(){const result=await Swal.fire(Object.assign({},swalTheme,{icon:'question',title:'Reboot device?',text:'WX Station will restart immediately.',showCancelButton:true,confirmButtonText:'Reboot',cancelButtonText:'Cancel'}));if(result.isConfirmed){showDialog('success','Rebooting','WX Station is restarting...');fetch('/reboot');}}";
 
-  if (flashTitle.length()) {
+  if (request->hasArg("ticket")) {
+    // Handlers answer before the network task applies the change. Wait for
+    // it, then reload without the ticket so the form shows the new values.
+    script += "document.addEventListener('DOMContentLoaded',function(){"
+        "Swal.fire(Object.assign({},swalTheme,{toast:true,position:'bottom-end',title:'Applying settings...',showConfirmButton:false,didOpen:function(){Swal.showLoading();}}));"
+        "const url=new URL(window.location.href);const ticket=url.searchParams.get('ticket');url.searchParams.delete('ticket');"
+        "const giveUpAt=Date.now()+15000;"
+        "async function poll(){let done=false;try{const response=await fetch('/applied?ticket='+ticket);done=(await response.json()).done;}catch(e){}"
+        "if(done||Date.now()>giveUpAt){window.location.replace(url.toString());}else{setTimeout(poll,300);}}"
+        "poll();});";
+  } else if (flashTitle.length()) {
     script += "document.addEventListener('DOMContentLoaded',function(){showToast('"
       + flashIcon + "','"
       + htmlEscape(flashTitle) + "','"
@@ -396,13 +473,13 @@ String buildSweetAlertScript() {
   return script;
 }
 
-String buildFooter() {
+String buildFooter(AsyncWebServerRequest* request) {
   return String()
     + "<footer class='footer text-center py-3 mt-4 small'>"
       "Made with ❤️ by <a href='https://www.ok1kky.cz' target='_blank'>OK1KKY</a> | "
       "WX-Station " + String(programVers) +
     "</footer>"
-    + buildSweetAlertScript()
+    + buildSweetAlertScript(request)
     + "</body></html>";
 }
 
@@ -474,7 +551,8 @@ String buildSettingsScript() {
           "const unitLabelOn=document.getElementById('gpioTriggerOnUnit'+index);"
           "const unitLabelOff=document.getElementById('gpioTriggerOffUnit'+index);"
           "const selectedOption=select.options[select.selectedIndex];"
-          "const unit=(selectedOption&&selectedOption.dataset.unit)?selectedOption.dataset.unit:'';"
+          "const condition=document.getElementsByName('gpioTriggerCondition'+index)[0];"
+          "const unit=((selectedOption&&selectedOption.dataset.unit)?selectedOption.dataset.unit:'')+(condition&&condition.value==='1'?'/h':'');"
           "if(unitLabelOn){unitLabelOn.textContent=unit;}"
           "if(unitLabelOff){unitLabelOff.textContent=unit;}"
         "});"
@@ -494,19 +572,28 @@ String buildSettingsScript() {
           "});"
         "});"
       "}"
+      "function gpioTriggerSlotCount(){const input=document.getElementsByName('gpioTriggerSlots')[0];const count=input?parseInt(input.value,10):" + String(GPIO_TRIGGER_COUNT) + ";return Number.isNaN(count)?" + String(GPIO_TRIGGER_COUNT) + ":count;}"
+      "function refreshGpioTriggerSlots(){"
+        "const count=gpioTriggerSlotCount();"
+        "for(let i=0;i<" + String(GPIO_TRIGGER_COUNT) + ";i++){const shown=i<count;const toggle=document.getElementById('gpioTriggerEnabled'+i);document.getElementById('gpioTriggerSlot'+i).style.display=shown?'':'none';document.getElementById('gpioTriggerFields'+i).style.display=shown&&toggle.checked?'block':'none';}"
+      "}"
       "function refreshGpioTriggerPinOptions(){"
         "const selects=[...document.querySelectorAll('.gpio-trigger-pin-select')];"
         "const selectedPins=new Set();"
-        "selects.forEach(select=>{const index=select.dataset.index;const enabled=document.getElementById('gpioTriggerEnabled'+index);const value=parseInt(select.value,10);if(enabled&&enabled.checked&&!Number.isNaN(value)&&value>=0){selectedPins.add(value);}});"
+        "const slotCount=gpioTriggerSlotCount();"
+        "selects.forEach(select=>{const index=select.dataset.index;const enabled=index<slotCount&&document.getElementById('gpioTriggerEnabled'+index);const value=parseInt(select.value,10);if(enabled&&enabled.checked&&!Number.isNaN(value)&&value>=0){selectedPins.add(value);}});"
         "selects.forEach(select=>{const ownValue=parseInt(select.value,10);[...select.options].forEach(option=>{const pin=parseInt(option.value,10);if(Number.isNaN(pin)||pin<0){option.disabled=false;return;}const reserved=option.dataset.reserved==='1';const duplicated=selectedPins.has(pin)&&pin!==ownValue;option.disabled=reserved||duplicated;});});"
       "}"
       "document.addEventListener('DOMContentLoaded',function(){"
         "toggleSection('activeAPRS','aprsFields');"
         "toggleSection('activeMQTT','mqttFields');"
         "toggleSection('activeSYSLOG','syslogFields');"
-        "for(let i=0;i<3;i++){toggleSection('gpioTriggerEnabled'+i,'gpioTriggerFields'+i);}refreshGpioTriggerMetricOptions();refreshGpioTriggerUnits();refreshGpioTriggerPinOptions();"
+        "toggleSection('staticIpActive','staticIpFields');"
+        "refreshGpioTriggerSlots();refreshGpioTriggerMetricOptions();refreshGpioTriggerUnits();refreshGpioTriggerPinOptions();"
+        "document.getElementsByName('gpioTriggerSlots')[0].addEventListener('input',function(){refreshGpioTriggerSlots();refreshGpioTriggerPinOptions();});"
         "document.querySelectorAll('.gpio-trigger-pin-select').forEach(select=>select.addEventListener('change',refreshGpioTriggerPinOptions));"
         "document.querySelectorAll('select[name^=\"gpioTriggerMetric\"]').forEach(select=>select.addEventListener('change',function(){refreshGpioTriggerMetricOptions();refreshGpioTriggerUnits();}));"
+        "document.querySelectorAll('select[name^=\"gpioTriggerCondition\"]').forEach(select=>select.addEventListener('change',refreshGpioTriggerUnits));"
         "document.querySelectorAll('.gpio-trigger-toggle').forEach(toggle=>toggle.addEventListener('change',function(){const index=this.dataset.index;toggleSection('gpioTriggerEnabled'+index,'gpioTriggerFields'+index);refreshGpioTriggerPinOptions();}));"
         "const lightToggle=document.getElementsByName('activeLight')[0];"
         "const rainToggle=document.getElementById('activeRain');"
@@ -539,13 +626,8 @@ String buildStatusJson() {
   return json;
 }
 
-String buildDashboardPage() {
-  String ssid = wifiSsidValue();
-  String localIp = localIpValue();
-
-  String html = buildHead("WX Dashboard");
-  html += buildNavbar("/", false);
-  html += "<main class='page-content'><div class='container page-shell mx-auto py-4'>";
+String buildDashboardCards() {
+  String html = "<main class='page-content'><div class='container page-shell mx-auto py-4'>";
 
   html += "<div class='row card-grid mb-4'>";
   html +=
@@ -561,8 +643,14 @@ String buildDashboardPage() {
     + formatFloatValue(seaLevelPressure, 2, " hPa")
     + "</div></div></div>";
   html += "</div>";
+  return html;
+}
+
+String buildDashboardPanels() {
+  String ssid = wifiSsidValue();
+  String localIp = localIpValue();
 
-  html += "<div class='row g-4'>";
+  String html = "<div class='row g-4'>";
   html +=
     "<div class='col-lg-7'>"
       "<div class='panel'>"
@@ -597,16 +685,20 @@ String buildDashboardPage() {
   html += "</div>";
 
   html += "</div></main>";
-  html += buildDashboardRefreshScript();
-  html += buildFooter();
   return html;
 }
 
-String buildSettingsPage() {
-  String html = buildHead("WX Settings");
-  html += buildNavbar("/setting", true);
-
-  html += "<main class='page-content'><div class='container page-shell py-4 pb-2 mx-auto'>"
+const SectionRenderer kDashboardSections[] = {
+  [](AsyncWebServerRequest*) { return buildHead("WX Dashboard"); },
+  [](AsyncWebServerRequest*) { return buildNavbar("/", false); },
+  [](AsyncWebServerRequest*) { return buildDashboardCards(); },
+  [](AsyncWebServerRequest*) { return buildDashboardPanels(); },
+  [](AsyncWebServerRequest*) { return buildDashboardRefreshScript(); },
+  [](AsyncWebServerRequest* request) { return buildFooter(request); },
+};
+
+String buildSettingsFormOpen() {
+  String html = "<main class='page-content'><div class='container page-shell py-4 pb-2 mx-auto'>"
           "<form id='configForm' method='POST' action='/save'>";
 
   html +=
@@ -614,7 +706,11 @@ String buildSettingsPage() {
       "Before you start configuring your WX-Station, please read the instructions at "
       "<a href='https://github.com/ondrahladik/WX-Station/tree/main/docs' class='alert-link' target='_blank'>GitHub Docs</a>."
     "</div>";
+  return html;
+}
 
+String buildSettingsStationSection() {
+  String html;
   html +=
     "<section>"
       "<h5><i class='bi bi-person-circle'></i> STATION</h5>"
@@ -631,7 +727,40 @@ String buildSettingsPage() {
         "</div>"
       "</div>"
     "</section>";
+  return html;
+}
+
+String buildSettingsNetworkSection() {
+  String html;
+  html +=
+    "<section>"
+      "<div class='d-flex align-items-center justify-content-between mb-3'>"
+        "<h5><i class='bi bi-wifi'></i> STATIC IP</h5>"
+        "<div class='form-check form-switch mb-0'>"
+          "<input class='form-check-input' type='checkbox' id='staticIpActive' name='staticIpActive' "
+          + String(config.staticIpActive ? "checked" : "")
+          + " onclick='document.getElementById(\"staticIpFields\").style.display=this.checked?\"block\":\"none\";'>"
+        "</div>"
+      "</div>"
+      "<div id='staticIpFields' style='display:" + String(config.staticIpActive ? "block" : "none") + ";'>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Address / Gateway</label>"
+          "<div class='col-12 col-md-4 mb-3 mb-md-0'><input type='text' class='form-control' name='staticIp' value='" + htmlEscape(config.staticIp) + "' placeholder='192.168.1.50'></div>"
+          "<div class='col-12 col-md-4'><input type='text' class='form-control' name='staticGateway' value='" + htmlEscape(config.staticGateway) + "' placeholder='192.168.1.1'></div>"
+        "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Subnet / DNS</label>"
+          "<div class='col-12 col-md-4 mb-3 mb-md-0'><input type='text' class='form-control' name='staticSubnet' value='" + htmlEscape(config.staticSubnet) + "' placeholder='255.255.255.0'></div>"
+          "<div class='col-12 col-md-4'><input type='text' class='form-control' name='staticDns' value='" + htmlEscape(config.staticDns) + "' placeholder='Gateway'></div>"
+        "</div>"
+        "<div class='mini-note mb-3'>Used from the next restart or Wi-Fi reconnect.</div>"
+      "</div>"
+    "</section>";
+  return html;
+}
 
+String buildSettingsDataSection() {
+  String html;
   html +=
     "<section>"
       "<h5><i class='bi bi-server'></i> DATA</h5>"
@@ -703,7 +832,11 @@ String buildSettingsPage() {
         "</div>"
       "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsServerSection() {
+  String html;
   html +=
     "<section>"
       "<h5><i class='bi bi-hdd-stack-fill'></i> SERVER</h5>"
@@ -727,6 +860,11 @@ String buildSettingsPage() {
           "<div class='col-12 col-md-4 mb-3 mb-md-0'><input type='text' class='form-control' name='serverUrl0' value='" + htmlEscape(config.serverUrl0) + "' placeholder='http://example.com/'></div>"
           "<div class='col-12 col-md-4'><input type='text' class='form-control' name='serverName0' value='" + htmlEscape(config.serverName0) + "' placeholder='wx-station'></div>"
         "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Public IP lookup</label>"
+          "<div class='col-12 col-md-8'><input type='text' class='form-control' name='publicIpUrl' value='" + htmlEscape(config.publicIpUrl) + "' placeholder='http://api.ipify.org'>"
+            "<div class='mini-note mt-1'>URL answering with the bare address, leave empty to report it as unknown.</div></div>"
+        "</div>"
       "</div>"
       "<div id='ser1Fields' style='display:" + String(config.serverActive1 ? "block" : "none") + ";'>"
         "<div class='row mb-3'>"
@@ -750,7 +888,11 @@ String buildSettingsPage() {
         "</div>"
       "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsAprsSection() {
+  String html;
   html +=
     "<section>"
       "<div class='d-flex align-items-center justify-content-between mb-3'>"
@@ -779,11 +921,15 @@ String buildSettingsPage() {
         "</div>"
         "<div class='row mb-3'>"
           "<label class='col-12 col-md-4 col-form-label'>Comment</label>"
-          "<div class='col-12 col-md-8'><input type='text' class='form-control' name='aprsComment' value='" + htmlEscape(String(config.aprsComment)) + "' placeholder='WX-Station https://www.ok1kky.cz'></div>"
+          "<div class='col-12 col-md-8'><input type='text' class='form-control' name='aprsComment' value='" + htmlEscape(config.aprsComment) + "' placeholder='WX-Station https://www.ok1kky.cz'></div>"
         "</div>"
       "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsMqttSection() {
+  String html;
   html +=
     "<section>"
       "<div class='d-flex align-items-center justify-content-between mb-3'>"
@@ -810,29 +956,97 @@ String buildSettingsPage() {
           "<div class='col-12 col-md-4 mb-3 mb-md-0'><input type='text' class='form-control' name='mqttTopicSub1' value='" + htmlEscape(config.mqttTopicSub1) + "' placeholder='Sub topic 1'></div>"
           "<div class='col-12 col-md-4'><input type='text' class='form-control' name='mqttTopicSub2' value='" + htmlEscape(config.mqttTopicSub2) + "' placeholder='Sub topic 2'></div>"
         "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Payload format / Replay rate</label>"
+          "<div class='col-12 col-md-4 mb-3 mb-md-0'>"
+            "<select class='form-select' name='mqttPayloadFormat'>"
+              "<option value='0'" + String(config.mqttPayloadFormat == MQTT_PAYLOAD_JSON ? " selected" : "") + ">JSON</option>"
+              "<option value='1'" + String(config.mqttPayloadFormat == MQTT_PAYLOAD_MSGPACK ? " selected" : "") + ">MessagePack</option>"
+            "</select>"
+          "</div>"
+          "<div class='col-12 col-md-4'>"
+            "<div class='input-group'>"
+              "<input type='number' class='form-control' name='mqttReplayRate' value='" + String(config.mqttReplayRate) + "' placeholder='2'>"
+              "<span class='input-group-text'>msg/s</span>"
+            "</div>"
+          "</div>"
+        "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>On change / Max silence</label>"
+          "<div class='col-12 col-md-4 mb-3 mb-md-0 d-flex align-items-center'>"
+            "<div class='form-check form-switch mb-0'>"
+              "<input class='form-check-input' type='checkbox' id='mqttChangeMode' name='mqttChangeMode' "
+              + String(config.mqttChangeMode ? "checked" : "")
+              + " onclick='document.getElementById(\"mqttChangeFields\").style.display=this.checked?\"block\":\"none\";'>"
+            "</div>"
+          "</div>"
+          "<div class='col-12 col-md-4'>"
+            "<div class='input-group'>"
+              "<input type='number' class='form-control' name='mqttMaxSilence' value='" + String(config.mqttMaxSilence / 60000) + "' placeholder='15'>"
+              "<span class='input-group-text'>min</span>"
+            "</div>"
+          "</div>"
+        "</div>"
+        "<div id='mqttChangeFields' style='display:" + String(config.mqttChangeMode ? "block" : "none") + ";'>"
+          "<div class='row mb-3'>"
+            "<label class='col-12 col-md-4 col-form-label'>Deadband T / H</label>"
+            "<div class='col-12 col-md-4 mb-3 mb-md-0'><div class='input-group'><input type='number' step='0.01' class='form-control' name='mqttDeadbandTemp' value='" + String(config.mqttDeadbandTemp, 2) + "' placeholder='0.2'><span class='input-group-text'>&deg;C</span></div></div>"
+            "<div class='col-12 col-md-4'><div class='input-group'><input type='number' step='0.01' class='form-control' name='mqttDeadbandHumi' value='" + String(config.mqttDeadbandHumi, 2) + "' placeholder='1'><span class='input-group-text'>%</span></div></div>"
+          "</div>"
+          "<div class='row mb-3'>"
+            "<label class='col-12 col-md-4 col-form-label'>Deadband P / Light</label>"
+            "<div class='col-12 col-md-4 mb-3 mb-md-0'><div class='input-group'><input type='number' step='0.01' class='form-control' name='mqttDeadbandPress' value='" + String(config.mqttDeadbandPress, 2) + "' placeholder='0.3'><span class='input-group-text'>hPa</span></div></div>"
+            "<div class='col-12 col-md-4'><div class='input-group'><input type='number' step='0.01' class='form-control' name='mqttDeadbandLight' value='" + String(config.mqttDeadbandLight, 2) + "' placeholder='10'><span class='input-group-text'>W/m&sup2;</span></div></div>"
+          "</div>"
+          "<div class='row mb-3'>"
+            "<label class='col-12 col-md-4 col-form-label'>Deadband Rain / RSSI</label>"
+            "<div class='col-12 col-md-4 mb-3 mb-md-0'><div class='input-group'><input type='number' step='0.01' class='form-control' name='mqttDeadbandRain' value='" + String(config.mqttDeadbandRain, 2) + "' placeholder='0'><span class='input-group-text'>mm</span></div></div>"
+            "<div class='col-12 col-md-4'><div class='input-group'><input type='number' step='1' class='form-control' name='mqttDeadbandRssi' value='" + String(config.mqttDeadbandRssi, 0) + "' placeholder='5'><span class='input-group-text'>dB</span></div></div>"
+          "</div>"
+        "</div>"
       "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsTriggerSection() {
+  String html;
   html +=
     "<section>"
       "<h5><i class='bi bi-lightning-charge-fill'></i> TRIGGER</h5>"
-      "<div class='d-flex flex-wrap justify-content-between align-items-center gap-3 mb-3'>"
-        "<div class='d-flex align-items-center'><p class='mb-0'>Trigger 1</p><div class='form-check form-switch ms-2 mb-0'><input class='form-check-input gpio-trigger-toggle' type='checkbox' id='gpioTriggerEnabled0' name='gpioTriggerEnabled0' data-index='0' "
-          + String(config.gpioTriggers[0].enabled ? "checked" : "")
-          + " onclick='document.getElementById(\"gpioTriggerFields0\").style.display=this.checked?\"block\":\"none\";'></div></div>"
-        "<div class='d-flex align-items-center'><p class='mb-0'>Trigger 2</p><div class='form-check form-switch ms-2 mb-0'><input class='form-check-input gpio-trigger-toggle' type='checkbox' id='gpioTriggerEnabled1' name='gpioTriggerEnabled1' data-index='1' "
-          + String(config.gpioTriggers[1].enabled ? "checked" : "")
-          + " onclick='document.getElementById(\"gpioTriggerFields1\").style.display=this.checked?\"block\":\"none\";'></div></div>"
-        "<div class='d-flex align-items-center'><p class='mb-0'>Trigger 3</p><div class='form-check form-switch ms-2 mb-0'><input class='form-check-input gpio-trigger-toggle' type='checkbox' id='gpioTriggerEnabled2' name='gpioTriggerEnabled2' data-index='2' "
-          + String(config.gpioTriggers[2].enabled ? "checked" : "")
-          + " onclick='document.getElementById(\"gpioTriggerFields2\").style.display=this.checked?\"block\":\"none\";'></div></div>"
-      "</div>";
+      "<div class='row mb-3'>"
+        "<label class='col-12 col-md-4 col-form-label'>Slots</label>"
+        "<div class='col-12 col-md-4'>"
+          "<input type='number' min='1' max='" + String(GPIO_TRIGGER_COUNT) + "' step='1' class='form-control' name='gpioTriggerSlots' value='" + String(config.gpioTriggerSlots) + "'>"
+        "</div>"
+      "</div>"
+      "<div class='d-flex flex-wrap justify-content-between align-items-center gap-3 mb-3'>";
+
+  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+    bool shown = i < config.gpioTriggerSlots;
+    html +=
+        "<div class='d-flex align-items-center' id='gpioTriggerSlot" + String(i) + "'" + String(shown ? "" : " style='display:none;'") + "><p class='mb-0'>Trigger " + String(i + 1) + "</p><div class='form-check form-switch ms-2 mb-0'><input class='form-check-input gpio-trigger-toggle' type='checkbox' id='gpioTriggerEnabled" + String(i) + "' name='gpioTriggerEnabled" + String(i) + "' data-index='" + String(i) + "' "
+          + String(config.gpioTriggers[i].enabled ? "checked" : "")
+          + " onclick='document.getElementById(\"gpioTriggerFields" + String(i) + "\").style.display=this.checked?\"block\":\"none\";'></div></div>";
+  }
+  html += "</div>";
 
   for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
     const GPIOTriggerConfig& trigger = config.gpioTriggers[i];
 
+    // Compiled here only to point at the mistake, the station compiles the
+    // rule again when the config is applied
+    String ruleNote;
+    if (trigger.condition == GPIO_TRIGGER_CONDITION_RULE) {
+      RuleEngine::Program program;
+      RuleEngine::Error error;
+      if (!RuleEngine::compile(trigger.rule.c_str(), program, error)) {
+        ruleNote = "<div class='mini-note mt-1'>Rule error at character " + String(error.position + 1) + ": " + htmlEscape(String(error.message)) + ". The trigger stays OFF.</div>";
+      }
+    }
+
     html +=
-      "<div id='gpioTriggerFields" + String(i) + "' style='display:" + String(trigger.enabled ? "block" : "none") + ";'>"
+      "<div id='gpioTriggerFields" + String(i) + "' style='display:" + String(trigger.enabled && i < config.gpioTriggerSlots ? "block" : "none") + ";'>"
         "<div class='row mb-3'>"
           "<label class='col-12 col-md-4 col-form-label'>Trigger " + String(i + 1) + "</label>"
           "<div class='col-12 col-md-4 mb-3 mb-md-0'>"
@@ -861,11 +1075,37 @@ String buildSettingsPage() {
             "</div>"
           "</div>"
         "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Trigger " + String(i + 1) + " condition</label>"
+          "<div class='col-12 col-md-4'>"
+            "<select class='form-select' name='gpioTriggerCondition" + String(i) + "'>"
+              "<option value='0'" + String(trigger.condition == GPIO_TRIGGER_CONDITION_LEVEL ? " selected" : "") + ">Value</option>"
+              "<option value='1'" + String(trigger.condition == GPIO_TRIGGER_CONDITION_RATE ? " selected" : "") + ">Change per hour</option>"
+              "<option value='2'" + String(trigger.condition == GPIO_TRIGGER_CONDITION_RULE ? " selected" : "") + ">Rule</option>"
+            "</select>"
+          "</div>"
+        "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Trigger " + String(i + 1) + " rule</label>"
+          "<div class='col-12 col-md-8'>"
+            "<input type='text' class='form-control' name='gpioTriggerRule" + String(i) + "' maxlength='" + String(decltype(GPIOTriggerConfig::rule)::kCapacity) + "' value='" + htmlEscape(trigger.rule) + "' placeholder='temp &gt; 30 and humidity &gt; 70 or rain_1h &gt; 2'>"
+            + ruleNote +
+          "</div>"
+        "</div>"
+        "<div class='row mb-3'>"
+          "<label class='col-12 col-md-4 col-form-label'>Trigger " + String(i + 1) + " min ON / OFF</label>"
+          "<div class='col-12 col-md-4 mb-3 mb-md-0'><div class='input-group'><input type='number' step='1' min='0' class='form-control' name='gpioTriggerMinOn" + String(i) + "' value='" + String(trigger.minOnSec) + "' placeholder='0'><span class='input-group-text'>s</span></div></div>"
+          "<div class='col-12 col-md-4'><div class='input-group'><input type='number' step='1' min='0' class='form-control' name='gpioTriggerMinOff" + String(i) + "' value='" + String(trigger.minOffSec) + "' placeholder='0'><span class='input-group-text'>s</span></div></div>"
+        "</div>"
       "</div>";
   }
 
   html += "</section>";
+  return html;
+}
 
+String buildSettingsSyslogSection() {
+  String html;
   html +=
     "<section>"
       "<div class='d-flex align-items-center justify-content-between mb-3'>"
@@ -884,7 +1124,11 @@ String buildSettingsPage() {
         "</div>"
       "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsIntervalSection() {
+  String html;
   html +=
     "<section>"
       "<h5><i class='bi bi-clock-fill'></i> INTERVAL</h5>"
@@ -921,8 +1165,20 @@ String buildSettingsPage() {
           "</div>"
         "</div>"
       "</div>"
+      "<div class='row mb-3'>"
+        "<label class='col-12 col-md-4 col-form-label'>Align to clock</label>"
+        "<div class='col-12 col-md-8 d-flex align-items-center'>"
+          "<div class='form-check form-switch mb-0'>"
+            "<input class='form-check-input' type='checkbox' id='alignIntervals' name='alignIntervals' " + String(config.alignIntervals ? "checked" : "") + ">"
+          "</div>"
+        "</div>"
+      "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsHeartbeatSection() {
+  String html;
   html +=
     "<section>"
       "<div class='d-flex align-items-center justify-content-between mb-3'>"
@@ -932,7 +1188,11 @@ String buildSettingsPage() {
         "</div>"
       "</div>"
     "</section>";
+  return html;
+}
 
+String buildSettingsDebugSection() {
+  String html;
   html +=
     "<section class='last'>"
       "<div class='d-flex align-items-center justify-content-between mb-3'>"
@@ -942,17 +1202,30 @@ String buildSettingsPage() {
         "</div>"
       "</div>"
     "</section>";
-
-  html += "</form></div></main>";
-  html += buildSettingsScript();
-  html += buildFooter();
   return html;
 }
 
-String buildDebugPage() {
-  String html = buildHead("WX Debug");
-  html += buildNavbar("/debug", false);
-  html += "<main class='page-content'><div class='container page-shell mx-auto py-4'>";
+const SectionRenderer kSettingsSections[] = {
+  [](AsyncWebServerRequest*) { return buildHead("WX Settings"); },
+  [](AsyncWebServerRequest*) { return buildNavbar("/setting", true); },
+  [](AsyncWebServerRequest*) { return buildSettingsFormOpen(); },
+  [](AsyncWebServerRequest*) { return buildSettingsStationSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsNetworkSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsDataSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsServerSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsAprsSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsMqttSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsTriggerSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsSyslogSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsIntervalSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsHeartbeatSection(); },
+  [](AsyncWebServerRequest*) { return buildSettingsDebugSection(); },
+  [](AsyncWebServerRequest*) -> String { return String("</form></div></main>") + buildSettingsScript(); },
+  [](AsyncWebServerRequest* request) { return buildFooter(request); },
+};
+
+String buildDebugPanel() {
+  String html = "<main class='page-content'><div class='container page-shell mx-auto py-4'>";
   html +=
     "<div class='panel'>"
       "<div class='d-flex justify-content-between align-items-center mb-3'>"
@@ -968,209 +1241,657 @@ String buildDebugPage() {
       + "</div>"
     "</div>";
   html += "</div></main>";
-  html += buildDebugRefreshScript();
-  html += buildFooter();
   return html;
 }
 
-}  // namespace
+const SectionRenderer kDebugSections[] = {
+  [](AsyncWebServerRequest*) { return buildHead("WX Debug"); },
+  [](AsyncWebServerRequest*) { return buildNavbar("/debug", false); },
+  [](AsyncWebServerRequest*) { return buildDebugPanel(); },
+  [](AsyncWebServerRequest*) { return buildDebugRefreshScript(); },
+  [](AsyncWebServerRequest* request) { return buildFooter(request); },
+};
+
+String buildPerfRow(const String& name, const Metrics::Histogram& histogram) {
+  return String("<tr><td>") + name + "</td>"
+    + "<td>" + String(histogram.getCount()) + "</td>"
+    + "<td>" + formatDurationUs(histogram.getMin()) + "</td>"
+    + "<td>" + formatDurationUs(histogram.getPercentile(50)) + "</td>"
+    + "<td>" + formatDurationUs(histogram.getPercentile(99)) + "</td>"
+    + "<td>" + formatDurationUs(histogram.getMax()) + "</td></tr>";
+}
 
-// ====== Handle upload ======
-void handleUpload() {
-  HTTPUpload& upload = server.upload();
-  if (upload.status == UPLOAD_FILE_START) {
-    if (LittleFS.exists("/config.json")) {
-      LittleFS.remove("/config.json");
+String buildPerfPanel() {
+  uint32_t sensingOverheadUs = Profiler::getTimerOverheadNs() * Profiler::getTimersPerIteration(Profiler::Task::Sensing) / 1000UL;
+  uint32_t networkOverheadUs = Profiler::getTimerOverheadNs() * Profiler::getTimersPerIteration(Profiler::Task::Network) / 1000UL;
+
+  String html = "<main class='page-content'><div class='container page-shell mx-auto py-4'>";
+  html +=
+    "<div class='panel'>"
+      "<h5 class='mb-3'><i class='bi bi-speedometer2'></i> Loop profile</h5>"
+      "<div class='mini-note mb-3'>Percentiles are estimated from fixed histogram buckets. Values are collected since boot.</div>"
+      "<table class='list-table'>"
+        "<tr><td>Stalls (over " + formatDurationUs(Profiler::kStallThresholdUs) + ")</td><td>" + String(Profiler::getStallCount()) + "</td></tr>"
+        "<tr><td>Timer overhead</td><td>" + String(Profiler::getTimerOverheadNs()) + " ns per stage, ~" + formatDurationUs(sensingOverheadUs) + " per sensing pass, ~" + formatDurationUs(networkOverheadUs) + " per network pass</td></tr>"
+        "<tr><td>Last config load</td><td>" + formatDurationUs(getConfigLoadStats().durationUs) + (getConfigLoadStats().fromSnapshot ? " from snapshot" : " from JSON") + "</td></tr>"
+      "</table>"
+      "<table class='list-table mt-3'>"
+        "<tr><th>Stage</th><th>Count</th><th>Min</th><th>p50</th><th>p99</th><th>Max</th></tr>";
+
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Profiler::Task::Count); i++) {
+    Profiler::Task task = static_cast<Profiler::Task>(i);
+    html += buildPerfRow(String("loop ") + Profiler::getTaskName(task), Profiler::getIterationHistogram(task));
+  }
+
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Profiler::Stage::Count); i++) {
+    Profiler::Stage stage = static_cast<Profiler::Stage>(i);
+    html += buildPerfRow(Profiler::getStageName(stage), Profiler::getStageHistogram(stage));
+  }
+
+  html +=
+      "</table>"
+    "</div>";
+  return html;
+}
+
+// Stats are read without a lock from the task that does not own the
+// table, a row may mix two consecutive runs
+String buildJobRows(const Scheduler::JobTable& jobs, const char* taskName) {
+  String html;
+  for (Scheduler::JobId id = 0; id < jobs.getJobCount(); id++) {
+    const Scheduler::JobStats& stats = jobs.getJobStats(id);
+    uint32_t lateAvgMs = stats.runs > 0 ? stats.lateSumMs / stats.runs : 0;
+    uint32_t periodMs = jobs.getPeriodMs(id);
+    html += String("<tr><td>") + jobs.getJobName(id) + (jobs.isEnabled(id) ? "" : " (off)") + "</td>"
+      + "<td>" + taskName + "</td>"
+      + "<td>" + (periodMs > 0 ? String(periodMs / 1000UL) + " s" : String("once")) + "</td>"
+      + "<td>" + String(stats.runs) + "</td>"
+      + "<td>" + String(lateAvgMs) + " ms</td>"
+      + "<td>" + String(stats.lateMaxMs) + " ms</td>"
+      + "<td>" + String(stats.overruns) + "</td>"
+      + "<td>" + String(stats.durationMaxMs) + " ms</td></tr>";
+  }
+  return html;
+}
+
+String buildJobsPanel() {
+  String html =
+    "<div class='panel mt-4'>"
+      "<h5 class='mb-3'><i class='bi bi-calendar-check'></i> Jobs</h5>"
+      "<div class='mini-note mb-3'>Periodic work run by the scheduler since boot. Late is how long a job waited past its deadline, an overrun is a run that started a whole period late.</div>"
+      "<table class='list-table'>"
+        "<tr><th>Job</th><th>Task</th><th>Period</th><th>Runs</th><th>Late avg</th><th>Late max</th><th>Overruns</th><th>Max run</th></tr>";
+
+  html += buildJobRows(sensingJobs, Profiler::getTaskName(Profiler::Task::Sensing));
+  html += buildJobRows(networkJobs, Profiler::getTaskName(Profiler::Task::Network));
+
+  html +=
+      "</table>"
+    "</div>";
+  return html;
+}
+
+String buildClockPanel() {
+  float driftPpm;
+  bool driftValid = TimeKeeper::getDriftPpm(driftPpm);
+  uint32_t syncCount = TimeKeeper::getSyncCount();
+
+  String html =
+    "<div class='panel mt-4'>"
+      "<h5 class='mb-3'><i class='bi bi-clock-history'></i> Clock</h5>"
+      "<div class='mini-note mb-3'>Offset is NTP minus the local clock when an answer came. Offsets up to " + String(TimeKeeper::kSlewLimitMs / 1000) + " s are slewed, larger ones stepped.</div>"
+      "<table class='list-table'>"
+        "<tr><td>Source</td><td>" + TimeKeeper::getSourceName(TimeKeeper::getSource()) + (TimeKeeper::isTrusted() ? "" : " (not trusted)") + "</td></tr>"
+        "<tr><td>NTP answers</td><td>" + String(syncCount) + "</td></tr>"
+        "<tr><td>Last answer</td><td>" + (syncCount > 0 ? String(TimeKeeper::getSecondsSinceSync()) + " s ago" : String("none yet")) + "</td></tr>"
+        "<tr><td>Drift</td><td>" + (driftValid ? formatFloatValue(driftPpm, 1, " ppm") : String("not estimated yet")) + "</td></tr>"
+      "</table>";
+
+  TimeKeeper::SyncRecord records[TimeKeeper::kHistoryLength];
+  uint8_t count = TimeKeeper::getHistory(records, TimeKeeper::kHistoryLength);
+  if (count > 0) {
+    html +=
+      "<table class='list-table mt-3'>"
+        "<tr><th>Unix time</th><th>Offset</th><th>Correction</th></tr>";
+    for (uint8_t i = 0; i < count; i++) {
+      html += "<tr><td>" + String(records[i].atSec) + "</td>"
+        + "<td>" + String(records[i].offsetMs) + " ms</td>"
+        + "<td>" + (records[i].stepped ? "stepped" : "slewed") + "</td></tr>";
+    }
+    html += "</table>";
+  }
+
+  html += "</div>";
+  return html;
+}
+
+// Bars are placed on a scale from boot to the last phase end
+String buildBootPanel() {
+  uint32_t scaleMs = 1;
+  for (uint8_t i = 0; i < static_cast<uint8_t>(BootTimeline::Phase::Count); i++) {
+    BootTimeline::Span span = BootTimeline::getSpan(static_cast<BootTimeline::Phase>(i));
+    if (span.finished && span.endMs > scaleMs) {
+      scaleMs = span.endMs;
     }
-    uploadFile = LittleFS.open("/config.json", "w");
-  } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (uploadFile) {
-      uploadFile.write(upload.buf, upload.currentSize);
+  }
+
+  String html =
+    "<div class='panel mt-4'>"
+      "<h5 class='mb-3'><i class='bi bi-hourglass-split'></i> Boot</h5>"
+      "<div class='mini-note mb-3'>Time since boot when each phase started and ended. Phases overlap, the sensors are set up while Wi-Fi connects. First sample after " + String(BootTimeline::getFirstSampleMs()) + " ms.</div>"
+      "<table class='list-table'>"
+        "<tr><th>Phase</th><th>Start</th><th>End</th><th>Duration</th><th style='width:40%'></th></tr>";
+
+  for (uint8_t i = 0; i < static_cast<uint8_t>(BootTimeline::Phase::Count); i++) {
+    BootTimeline::Phase phase = static_cast<BootTimeline::Phase>(i);
+    BootTimeline::Span span = BootTimeline::getSpan(phase);
+    if (!span.started) {
+      continue;
     }
-  } else if (upload.status == UPLOAD_FILE_END) {
-    if (uploadFile) {
-      uploadFile.close();
+    if (!span.finished) {
+      html += String("<tr><td>") + BootTimeline::getPhaseName(phase) + "</td>"
+        + "<td>" + String(span.startMs) + " ms</td><td colspan='3'>running</td></tr>";
+      continue;
+    }
+
+    float leftPercent = 100.0f * span.startMs / scaleMs;
+    float widthPercent = 100.0f * (span.endMs - span.startMs) / scaleMs;
+    html += String("<tr><td>") + BootTimeline::getPhaseName(phase) + "</td>"
+      + "<td>" + String(span.startMs) + " ms</td>"
+      + "<td>" + String(span.endMs) + " ms</td>"
+      + "<td>" + String(span.endMs - span.startMs) + " ms</td>"
+      + "<td><div style='position:relative; height:0.6rem;'>"
+        "<div style='position:absolute; top:0; bottom:0; left:" + String(leftPercent, 1) + "%; width:" + String(widthPercent < 0.5f ? 0.5f : widthPercent, 1) + "%; background:currentColor; opacity:0.6;'></div>"
+      "</div></td></tr>";
+  }
+
+  html +=
+      "</table>"
+    "</div>";
+  return html;
+}
+
+// Closes the page shell opened by buildPerfPanel()
+String buildHeapPanel() {
+  String html =
+    "<div class='panel mt-4'>"
+      "<h5 class='mb-3'><i class='bi bi-memory'></i> Heap</h5>";
+
+  if (HeapTracker::kEnabled) {
+    html +=
+      "<div class='mini-note mb-3'>Net heap change per network loop stage since boot. The web server allocates at the same time and shows up in single runs, a stage that keeps memory grows run after run.</div>"
+      "<table class='list-table mb-3'>"
+        "<tr><th>Stage</th><th>Runs</th><th>Grew</th><th>Blocks</th><th>Bytes</th><th>Max bytes/run</th></tr>";
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Profiler::Stage::Count); i++) {
+      Profiler::Stage stage = static_cast<Profiler::Stage>(i);
+      if (!HeapTracker::isTracked(stage)) {
+        continue;
+      }
+
+      const HeapTracker::StageStats& stats = HeapTracker::getStageStats(stage);
+      html += String("<tr><td>") + Profiler::getStageName(stage) + "</td>"
+        + "<td>" + String(stats.calls) + "</td>"
+        + "<td>" + String(stats.growingCalls) + "</td>"
+        + "<td>" + String(stats.netBlocks) + "</td>"
+        + "<td>" + String(stats.netBytes) + "</td>"
+        + "<td>" + String(stats.maxBytesPerCall) + "</td></tr>";
+    }
+    html += "</table>";
+  } else {
+    html += "<div class='mini-note mb-3'>Build with <code>WX_HEAP_TRACKING</code> set to 1 to record the heap change of each network loop stage.</div>";
+  }
+
+  html +=
+      "<div class='mini-note mb-3'>Free heap sampled every 10 minutes. The heap is shared by all tasks, so this shows whether the station as a whole leaks or fragments.</div>"
+      "<table class='list-table'>"
+        "<tr><th>Uptime</th><th>Free</th><th>Largest block</th><th>Min free</th><th>Blocks</th></tr>";
+
+  for (uint8_t i = 0; i < HeapTracker::getSampleCount(); i++) {
+    const HeapTracker::Sample& sample = HeapTracker::getSample(i);
+    html += "<tr><td>" + String(sample.uptimeS / 60UL) + " min</td>"
+      + "<td>" + String(sample.freeBytes) + "</td>"
+      + "<td>" + String(sample.largestFreeBlock) + "</td>"
+      + "<td>" + String(sample.minFreeBytes) + "</td>"
+      + "<td>" + String(sample.allocatedBlocks) + "</td></tr>";
+  }
+
+  html +=
+      "</table>"
+    "</div>";
+  html += "</div></main>";
+  return html;
+}
+
+const SectionRenderer kPerfSections[] = {
+  [](AsyncWebServerRequest*) { return buildHead("WX Perf"); },
+  [](AsyncWebServerRequest*) { return buildNavbar("/debug/perf", false); },
+  [](AsyncWebServerRequest*) { return buildPerfPanel(); },
+  [](AsyncWebServerRequest*) { return buildJobsPanel(); },
+  [](AsyncWebServerRequest*) { return buildClockPanel(); },
+  [](AsyncWebServerRequest*) { return buildBootPanel(); },
+  [](AsyncWebServerRequest*) { return buildHeapPanel(); },
+  [](AsyncWebServerRequest* request) { return buildFooter(request); },
+};
+
+// Streams a page as chunked response, rendering one section at a time so the
+// whole document never has to be held in RAM.
+template <size_t N>
+void sendSections(AsyncWebServerRequest* request, const char* contentType, const SectionRenderer (&sections)[N]) {
+  std::shared_ptr<SectionedResponse> state = std::make_shared<SectionedResponse>();
+  state->request = request;
+  state->sections = sections;
+  state->sectionCount = N;
+  state->nextSection = 0;
+  state->pendingOffset = 0;
+
+  AsyncWebServerResponse* response = request->beginChunkedResponse(
+    contentType,
+    [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      (void)index;
+      while (state->pendingOffset >= state->pending.length()) {
+        if (state->nextSection >= state->sectionCount) {
+          return 0;
+        }
+
+        StationStateLock lock;
+        state->pending = state->sections[state->nextSection++](state->request);
+        state->pendingOffset = 0;
+      }
+
+      size_t chunkLength = state->pending.length() - state->pendingOffset;
+      if (chunkLength > maxLen) {
+        chunkLength = maxLen;
+      }
+      memcpy(buffer, state->pending.c_str() + state->pendingOffset, chunkLength);
+      state->pendingOffset += chunkLength;
+      return chunkLength;
     }
+  );
+  request->send(response);
+}
+
+void sendRedirect(AsyncWebServerRequest* request, const char* location) {
+  AsyncWebServerResponse* response = request->beginResponse(303, "text/plain", "");
+  response->addHeader("Location", location);
+  request->send(response);
+}
+
+// The settings page polls /applied with the ticket and reloads once the
+// network task is through, see buildSweetAlertScript()
+void redirectWithTicket(AsyncWebServerRequest* request, const String& location, uint32_t ticket) {
+  if (ticket == WebActions::kNoTicket) {
+    request->send(503, "text/plain", "Busy, try again");
+    return;
+  }
+  sendRedirect(request, (location + "&ticket=" + String(ticket)).c_str());
+}
+
+// Reloads config from flash and applies whatever differs from the old one
+void reloadConfig() {
+  scratchConfig = config;
+  {
+    StationStateLock lock;
     loadConfig();
-    Heartbeat::setEnabled(config.activeHeartbeat);
-    RainGauge::onConfigurationChanged(config.activeRain, config.rainTipMm);
-    applyGPIOTriggerConfiguration();
   }
+  applyConfigChanges(diffConfig(scratchConfig, config));
+}
+
+}  // namespace
+
+void beginStationState() {
+  stationStateMutex = xSemaphoreCreateRecursiveMutex();
+  WebActions::begin();
+}
+
+void lockStationState() {
+  xSemaphoreTakeRecursive(stationStateMutex, portMAX_DELAY);
+}
+
+void unlockStationState() {
+  xSemaphoreGiveRecursive(stationStateMutex);
+}
+
+// ====== Handle upload ======
+namespace {
+
+RestoreUpload* getRestoreUpload(AsyncWebServerRequest* request) {
+  return static_cast<RestoreUpload*>(request->_tempObject);
+}
+
+// Drops the temp file when this request wrote it, also on disconnect
+void releaseRestoreFile(AsyncWebServerRequest* request) {
+  if (restoringRequest != request) {
+    return;
+  }
+  request->_tempFile.close();
+  LittleFS.remove(kRestoreTempFile);
+  restoringRequest = nullptr;
+}
+
+void failRestoreUpload(AsyncWebServerRequest* request, RestoreUpload outcome) {
+  *getRestoreUpload(request) = outcome;
+  releaseRestoreFile(request);
+}
+
+bool startRestoreUpload(AsyncWebServerRequest* request) {
+  if (request->_tempObject != nullptr) {
+    // A second file in the same form
+    failRestoreUpload(request, RestoreUpload::Failed);
+    return false;
+  }
+  request->_tempObject = malloc(sizeof(RestoreUpload));
+  if (request->_tempObject == nullptr) {
+    return false;
+  }
+
+  *getRestoreUpload(request) = RestoreUpload::Receiving;
+  if (request->contentLength() > kMaxRestoreBytes) {
+    *getRestoreUpload(request) = RestoreUpload::TooLarge;
+    return false;
+  }
+  if (restoringRequest != nullptr) {
+    *getRestoreUpload(request) = RestoreUpload::Busy;
+    return false;
+  }
+
+  restoringRequest = request;
+  request->onDisconnect([request]() { releaseRestoreFile(request); });
+  request->_tempFile = LittleFS.open(kRestoreTempFile, "w");
+  if (!request->_tempFile) {
+    failRestoreUpload(request, RestoreUpload::Failed);
+    return false;
+  }
+  return true;
+}
+
+// Answers 413 to a POST whose declared body is over the limit, before the
+// server parses or keeps any of it. A trivial handler has its body
+// skipped. Added ahead of the route it guards, which then never sees
+// the request.
+class BodyLimitHandler : public AsyncWebHandler {
+ public:
+  BodyLimitHandler(const char* uri, size_t maxBytes) : uri_(uri), maxBytes_(maxBytes) {}
+
+  bool canHandle(AsyncWebServerRequest* request) const override {
+    return request->method() == HTTP_POST && request->contentLength() > maxBytes_ && request->url() == uri_;
+  }
+
+  void handleRequest(AsyncWebServerRequest* request) override {
+    request->send(413, "text/plain", "Request too large");
+  }
+
+  bool isRequestHandlerTrivial() const override {
+    return true;
+  }
+
+ private:
+  const char* uri_;
+  size_t maxBytes_;
+};
+
+}  // namespace
+
+void handleUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len, bool final) {
+  (void)filename;
+
+  if (index == 0 && !startRestoreUpload(request)) {
+    return;
+  }
+  RestoreUpload* upload = getRestoreUpload(request);
+  if (upload == nullptr || *upload != RestoreUpload::Receiving) {
+    return;
+  }
+
+  if (index + len > kMaxRestoreBytes) {
+    failRestoreUpload(request, RestoreUpload::TooLarge);
+    return;
+  }
+  if (request->_tempFile.write(data, len) != len) {
+    failRestoreUpload(request, RestoreUpload::Failed);
+    return;
+  }
+
+  if (final) {
+    // Moved into place by the request handler, once the body is complete
+    request->_tempFile.close();
+    *upload = index + len > 0 ? RestoreUpload::Complete : RestoreUpload::Failed;
+  }
+}
+
+// Installs the backup only when this request uploaded all of it
+void handleRestore(AsyncWebServerRequest* request) {
+  RestoreUpload* upload = getRestoreUpload(request);
+  RestoreUpload outcome = upload != nullptr ? *upload : RestoreUpload::Failed;
+  if (request->contentLength() > kMaxRestoreBytes) {
+    outcome = RestoreUpload::TooLarge;
+  }
+
+  if (outcome != RestoreUpload::Complete || restoringRequest != request) {
+    releaseRestoreFile(request);
+    switch (outcome) {
+      case RestoreUpload::TooLarge:
+        request->send(413, "text/plain", "Backup file too large");
+        break;
+      case RestoreUpload::Busy:
+        request->send(503, "text/plain", "Another restore is running, try again");
+        break;
+      default:
+        request->send(400, "text/plain", "No backup file received");
+        break;
+    }
+    return;
+  }
+
+  restoringRequest = nullptr;
+  invalidateConfigSnapshot();
+  if (!LittleFS.rename(kRestoreTempFile, kConfigFile)) {
+    LittleFS.remove(kRestoreTempFile);
+    request->send(500, "text/plain", "Failed to store the backup");
+    return;
+  }
+  redirectWithTicket(request, "/setting?restored=1", WebActions::push(WebActions::Action::ReloadConfig));
 }
 
 // ====== Handle root page ======
-void handleRoot() {
-  server.send(200, "text/html", buildDashboardPage());
+void handleRoot(AsyncWebServerRequest* request) {
+  sendSections(request, "text/html", kDashboardSections);
 }
 
-void handleSettings() {
-  server.send(200, "text/html", buildSettingsPage());
+void handleSettings(AsyncWebServerRequest* request) {
+  sendSections(request, "text/html", kSettingsSections);
 }
 
-void handleDebug() {
-  server.send(200, "text/html", buildDebugPage());
+void handleDebug(AsyncWebServerRequest* request) {
+  sendSections(request, "text/html", kDebugSections);
 }
 
-void handleDebugLogs() {
-  server.send(200, "text/html", logEscape(getDebugLogBuffer()));
+void handleDebugPerf(AsyncWebServerRequest* request) {
+  sendSections(request, "text/html", kPerfSections);
 }
 
-void handleDebugClear() {
+void handleDebugLogs(AsyncWebServerRequest* request) {
+  String html;
+  {
+    StationStateLock lock;
+    html = logEscape(getDebugLogBuffer());
+  }
+  request->send(200, "text/html", html);
+}
+
+void handleDebugClear(AsyncWebServerRequest* request) {
   clearDebugLogBuffer();
-  server.send(200, "text/plain", "OK");
+  request->send(200, "text/plain", "OK");
 }
 
-void handleStatus() {
-  server.send(200, "application/json", buildStatusJson());
+void handleStatus(AsyncWebServerRequest* request) {
+  String json;
+  {
+    StationStateLock lock;
+    json = buildStatusJson();
+  }
+  request->send(200, "application/json", json);
 }
 
 // ====== Handle save config ======
-void handleSave() {
-  config.debugMode       = server.hasArg("debugMode");
-  config.activeHeartbeat = server.hasArg("activeHeartbeat");
-  config.activeAPRS      = server.hasArg("activeAPRS");
-  config.activeMQTT      = server.hasArg("activeMQTT");
-  config.activeSYSLOG    = server.hasArg("activeSYSLOG");
-
-  if (server.hasArg("stationName")) config.stationName = server.arg("stationName");
-  if (server.hasArg("altitude")) config.altitude = server.arg("altitude").toFloat();
-
-  config.activeLight = server.hasArg("activeLight");
-  config.activeRain  = server.hasArg("activeRain");
-
-  if (server.hasArg("dataTemp"))  config.dataTemp  = server.arg("dataTemp");
-  if (server.hasArg("dataHumi"))  config.dataHumi  = server.arg("dataHumi");
-  if (server.hasArg("dataPress")) config.dataPress = server.arg("dataPress");
-  if (server.hasArg("dataLight")) config.dataLight = server.arg("dataLight");
-  if (server.hasArg("dataRssi"))  config.dataRssi  = server.arg("dataRssi");
-
-  if (server.hasArg("offsetTemp"))  config.offsetTemp  = server.arg("offsetTemp").toFloat();
-  if (server.hasArg("offsetHumi"))  config.offsetHumi  = server.arg("offsetHumi").toFloat();
-  if (server.hasArg("offsetPress")) config.offsetPress = server.arg("offsetPress").toFloat();
-  if (server.hasArg("rainTipMm"))   config.rainTipMm   = server.arg("rainTipMm").toFloat();
-
-  config.serverActive0 = server.hasArg("serverActive0");
-  if (server.hasArg("serverUrl0")) config.serverUrl0 = server.arg("serverUrl0");
-  if (server.hasArg("serverName0")) config.serverName0 = server.arg("serverName0");
-  config.serverActive1 = server.hasArg("serverActive1");
-  if (server.hasArg("serverUrl1")) config.serverUrl1 = server.arg("serverUrl1");
-  if (server.hasArg("serverName1")) config.serverName1 = server.arg("serverName1");
-  config.serverActive2 = server.hasArg("serverActive2");
-  if (server.hasArg("serverUrl2")) config.serverUrl2 = server.arg("serverUrl2");
-  if (server.hasArg("serverName2")) config.serverName2 = server.arg("serverName2");
-  config.serverActive3 = server.hasArg("serverActive3");
-  if (server.hasArg("serverUrl3")) config.serverUrl3 = server.arg("serverUrl3");
-  if (server.hasArg("serverName3")) config.serverName3 = server.arg("serverName3");
-
-  if (server.hasArg("aprsHost")) config.aprsHost = server.arg("aprsHost");
-  if (server.hasArg("aprsPort")) config.aprsPort = server.arg("aprsPort").toInt();
-  if (server.hasArg("aprsCall")) config.aprsCall = server.arg("aprsCall");
-  if (server.hasArg("aprsPass")) config.aprsPass = server.arg("aprsPass");
-  if (server.hasArg("aprsLat")) config.aprsLat = server.arg("aprsLat");
-  if (server.hasArg("aprsLon")) config.aprsLon = server.arg("aprsLon");
-  if (server.hasArg("aprsComment")) strncpy(config.aprsComment, server.arg("aprsComment").c_str(), sizeof(config.aprsComment) - 1);
-
-  if (server.hasArg("mqttServer")) config.mqttServer = server.arg("mqttServer");
-  if (server.hasArg("mqttPort")) config.mqttPort = server.arg("mqttPort").toInt();
-  if (server.hasArg("mqttTopicPub1")) config.mqttTopicPub1 = server.arg("mqttTopicPub1");
-  if (server.hasArg("mqttTopicPub2")) config.mqttTopicPub2 = server.arg("mqttTopicPub2");
-  if (server.hasArg("mqttTopicSub1")) config.mqttTopicSub1 = server.arg("mqttTopicSub1");
-  if (server.hasArg("mqttTopicSub2")) config.mqttTopicSub2 = server.arg("mqttTopicSub2");
-
-  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
-    config.gpioTriggers[i].enabled = server.hasArg("gpioTriggerEnabled" + String(i));
-    if (server.hasArg("gpioTriggerMetric" + String(i))) config.gpioTriggers[i].value = static_cast<uint8_t>(server.arg("gpioTriggerMetric" + String(i)).toInt());
-    if (server.hasArg("gpioTriggerPin" + String(i))) config.gpioTriggers[i].gpioPin = static_cast<int8_t>(server.arg("gpioTriggerPin" + String(i)).toInt());
-    if (server.hasArg("gpioTriggerOnValue" + String(i))) config.gpioTriggers[i].triggerOnValue = server.arg("gpioTriggerOnValue" + String(i)).toFloat();
-    if (server.hasArg("gpioTriggerOffValue" + String(i))) config.gpioTriggers[i].triggerOffValue = server.arg("gpioTriggerOffValue" + String(i)).toFloat();
+// Bodies over kMaxFormBodyBytes are turned away by a BodyLimitHandler
+void handleSave(AsyncWebServerRequest* request) {
+  Config& updated = formConfig;
+  {
+    StationStateLock lock;
+    updated = config;
   }
+  uint8_t truncated = 0;
+  uint8_t rejected = 0;
+
+  // Checkboxes are only sent when ticked, every other field only when present
+  for (size_t i = 0; i < getConfigFieldCount(); i++) {
+    const ConfigField& field = getConfigField(i);
+    const char* formKey = field.formKey != nullptr ? field.formKey : field.key;
+
+    if (field.type == ConfigFieldType::Bool) {
+      setConfigFieldValue(updated, field, request->hasArg(formKey) ? "true" : "false");
+      continue;
+    }
+    if (!request->hasArg(formKey)) {
+      continue;
+    }
 
-  if (server.hasArg("syslogServer")) config.syslogServer = server.arg("syslogServer");
-  if (server.hasArg("syslogPort")) config.syslogPort = server.arg("syslogPort").toInt();
+    switch (setConfigFieldValue(updated, field, request->arg(formKey).c_str(), true)) {
+      case ConfigSetResult::Ok:
+        break;
+      case ConfigSetResult::Truncated:
+        truncated++;
+        break;
+      case ConfigSetResult::OutOfRange:
+      case ConfigSetResult::Invalid:
+        rejected++;
+        break;
+    }
+  }
 
-  if (server.hasArg("intervalHttp")) config.intervalHttp = server.arg("intervalHttp").toInt() * 60000;
-  if (server.hasArg("intervalAprs")) config.intervalAprs = server.arg("intervalAprs").toInt() * 60000;
-  if (server.hasArg("intervalMqtt")) config.intervalMqtt = server.arg("intervalMqtt").toInt() * 60000;
-  if (server.hasArg("restartMode")) config.restartMode = server.arg("restartMode").toInt();
+  uint32_t ticket = WebActions::pushConfig(updated);
+  if (rejected > 0) {
+    redirectWithTicket(request, "/setting?saved=1&rejected=1", ticket);
+  } else if (truncated > 0) {
+    redirectWithTicket(request, "/setting?saved=1&truncated=1", ticket);
+  } else {
+    redirectWithTicket(request, "/setting?saved=1", ticket);
+  }
+}
 
-  config.aprsComment[sizeof(config.aprsComment) - 1] = '\0';
+// ====== Deferred actions ======
+// Runs the oldest queued web action on the network task
+void serviceWeb() {
+  WebActions::Entry entry;
+  if (!WebActions::peek(entry, scratchConfig)) {
+    return;
+  }
 
-  saveConfig();
-  Heartbeat::setEnabled(config.activeHeartbeat);
-  RainGauge::onConfigurationChanged(config.activeRain, config.rainTipMm);
-  applyGPIOTriggerConfiguration();
+  switch (entry.action) {
+    case WebActions::Action::ApplyConfig:
+      {
+        uint16_t changed = diffConfig(config, scratchConfig);
+        {
+          StationStateLock lock;
+          config = scratchConfig;
+        }
+        saveConfig();
+        applyConfigChanges(changed);
+      }
+      break;
+    case WebActions::Action::ReloadConfig:
+      reloadConfig();
+      break;
+    case WebActions::Action::FactoryReset:
+      if (LittleFS.exists(kConfigFile)) {
+        LittleFS.remove(kConfigFile);
+      }
+      RainGauge::reset();
+      reloadConfig();
+      break;
+    case WebActions::Action::StartCaptivePortal:
+    case WebActions::Action::Reboot:
+      // Give the web task time to flush the response first
+      if (millis() - entry.queuedAtMs < kRebootDelayMs) {
+        return;
+      }
+      WebActions::complete(entry.ticket);
+      if (entry.action == WebActions::Action::Reboot) {
+        restartStation(RestartInfo::Reason::Web);
+      }
+      startCaptivePortal();
+      return;
+  }
 
-  server.sendHeader("Location", "/setting?saved=1", true);
-  server.send(303, "text/plain", "");
+  WebActions::complete(entry.ticket);
 }
 
 // ====== Setup web ======
 void setupWeb() {
-  server.on("/", handleRoot);
-  server.on("/setting", handleSettings);
-  server.on("/debug", handleDebug);
+  server.on("/", HTTP_GET, handleRoot);
+  server.on("/setting", HTTP_GET, handleSettings);
+  server.on("/debug", HTTP_GET, handleDebug);
   server.on("/debug/logs", HTTP_GET, handleDebugLogs);
+  server.on("/debug/perf", HTTP_GET, handleDebugPerf);
   server.on("/debug/clear", HTTP_POST, handleDebugClear);
   server.on("/status", HTTP_GET, handleStatus);
+  server.addHandler(new BodyLimitHandler("/save", kMaxFormBodyBytes));
+  server.addHandler(new BodyLimitHandler("/restore", kMaxRestoreBytes));
   server.on("/save", HTTP_POST, handleSave);
 
-  server.on("/download", HTTP_GET, []() {
-    if (LittleFS.exists("/config.json")) {
-      File file = LittleFS.open("/config.json", "r");
-      server.sendHeader("Content-Disposition", "attachment; filename=config.json");
-      server.streamFile(file, "application/json");
-      file.close();
+  server.on("/download", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (LittleFS.exists(kConfigFile)) {
+      request->send(LittleFS, kConfigFile, "application/json", true);
     } else {
-      server.send(404, "text/plain", "Config file not found");
+      request->send(404, "text/plain", "Config file not found");
     }
   });
 
-  server.on(
-    "/restore",
-    HTTP_POST,
-    []() {
-      server.sendHeader("Location", "/setting?restored=1", true);
-      server.send(303, "text/plain", "");
-    },
-    handleUpload
-  );
+  server.on("/restore", HTTP_POST, handleRestore, handleUpload);
 
-  server.on("/wifi", HTTP_GET, []() {
-    server.sendHeader("Location", "/setting", true);
-    server.send(303, "text/plain", "");
-    delay(500);
-    startCaptivePortal();
+  server.on("/wifi", HTTP_GET, [](AsyncWebServerRequest* request) {
+    sendRedirect(request, "/setting");
+    WebActions::push(WebActions::Action::StartCaptivePortal);
   });
 
-  server.on("/factory", HTTP_GET, []() {
-    if (LittleFS.exists("/config.json")) {
-      LittleFS.remove("/config.json");
+  server.on("/factory", HTTP_GET, [](AsyncWebServerRequest* request) {
+    redirectWithTicket(request, "/setting?factory=1", WebActions::push(WebActions::Action::FactoryReset));
+  });
+
+  server.on("/reboot", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (WebActions::push(WebActions::Action::Reboot) == WebActions::kNoTicket) {
+      request->send(503, "text/plain", "Busy, try again");
+      return;
     }
-    RainGauge::reset();
-    loadConfig();
-    Heartbeat::setEnabled(config.activeHeartbeat);
-    RainGauge::onConfigurationChanged(config.activeRain, config.rainTipMm);
-    applyGPIOTriggerConfiguration();
-    server.sendHeader("Location", "/setting?factory=1", true);
-    server.send(303, "text/plain", "");
+    request->send(200, "text/plain", "Rebooting...");
+  });
+
+  server.on("/applied", HTTP_GET, [](AsyncWebServerRequest* request) {
+    uint32_t ticket = static_cast<uint32_t>(strtoul(request->arg("ticket").c_str(), nullptr, 10));
+    request->send(200, "application/json", WebActions::isDone(ticket) ? "{\"done\":true}" : "{\"done\":false}");
   });
 
-  server.on("/reboot", HTTP_GET, []() {
-    RainGauge::flush();
-    server.send(200, "text/plain", "Rebooting...");
-    delay(500);
-    ESP.restart();
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest* request) {
+    AsyncResponseStream* response = request->beginResponseStream("text/plain; version=0.0.4; charset=utf-8");
+    {
+      StationStateLock lock;
+      Metrics::writePrometheus(*response);
+    }
+    request->send(response);
   });
 
-  server.on("/config.json", HTTP_GET, []() {
-    if (LittleFS.exists("/config.json")) {
-      File file = LittleFS.open("/config.json", "r");
-      server.streamFile(file, "application/json");
-      file.close();
+  server.on("/config.json", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (LittleFS.exists(kConfigFile)) {
+      request->send(LittleFS, kConfigFile, "application/json");
     } else {
-      server.send(404, "text/plain", "Config file not found");
+      request->send(404, "text/plain", "Config file not found");
     }
   });
 
+  server.onNotFound([](AsyncWebServerRequest* request) {
+    request->send(404, "text/plain", "Not found");
+  });
+
   server.begin();
 }
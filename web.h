@@ -2,17 +2,38 @@
 #define WEB_H
 
 #include <Arduino.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include "config.h"
+#include "restartinfo.h"
 
-extern WebServer server;
+extern AsyncWebServer server;
 extern bool loadConfig();
 extern bool saveConfig();
 extern void startCaptivePortal();
+extern void restartStation(RestartInfo::Reason reason);
 extern String getDebugLogBuffer();
 extern void clearDebugLogBuffer();
 
-void setupWeb();       
-void handleRoot();   
-void handleSave();    
+// A second Config is too big for a task stack. Network task only, and
+// nothing is kept in it from one call to the next.
+extern Config scratchConfig;
+
+// Station state (config, debug log) is shared between loop() and the async
+// web task. Writers on the loop task and all web handlers hold this lock.
+// beginStationState() creates it, first thing in setup().
+void beginStationState();
+void lockStationState();
+void unlockStationState();
+
+struct StationStateLock {
+  StationStateLock() { lockStationState(); }
+  ~StationStateLock() { unlockStationState(); }
+};
+
+void setupWeb();
+void serviceWeb();
+void handleRoot(AsyncWebServerRequest* request);
+void handleSave(AsyncWebServerRequest* request);
 
 #endif
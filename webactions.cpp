@@ -0,0 +1,115 @@
+#include "webactions.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+namespace WebActions {
+
+namespace {
+
+struct Slot {
+  Entry entry;
+  bool started;
+};
+
+// Handlers run on the AsyncTCP task, peek() and complete() on the
+// network task. Held for a Config copy at most.
+SemaphoreHandle_t queueMutex = nullptr;
+
+Slot slots[kCapacity] = {};
+uint8_t head = 0;
+uint8_t count = 0;
+uint32_t lastTicket = kNoTicket;
+uint32_t completedTicket = kNoTicket;
+
+// Config of the ApplyConfig entry that has not started yet, there is at
+// most one
+Config pendingConfig;
+uint32_t pendingConfigTicket = kNoTicket;
+
+struct QueueLock {
+  QueueLock() { xSemaphoreTake(queueMutex, portMAX_DELAY); }
+  ~QueueLock() { xSemaphoreGive(queueMutex); }
+};
+
+uint32_t append(Action action) {
+  if (count >= kCapacity) {
+    return kNoTicket;
+  }
+
+  lastTicket++;
+  if (lastTicket == kNoTicket) {
+    lastTicket++;
+  }
+  Slot& slot = slots[(head + count) % kCapacity];
+  slot.entry = {action, lastTicket, millis()};
+  slot.started = false;
+  count++;
+  return lastTicket;
+}
+
+}
+
+void begin() {
+  if (queueMutex == nullptr) {
+    queueMutex = xSemaphoreCreateMutex();
+  }
+}
+
+uint32_t push(Action action) {
+  QueueLock lock;
+  return append(action);
+}
+
+uint32_t pushConfig(const Config& updated) {
+  QueueLock lock;
+  if (pendingConfigTicket == kNoTicket) {
+    pendingConfigTicket = append(Action::ApplyConfig);
+    if (pendingConfigTicket == kNoTicket) {
+      return kNoTicket;
+    }
+  }
+  pendingConfig = updated;
+  return pendingConfigTicket;
+}
+
+bool peek(Entry& entry, Config& target) {
+  QueueLock lock;
+  if (count == 0) {
+    return false;
+  }
+
+  Slot& slot = slots[head];
+  if (!slot.started && slot.entry.ticket == pendingConfigTicket) {
+    target = pendingConfig;
+    pendingConfigTicket = kNoTicket;
+  }
+  slot.started = true;
+  entry = slot.entry;
+  return true;
+}
+
+void complete(uint32_t ticket) {
+  QueueLock lock;
+  if (count == 0 || slots[head].entry.ticket != ticket) {
+    return;
+  }
+
+  completedTicket = ticket;
+  head = (head + 1) % kCapacity;
+  count--;
+}
+
+bool isDone(uint32_t ticket) {
+  QueueLock lock;
+  // Tickets run in order, so everything up to the last completed one is
+  // done. Unsigned difference, right across a wrap of the counter.
+  return ticket != kNoTicket && static_cast<int32_t>(completedTicket - ticket) >= 0;
+}
+
+uint8_t getDepth() {
+  QueueLock lock;
+  return count;
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+// Work the web handlers hand to the network task, which owns the config
+// file and the subsystems. Handlers queue an action, get a ticket and
+// answer at once; the page asks /applied?ticket=N until the network task
+// has been through it. Actions run in the order they came in, so a save
+// never cancels a reboot queued before it.
+namespace WebActions {
+
+constexpr uint8_t kCapacity = 8;
+// push() and pushConfig() return it when the queue is full
+constexpr uint32_t kNoTicket = 0;
+
+enum class Action : uint8_t {
+  ApplyConfig,
+  ReloadConfig,
+  FactoryReset,
+  StartCaptivePortal,
+  Reboot
+};
+
+struct Entry {
+  Action action;
+  uint32_t ticket;
+  unsigned long queuedAtMs;
+};
+
+// Creates the lock, call before the web server and the tasks start
+void begin();
+
+uint32_t push(Action action);
+
+// Queues a config to apply. While an earlier one has not started yet,
+// it is replaced and keeps its place and ticket, so quick saves from
+// several browsers collapse into one write.
+uint32_t pushConfig(const Config& updated);
+
+// Oldest action, which stays queued until complete(). The first peek at
+// an ApplyConfig copies its config into target and frees the slot for
+// the next save.
+bool peek(Entry& entry, Config& target);
+
+// Drops the oldest action when it still has that ticket
+void complete(uint32_t ticket);
+
+// True once the action of that ticket, and every one before it, ran
+bool isDone(uint32_t ticket);
+uint8_t getDepth();
+
+}
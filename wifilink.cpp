@@ -0,0 +1,364 @@
+#include "wifilink.h"
+
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include "config.h"
+#include "metrics.h"
+
+namespace WifiLink {
+
+namespace {
+
+constexpr const char* kFile = "/wifi_ap.bin";
+constexpr uint32_t kVersion = 1;
+constexpr uint8_t kMaxBackoffShift = 6;
+
+struct StoredAccessPoint {
+  uint32_t version;
+  char ssid[33];
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+struct Credentials {
+  char ssid[33];
+  char password[65];
+};
+
+StoredAccessPoint stored = {};
+bool storedValid = false;
+
+State state = State::Waiting;
+Mode mode = Mode::Direct;
+// An attempt this module started, as opposed to WiFiManager's
+bool attemptActive = false;
+uint8_t failedAttempts = 0;
+uint8_t failedDirectAttempts = 0;
+unsigned long retryDelayMs = 0;
+unsigned long nextAttemptAtMs = 0;
+unsigned long attemptStartedAtMs = 0;
+uint32_t lastConnectMs = 0;
+uint32_t lastAssociateMs = 0;
+uint32_t lastAddressMs = 0;
+uint32_t bootConnectMs = 0;
+
+// Written by the Arduino event task
+volatile uint32_t associatedAtMs = 0;
+volatile uint32_t addressedAtMs = 0;
+
+bool isDue(unsigned long now, unsigned long at) {
+  return static_cast<long>(now - at) >= 0;
+}
+
+bool loadStored() {
+  storedValid = false;
+  if (!LittleFS.exists(kFile)) {
+    return false;
+  }
+
+  File file = LittleFS.open(kFile, "r");
+  if (!file) {
+    return false;
+  }
+
+  size_t bytesRead = file.read(reinterpret_cast<uint8_t*>(&stored), sizeof(stored));
+  file.close();
+
+  storedValid = bytesRead == sizeof(stored)
+    && stored.version == kVersion
+    && stored.ssid[0] != '\0'
+    && stored.channel >= 1 && stored.channel <= 14;
+  return storedValid;
+}
+
+// Written only when the access point changed, a reconnect to the same
+// one costs no flash wear
+bool saveStored(const char* ssid, const uint8_t* bssid, uint8_t channel) {
+  if (storedValid && strcmp(stored.ssid, ssid) == 0
+      && memcmp(stored.bssid, bssid, sizeof(stored.bssid)) == 0 && stored.channel == channel) {
+    return true;
+  }
+
+  memset(&stored, 0, sizeof(stored));
+  stored.version = kVersion;
+  strncpy(stored.ssid, ssid, sizeof(stored.ssid) - 1);
+  memcpy(stored.bssid, bssid, sizeof(stored.bssid));
+  stored.channel = channel;
+
+  File file = LittleFS.open(kFile, "w");
+  if (!file) {
+    storedValid = false;
+    return false;
+  }
+
+  size_t bytesWritten = file.write(reinterpret_cast<const uint8_t*>(&stored), sizeof(stored));
+  file.close();
+  storedValid = bytesWritten == sizeof(stored);
+  return storedValid;
+}
+
+// The driver's config is not null terminated when a field is full
+bool readCredentials(Credentials& credentials) {
+  wifi_config_t driverConfig;
+  if (esp_wifi_get_config(WIFI_IF_STA, &driverConfig) != ESP_OK) {
+    return false;
+  }
+
+  memset(&credentials, 0, sizeof(credentials));
+  memcpy(credentials.ssid, driverConfig.sta.ssid, sizeof(driverConfig.sta.ssid));
+  memcpy(credentials.password, driverConfig.sta.password, sizeof(driverConfig.sta.password));
+  return credentials.ssid[0] != '\0';
+}
+
+// WiFi.begin() with a BSSID saves it to the driver's NVS config. Cleared
+// after a failed direct attempt, so WiFiManager's own connect scans.
+void unpinAccessPoint() {
+  wifi_config_t driverConfig;
+  if (esp_wifi_get_config(WIFI_IF_STA, &driverConfig) != ESP_OK || !driverConfig.sta.bssid_set) {
+    return;
+  }
+
+  driverConfig.sta.bssid_set = 0;
+  driverConfig.sta.channel = 0;
+  esp_wifi_set_config(WIFI_IF_STA, &driverConfig);
+}
+
+bool canConnectDirect(const Credentials& credentials) {
+  return storedValid && strcmp(stored.ssid, credentials.ssid) == 0;
+}
+
+bool startAttempt(Mode attemptMode) {
+  Credentials credentials;
+  if (!readCredentials(credentials)) {
+    return false;
+  }
+  if (attemptMode == Mode::Direct && !canConnectDirect(credentials)) {
+    attemptMode = Mode::Scan;
+  }
+
+  WiFi.disconnect();
+  applyAddressConfig();
+  associatedAtMs = 0;
+  addressedAtMs = 0;
+  attemptStartedAtMs = millis();
+  mode = attemptMode;
+  attemptActive = true;
+
+  if (mode == Mode::Direct) {
+    WiFi.begin(credentials.ssid, credentials.password, stored.channel, stored.bssid);
+  } else {
+    WiFi.begin(credentials.ssid, credentials.password);
+  }
+  state = State::Connecting;
+  return true;
+}
+
+Event onConnected() {
+  unsigned long now = millis();
+  if (bootConnectMs == 0) {
+    bootConnectMs = now;
+  }
+
+  if (attemptActive) {
+    uint32_t associatedAt = associatedAtMs;
+    uint32_t addressedAt = addressedAtMs;
+    lastConnectMs = now - attemptStartedAtMs;
+    lastAssociateMs = associatedAt != 0 ? associatedAt - attemptStartedAtMs : lastConnectMs;
+    lastAddressMs = associatedAt != 0 && addressedAt != 0 ? addressedAt - associatedAt : 0;
+    Metrics::recordWifiConnect(mode == Mode::Direct ? Metrics::WifiConnectMode::Direct : Metrics::WifiConnectMode::Scan,
+                               true, lastAssociateMs, lastAddressMs);
+    attemptActive = false;
+  }
+
+  // Reconnects are the link's job, the driver's own retry would race it
+  WiFi.setAutoReconnect(false);
+
+  Credentials credentials;
+  uint8_t* bssid = WiFi.BSSID();
+  if (readCredentials(credentials) && bssid != nullptr) {
+    saveStored(credentials.ssid, bssid, static_cast<uint8_t>(WiFi.channel()));
+  }
+
+  failedAttempts = 0;
+  failedDirectAttempts = 0;
+  retryDelayMs = 0;
+  state = State::Connected;
+  return Event::Connected;
+}
+
+Event fail() {
+  Metrics::recordWifiConnect(mode == Mode::Direct ? Metrics::WifiConnectMode::Direct : Metrics::WifiConnectMode::Scan,
+                             false, 0, 0);
+  attemptActive = false;
+  WiFi.disconnect();
+
+  if (mode == Mode::Direct) {
+    failedDirectAttempts++;
+    unpinAccessPoint();
+  }
+
+  uint8_t shift = failedAttempts < kMaxBackoffShift ? failedAttempts : kMaxBackoffShift;
+  if (failedAttempts < 255) {
+    failedAttempts++;
+  }
+  unsigned long backoffMs = kBackoffMinMs << shift;
+  if (backoffMs > kBackoffMaxMs) {
+    backoffMs = kBackoffMaxMs;
+  }
+  retryDelayMs = backoffMs / 2 + static_cast<unsigned long>(random(static_cast<long>(backoffMs / 2) + 1));
+  nextAttemptAtMs = millis() + retryDelayMs;
+  state = State::Waiting;
+  return Event::Failed;
+}
+
+Mode nextMode() {
+  return failedDirectAttempts < kDirectAttempts ? Mode::Direct : Mode::Scan;
+}
+
+}  // namespace
+
+void begin() {
+  loadStored();
+
+  WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t) { associatedAtMs = millis(); },
+               ARDUINO_EVENT_WIFI_STA_CONNECTED);
+  WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t) { addressedAtMs = millis(); },
+               ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  state = State::Waiting;
+  nextAttemptAtMs = millis();
+}
+
+bool startBootConnect() {
+  WiFi.mode(WIFI_STA);
+
+  Credentials credentials;
+  if (!readCredentials(credentials) || !canConnectDirect(credentials)) {
+    return false;
+  }
+  return startAttempt(Mode::Direct);
+}
+
+bool finishBootConnect() {
+  if (state != State::Connecting) {
+    return state == State::Connected;
+  }
+
+  while (millis() - attemptStartedAtMs < kDirectTimeoutMs) {
+    if (WiFi.status() == WL_CONNECTED) {
+      onConnected();
+      return true;
+    }
+    delay(20);
+  }
+
+  fail();
+  return false;
+}
+
+void applyAddressConfig() {
+  IPAddress address;
+  IPAddress gateway;
+  IPAddress subnet;
+  IPAddress dns;
+  if (getStaticAddress(address, gateway, subnet, dns)) {
+    WiFi.config(address, gateway, subnet, dns);
+  } else {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  }
+}
+
+bool getStaticAddress(IPAddress& address, IPAddress& gateway, IPAddress& subnet, IPAddress& dns) {
+  if (!config.staticIpActive
+      || !address.fromString(config.staticIp.c_str())
+      || !gateway.fromString(config.staticGateway.c_str())
+      || !subnet.fromString(config.staticSubnet.c_str())) {
+    return false;
+  }
+
+  if (config.staticDns.length() == 0) {
+    dns = gateway;
+    return true;
+  }
+  return dns.fromString(config.staticDns.c_str());
+}
+
+bool usesStaticAddress() {
+  IPAddress address;
+  IPAddress gateway;
+  IPAddress subnet;
+  IPAddress dns;
+  return getStaticAddress(address, gateway, subnet, dns);
+}
+
+Event update() {
+  bool connected = WiFi.status() == WL_CONNECTED;
+
+  switch (state) {
+    case State::Connected:
+      if (connected) {
+        return Event::None;
+      }
+      // First attempt right away, most drops are short
+      state = State::Waiting;
+      nextAttemptAtMs = millis();
+      failedDirectAttempts = 0;
+      return Event::Lost;
+    case State::Waiting:
+      if (connected) {
+        return onConnected();
+      }
+      if (isDue(millis(), nextAttemptAtMs) && !startAttempt(nextMode())) {
+        // Nothing stored to connect to, WiFiManager's portal is the only way
+        nextAttemptAtMs = millis() + kBackoffMaxMs;
+      }
+      return Event::None;
+    case State::Connecting:
+      if (connected) {
+        return onConnected();
+      }
+      if (millis() - attemptStartedAtMs > (mode == Mode::Direct ? kDirectTimeoutMs : kScanTimeoutMs)) {
+        return fail();
+      }
+      return Event::None;
+  }
+  return Event::None;
+}
+
+State getState() {
+  return state;
+}
+
+Mode getMode() {
+  return mode;
+}
+
+const char* getModeName(Mode linkMode) {
+  return linkMode == Mode::Direct ? "direct" : "scan";
+}
+
+uint8_t getFailedAttempts() {
+  return failedAttempts;
+}
+
+unsigned long getRetryDelayMs() {
+  return retryDelayMs;
+}
+
+uint32_t getLastConnectMs() {
+  return lastConnectMs;
+}
+
+uint32_t getLastAssociateMs() {
+  return lastAssociateMs;
+}
+
+uint32_t getLastAddressMs() {
+  return lastAddressMs;
+}
+
+uint32_t getBootConnectMs() {
+  return bootConnectMs;
+}
+
+}  // namespace WifiLink
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Station side Wi-Fi connection. The BSSID and channel of the last good
+// connection are kept on LittleFS, so a connect first goes straight to
+// that access point without a scan. When it is gone the link falls back
+// to a normal scan for the stored SSID. Credentials stay where
+// WiFiManager put them, in the Wi-Fi driver's NVS config.
+namespace WifiLink {
+
+// Upper bounds for one attempt, up to the IP address
+constexpr unsigned long kDirectTimeoutMs = 4000;
+constexpr unsigned long kScanTimeoutMs = 12000;
+
+// Direct attempts in a row before the link scans instead, the access
+// point may have moved to another channel
+constexpr uint8_t kDirectAttempts = 2;
+
+// Retry delay doubles per failed attempt, half of it is random jitter
+constexpr unsigned long kBackoffMinMs = 1000;
+constexpr unsigned long kBackoffMaxMs = 60000;
+
+enum class State : uint8_t {
+  Waiting,
+  Connecting,
+  Connected
+};
+
+enum class Mode : uint8_t {
+  // Stored BSSID and channel
+  Direct,
+  // Any access point with the stored SSID
+  Scan
+};
+
+enum class Event : uint8_t {
+  None,
+  Connected,
+  Failed,
+  Lost
+};
+
+// Loads the stored access point. Needs LittleFS mounted, call before the
+// first connect.
+void begin();
+
+// One direct attempt during setup, split in two so the caller can do
+// local work while the driver associates. startBootConnect() returns
+// false right away when nothing is stored, the caller then connects the
+// usual way. finishBootConnect() waits for the rest of kDirectTimeoutMs.
+bool startBootConnect();
+bool finishBootConnect();
+
+// Applies the static address from config, or DHCP when it is off or not
+// valid. WiFi.begin() picks it up.
+void applyAddressConfig();
+// False when the static address is off in config or one of its
+// addresses does not parse. An empty DNS is the gateway.
+bool getStaticAddress(IPAddress& address, IPAddress& gateway, IPAddress& subnet, IPAddress& dns);
+bool usesStaticAddress();
+
+// Follows the connection and runs reconnect attempts without blocking.
+// Once connected, stores the access point when it changed.
+Event update();
+
+State getState();
+Mode getMode();
+const char* getModeName(Mode mode);
+uint8_t getFailedAttempts();
+unsigned long getRetryDelayMs();
+// Phases of the last successful attempt made by the link
+uint32_t getLastConnectMs();
+uint32_t getLastAssociateMs();
+uint32_t getLastAddressMs();
+// Time from boot to the first connection, 0 until then
+uint32_t getBootConnectMs();
+
+}
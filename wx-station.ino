@@ -7,15 +7,33 @@
 #include <WiFiManager.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
-#include <WebServer.h>
 #include <ESPmDNS.h>
 #include <BH1750.h>
 #include <time.h>
 #include <Wire.h>
-#include "config.h"
+#include <atomic>
+#include "boottimeline.h"
+#include "configstore.h"
 #include "heartbeat.h"
+#include "heaptrack.h"
+#include "httpupload.h"
+#include "metrics.h"
+#include "mqttcommand.h"
+#include "mqttlink.h"
+#include "mqttoutbox.h"
+#include "mqttpublish.h"
+#include "mqttstream.h"
+#include "payload.h"
+#include "profiler.h"
+#include "publicip.h"
 #include "rain.h"
+#include "restartinfo.h"
+#include "scheduler.h"
+#include "tasklink.h"
+#include "timekeeper.h"
+#include "triggers.h"
 #include "web.h"
+#include "wifilink.h"
 
 const char* programName = "WX-Station";
 const char* programVers = "v1.0.7";
@@ -29,28 +47,36 @@ PubSubClient mqttClient(wifiClient);
 
 // ====== Global variables ======
 bool mqttNoWiFiReported = false;
-bool bmeOK = false;
-bool lightOK = false;
+bool mqttReconfigurePending = false;
 bool setupCompleted = false;
-bool accessPointModeActive = false;
-bool fatalErrorActive = false;
-bool runtimeSensorFaultActive = false;
-uint8_t bmeReadErrorCount = 0;
-uint8_t lightReadErrorCount = 0;
-
-unsigned long lastSensorRead = 0;
-unsigned long lastHttpSend = 0;
-unsigned long lastAprsSend = 0;
-unsigned long lastMQTTSend = 0;
-unsigned long lastRestart = 0;
+// Written by one task and read by the other in refreshHeartbeatState(),
+// or by the web server. The sensor fault flag lives in TaskLink.
+std::atomic<bool> bmeOK{false};
+std::atomic<bool> lightOK{false};
+std::atomic<bool> accessPointModeActive{false};
+std::atomic<bool> fatalErrorActive{false};
+std::atomic<uint8_t> bmeReadErrorCount{0};
+std::atomic<uint8_t> lightReadErrorCount{0};
+
+// Sensing jobs run on the Arduino loop task, network jobs on networkTask
+Scheduler::JobTable sensingJobs;
+Scheduler::JobTable networkJobs;
+Scheduler::JobId sensorJob = Scheduler::kNoJob;
+Scheduler::JobId httpJob = Scheduler::kNoJob;
+Scheduler::JobId aprsJob = Scheduler::kNoJob;
+Scheduler::JobId mqttPublishJob = Scheduler::kNoJob;
+Scheduler::JobId restartJob = Scheduler::kNoJob;
+Scheduler::JobId infoJob = Scheduler::kNoJob;
+Scheduler::JobId publicIpJob = Scheduler::kNoJob;
+Scheduler::JobId recoveryJob = Scheduler::kNoJob;
 unsigned long restartIntervalMs = 0;
 unsigned long intervalSensor = 30000;
-unsigned long lastMQTTReconnectAttempt = 0;
-const unsigned long mqttReconnectInterval = 10000; 
 const uint8_t maxConsecutiveBmeReadErrors = 5;
 const uint8_t maxConsecutiveLightReadErrors = 5;
+const uint32_t heartbeatUploadFailureLimit = 3;
+// With the WifiLink backoff, about 4 minutes without Wi-Fi
+const uint8_t maxWiFiReconnectAttempts = 9;
 const unsigned long sensorRecoveryIntervalMs = 5000;
-const unsigned long ntpResyncIntervalMs = 6UL * 60UL * 60UL * 1000UL;
 const uint8_t bmeI2cAddress = 0x76;
 const uint8_t bh1750PrimaryAddress = 0x23;
 const uint8_t bh1750SecondaryAddress = 0x5C;
@@ -63,23 +89,34 @@ const uint8_t i2cSdaPin = 21;
 const uint8_t i2cSclPin = 22;
 #endif
 
+// Latest reading as seen by the network task, the web UI and metrics
 float temperature, humidity, pressure, seaLevelPressure;
 float lightLux, lightWm2;
 int rssi;
+// Counts received readings, so the outbox never gets the same reading
+// twice, and when the latest one arrived. Written with the reading under
+// the station state lock.
+uint32_t sampleSequence = 0;
+uint32_t sampleUnixTime = 0;
+uint32_t handledSampleSequence = 0;
+
+// Owned by the sensing task, readings reach the network task through
+// TaskLink
+TaskLink::Sample sensingSample = {};
+Config sensingConfig;
+
+TaskHandle_t networkTask = nullptr;
+const uint32_t networkTaskStackBytes = 16384;
+bool networkFaultSeen = false;
 
 Adafruit_BME280 bme;
 BH1750 lightSensor;  
 uint8_t activeBh1750Address = bh1750PrimaryAddress;
-unsigned long lastNtpSyncAttempt = 0;
-bool clockSynchronized = false;
 String debugLogBuffer;
 const size_t maxDebugLogBufferLength = 12000;
-int8_t activeGPIOTriggerPins[GPIO_TRIGGER_COUNT] = {
-  GPIO_TRIGGER_PIN_DISABLED,
-  GPIO_TRIGGER_PIN_DISABLED,
-  GPIO_TRIGGER_PIN_DISABLED
-};
-bool gpioTriggerStates[GPIO_TRIGGER_COUNT] = {false, false, false};
+// Filled with GPIO_TRIGGER_PIN_DISABLED by applyGPIOTriggerConfiguration()
+int8_t activeGPIOTriggerPins[GPIO_TRIGGER_COUNT];
+bool gpioTriggerPinsInitialized = false;
 
 const char* ntpServerPrimary = "pool.ntp.org";
 const char* ntpServerSecondary = "time.google.com";
@@ -95,23 +132,49 @@ bool isI2CDeviceResponsive(uint8_t address);
 bool isBME280Responsive();
 bool isBH1750Responsive();
 void tryRecoverSensors();
-bool synchronizeClock(bool waitForSync = true);
+void followClock();
 void startMDNSService();
 void applyGPIOTriggerConfiguration();
-void updateGPIOTriggers();
+void evaluateGPIOTriggers();
+void restartInterval();
+void subscribeCommandTopics();
+void refreshSensingJobs();
+unsigned long mqttPublishPeriodMs();
+void alignNetworkJobs();
+
+// The sensing task logs by its own copy of the config, the network task
+// rewrites config when a change is applied
+bool isDebugMode() {
+  return TaskLink::isSensingTask() ? sensingConfig.debugMode : config.debugMode;
+}
 
+// Called from both tasks, each flag has one writer
 void refreshHeartbeatState() {
-  if (fatalErrorActive || runtimeSensorFaultActive) {
+  if (fatalErrorActive || TaskLink::hasSensorFault()) {
     Heartbeat::setState(Heartbeat::State::Error);
   } else if (accessPointModeActive) {
     Heartbeat::setState(Heartbeat::State::AccessPoint);
-  } else if (setupCompleted) {
-    Heartbeat::setState(Heartbeat::State::Normal);
-  } else {
+  } else if (!setupCompleted) {
     Heartbeat::setState(Heartbeat::State::Booting);
+  } else if (bmeReadErrorCount > 0 || lightReadErrorCount > 0) {
+    Heartbeat::setState(Heartbeat::State::SensorDegraded);
+  } else if (Metrics::getUploadFailureStreak() >= heartbeatUploadFailureLimit) {
+    Heartbeat::setState(Heartbeat::State::UploadsFailing);
+  } else if (!TimeKeeper::isTrusted()) {
+    Heartbeat::setState(Heartbeat::State::NoTime);
+  } else {
+    Heartbeat::setState(Heartbeat::State::Normal);
   }
 }
 
+// A software restart keeps the rain state in RTC memory, flash is left
+// for the power cut case
+void restartStation(RestartInfo::Reason reason) {
+  RainGauge::retain();
+  RestartInfo::prepare(reason);
+  ESP.restart();
+}
+
 void setAccessPointMode(bool active) {
   accessPointModeActive = active;
   refreshHeartbeatState();
@@ -128,28 +191,30 @@ void setFatalError(const char* message) {
 }
 
 void setRuntimeSensorFault(const char* message) {
-  if (!runtimeSensorFaultActive) {
+  if (!TaskLink::hasSensorFault()) {
     debugPrint(message, true);
     logToSyslog(message);
   }
 
-  runtimeSensorFaultActive = true;
+  TaskLink::setSensorFault(true);
   bmeOK = false;
   lightOK = false;
   refreshHeartbeatState();
+  refreshSensingJobs();
 }
 
 void clearRuntimeSensorFault() {
-  if (!runtimeSensorFaultActive) {
+  if (!TaskLink::hasSensorFault()) {
     return;
   }
 
-  runtimeSensorFaultActive = false;
+  TaskLink::setSensorFault(false);
   bmeReadErrorCount = 0;
   lightReadErrorCount = 0;
   debugPrint("SENS | Sensor communication restored, resuming station.", true);
   logToSyslog("SENS | Sensor communication restored, resuming station.");
   refreshHeartbeatState();
+  refreshSensingJobs();
 }
 
 void onConfigPortalStarted(WiFiManager* wifiManager) {
@@ -158,8 +223,9 @@ void onConfigPortalStarted(WiFiManager* wifiManager) {
 }
 
 void appendDebugLog(const String& msg, bool newline) {
-  if (!config.debugMode) return;
+  if (!isDebugMode()) return;
 
+  StationStateLock lock;
   debugLogBuffer += msg;
   if (newline || debugLogBuffer.length() == 0 || debugLogBuffer[debugLogBuffer.length() - 1] != '\n') {
     debugLogBuffer += "\n";
@@ -171,10 +237,12 @@ void appendDebugLog(const String& msg, bool newline) {
 }
 
 String getDebugLogBuffer() {
+  StationStateLock lock;
   return debugLogBuffer;
 }
 
 void clearDebugLogBuffer() {
+  StationStateLock lock;
   debugLogBuffer = "";
 }
 
@@ -186,10 +254,10 @@ bool isGPIOTriggerMetricAvailable(uint8_t metric) {
     case GPIO_TRIGGER_METRIC_RSSI:
       return true;
     case GPIO_TRIGGER_METRIC_LIGHT:
-      return config.activeLight;
+      return sensingConfig.activeLight;
     case GPIO_TRIGGER_METRIC_RAIN_1H:
     case GPIO_TRIGGER_METRIC_RAIN_24H:
-      return config.activeRain;
+      return sensingConfig.activeRain;
     default:
       return false;
   }
@@ -247,41 +315,25 @@ bool isGPIOTriggerSelectablePin(int pin) {
   return pin >= 0 && pin <= 40 && !isReservedGPIOPin(pin);
 }
 
-bool readGPIOTriggerMetricValue(uint8_t metric, float& value) {
-  switch (metric) {
-    case GPIO_TRIGGER_METRIC_TEMPERATURE:
-      value = temperature;
-      return !isnan(value);
-    case GPIO_TRIGGER_METRIC_HUMIDITY:
-      value = humidity;
-      return !isnan(value);
-    case GPIO_TRIGGER_METRIC_PRESSURE:
-      value = seaLevelPressure;
-      return !isnan(value);
-    case GPIO_TRIGGER_METRIC_LIGHT:
-      if (!config.activeLight) {
-        return false;
-      }
-      value = lightWm2;
-      return !isnan(value);
-    case GPIO_TRIGGER_METRIC_RAIN_1H:
-      if (!config.activeRain) {
-        return false;
-      }
-      value = RainGauge::getRainLastHourMm();
-      return !isnan(value);
-    case GPIO_TRIGGER_METRIC_RAIN_24H:
-      if (!config.activeRain) {
-        return false;
-      }
-      value = RainGauge::getRainLast24HoursMm();
-      return !isnan(value);
-    case GPIO_TRIGGER_METRIC_RSSI:
-      value = static_cast<float>(rssi);
-      return true;
-    default:
-      return false;
+// The metrics the triggers look at, as of the latest reading
+TriggerEngine::Sample buildGPIOTriggerSample() {
+  TriggerEngine::Sample sample = {};
+  sample.atMs = millis();
+
+  sample.values[GPIO_TRIGGER_METRIC_TEMPERATURE] = sensingSample.temperature;
+  sample.values[GPIO_TRIGGER_METRIC_HUMIDITY] = sensingSample.humidity;
+  sample.values[GPIO_TRIGGER_METRIC_PRESSURE] = sensingSample.seaLevelPressure;
+  sample.values[GPIO_TRIGGER_METRIC_LIGHT] = sensingSample.lightWm2;
+  sample.values[GPIO_TRIGGER_METRIC_RSSI] = static_cast<float>(sensingSample.rssi);
+  if (sensingConfig.activeRain) {
+    sample.values[GPIO_TRIGGER_METRIC_RAIN_1H] = RainGauge::getRainLastHourMm();
+    sample.values[GPIO_TRIGGER_METRIC_RAIN_24H] = RainGauge::getRainLast24HoursMm();
+  }
+
+  for (uint8_t metric = 0; metric < GPIO_TRIGGER_METRIC_COUNT; metric++) {
+    sample.valid[metric] = isGPIOTriggerMetricAvailable(metric) && !isnan(sample.values[metric]);
   }
+  return sample;
 }
 
 void releaseGPIOTriggerPin(uint8_t index) {
@@ -292,40 +344,68 @@ void releaseGPIOTriggerPin(uint8_t index) {
   }
 
   activeGPIOTriggerPins[index] = GPIO_TRIGGER_PIN_DISABLED;
-  gpioTriggerStates[index] = false;
+  TriggerEngine::setActive(index, false);
 }
 
-void applyGPIOTriggerOutput(uint8_t index, bool enabled) {
-  int8_t pin = activeGPIOTriggerPins[index];
+void applyGPIOTriggerOutput(const TriggerEngine::Change& change) {
+  int8_t pin = activeGPIOTriggerPins[change.index];
   if (pin == GPIO_TRIGGER_PIN_DISABLED) {
     return;
   }
 
-  gpioTriggerStates[index] = enabled;
-  digitalWrite(pin, enabled ? HIGH : LOW);
+  digitalWrite(pin, change.on ? HIGH : LOW);
 
-  String message = "TRG" + String(index + 1)
+  const GPIOTriggerConfig& trigger = sensingConfig.gpioTriggers[change.index];
+  String message = "TRG" + String(change.index + 1)
     + " | GPIO " + String(pin)
-    + " | " + String(enabled ? "ON" : "OFF")
-    + " | " + gpioTriggerMetricLabel(config.gpioTriggers[index].value)
-    + ": " + String(enabled ? config.gpioTriggers[index].triggerOnValue : config.gpioTriggers[index].triggerOffValue, 2)
-    + " " + gpioTriggerMetricUnit(config.gpioTriggers[index].value);
+    + " | " + String(change.on ? "ON" : "OFF");
+  if (trigger.condition == GPIO_TRIGGER_CONDITION_RULE) {
+    message += " | Rule: " + String(trigger.rule.c_str());
+  } else {
+    bool rate = trigger.condition == GPIO_TRIGGER_CONDITION_RATE;
+    message += String(" | ") + gpioTriggerMetricLabel(trigger.value) + (rate ? " rate" : "")
+      + ": " + String(change.value, 2)
+      + " " + gpioTriggerMetricUnit(trigger.value) + (rate ? "/h" : "");
+  }
   debugPrint(message, true);
   logToSyslog(message.c_str());
 }
 
 void applyGPIOTriggerConfiguration() {
+  if (!gpioTriggerPinsInitialized) {
+    for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
+      activeGPIOTriggerPins[i] = GPIO_TRIGGER_PIN_DISABLED;
+    }
+    gpioTriggerPinsInitialized = true;
+  }
+
   bool claimedPins[41] = {false};
 
   for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
-    GPIOTriggerConfig& trigger = config.gpioTriggers[i];
+    GPIOTriggerConfig& trigger = sensingConfig.gpioTriggers[i];
+    bool rule = trigger.condition == GPIO_TRIGGER_CONDITION_RULE;
+    // A rule names its own metrics, one without a value only makes its
+    // comparison false
     bool validConfiguration =
+      i < sensingConfig.gpioTriggerSlots &&
       trigger.enabled &&
-      trigger.value < GPIO_TRIGGER_METRIC_COUNT &&
-      isGPIOTriggerMetricAvailable(trigger.value) &&
+      (rule || (trigger.value < GPIO_TRIGGER_METRIC_COUNT && isGPIOTriggerMetricAvailable(trigger.value))) &&
       isGPIOTriggerSelectablePin(trigger.gpioPin) &&
       !claimedPins[trigger.gpioPin];
 
+    if (validConfiguration && rule) {
+      RuleEngine::Program program;
+      RuleEngine::Error error;
+      if (RuleEngine::compile(trigger.rule.c_str(), program, error)) {
+        TriggerEngine::setRule(i, program);
+      } else {
+        String message = "TRG" + String(i + 1) + " | Rule error at " + String(error.position) + ": " + error.message;
+        debugPrint(message, true);
+        logToSyslog(message.c_str());
+        validConfiguration = false;
+      }
+    }
+
     if (!validConfiguration) {
       releaseGPIOTriggerPin(i);
       continue;
@@ -338,51 +418,32 @@ void applyGPIOTriggerConfiguration() {
       activeGPIOTriggerPins[i] = trigger.gpioPin;
       pinMode(activeGPIOTriggerPins[i], OUTPUT);
       digitalWrite(activeGPIOTriggerPins[i], LOW);
-      gpioTriggerStates[i] = false;
+      TriggerEngine::setActive(i, true);
     } else {
       pinMode(activeGPIOTriggerPins[i], OUTPUT);
-      digitalWrite(activeGPIOTriggerPins[i], gpioTriggerStates[i] ? HIGH : LOW);
+      digitalWrite(activeGPIOTriggerPins[i], TriggerEngine::isOn(i) ? HIGH : LOW);
     }
   }
 }
 
-void updateGPIOTriggers() {
-  for (uint8_t i = 0; i < GPIO_TRIGGER_COUNT; i++) {
-    int8_t pin = activeGPIOTriggerPins[i];
-    if (pin == GPIO_TRIGGER_PIN_DISABLED) {
-      continue;
-    }
-
-    GPIOTriggerConfig& trigger = config.gpioTriggers[i];
-    float currentValue = 0.0f;
-    if (!readGPIOTriggerMetricValue(trigger.value, currentValue)) {
-      continue;
-    }
-
-    bool nextState = gpioTriggerStates[i];
-    if (trigger.triggerOnValue >= trigger.triggerOffValue) {
-      if (!nextState && currentValue >= trigger.triggerOnValue) {
-        nextState = true;
-      } else if (nextState && currentValue <= trigger.triggerOffValue) {
-        nextState = false;
-      }
-    } else {
-      if (!nextState && currentValue <= trigger.triggerOnValue) {
-        nextState = true;
-      } else if (nextState && currentValue >= trigger.triggerOffValue) {
-        nextState = false;
-      }
-    }
+// Runs once per sensor reading, and after a trigger config change so new
+// thresholds apply without waiting for the next one
+void evaluateGPIOTriggers() {
+  if (TriggerEngine::getActiveCount() == 0) {
+    return;
+  }
 
-    if (nextState != gpioTriggerStates[i]) {
-      applyGPIOTriggerOutput(i, nextState);
-    }
+  Profiler::StageTimer stageTimer(Profiler::Stage::Triggers);
+  TriggerEngine::Change changes[GPIO_TRIGGER_COUNT];
+  uint8_t changeCount = TriggerEngine::evaluate(sensingConfig.gpioTriggers, buildGPIOTriggerSample(), changes);
+  for (uint8_t i = 0; i < changeCount; i++) {
+    applyGPIOTriggerOutput(changes[i]);
   }
 }
 
 // ====== Functions ======
 void debugPrint(const String& msg, bool newline = false) {
-  if (!config.debugMode) return;
+  if (!isDebugMode()) return;
 
   appendDebugLog(msg, true);
   if (newline) Serial.println(msg);
@@ -390,7 +451,7 @@ void debugPrint(const String& msg, bool newline = false) {
 }
 
 void debugPrint(const char* msg, bool newline = false) {
-  if (!config.debugMode) return;
+  if (!isDebugMode()) return;
 
   appendDebugLog(String(msg), true);
   if (newline) Serial.println(msg);
@@ -398,18 +459,18 @@ void debugPrint(const char* msg, bool newline = false) {
 }
 
 void debugPrintln() {
-  if (config.debugMode) {
+  if (isDebugMode()) {
     appendDebugLog("", true);
     Serial.println();
   }
 }
 
-void logToSyslog(const char* message) {
+void sendSyslog(const char* message) {
   if (!config.activeSYSLOG) return;
 
   String syslogMessage = "<134>";
   
-  syslogMessage += config.stationName;
+  syslogMessage += config.stationName.c_str();
   syslogMessage += ": ";
   syslogMessage += message;
 
@@ -419,6 +480,21 @@ void logToSyslog(const char* message) {
   udp.endPacket();
 }
 
+// The UDP send resolves the server name and may block for seconds, so
+// lines logged by the sensing task are sent later by the network task
+void logToSyslog(const char* message) {
+  if (!TaskLink::deferLogLine(message)) {
+    sendSyslog(message);
+  }
+}
+
+void drainSyslogQueue() {
+  char text[TaskLink::kLogLineLength];
+  while (TaskLink::takeLogLine(text, sizeof(text))) {
+    sendSyslog(text);
+  }
+}
+
 void welcomeMessage() {
   String line = String(programName) + " " + programVers + " | Local IP: " + WiFi.localIP().toString();
   int len = line.length();
@@ -460,11 +536,120 @@ void restartInterval() {
   }
 }
 
+// Changes to what the sensing task owns, applied by that task
+const uint16_t sensingSubsystems = CONFIG_SUBSYSTEM_DEBUG | CONFIG_SUBSYSTEM_HEARTBEAT | CONFIG_SUBSYSTEM_RAIN
+  | CONFIG_SUBSYSTEM_SENSORS | CONFIG_SUBSYSTEM_TRIGGERS | CONFIG_SUBSYSTEM_INTERVALS;
+
+// Sensing task side of applyConfigChanges(). Takes its own copy of the
+// config first, so it never reads fields the web UI is writing.
+void receiveConfigChanges() {
+  uint16_t changed = TaskLink::takeConfigChanges();
+  if (changed == CONFIG_SUBSYSTEM_NONE) {
+    return;
+  }
+
+  {
+    StationStateLock lock;
+    sensingConfig = config;
+  }
+
+  if (changed & CONFIG_SUBSYSTEM_HEARTBEAT) {
+    Heartbeat::setEnabled(sensingConfig.activeHeartbeat);
+  }
+  if (changed & CONFIG_SUBSYSTEM_RAIN) {
+    RainGauge::onConfigurationChanged(sensingConfig.activeRain, sensingConfig.rainTipMm);
+  }
+  if (changed & CONFIG_SUBSYSTEM_SENSORS) {
+    if (sensingConfig.activeLight != lightOK && !initBH1750(1, false)) {
+      setRuntimeSensorFault("SENS | BH1750 initialization failed.");
+    }
+    // Offsets and altitude show up with the next reading
+    sensingJobs.schedule(sensorJob);
+  }
+  if (changed & CONFIG_SUBSYSTEM_TRIGGERS) {
+    applyGPIOTriggerConfiguration();
+    evaluateGPIOTriggers();
+  }
+  if (changed & CONFIG_SUBSYSTEM_INTERVALS) {
+    sensingJobs.setAligned(sensorJob, sensingConfig.alignIntervals);
+  }
+}
+
+// Pushes a saved config change to the subsystems that use the changed
+// fields, so nothing waits for a reboot. Syslog settings are read on
+// every use and need no action here. Runs on the network task, the
+// sensing part is handed over, see receiveConfigChanges().
+void applyConfigChanges(uint16_t changed) {
+  if (changed == CONFIG_SUBSYSTEM_NONE) {
+    return;
+  }
+
+  if ((changed & sensingSubsystems) && !TaskLink::pushConfigChange(changed & sensingSubsystems)) {
+    debugPrint("SYST | Config change queue full, sensing settings apply after restart", true);
+  }
+  if (changed & CONFIG_SUBSYSTEM_HTTP) {
+    networkJobs.schedule(httpJob);
+    // Looks up again only when the lookup URL changed
+    networkJobs.schedule(publicIpJob);
+  }
+  if (changed & CONFIG_SUBSYSTEM_APRS) {
+    networkJobs.schedule(aprsJob);
+  }
+  if (changed & CONFIG_SUBSYSTEM_MQTT) {
+    // Done by runningMQTT(), this may run inside the MQTT callback
+    mqttReconfigurePending = true;
+  }
+  if (changed & (CONFIG_SUBSYSTEM_MQTT | CONFIG_SUBSYSTEM_MQTT_PUBLISH)) {
+    ChangePublisher::reset();
+    networkJobs.setPeriod(mqttPublishJob, mqttPublishPeriodMs());
+    networkJobs.schedule(mqttPublishJob);
+  }
+  if (changed & CONFIG_SUBSYSTEM_INTERVALS) {
+    networkJobs.setPeriod(httpJob, config.intervalHttp);
+    networkJobs.setPeriod(aprsJob, config.intervalAprs);
+    networkJobs.setPeriod(mqttPublishJob, mqttPublishPeriodMs());
+    alignNetworkJobs();
+  }
+  if (changed & CONFIG_SUBSYSTEM_RESTART) {
+    restartInterval();
+    networkJobs.schedule(restartJob, restartIntervalMs);
+    refreshNetworkJobs();
+  }
+
+  String msg = "SYST | Config applied to";
+  const char* const names[] = {"debug", "heartbeat", "sensors", "rain", "http", "aprs", "mqtt", "triggers", "syslog", "intervals", "restart", "mqtt_publish"};
+  for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (changed & (1 << i)) {
+      msg += " ";
+      msg += names[i];
+    }
+  }
+  debugPrint(msg, true);
+  logToSyslog(msg.c_str());
+}
+
+// Reports stalls of both tasks, from the network task so the report
+// itself cannot stall the sensing loop
+void reportLoopStalls() {
+  for (uint8_t i = 0; i < static_cast<uint8_t>(Profiler::Task::Count); i++) {
+    Profiler::StallReport stall;
+    if (!Profiler::takeStall(static_cast<Profiler::Task>(i), stall)) {
+      continue;
+    }
+
+    String msg = "PERF | Loop " + String(Profiler::getTaskName(stall.task)) + " stalled "
+      + String(stall.iterationUs / 1000UL) + " ms, slowest stage "
+      + Profiler::getStageName(stall.slowestStage) + " " + String(stall.slowestStageUs / 1000UL) + " ms";
+    debugPrint(msg, true);
+    logToSyslog(msg.c_str());
+  }
+}
+
 void startCaptivePortal() {
   setAccessPointMode(true);
   debugPrint("Web server turned off", true);
   logToSyslog("Web server turned off");
-  server.stop();  
+  server.end();
 
   wm.setConnectRetries(3);        
   wm.setConfigPortalTimeout(600);   
@@ -478,43 +663,38 @@ void startCaptivePortal() {
   logToSyslog("Web server turned on");
 }
 
+// Reconnects without blocking, see WifiLink
 void reconnectWiFi() {
-  static bool reconnecting = false;
-  static unsigned long reconnectStart = 0;
-  static int failedAttempts = 0; 
-  const unsigned long reconnectInterval = 10000;
-
-  if (WiFi.status() != WL_CONNECTED) {
-    if (!reconnecting) {
+  switch (WifiLink::update()) {
+    case WifiLink::Event::None:
+      break;
+    case WifiLink::Event::Lost:
       debugPrint("WiFi | Lost connection, starting reconnect...", true);
       logToSyslog("WiFi | Lost connection, starting reconnect...");
-      reconnecting = true;
-      reconnectStart = millis();
-      failedAttempts = 0; 
-    } else {
-      if (millis() - reconnectStart >= reconnectInterval) {
-        debugPrint("WiFi | Attempting reconnect...", true);
-        logToSyslog("WiFi | Attempting reconnect...");
-        WiFi.reconnect();
-        reconnectStart = millis();
-        failedAttempts++;
-
-        if (failedAttempts >= 9) {   
-          debugPrint("REST | Reconnect failed too many times -> Restarting...", true);
-          logToSyslog("REST | Reconnect failed too many times -> Restarting...");
-          RainGauge::flush();
-          ESP.restart();
-        }
+      break;
+    case WifiLink::Event::Connected:
+      {
+        String msg = "WiFi | Reconnected in " + String(WifiLink::getLastConnectMs()) + " ms ("
+          + WifiLink::getModeName(WifiLink::getMode()) + ", associate " + String(WifiLink::getLastAssociateMs())
+          + " ms, address " + String(WifiLink::getLastAddressMs()) + " ms)";
+        debugPrint(msg, true);
+        logToSyslog(msg.c_str());
       }
-    }
-  } else {
-    if (reconnecting) {
-      debugPrint("WiFi | Reconnected!", true);
-      logToSyslog("WiFi | Reconnected!");
       startMDNSService();
-      reconnecting = false;
-      failedAttempts = 0;
-    }
+      break;
+    case WifiLink::Event::Failed:
+      {
+        String msg = "WiFi | Reconnect (" + String(WifiLink::getModeName(WifiLink::getMode())) + ") failed, retry in "
+          + String(WifiLink::getRetryDelayMs()) + " ms";
+        debugPrint(msg, true);
+        logToSyslog(msg.c_str());
+      }
+      if (WifiLink::getFailedAttempts() >= maxWiFiReconnectAttempts) {
+        debugPrint("REST | Reconnect failed too many times -> Restarting...", true);
+        logToSyslog("REST | Reconnect failed too many times -> Restarting...");
+        restartStation(RestartInfo::Reason::WiFi);
+      }
+      break;
   }
 }
 
@@ -572,7 +752,7 @@ bool isBH1750Responsive() {
 }
 
 bool initBH1750(uint8_t attempts, bool waitBetweenAttempts) {
-  if (!config.activeLight) {
+  if (!sensingConfig.activeLight) {
     lightOK = false;
     lightReadErrorCount = 0;
     return true;
@@ -607,16 +787,8 @@ bool initBH1750(uint8_t attempts, bool waitBetweenAttempts) {
   return false;
 }
 
+// Runs every sensorRecoveryIntervalMs while the station is in sensor fault
 void tryRecoverSensors() {
-  static unsigned long lastRecoveryAttempt = 0;
-  unsigned long now = millis();
-
-  if (now - lastRecoveryAttempt < sensorRecoveryIntervalMs) {
-    return;
-  }
-
-  lastRecoveryAttempt = now;
-
   debugPrint("SENS | Sensor recovery in progress...", true);
   logToSyslog("SENS | Sensor recovery in progress...");
 
@@ -627,53 +799,28 @@ void tryRecoverSensors() {
     clearRuntimeSensorFault();
     readSensorData();
 
-    if (config.activeLight) {
+    if (sensingConfig.activeLight) {
       readLightSensor();
     }
+    TaskLink::pushSample(sensingSample);
   }
 }
 
-bool synchronizeClock(bool waitForSync) {
-  if (WiFi.status() != WL_CONNECTED) {
-    return false;
-  }
-
-  time_t now = time(nullptr);
-  if (now >= 1700000000) {
-    clockSynchronized = true;
-    return true;
-  }
-
-  unsigned long currentAttemptMs = millis();
-  if (!waitForSync && (currentAttemptMs - lastNtpSyncAttempt < ntpResyncIntervalMs)) {
-    return clockSynchronized;
-  }
-
-  lastNtpSyncAttempt = currentAttemptMs;
-  configTime(0, 0, ntpServerPrimary, ntpServerSecondary, ntpServerTertiary);
-
-  if (!waitForSync) {
-    return false;
+// SNTP itself runs in the background, this only reports its answers
+void followClock() {
+  TimeKeeper::SyncRecord record;
+  if (!TimeKeeper::update(record)) {
+    return;
   }
 
-  debugPrint("TIME | Waiting for NTP sync...", true);
-  logToSyslog("TIME | Waiting for NTP sync...");
-
-  for (uint8_t attempt = 0; attempt < 20; attempt++) {
-    delay(500);
-    now = time(nullptr);
-    if (now >= 1700000000) {
-      clockSynchronized = true;
-      debugPrint("TIME | NTP synchronized.", true);
-      logToSyslog("TIME | NTP synchronized.");
-      return true;
-    }
+  String msg = "TIME | NTP synchronized, offset " + String(record.offsetMs) + " ms";
+  msg += record.stepped ? ", stepped" : ", slewed";
+  float driftPpm;
+  if (TimeKeeper::getDriftPpm(driftPpm)) {
+    msg += ", drift " + String(driftPpm, 1) + " ppm";
   }
-
-  clockSynchronized = false;
-  debugPrint("TIME | NTP sync timeout, continuing without confirmed time.", true);
-  logToSyslog("TIME | NTP sync timeout, continuing without confirmed time.");
-  return false;
+  debugPrint(msg, true);
+  logToSyslog(msg.c_str());
 }
 
 void readSensorData() {
@@ -707,13 +854,13 @@ void readSensorData() {
 
   bmeReadErrorCount = 0;
 
-  float seaLevel = pres / pow(1.0 - (config.altitude / 44330.0), 5.255);
+  float seaLevel = pres / pow(1.0 - (sensingConfig.altitude / 44330.0), 5.255);
 
-  temperature = temp + config.offsetTemp;
-  humidity    = hum + config.offsetHumi;
-  pressure    = pres + config.offsetPress;
-  seaLevelPressure = seaLevel + config.offsetPress; 
-  rssi = WiFi.RSSI();
+  sensingSample.temperature = temp + sensingConfig.offsetTemp;
+  sensingSample.humidity    = hum + sensingConfig.offsetHumi;
+  sensingSample.pressure    = pres + sensingConfig.offsetPress;
+  sensingSample.seaLevelPressure = seaLevel + sensingConfig.offsetPress; 
+  sensingSample.rssi = WiFi.RSSI();
 }
 
 void readLightSensor() {
@@ -744,29 +891,23 @@ void readLightSensor() {
     }
 
     lightReadErrorCount = 0;
-    lightLux = lux;
-    lightWm2 = lux * 0.0079;
+    sensingSample.lightLux = lux;
+    sensingSample.lightWm2 = lux * 0.0079;
 }
 
 void sendInfoToDB() {
   if (!config.serverActive0) return;
 
   String localIP = WiFi.localIP().toString();
-  String publicIP = "unknown";
+  // Cached by the public_ip job, never looked up here
+  String publicIP = PublicIp::get();
 
   HTTPClient http;
-  http.begin("http://api.ipify.org");
-  int httpCode = http.GET();
-  if (httpCode == 200) {
-    publicIP = http.getString();
-    publicIP.trim();
-  }
-  http.end();
 
-  String url = config.serverUrl0;
+  String url = config.serverUrl0.c_str();
   if (config.serverName0.length() > 0) { 
       url += "?station=";
-      url += config.serverName0;
+      url += config.serverName0.c_str();
       url += "&version=";
       url += programVers;
   } else {
@@ -776,8 +917,10 @@ void sendInfoToDB() {
   url += "&loc-ip=" + localIP;
   url += "&pub-ip=" + publicIP;
 
+  unsigned long startedAtMs = millis();
   http.begin(url);
   int response = http.GET();
+  Metrics::recordUpload(Metrics::Destination::Info, response > 0, millis() - startedAtMs);
   if (response > 0) {
     String msg = "INFO | SENT OK | HTTP " + String(response) + " | URL: " + url;
     debugPrint(msg, true);
@@ -790,124 +933,56 @@ void sendInfoToDB() {
   http.end();
 }
 
-void sendDataToDB() {
-  String rainParam = "";
-  if (config.activeRain) {
-    rainParam = "&rain_1h=" + String(RainGauge::getRainLastHourMm(), 2);
-    rainParam += "&rain_24h=" + String(RainGauge::getRainLast24HoursMm(), 2);
-  }
-
-  // Server 1
-  if (config.serverActive1) {
-      String url = config.serverUrl1 + "?";
-      
-      bool firstParam = true;
+// Current readings, for the servers, Pub Sub 1 and the outbox
+Payload::Sample currentSample() {
+  Payload::Sample sample;
+  sample.temperature = temperature;
+  sample.humidity = humidity;
+  sample.seaLevelPressure = seaLevelPressure;
+  sample.lightWm2 = lightWm2;
+  sample.rain1h = RainGauge::getRainLastHourMm();
+  sample.rain24h = RainGauge::getRainLast24HoursMm();
+  sample.rssi = rssi;
+  sample.timestamp = sampleUnixTime;
+  return sample;
+}
 
-      if (config.serverName1.length() > 0) {
-          url += "station=" + config.serverName1;
-          firstParam = false;
-      }
+// Network task only, the URL and log line are kept off its stack
+void sendDataToServer(const char* tag, const char* serverUrl, const char* stationName, Metrics::Destination destination, const Payload::Sample& sample) {
+  static char url[HttpUpload::kMaxLength];
+  static char msg[HttpUpload::kMaxLength + 40];
 
-      url += (firstParam ? "" : "&") + String(config.dataTemp) + "=" + String(temperature, 2);
-      firstParam = false;
-      url += "&" + String(config.dataHumi) + "=" + String(humidity, 2);
-      url += "&" + String(config.dataPress) + "=" + String(seaLevelPressure, 2);
-      if (config.activeLight) {
-        url += "&" + String(config.dataLight) + "=" + String(lightWm2, 2);
-      }
-      url += rainParam;
-      url += "&" + String(config.dataRssi) + "=" + String(rssi);
+  if (HttpUpload::buildUrl(serverUrl, stationName, sample, config, url, sizeof(url)) == 0) {
+    snprintf(msg, sizeof(msg), "%s | SENT KO | URL longer than %u bytes", tag, static_cast<unsigned>(sizeof(url) - 1));
+    debugPrint(msg, true);
+    logToSyslog(msg);
+    return;
+  }
 
-      HTTPClient http;
-      http.begin(url);
-      int httpResponseCode = http.GET();
+  HTTPClient http;
+  unsigned long startedAtMs = millis();
+  http.begin(url);
+  int httpResponseCode = http.GET();
+  Metrics::recordUpload(destination, httpResponseCode > 0, millis() - startedAtMs);
 
-      String msg;
+  snprintf(msg, sizeof(msg), "%s | SENT %s | HTTP %d | URL: %s", tag, httpResponseCode > 0 ? "OK" : "KO", httpResponseCode, url);
+  debugPrint(msg, true);
+  logToSyslog(msg);
 
-      if (httpResponseCode > 0) {
-          msg = "SVR1 | SENT OK | HTTP " + String(httpResponseCode) + " | URL: " + url;
-      } else {
-          msg = "SVR1 | SENT KO | HTTP " + String(httpResponseCode) + " | URL: " + url;
-      }
+  http.end();
+}
 
-      debugPrint(msg, true);
-      logToSyslog(msg.c_str());
+void sendDataToDB() {
+  Payload::Sample sample = currentSample();
 
-      http.end();
+  if (config.serverActive1) {
+    sendDataToServer("SVR1", config.serverUrl1.c_str(), config.serverName1.c_str(), Metrics::Destination::Server1, sample);
   }
-
-  // Server 2
   if (config.serverActive2) {
-      String url = config.serverUrl2 + "?";
-      bool firstParam = true;
-
-      if (config.serverName2.length() > 0) {
-          url += "station=" + config.serverName2;
-          firstParam = false;
-      }
-
-      url += (firstParam ? "" : "&") + String(config.dataTemp) + "=" + String(temperature, 2);
-      firstParam = false;
-      url += "&" + String(config.dataHumi) + "=" + String(humidity, 2);
-      url += "&" + String(config.dataPress) + "=" + String(seaLevelPressure, 2);
-      if (config.activeLight) {
-        url += "&" + String(config.dataLight) + "=" + String(lightWm2, 2);
-      }
-      url += rainParam;
-      url += "&" + String(config.dataRssi) + "=" + String(rssi);
-
-      HTTPClient http;
-      http.begin(url);
-      int httpResponseCode = http.GET();
-
-      String msg;
-      if (httpResponseCode > 0) {
-          msg = "SVR2 | SENT OK | HTTP " + String(httpResponseCode) + " | URL: " + url;
-      } else {
-          msg = "SVR2 | SENT KO | HTTP " + String(httpResponseCode) + " | URL: " + url;
-      }
-
-      debugPrint(msg, true);
-      logToSyslog(msg.c_str());
-
-      http.end();
+    sendDataToServer("SVR2", config.serverUrl2.c_str(), config.serverName2.c_str(), Metrics::Destination::Server2, sample);
   }
-
-  // Server 3
   if (config.serverActive3) {
-      String url = config.serverUrl3 + "?";
-      bool firstParam = true;
-
-      if (config.serverName3.length() > 0) {
-          url += "station=" + config.serverName3;
-          firstParam = false;
-      }
-
-      url += (firstParam ? "" : "&") + String(config.dataTemp) + "=" + String(temperature, 2);
-      firstParam = false;
-      url += "&" + String(config.dataHumi) + "=" + String(humidity, 2);
-      url += "&" + String(config.dataPress) + "=" + String(seaLevelPressure, 2);
-      if (config.activeLight) {
-        url += "&" + String(config.dataLight) + "=" + String(lightWm2, 2);
-      }
-      url += rainParam;
-      url += "&" + String(config.dataRssi) + "=" + String(rssi);
-
-      HTTPClient http;
-      http.begin(url);
-      int httpResponseCode = http.GET();
-
-      String msg;
-      if (httpResponseCode > 0) {
-          msg = "SVR3 | SENT OK | HTTP " + String(httpResponseCode) + " | URL: " + url;
-      } else {
-          msg = "SVR3 | SENT KO | HTTP " + String(httpResponseCode) + " | URL: " + url;
-      }
-
-      debugPrint(msg, true);
-      logToSyslog(msg.c_str());
-
-      http.end();
+    sendDataToServer("SVR3", config.serverUrl3.c_str(), config.serverName3.c_str(), Metrics::Destination::Server3, sample);
   }
 }
 
@@ -915,8 +990,9 @@ void sendDataToAPRS() {
   if (!config.activeAPRS) return;
 
   WiFiClient client;
-  debugPrint(String("APRS | Connecting to ") + config.aprsHost + ":" + String(config.aprsPort));
-  String msg = String("APRS | Connecting to ") + config.aprsHost + ":" + String(config.aprsPort);
+  debugPrint(String("APRS | Connecting to ") + config.aprsHost.c_str() + ":" + String(config.aprsPort));
+  String msg = String("APRS | Connecting to ") + config.aprsHost.c_str() + ":" + String(config.aprsPort);
+  unsigned long startedAtMs = millis();
 
   if (client.connect(config.aprsHost.c_str(), (uint16_t)config.aprsPort)) {
     debugPrint(" -> Connected", true);
@@ -924,7 +1000,7 @@ void sendDataToAPRS() {
 
     // Login to APRS-IS
     char login[80];
-    sprintf(login, "user %s pass %s vers WX_ESP32 0.1 filter m/1", config.aprsCall, config.aprsPass);
+    snprintf(login, sizeof(login), "user %s pass %s vers WX_ESP32 0.1 filter m/1", config.aprsCall.c_str(), config.aprsPass.c_str());
     client.println(login);
 
     // Temperature for APRS must be in °F
@@ -961,17 +1037,17 @@ void sendDataToAPRS() {
 
     snprintf(sentence, sizeof(sentence),
              "%s>APRS,TCPIP*:@%02d%02d%02dz%s/%s_.../...t%03dh%02db%05d%s%s%s%s",
-             config.aprsCall,
+             config.aprsCall.c_str(),
              0, 0, 0,
-             config.aprsLat,
-             config.aprsLon,
+             config.aprsLat.c_str(),
+             config.aprsLon.c_str(),
              (int)temperatureF,
              (int)humidity,
              (int)(seaLevelPressure * 10),
              lightPart,
              rainPart,
              rain24Part,
-             config.aprsComment);
+             config.aprsComment.c_str());
 
     // Sending
     client.println(sentence);
@@ -979,343 +1055,703 @@ void sendDataToAPRS() {
     logToSyslog((String("APRS | SENT OK | ") + sentence).c_str());
 
     client.stop();
+    Metrics::recordUpload(Metrics::Destination::Aprs, true, millis() - startedAtMs);
   } else {
+    Metrics::recordUpload(Metrics::Destination::Aprs, false, millis() - startedAtMs);
     debugPrint("APRS | SENT KO", true);
     logToSyslog("APRS | SENT KO");
   }
 }
 
+// Connects in phases over several loop passes, see MqttLink
 void runningMQTT() {
-  if (mqttClient.connected()) {
-    mqttClient.loop(); 
-    mqttNoWiFiReported = false; 
+  // Server, client id and subscriptions are only used on connect
+  if (mqttReconfigurePending) {
+    mqttReconfigurePending = false;
+    mqttClient.setServer(config.mqttServer.c_str(), config.mqttPort);
+    if (config.activeMQTT) {
+      MqttLink::restart();
+    } else {
+      MqttLink::stop();
+    }
+  }
+
+  if (!config.activeMQTT) {
+    return;
+  }
+  if (WiFi.status() != WL_CONNECTED && MqttLink::getState() != MqttLink::State::Connected) {
     return;
   }
 
-  unsigned long now = millis();
-  if (now - lastMQTTReconnectAttempt > mqttReconnectInterval) {
-    lastMQTTReconnectAttempt = now;
-    debugPrint("MQTT | Attempting reconnect...", true);
-    logToSyslog("MQTT | Attempting reconnect...");
-    if (mqttClient.connect(config.stationName.c_str())) {
-      debugPrint("MQTT | Reconnected!", true);
-      logToSyslog("MQTT | Reconnected!");
-      if (config.mqttTopicSub1.length() > 0) {
-        mqttClient.subscribe(config.mqttTopicSub1.c_str());
+  MqttLink::State attemptState = MqttLink::getState();
+  switch (MqttLink::update()) {
+    case MqttLink::Event::None:
+      if (attemptState == MqttLink::State::Waiting && MqttLink::getState() != MqttLink::State::Waiting) {
+        debugPrint("MQTT | Attempting reconnect...", true);
+        logToSyslog("MQTT | Attempting reconnect...");
       }
-      if (config.mqttTopicSub2.length() > 0) {
-        mqttClient.subscribe(config.mqttTopicSub2.c_str());
+      break;
+    case MqttLink::Event::Connected:
+      {
+        String msg = "MQTT | Reconnected in " + String(MqttLink::getLastConnectMs()) + " ms";
+        debugPrint(msg, true);
+        logToSyslog(msg.c_str());
       }
+      subscribeCommandTopics();
       mqttNoWiFiReported = false;
-    } else {
-      debugPrint("MQTT | Failed rc=" + String(mqttClient.state()), true);
-      logToSyslog((String("MQTT | Failed rc=") + String(mqttClient.state())).c_str());
-    }
+      // Fresh data for whoever waited on the broker
+      networkJobs.schedule(mqttPublishJob);
+      break;
+    case MqttLink::Event::Failed:
+      {
+        String msg = "MQTT | Failed at " + String(MqttLink::getFailureName(MqttLink::getLastFailure()));
+        if (MqttLink::getLastFailure() == MqttLink::Failure::Handshake) {
+          msg += " rc=" + String(MqttLink::getLastHandshakeCode());
+        }
+        msg += ", retry in " + String(MqttLink::getRetryDelayMs() / 1000UL) + " s";
+        debugPrint(msg, true);
+        logToSyslog(msg.c_str());
+      }
+      break;
+    case MqttLink::Event::Lost:
+      debugPrint("MQTT | Connection lost", true);
+      logToSyslog("MQTT | Connection lost");
+      break;
+  }
+
+  if (MqttLink::getState() == MqttLink::State::Connected) {
+    drainMqttOutbox();
   }
 }
 
-void publishToMQTT() {
-  if (!config.activeMQTT) return;
+bool offerChangedMetric(ChangePublisher::Metric metric, const char* key, float value, uint8_t decimals, float deadband) {
+  String topic = String(config.mqttTopicPub1.c_str()) + "/" + key;
+  return ChangePublisher::offer(mqttClient, metric, topic.c_str(), value, decimals, deadband, config.mqttMaxSilence);
+}
 
-  if (!mqttClient.connected()) {
-    debugPrint("MQTT | Not connected, skipping publish", true);
-    logToSyslog("MQTT | Not connected, skipping publish");
+// Runs after every sensor read, most calls publish nothing
+void publishChangedToMQTT() {
+  if (config.mqttTopicPub1.isEmpty()) {
     return;
   }
 
-  StaticJsonDocument<256> jsonDoc;
-  jsonDoc[config.dataTemp]  = roundf(temperature * 100) / 100.0;
-  jsonDoc[config.dataHumi]  = roundf(humidity * 100) / 100.0;
-  jsonDoc[config.dataPress] = roundf(seaLevelPressure * 100) / 100.0;
+  uint8_t sent = 0;
+  sent += offerChangedMetric(ChangePublisher::Metric::Temperature, config.dataTemp.c_str(), temperature, 2, config.mqttDeadbandTemp);
+  sent += offerChangedMetric(ChangePublisher::Metric::Humidity, config.dataHumi.c_str(), humidity, 2, config.mqttDeadbandHumi);
+  sent += offerChangedMetric(ChangePublisher::Metric::Pressure, config.dataPress.c_str(), seaLevelPressure, 2, config.mqttDeadbandPress);
   if (config.activeLight) {
-    jsonDoc[config.dataLight] = roundf(lightWm2 * 100) / 100.0;
+    sent += offerChangedMetric(ChangePublisher::Metric::Light, config.dataLight.c_str(), lightWm2, 2, config.mqttDeadbandLight);
   }
   if (config.activeRain) {
-    jsonDoc["rain_1h"] = roundf(RainGauge::getRainLastHourMm() * 100) / 100.0;
-    jsonDoc["rain_24h"] = roundf(RainGauge::getRainLast24HoursMm() * 100) / 100.0;
+    sent += offerChangedMetric(ChangePublisher::Metric::Rain1h, "rain_1h", RainGauge::getRainLastHourMm(), 2, config.mqttDeadbandRain);
+    sent += offerChangedMetric(ChangePublisher::Metric::Rain24h, "rain_24h", RainGauge::getRainLast24HoursMm(), 2, config.mqttDeadbandRain);
   }
-  jsonDoc[config.dataRssi]  = rssi;
+  sent += offerChangedMetric(ChangePublisher::Metric::Rssi, config.dataRssi.c_str(), rssi, 0, config.mqttDeadbandRssi);
 
-  char jsonBuffer[320];
-  serializeJson(jsonDoc, jsonBuffer);
+  if (sent > 0) {
+    String msg = "MQTT | SENT OK | " + String(sent) + " changed values to " + config.mqttTopicPub1.c_str() + "/";
+    debugPrint(msg, true);
+    logToSyslog(msg.c_str());
+  }
+}
 
-  if (config.mqttTopicPub1.length() > 0) {
-    if (mqttClient.publish(config.mqttTopicPub1.c_str(), jsonBuffer)) {
-      debugPrint("MQTT | SENT OK | " + String(jsonBuffer), true);
-      logToSyslog((String("MQTT | SENT OK | ") + String(jsonBuffer)).c_str());
-    } else {
-      debugPrint("MQTT | SENT KO", true);
-      logToSyslog("MQTT | SENT KO");
-    }
+// Unix time of the sample, 0 while the clock is not trusted yet. Lets
+// consumers place messages replayed from the outbox.
+uint32_t sampleTimestamp() {
+  if (!TimeKeeper::isTrusted()) {
+    return 0;
+  }
+  return static_cast<uint32_t>(time(nullptr));
+}
+
+// Keeps a measurement for replay, see drainMqttOutbox(). A reading that
+// was already sent or queued is not queued again, e.g. while the sensor
+// is faulty the job still runs but nothing new arrives.
+void queueForMQTT(const uint8_t* payload, size_t length, const char* reason) {
+  if (handledSampleSequence == sampleSequence) {
+    debugPrint("MQTT | " + String(reason) + ", no new reading to queue", true);
+    return;
+  }
+
+  String msg;
+  handledSampleSequence = sampleSequence;
+  if (MqttOutbox::push(payload, length)) {
+    msg = "MQTT | QUEUED | " + String(reason) + ", " + String(MqttOutbox::getDepth()) + " waiting";
   } else {
+    msg = "MQTT | " + String(reason) + ", message lost (outbox unavailable)";
+  }
+  debugPrint(msg, true);
+  logToSyslog(msg.c_str());
+}
+
+void publishToMQTT() {
+  if (!config.activeMQTT) return;
+
+  if (config.mqttChangeMode) {
+    // Retained per-value topics carry only the latest state, nothing
+    // to replay, and change mode runs on every sensor read
+    if (mqttClient.connected()) {
+      publishChangedToMQTT();
+    }
+    return;
+  }
+
+  if (config.mqttTopicPub1.length() == 0) {
     debugPrint("MQTT | Publish topic is empty, skipping", true);
     logToSyslog("MQTT | Publish topic is empty, skipping");
+    return;
   }
-}
 
-void subscribeMQTT(char* topic, byte* payload, unsigned int length) {
-  String message;
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
-  }
-
-  message.trim();
-
-  // ======= Command =======
-  if (message.equalsIgnoreCase("reboot")) {
-    debugPrint("MQTT | RECV OK | Command RESET -> Restarting ESP...", true);
-    logToSyslog("MQTT | RECV OK | Command RESET -> Restarting ESP...");
-    RainGauge::flush();
-    ESP.restart();
-  } 
-  else if (message.equalsIgnoreCase("start-ap")) {
-    debugPrint("MQTT | RECV OK | Command START-AP -> Captive portal started...", true);
-    logToSyslog("MQTT | RECV OK | Command START-AP -> Captive portal started...");
-    startCaptivePortal();
-  }
-  else if (message.equalsIgnoreCase("info")) {
-    debugPrint("MQTT | RECV OK | Command INFO -> Sending info...", true);
-    logToSyslog("MQTT | RECV OK | Command INFO -> Sending info...");
-    sendInfoToDB();
-  }
-  // ======= Get config value =======
-  else if (message.startsWith("get(") && message.endsWith(")")) {
-    String key = message.substring(4, message.length() - 1);
-    key.trim();
-    
-    File file = LittleFS.open("/config.json", "r");
-    if (!file) {
-      debugPrint("MQTT | RECV KO | Command get(" + key + ") -> Cannot open config", true);
-      logToSyslog(("MQTT | RECV KO | Command get(" + key + ") -> Cannot open config").c_str());
-      return;
+  // Network task only, kept off its stack
+  static uint8_t payload[Payload::kMaxLength];
+  static char msg[Payload::kMaxLength + 24];
+  size_t payloadLength = 0;
+  bool msgPack = config.mqttPayloadFormat == MQTT_PAYLOAD_MSGPACK;
+  Payload::Sample sample = currentSample();
+
+  if (msgPack) {
+    payloadLength = Payload::buildMsgPack(sample, config, payload, sizeof(payload));
+  } else {
+    payloadLength = Payload::buildJson(sample, config, payload, sizeof(payload));
+  }
+
+  if (!mqttClient.connected()) {
+    queueForMQTT(payload, payloadLength, "Not connected");
+    return;
+  }
+  // Older messages go first, so consumers see the series in order
+  if (MqttOutbox::getDepth() > 0) {
+    queueForMQTT(payload, payloadLength, "Outbox still draining");
+    return;
+  }
+
+  unsigned long startedAtMs = millis();
+  bool published = mqttClient.publish(config.mqttTopicPub1.c_str(), payload, payloadLength);
+  Metrics::recordUpload(Metrics::Destination::Mqtt, published, millis() - startedAtMs);
+  if (published) {
+    handledSampleSequence = sampleSequence;
+    if (msgPack) {
+      snprintf(msg, sizeof(msg), "MQTT | SENT OK | MessagePack v%u, %u bytes", Payload::kMsgPackSchemaVersion, static_cast<unsigned>(payloadLength));
+    } else {
+      // buildJson() leaves the text terminated
+      snprintf(msg, sizeof(msg), "MQTT | SENT OK | %s", reinterpret_cast<const char*>(payload));
     }
+    debugPrint(msg, true);
+    logToSyslog(msg);
+  } else {
+    debugPrint("MQTT | SENT KO", true);
+    logToSyslog("MQTT | SENT KO");
+    queueForMQTT(payload, payloadLength, "Publish failed");
+  }
+}
 
-    // Return entire config
-    if (key == "config") {
-      String configJson;
-      while (file.available()) {
-        configJson += (char)file.read();
-      }
-      file.close();
-      
-      mqttClient.publish(config.mqttTopicPub2.c_str(), configJson.c_str());
+// Replays queued measurements oldest first, at most mqttReplayRate per
+// second so the backlog does not crowd out live traffic
+void drainMqttOutbox() {
+  if (MqttOutbox::getDepth() == 0 || config.mqttTopicPub1.isEmpty()) {
+    return;
+  }
+
+  if (MqttOutbox::drain(mqttClient, config.mqttTopicPub1.c_str(), config.mqttReplayRate)
+      && MqttOutbox::getDepth() == 0) {
+    String msg = "MQTT | Outbox drained, " + String(MqttOutbox::getReplayedCount()) + " replayed since boot";
+    debugPrint(msg, true);
+    logToSyslog(msg.c_str());
+  }
+}
+
+// ====== MQTT commands ======
+// Replies go to Pub Sub 2, or to Pub Sub 2/<id> when the command carried an id
+String commandReplyTopic(const MqttCommand::Request& request) {
+  String topic = config.mqttTopicPub2.c_str();
+  if (!request.id.isEmpty()) {
+    topic += "/";
+    topic += request.id.toString();
+  }
+  return topic;
+}
+
+void publishCommandReply(const MqttCommand::Request& request, const char* text) {
+  String topic = commandReplyTopic(request);
+  mqttClient.publish(topic.c_str(), text);
+}
+
+// Logs a failed command, callers that sent an id also get the reason back
+void rejectCommand(const MqttCommand::Request& request, const String& reason) {
+  String msg = "MQTT | RECV KO | Command " + request.name.toString();
+  if (request.hasArgument) {
+    msg += "(" + request.argument.toString() + ")";
+  }
+  msg += " -> " + reason;
+  debugPrint(msg, true);
+  logToSyslog(msg.c_str());
+
+  if (!request.id.isEmpty()) {
+    publishCommandReply(request, ("KO " + reason).c_str());
+  }
+}
+
+void handleRebootCommand(const MqttCommand::Request& request) {
+  (void)request;
+  debugPrint("MQTT | RECV OK | Command RESET -> Restarting ESP...", true);
+  logToSyslog("MQTT | RECV OK | Command RESET -> Restarting ESP...");
+  restartStation(RestartInfo::Reason::Command);
+}
+
+void handleStartApCommand(const MqttCommand::Request& request) {
+  (void)request;
+  debugPrint("MQTT | RECV OK | Command START-AP -> Captive portal started...", true);
+  logToSyslog("MQTT | RECV OK | Command START-AP -> Captive portal started...");
+  startCaptivePortal();
+}
+
+void handleInfoCommand(const MqttCommand::Request& request) {
+  (void)request;
+  debugPrint("MQTT | RECV OK | Command INFO -> Sending info...", true);
+  logToSyslog("MQTT | RECV OK | Command INFO -> Sending info...");
+  // The callback runs inside the network pass, the job follows in the next
+  networkJobs.schedule(infoJob);
+}
+
+void handlePerfCommand(const MqttCommand::Request& request) {
+  String summary = Profiler::buildSummaryJson();
+  String topic = commandReplyTopic(request);
+  MqttStream::publishText(mqttClient, topic.c_str(), summary.c_str(), summary.length());
+  debugPrint("MQTT | RECV OK | Command PERF -> Loop profile sent", true);
+  logToSyslog("MQTT | RECV OK | Command PERF -> Loop profile sent");
+}
+
+void handleHeapCommand(const MqttCommand::Request& request) {
+  String summary = HeapTracker::buildSummaryJson();
+  String topic = commandReplyTopic(request);
+  MqttStream::publishText(mqttClient, topic.c_str(), summary.c_str(), summary.length());
+  debugPrint("MQTT | RECV OK | Command HEAP -> Heap profile sent", true);
+  logToSyslog("MQTT | RECV OK | Command HEAP -> Heap profile sent");
+}
+
+// ======= Get config value =======
+void handleGetCommand(const MqttCommand::Request& request) {
+  String topic = commandReplyTopic(request);
+
+  // Return entire config
+  if (request.argument.equalsIgnoreCase("config")) {
+    DynamicJsonDocument doc(getConfigJsonCapacity());
+    writeConfigJson(config, doc);
+
+    if (MqttStream::publishJson(mqttClient, topic.c_str(), doc, true)) {
       debugPrint("MQTT | RECV OK | Command get(config) -> Full config sent", true);
       logToSyslog("MQTT | RECV OK | Command get(config) -> Full config sent");
-      return;
+    } else {
+      debugPrint("MQTT | RECV KO | Command get(config) -> Publish failed", true);
+      logToSyslog("MQTT | RECV KO | Command get(config) -> Publish failed");
     }
+    return;
+  }
 
-    StaticJsonDocument<4096> doc;
-    DeserializationError error = deserializeJson(doc, file);
-    file.close();
+  char key[32];
+  const ConfigField* field = request.argument.copyTo(key, sizeof(key)) ? findConfigField(key) : nullptr;
+  if (field == nullptr) {
+    rejectCommand(request, "Unknown key");
+    return;
+  }
 
-    if (error) {
-      debugPrint("MQTT | RECV KO | Command get(" + key + ") -> JSON parse error", true);
-      logToSyslog(("MQTT | RECV KO | Command get(" + key + ") -> JSON parse error").c_str());
-      return;
-    }
+  String response = String(key) + "(" + formatConfigFieldValue(config, *field) + ")";
+  mqttClient.publish(topic.c_str(), response.c_str());
+  debugPrint("MQTT | RECV OK | Command get(" + String(key) + ") -> " + response, true);
+  logToSyslog(("MQTT | RECV OK | Command get(" + String(key) + ") -> " + response).c_str());
+}
 
-    if (doc.containsKey(key)) {
-      String value;
-      JsonVariant val = doc[key];
-      
-      if (val.is<bool>()) {
-        value = val.as<bool>() ? "true" : "false";
-      } else if (val.is<int>()) {
-        value = String(val.as<int>());
-      } else if (val.is<float>()) {
-        value = String(val.as<float>());
-      } else {
-        value = val.as<String>();
-      }
+// ======= Set full config JSON =======
+void setWholeConfig(const MqttCommand::Request& request) {
+  DynamicJsonDocument doc(getConfigJsonCapacity());
+  DeserializationError error = deserializeJson(doc, request.value.data, request.value.length);
+  if (error) {
+    rejectCommand(request, "JSON parse error: " + String(error.c_str()));
+    return;
+  }
 
-      String response = key + "(" + value + ")";
-      mqttClient.publish(config.mqttTopicPub2.c_str(), response.c_str());
-      debugPrint("MQTT | RECV OK | Command get(" + key + ") -> " + response, true);
-      logToSyslog(("MQTT | RECV OK | Command get(" + key + ") -> " + response).c_str());
-    } else {
-      debugPrint("MQTT | RECV KO | Command get(" + key + ") -> Unknown key", true);
-      logToSyslog(("MQTT | RECV KO | Command get(" + key + ") -> Unknown key").c_str());
-    }
+  // Keys missing from the message fall back to defaults, as before
+  Config& updated = scratchConfig;
+  setConfigDefaults(updated);
+  readConfigJson(doc, updated);
+  uint16_t changed = diffConfig(config, updated);
+
+  {
+    StationStateLock lock;
+    config = updated;
   }
-  // ======= Set full config JSON =======
-  else if (message.startsWith("set(config=")) {
-    int startIdx = 11; 
-    int endIdx = message.lastIndexOf(')');
-    
-    if (endIdx <= startIdx) {
-      debugPrint("MQTT | RECV KO | Command set(config) -> Invalid format", true);
-      logToSyslog("MQTT | RECV KO | Command set(config) -> Invalid format");
-      return;
-    }
-    
-    String jsonStr = message.substring(startIdx, endIdx);
-    jsonStr.trim();
-    
-    StaticJsonDocument<4096> doc;
-    DeserializationError error = deserializeJson(doc, jsonStr);
-    
-    if (error) {
-      String errMsg = "MQTT | RECV KO | Command set(config) -> JSON parse error: " + String(error.c_str());
-      debugPrint(errMsg, true);
-      logToSyslog(errMsg.c_str());
-      return;
+  if (!saveConfig()) {
+    rejectCommand(request, "Failed to save");
+    return;
+  }
+
+  publishCommandReply(request, "set(config) OK");
+  debugPrint("MQTT | RECV OK | set(config) -> Full config replaced", true);
+  logToSyslog("MQTT | RECV OK | set(config) -> Full config replaced");
+  applyConfigChanges(changed);
+}
+
+// ======= Set config value =======
+void handleSetCommand(const MqttCommand::Request& request) {
+  if (request.key.equalsIgnoreCase("config")) {
+    setWholeConfig(request);
+    return;
+  }
+
+  char key[32];
+  const ConfigField* field = request.key.copyTo(key, sizeof(key)) ? findConfigField(key) : nullptr;
+  if (field == nullptr) {
+    rejectCommand(request, "Unknown key");
+    return;
+  }
+
+  // Longer than any field, so a cut here still reports as truncated
+  char value[kConfigUrlLength + 32];
+  request.value.copyTo(value, sizeof(value));
+
+  Config& updated = scratchConfig;
+  updated = config;
+  ConfigSetResult result = setConfigFieldValue(updated, *field, value);
+  if (result == ConfigSetResult::OutOfRange || result == ConfigSetResult::Invalid) {
+    rejectCommand(request, result == ConfigSetResult::OutOfRange ? "Out of range" : "Invalid value");
+    return;
+  }
+
+  uint16_t changed = diffConfig(config, updated);
+  {
+    StationStateLock lock;
+    config = updated;
+  }
+  if (!saveConfig()) {
+    rejectCommand(request, "Failed to save");
+    return;
+  }
+
+  String response = "set(" + String(key) + "=" + formatConfigFieldValue(config, *field) + ") OK";
+  if (result == ConfigSetResult::Truncated) {
+    response += " (truncated)";
+  }
+  publishCommandReply(request, response.c_str());
+  debugPrint("MQTT | RECV OK | " + response, true);
+  logToSyslog(("MQTT | RECV OK | " + response).c_str());
+  applyConfigChanges(changed);
+}
+
+// ======= OTA Update =======
+void handleUpdateCommand(const MqttCommand::Request& request) {
+  String url = request.argument.toString();
+  debugPrint("MQTT | RECV OK | Command UPDATE -> URL: " + url, true);
+  logToSyslog((String("MQTT | RECV OK | Command UPDATE -> URL: ") + url).c_str());
+
+  if (WiFi.status() == WL_CONNECTED) {
+    HTTPClient http;
+
+    http.begin(url);       
+    http.setTimeout(30000); 
+
+    t_httpUpdate_return ret = httpUpdate.update(http); 
+
+    switch(ret) {
+      case HTTP_UPDATE_FAILED:
+        debugPrint(" OTA | UPDATE FAILED | " + String(httpUpdate.getLastError()) + ": " + httpUpdate.getLastErrorString(), true);
+        logToSyslog((String(" OTA | UPDATE FAILED | ") + String(httpUpdate.getLastError()) + ": " + httpUpdate.getLastErrorString()).c_str());
+        break;
+      case HTTP_UPDATE_NO_UPDATES:
+        debugPrint(" OTA | No updates available", true);
+        logToSyslog(" OTA | No updates available");
+        break;
+      case HTTP_UPDATE_OK:
+        debugPrint(" OTA | UPDATE OK | Restarting...", true);
+        logToSyslog(" OTA | UPDATE OK | Restarting...");
+        delay(1000);
+        // The new firmware may not take the RTC copy, the file has to be current
+        RainGauge::flush();
+        restartStation(RestartInfo::Reason::Update);
+        break;
     }
-    
-    File outFile = LittleFS.open("/config.json", "w");
-    if (outFile) {
-      serializeJsonPretty(doc, outFile);
-      outFile.close();
-      loadConfig();
-      Heartbeat::setEnabled(config.activeHeartbeat);
-      RainGauge::onConfigurationChanged(config.activeRain, config.rainTipMm);
-      applyGPIOTriggerConfiguration();
-      
-      mqttClient.publish(config.mqttTopicPub2.c_str(), "set(config) OK");
-      debugPrint("MQTT | RECV OK | set(config) -> Full config replaced", true);
-      logToSyslog("MQTT | RECV OK | set(config) -> Full config replaced");
-    } else {
-      debugPrint("MQTT | RECV KO | Command set(config) -> Failed to save", true);
-      logToSyslog("MQTT | RECV KO | Command set(config) -> Failed to save");
+    http.end(); 
+  }
+}
+
+const MqttCommand::Entry mqttCommands[] = {
+  {"reboot", MqttCommand::ArgType::None, handleRebootCommand},
+  {"start-ap", MqttCommand::ArgType::None, handleStartApCommand},
+  {"info", MqttCommand::ArgType::None, handleInfoCommand},
+  {"perf", MqttCommand::ArgType::None, handlePerfCommand},
+  {"heap", MqttCommand::ArgType::None, handleHeapCommand},
+  {"get", MqttCommand::ArgType::Text, handleGetCommand},
+  {"set", MqttCommand::ArgType::KeyValue, handleSetCommand},
+  {"update", MqttCommand::ArgType::Text, handleUpdateCommand}
+};
+
+// Each command topic also takes "<topic>/<command>" with the argument as payload
+void subscribeCommandTopics() {
+  const char* topics[] = {config.mqttTopicSub1.c_str(), config.mqttTopicSub2.c_str()};
+  for (const char* topic : topics) {
+    if (topic[0] == '\0') {
+      continue;
     }
+    mqttClient.subscribe(topic);
+    mqttClient.subscribe((String(topic) + "/+").c_str());
   }
-  // ======= Set config value =======
-  else if (message.startsWith("set(") && message.endsWith(")")) {
-    String content = message.substring(4, message.length() - 1);
-    int eqPos = content.indexOf('=');
-    
-    if (eqPos == -1) {
-      debugPrint("MQTT | RECV KO | Command set() -> Missing '='", true);
-      logToSyslog("MQTT | RECV KO | Command set() -> Missing '='");
+}
+
+void subscribeMQTT(char* topic, byte* payload, unsigned int length) {
+  const char* text = reinterpret_cast<const char*>(payload);
+  const char* sub1 = config.mqttTopicSub1.c_str();
+  const char* sub2 = config.mqttTopicSub2.c_str();
+  bool commandTopic = strcmp(topic, sub1) == 0 || strcmp(topic, sub2) == 0;
+
+  MqttCommand::Request request;
+  if (commandTopic) {
+    if (!MqttCommand::parsePayload(text, length, request)) {
+      debugPrint("MQTT | RECV KO | Malformed command", true);
+      logToSyslog("MQTT | RECV KO | Malformed command");
       return;
     }
-    
-    String key = content.substring(0, eqPos);
-    String value = content.substring(eqPos + 1);
-    key.trim();
-    value.trim();
-    
-    File file = LittleFS.open("/config.json", "r");
-    StaticJsonDocument<4096> doc;
-    
-    if (file) {
-      deserializeJson(doc, file);
-      file.close();
-    }
+  } else if (!MqttCommand::parseTopic(topic, sub1, text, length, request) &&
+             !MqttCommand::parseTopic(topic, sub2, text, length, request)) {
+    return;
+  }
 
-    String valueParsed = value;
-    valueParsed.replace(',', '.');
-    bool hasDecimal = (valueParsed.indexOf('.') >= 0);
-    
-    // Fields that allow float values
-    bool isFloatField = (key == "altitude" || key == "offsetTemp" || key == "offsetHumi" ||
-                         key == "offsetPress" || key == "rainTipMm");
-    
-    if (doc.containsKey(key)) {
-      JsonVariant existing = doc[key];
-      if (existing.is<bool>()) {
-        doc[key] = (value == "true" || value == "1");
-      } else if (existing.is<float>() || existing.is<double>() || existing.is<int>()) {
-        if (isFloatField) {
-          doc[key] = valueParsed.toFloat();
-        } else {
-          doc[key] = valueParsed.toInt();
-        }
-      } else {
-        doc[key] = value;
-      }
-    } else {
-      // New key - auto-detect type from value
-      if (value == "true" || value == "false") {
-        doc[key] = (value == "true");
-      } else if (isFloatField && hasDecimal) {
-        doc[key] = valueParsed.toFloat();
-      } else if (valueParsed.toInt() != 0 || valueParsed == "0") {
-        doc[key] = valueParsed.toInt();
-      } else {
-        doc[key] = value;
+  switch (MqttCommand::dispatch(mqttCommands, sizeof(mqttCommands) / sizeof(mqttCommands[0]), request)) {
+    case MqttCommand::Result::Handled:
+      break;
+    case MqttCommand::Result::UnknownCommand:
+      // Other traffic below a command topic is not meant for the station
+      if (commandTopic) {
+        rejectCommand(request, "Unknown command");
       }
-    }
-    
-    File outFile = LittleFS.open("/config.json", "w");
-    if (outFile) {
-      serializeJsonPretty(doc, outFile);
-      outFile.close();
-      loadConfig();
-      Heartbeat::setEnabled(config.activeHeartbeat);
-      RainGauge::onConfigurationChanged(config.activeRain, config.rainTipMm);
-      applyGPIOTriggerConfiguration();
-      
-      String response = "set(" + key + "=" + value + ") OK";
-      mqttClient.publish(config.mqttTopicPub2.c_str(), response.c_str());
-      debugPrint("MQTT | RECV OK | " + response, true);
-      logToSyslog(("MQTT | RECV OK | " + response).c_str());
-    } else {
-      debugPrint("MQTT | RECV KO | Command set(" + key + ") -> Failed to save", true);
-      logToSyslog(("MQTT | RECV KO | Command set(" + key + ") -> Failed to save").c_str());
+      break;
+    case MqttCommand::Result::InvalidArgument:
+      rejectCommand(request, "Invalid argument");
+      break;
+  }
+}
+
+// ====== Setup ======
+// ====== Scheduled jobs ======
+// Offsets after the sensor reading, so an upload carries the reading
+// taken just before it
+const uint32_t mqttJobPhaseMs = 2000;
+const uint32_t httpJobPhaseMs = 4000;
+const uint32_t aprsJobPhaseMs = 6000;
+const uint32_t publicIpCheckMs = 5UL * 60UL * 1000UL;
+
+uint32_t schedulerNowMs() {
+  return millis();
+}
+
+// Change mode looks at every sensor reading
+unsigned long mqttPublishPeriodMs() {
+  return config.mqttChangeMode ? intervalSensor : config.intervalMqtt;
+}
+
+void alignNetworkJobs() {
+  networkJobs.setAligned(httpJob, config.alignIntervals);
+  networkJobs.setAligned(aprsJob, config.alignIntervals);
+  networkJobs.setAligned(mqttPublishJob, config.alignIntervals);
+}
+
+// Measurements pause while the sensors are in fault, the recovery job
+// runs instead. Sensing task only.
+void refreshSensingJobs() {
+  bool running = !TaskLink::hasSensorFault();
+  sensingJobs.setEnabled(sensorJob, running);
+  sensingJobs.setEnabled(recoveryJob, !running);
+}
+
+// Uploads pause with the measurements. Network task only, it follows the
+// fault flag the sensing task sets, see followSensorFault().
+void refreshNetworkJobs() {
+  bool running = !networkFaultSeen;
+  networkJobs.setEnabled(httpJob, running);
+  networkJobs.setEnabled(aprsJob, running);
+  networkJobs.setEnabled(mqttPublishJob, running);
+  networkJobs.setEnabled(restartJob, running && restartIntervalMs > 0);
+}
+
+void followSensorFault() {
+  if (TaskLink::followSensorFault(networkFaultSeen)) {
+    refreshNetworkJobs();
+  }
+}
+
+// Network task side of a reading, the globals are what uploads, the web
+// UI and metrics see
+void receiveSamples() {
+  TaskLink::Sample sample;
+  if (!TaskLink::receiveSample(sample)) {
+    return;
+  }
+
+  uint32_t timestamp = sampleTimestamp();
+  StationStateLock lock;
+  sampleSequence++;
+  sampleUnixTime = timestamp;
+  temperature = sample.temperature;
+  humidity = sample.humidity;
+  pressure = sample.pressure;
+  seaLevelPressure = sample.seaLevelPressure;
+  lightLux = sample.lightLux;
+  lightWm2 = sample.lightWm2;
+  rssi = sample.rssi;
+}
+
+// Also without WiFi: the triggers need the reading and the MQTT job
+// queues it for replay
+void runSensorJob() {
+  {
+    Profiler::StageTimer stageTimer(Profiler::Stage::Sensors);
+    readSensorData();   // BME280
+    if (sensingConfig.activeLight) {
+      readLightSensor();  // BH1750
     }
   }
-  // ======= OTA Update =======
-  else if (message.startsWith("update(") && message.endsWith(")")) {
-    String url = message.substring(7, message.length() - 1);
-    debugPrint("MQTT | RECV OK | Command UPDATE -> URL: " + url, true);
-    logToSyslog((String("MQTT | RECV OK | Command UPDATE -> URL: ") + url).c_str());
-
-    if (WiFi.status() == WL_CONNECTED) {
-      HTTPClient http;
-
-      http.begin(url);       
-      http.setTimeout(30000); 
-
-      t_httpUpdate_return ret = httpUpdate.update(http); 
-
-      switch(ret) {
-        case HTTP_UPDATE_FAILED:
-          debugPrint(" OTA | UPDATE FAILED | " + String(httpUpdate.getLastError()) + ": " + httpUpdate.getLastErrorString(), true);
-          logToSyslog((String(" OTA | UPDATE FAILED | ") + String(httpUpdate.getLastError()) + ": " + httpUpdate.getLastErrorString()).c_str());
-          break;
-        case HTTP_UPDATE_NO_UPDATES:
-          debugPrint(" OTA | No updates available", true);
-          logToSyslog(" OTA | No updates available");
-          break;
-        case HTTP_UPDATE_OK:
-          debugPrint(" OTA | UPDATE OK | Restarting...", true);
-          logToSyslog(" OTA | UPDATE OK | Restarting...");
-          delay(1000);
-          RainGauge::flush();
-          ESP.restart(); 
-          break;
-      }
-      http.end(); 
+  if (!TaskLink::hasSensorFault()) {
+    TaskLink::pushSample(sensingSample);
+    evaluateGPIOTriggers();
+  }
+  refreshHeartbeatState();
+}
+
+void runHttpJob() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  Profiler::StageTimer stageTimer(Profiler::Stage::Http);
+  sendDataToDB();
+}
+
+void runAprsJob() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  Profiler::StageTimer stageTimer(Profiler::Stage::Aprs);
+  sendDataToAPRS();
+}
+
+// Also without WiFi, the message then waits in the outbox
+void runMqttPublishJob() {
+  Profiler::StageTimer stageTimer(Profiler::Stage::MqttPublish);
+  publishToMQTT();
+}
+
+void runInfoJob() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  Profiler::StageTimer stageTimer(Profiler::Stage::Http);
+  BootTimeline::start(BootTimeline::Phase::Info);
+  sendInfoToDB();
+  BootTimeline::finish(BootTimeline::Phase::Info);
+}
+
+// Checks often but looks up only once the cache is stale, so a failed
+// lookup is retried sooner than the TTL. A new address is reported.
+void runPublicIpJob() {
+  if (WiFi.status() != WL_CONNECTED || !PublicIp::isStale(config.publicIpUrl.c_str())) {
+    return;
+  }
+
+  Profiler::StageTimer stageTimer(Profiler::Stage::Http);
+  switch (PublicIp::refresh(config.publicIpUrl.c_str())) {
+    case PublicIp::Result::Changed: {
+      String msg = String("INFO | Public IP is ") + PublicIp::get();
+      debugPrint(msg, true);
+      logToSyslog(msg.c_str());
+      networkJobs.schedule(infoJob);
+      break;
     }
+    case PublicIp::Result::Failed:
+      debugPrint("INFO | Public IP lookup failed, retrying later", true);
+      break;
+    case PublicIp::Result::Unchanged:
+    case PublicIp::Result::Off:
+      break;
   }
 }
 
-// ====== Setup ======
+void runRestartJob() {
+  debugPrint("REST | Periodic restart...", true);
+  logToSyslog("REST | Periodic restart...");
+  delay(1000);
+  restartStation(RestartInfo::Reason::Periodic);
+}
+
+void runRecoveryJob() {
+  Profiler::StageTimer stageTimer(Profiler::Stage::Recovery);
+  tryRecoverSensors();
+}
+
+// setup() has just read the sensors, so the sensor job first runs one
+// period from now. The first upload round and the station info are left
+// to the network task, right after it starts.
+void setupScheduler() {
+  sensingJobs.begin({schedulerNowMs, sampleTimestamp});
+  networkJobs.begin({schedulerNowMs, sampleTimestamp});
+
+  sensorJob = sensingJobs.addPeriodic("sensors", runSensorJob, intervalSensor, intervalSensor);
+  recoveryJob = sensingJobs.addPeriodic("recovery", runRecoveryJob, sensorRecoveryIntervalMs);
+  mqttPublishJob = networkJobs.addPeriodic("mqtt_publish", runMqttPublishJob, mqttPublishPeriodMs(), mqttPublishPeriodMs() + mqttJobPhaseMs);
+  httpJob = networkJobs.addPeriodic("http", runHttpJob, config.intervalHttp, config.intervalHttp + httpJobPhaseMs);
+  aprsJob = networkJobs.addPeriodic("aprs", runAprsJob, config.intervalAprs, config.intervalAprs + aprsJobPhaseMs);
+  restartJob = networkJobs.addOneShot("restart", runRestartJob, restartIntervalMs);
+  // Ahead of the info job, which reports the address it finds
+  publicIpJob = networkJobs.addPeriodic("public_ip", runPublicIpJob, publicIpCheckMs);
+  infoJob = networkJobs.addOneShot("info", runInfoJob, 0);
+
+  sensingJobs.setAligned(sensorJob, sensingConfig.alignIntervals);
+  alignNetworkJobs();
+  // Due now, an aligned job moves onto the wall clock after this run
+  networkJobs.schedule(mqttPublishJob, 0);
+  networkJobs.schedule(httpJob, 0);
+  networkJobs.schedule(aprsJob, 0);
+  networkFaultSeen = TaskLink::hasSensorFault();
+  refreshSensingJobs();
+  refreshNetworkJobs();
+}
+
+// Local work overlaps the Wi-Fi association and network dependent work
+// is left to the network task, see BootTimeline for the order
 void setup() {
+  BootTimeline::start(BootTimeline::Phase::Setup);
+  RestartInfo::begin();
+  // Before anything logs or a task starts
+  beginStationState();
   Serial.begin(115200);
+  BootTimeline::start(BootTimeline::Phase::Config);
   loadConfig();
+  // Rain windows need a time before Wi-Fi is up
+  TimeKeeper::begin();
+  sensingConfig = config;
+  BootTimeline::finish(BootTimeline::Phase::Config);
   Heartbeat::setEnabled(config.activeHeartbeat);
   Heartbeat::begin();
+  Profiler::begin();
   Wire.begin(i2cSdaPin, i2cSclPin);
 
+  // The driver associates in the background while the sensors and the
+  // file system are set up below
+  BootTimeline::start(BootTimeline::Phase::WiFi);
   WiFi.setHostname("WX-Station");
-  wm.setConnectRetries(3);
-  wm.setConfigPortalTimeout(600);
-  wm.setTitle("WX Station");
-  wm.setAPCallback(onConfigPortalStarted);
+  WifiLink::begin();
+  bool bootConnectStarted = WifiLink::startBootConnect();
 
-  if (!wm.autoConnect("WX-StationAP")) {
-    debugPrint("REST | Failed to connect, restarting...", true);
-    logToSyslog("REST | Failed to connect, restarting...");
-    RainGauge::flush();
-    ESP.restart();
+  BootTimeline::start(BootTimeline::Phase::Storage);
+  // Mounted once by loadConfig() at the top of setup()
+  if (!mountFileSystem()) {
+    setFatalError("SYST | LittleFS mount failed, even after format!");
   }
-  setAccessPointMode(false);
-  startMDNSService();
-  synchronizeClock(true);
   RainGauge::begin(config.activeRain, config.rainTipMm);
-  applyGPIOTriggerConfiguration();
+  bool outboxReady = MqttOutbox::begin();
+  BootTimeline::finish(BootTimeline::Phase::Storage);
 
+  BootTimeline::start(BootTimeline::Phase::Sensors);
+  applyGPIOTriggerConfiguration();
   if (!initBME280()) {
       setRuntimeSensorFault("SENS | BME280 initialization failed.");
   }
@@ -1324,126 +1760,202 @@ void setup() {
   if (!fatalErrorActive && !initBH1750()) {
       setRuntimeSensorFault("SENS | BH1750 initialization failed.");
   }
+  BootTimeline::finish(BootTimeline::Phase::Sensors);
+
+  if (!fatalErrorActive) {
+    BootTimeline::start(BootTimeline::Phase::FirstSample);
+    readSensorData();
+    if (sensingConfig.activeLight) {
+      readLightSensor();
+    }
+    BootTimeline::finish(BootTimeline::Phase::FirstSample);
+  }
+
+  if (config.staticIpActive && !WifiLink::usesStaticAddress()) {
+    debugPrint("WiFi | Static IP settings are not valid, using DHCP", true);
+  }
+
+  // Straight to the last access point first, the scan and the portal
+  // only when that fails
+  if (bootConnectStarted && WifiLink::finishBootConnect()) {
+    debugPrint("WiFi | Connected to the stored access point in " + String(WifiLink::getLastConnectMs()) + " ms", true);
+  } else {
+    wm.setConnectRetries(3);
+    wm.setConfigPortalTimeout(600);
+    wm.setTitle("WX Station");
+    wm.setAPCallback(onConfigPortalStarted);
+    IPAddress address;
+    IPAddress gateway;
+    IPAddress subnet;
+    IPAddress dns;
+    if (WifiLink::getStaticAddress(address, gateway, subnet, dns)) {
+      wm.setSTAStaticIPConfig(address, gateway, subnet, dns);
+    }
+
+    if (!wm.autoConnect("WX-StationAP")) {
+      debugPrint("REST | Failed to connect, restarting...", true);
+      logToSyslog("REST | Failed to connect, restarting...");
+      restartStation(RestartInfo::Reason::Portal);
+    }
+  }
+  // Stores the access point and takes over reconnects
+  WifiLink::update();
+  BootTimeline::finish(BootTimeline::Phase::WiFi);
+  setAccessPointMode(false);
 
+  BootTimeline::start(BootTimeline::Phase::Services);
+  startMDNSService();
+  TimeKeeper::startSntp(ntpServerPrimary, ntpServerSecondary, ntpServerTertiary);
   setupWeb();
 
   // MQTT setup
-  mqttClient.setBufferSize(2048);
+  // Incoming set(config) carries the whole config JSON, trigger slots included
+  mqttClient.setBufferSize(6144);
   mqttClient.setServer(config.mqttServer.c_str(), config.mqttPort);
   mqttClient.setCallback(subscribeMQTT);   
 
-  // Subscribe for control
-  if (mqttClient.connect(config.stationName.c_str())) {
-      if (config.mqttTopicSub1.length() > 0) {
-          mqttClient.subscribe(config.mqttTopicSub1.c_str());
-      }
-      if (config.mqttTopicSub2.length() > 0) {
-          mqttClient.subscribe(config.mqttTopicSub2.c_str());
-      }
+  // Connected from loop() so a dead broker cannot hold up the boot
+  MqttLink::begin(mqttClient, wifiClient);
+  if (!outboxReady) {
+    debugPrint("MQTT | Outbox unavailable, unsent messages will be lost", true);
+  } else if (MqttOutbox::getDepth() > 0) {
+    debugPrint("MQTT | Outbox holds " + String(MqttOutbox::getDepth()) + " messages from before the restart", true);
   }
+  BootTimeline::finish(BootTimeline::Phase::Services);
 
   welcomeMessage();
 
-  if (!LittleFS.begin()) {
-    debugPrint("SYST | LittleFS mount failed! Trying to format...", true);
-    logToSyslog("SYST | LittleFS mount failed! Trying to format...");
-    if (LittleFS.begin(true)) {
-      debugPrint("SYST | LittleFS formatted and mounted successfully.", true);
-      logToSyslog("SYST | LittleFS formatted and mounted successfully.");
-    } else {
-      setFatalError("SYST | LittleFS mount failed, even after format!");
-    }
+  String restartMsg = "SYST | Restart " + String(RestartInfo::getRestartCount()) + " since power on, reason: "
+    + RestartInfo::getLastReasonName();
+  if (RestartInfo::getPreviousUptimeSec() > 0) {
+    restartMsg += ", after " + String(RestartInfo::getPreviousUptimeSec()) + " s uptime";
+  }
+  debugPrint(restartMsg, true);
+  logToSyslog(restartMsg.c_str());
+  if (RainGauge::getRestoreSource() == RainGauge::RestoreSource::Rtc) {
+    debugPrint("RAIN | State taken over from RTC memory", true);
   }
 
   if (fatalErrorActive) {
     return;
   }
 
-  sendInfoToDB();
   restartInterval();
-  readSensorData();
-  if (config.activeLight) {
-    readLightSensor();
-  }
-  updateGPIOTriggers();
-  publishToMQTT();
-  sendDataToDB();
-  sendDataToAPRS();
+  setupScheduler();
+  // The reading was taken before Wi-Fi was up
+  sensingSample.rssi = WiFi.RSSI();
+  // Both sides of the queue still run here, so the web pages have the
+  // reading before the network task starts
+  TaskLink::pushSample(sensingSample);
+  receiveSamples();
+  evaluateGPIOTriggers();
 
   setupCompleted = true;
+  BootTimeline::finish(BootTimeline::Phase::Setup);
+  String msg = "BOOT | Ready after " + String(BootTimeline::getSpan(BootTimeline::Phase::Setup).endMs)
+    + " ms, first sample after " + String(BootTimeline::getFirstSampleMs()) + " ms";
+  debugPrint(msg, true);
+  logToSyslog(msg.c_str());
   refreshHeartbeatState();
+  startTasks();
 }
 
 // ====== Loop ======
-void loop() {
-  Heartbeat::update();
-  RainGauge::update();
-  updateGPIOTriggers();
+// Time critical local work: rain pulses, trigger outputs and the
+// sensor bus. Nothing in here waits on the network.
+void sensingPass() {
+  Profiler::IterationTimer iterationTimer(Profiler::Task::Sensing);
+
+  {
+    Profiler::StageTimer stageTimer(Profiler::Stage::Rain);
+    RainGauge::update();
+  }
 
   if (fatalErrorActive) {
     return;
   }
 
-  if (runtimeSensorFaultActive) {
-    reconnectWiFi();
-    runningMQTT();
-    server.handleClient();
-    tryRecoverSensors();
+  receiveConfigChanges();
+
+  // Sensor reading or, in fault, sensor recovery
+  sensingJobs.runNext();
+}
+
+// Everything that talks to the network, a slow server or DNS lookup
+// here no longer delays the sensing pass
+void networkPass() {
+  Profiler::IterationTimer iterationTimer(Profiler::Task::Network);
+  reportLoopStalls();
+  HeapTracker::update();
+
+  if (fatalErrorActive) {
     return;
   }
 
-  unsigned long now = millis();
+  receiveSamples();
+  drainSyslogQueue();
+  followSensorFault();
 
-  // Periodic restart
-  if (restartIntervalMs > 0 && (now - lastRestart >= restartIntervalMs)) {
-    debugPrint("REST | Periodic restart...", true);
-    logToSyslog("REST | Periodic restart...");
-    delay(1000);
-    RainGauge::flush();
-    ESP.restart();
+  // Wi-Fi watchdog 
+  {
+    Profiler::StageTimer stageTimer(Profiler::Stage::WiFi);
+    reconnectWiFi(); 
+  }
+  if (!networkFaultSeen) {
+    Profiler::StageTimer stageTimer(Profiler::Stage::Clock);
+    followClock();
   }
 
-  // Wi-Fi watchdog 
-  reconnectWiFi(); 
-  synchronizeClock(false);
+  // Uploads and periodic restart. Jobs that fall due together run in
+  // consecutive passes.
+  networkJobs.runNext();
 
-  // Read sensor
-  if (now - lastSensorRead >= intervalSensor) {
-      lastSensorRead = now;
+  {
+    Profiler::StageTimer stageTimer(Profiler::Stage::MqttLoop);
+    runningMQTT(); 
+  }
+  {
+    Profiler::StageTimer stageTimer(Profiler::Stage::Web);
+    serviceWeb();
+  }
 
-      if (WiFi.status() == WL_CONNECTED) {
-          readSensorData();   // BME280
+  refreshHeartbeatState();
+}
 
-          if (config.activeLight) {
-              readLightSensor();  // BH1750
-          }
-      }
+void networkTaskMain(void* parameter) {
+  (void)parameter;
+  for (;;) {
+    networkPass();
+    // Lets the idle task on this core feed the watchdog
+    vTaskDelay(1);
   }
+}
 
-  // HTTP 
-  if (now - lastHttpSend >= config.intervalHttp) {
-    lastHttpSend = now;
-    if (WiFi.status() == WL_CONNECTED) {
-      sendDataToDB();  
-    }
+// The network task goes next to the WiFi and lwIP tasks on core 0, the
+// Arduino loop keeps core 1 for sensing. Single core chips (ESP32-C3)
+// run both passes from loop() as before.
+void startTasks() {
+#if !CONFIG_FREERTOS_UNICORE
+  // Before the network task exists, its first logToSyslog() reads it
+  TaskLink::setSensingTask(xTaskGetCurrentTaskHandle());
+  if (xTaskCreatePinnedToCore(networkTaskMain, "wx-network", networkTaskStackBytes, nullptr, 1, &networkTask, 0) == pdPASS) {
+    return;
   }
 
-  // APRS
-  if (now - lastAprsSend >= config.intervalAprs) {
-    lastAprsSend = now;
-    if (WiFi.status() == WL_CONNECTED) {
-      sendDataToAPRS();
-    }
-  }
+  TaskLink::setSensingTask(nullptr);
+  networkTask = nullptr;
+  debugPrint("SYST | Network task not started, running single loop", true);
+#endif
+}
 
-  // MQTT
-  if (now - lastMQTTSend >= config.intervalMqtt) {
-    lastMQTTSend = now;
-    if (WiFi.status() == WL_CONNECTED) {
-      publishToMQTT();
-    }
-  }
+void loop() {
+  sensingPass();
 
-  runningMQTT(); 
-  server.handleClient();
+  if (networkTask == nullptr) {
+    networkPass();
+  } else {
+    // Network work has its own task, the sensing pass has no reason to
+    // spin faster than once per tick
+    vTaskDelay(1);
+  }
 }